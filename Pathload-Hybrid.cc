@@ -0,0 +1,531 @@
+// Pathload-Simulation.cc의 덤벨 토폴로지(10Mbps/2ms 보틀넥, 7Mbps CBR 경쟁 트래픽)를
+// 실시간 스케줄러로 돌리고, 네이티브 bwprobe가 그 보틀넥을 통과하도록 연결하는 하이브리드 시나리오.
+//
+//   bwprobe server --probe-to 127.0.0.1:9000  -->  [UDP 9000] bridge --fd--> left leaf 1
+//        ... dumbbell ...  right leaf 1 --fd--> bridge --> 127.0.0.1:8090  bwprobe client
+//
+// Each FdNetDevice sits on one end of an AF_UNIX socketpair; a bridge thread owns the other
+// ends and translates between real UDP datagrams and Ethernet/IPv4/UDP frames, answering ARP
+// for the virtual hosts behind the two leaves. No root or tap device is needed. The TCP
+// control channel of bwprobe stays on loopback, only the probes cross the simulated path.
+//
+//   ../waf --run "Pathload-Hybrid --stopTime=60"
+//   ../build/native/bwprobe server --probe-to 127.0.0.1:9000 &
+//   ../build/native/bwprobe client
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/point-to-point-layout-module.h"
+#include "ns3/fd-net-device-module.h"
+
+using namespace ns3;
+using namespace std;
+
+NS_LOG_COMPONENT_DEFINE ("PathloadHybrid");
+
+// 네이티브 프로세스 쪽 가상 호스트 주소. 보틀넥 양쪽 leaf 1에 /24로 붙음
+static const char *INGRESS_NETWORK = "10.4.1.0";
+static const char *EGRESS_NETWORK = "10.5.1.0";
+static const uint32_t INGRESS_HOST = 0x0a040102; // 10.4.1.2, the native sender
+static const uint32_t EGRESS_HOST = 0x0a050102;  // 10.5.1.2, the native receiver
+static const uint16_t SIM_PROBE_PORT = 8090;
+
+static const uint32_t ETH_HEADER = 14;
+static const uint32_t IP_HEADER = 20;
+static const uint32_t UDP_HEADER = 8;
+static const uint32_t MAX_FRAME = 2048;
+
+//================================================================
+// NATIVE BRIDGE
+//================================================================
+
+class NativeBridge
+{
+public:
+    NativeBridge();
+    ~NativeBridge();
+
+    bool Open(uint16_t listenPort, const std::string &forwardHost, uint16_t forwardPort);
+    int IngressDeviceFd(void) const { return m_ingressPair[0]; }
+    int EgressDeviceFd(void) const { return m_egressPair[0]; }
+    void SetIngressMac(Mac48Address mac) { mac.CopyTo(m_ingressMac); }
+    void Start(void);
+    void Stop(void);
+
+    uint64_t Injected(void) const { return m_injected.load(); }
+    uint64_t Delivered(void) const { return m_delivered.load(); }
+    uint64_t ArpReplies(void) const { return m_arpReplies.load(); }
+
+private:
+    void Loop(void);
+    void Inject(const uint8_t *payload, uint32_t length, uint16_t srcPort);
+    void HandleFrame(int fd, const uint8_t *frame, uint32_t length);
+    void ReplyArp(int fd, const uint8_t *frame, uint32_t length);
+
+    int m_udp;
+    int m_ingressPair[2];   // [0] FdNetDevice on left leaf 1, [1] bridge
+    int m_egressPair[2];    // [0] FdNetDevice on right leaf 1, [1] bridge
+    int m_wakePipe[2];
+    sockaddr_in m_forward;
+    uint8_t m_ingressMac[6];
+    uint8_t m_hostMac[6];
+    uint16_t m_ipId;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<uint64_t> m_injected;
+    std::atomic<uint64_t> m_delivered;
+    std::atomic<uint64_t> m_arpReplies;
+};
+
+NativeBridge::NativeBridge() :
+    m_udp(-1), m_ipId(0), m_running(false), m_injected(0), m_delivered(0), m_arpReplies(0)
+{
+    m_ingressPair[0] = m_ingressPair[1] = -1;
+    m_egressPair[0] = m_egressPair[1] = -1;
+    m_wakePipe[0] = m_wakePipe[1] = -1;
+    memset(&m_forward, 0, sizeof(m_forward));
+    memset(m_ingressMac, 0, sizeof(m_ingressMac));
+    // Locally administered MAC shared by both virtual hosts
+    static const uint8_t hostMac[6] = { 0x02, 0x62, 0x77, 0x70, 0x00, 0x01 };
+    memcpy(m_hostMac, hostMac, sizeof(m_hostMac));
+}
+
+NativeBridge::~NativeBridge()
+{
+    Stop();
+    // The [0] ends belong to the FdNetDevices
+    int fds[] = { m_udp, m_ingressPair[1], m_egressPair[1], m_wakePipe[0], m_wakePipe[1] };
+    for (uint32_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+    {
+        if (fds[i] >= 0)
+        {
+            close(fds[i]);
+        }
+    }
+}
+
+bool NativeBridge::Open(uint16_t listenPort, const std::string &forwardHost, uint16_t forwardPort)
+{
+    m_forward.sin_family = AF_INET;
+    m_forward.sin_port = htons(forwardPort);
+    if (inet_pton(AF_INET, forwardHost.c_str(), &m_forward.sin_addr) != 1)
+    {
+        NS_LOG_UNCOND("NativeBridge :: Open :: bad forward address " << forwardHost);
+        return false;
+    }
+
+    m_udp = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(listenPort);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(m_udp, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (m_udp < 0 || bind(m_udp, (const sockaddr *)&local, sizeof(local)) < 0)
+    {
+        NS_LOG_UNCOND("NativeBridge :: Open :: cannot bind UDP " << listenPort << " :: " << strerror(errno));
+        return false;
+    }
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, m_ingressPair) < 0 || socketpair(AF_UNIX, SOCK_DGRAM, 0, m_egressPair) < 0
+        || pipe(m_wakePipe) < 0)
+    {
+        NS_LOG_UNCOND("NativeBridge :: Open :: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void NativeBridge::Start(void)
+{
+    m_running = true;
+    m_thread = std::thread(&NativeBridge::Loop, this);
+}
+
+void NativeBridge::Stop(void)
+{
+    if (!m_running.exchange(false))
+    {
+        return;
+    }
+    char c = 0;
+    if (write(m_wakePipe[1], &c, 1) < 0)
+    {
+        // The thread also notices m_running on its next wakeup
+    }
+    m_thread.join();
+}
+
+void NativeBridge::Loop(void)
+{
+    uint8_t buf[MAX_FRAME];
+    struct pollfd pfd[4];
+    pfd[0].fd = m_udp;
+    pfd[1].fd = m_ingressPair[1];
+    pfd[2].fd = m_egressPair[1];
+    pfd[3].fd = m_wakePipe[0];
+    for (int i = 0; i < 4; i++)
+    {
+        pfd[i].events = POLLIN;
+    }
+
+    while (m_running)
+    {
+        if (poll(pfd, 4, 100) <= 0)
+        {
+            continue;
+        }
+        if (pfd[0].revents & POLLIN)
+        {
+            sockaddr_in from;
+            socklen_t fromLen = sizeof(from);
+            uint32_t room = MAX_FRAME - ETH_HEADER - IP_HEADER - UDP_HEADER;
+            ssize_t len;
+            while ((len = recvfrom(m_udp, buf, room, MSG_DONTWAIT, (sockaddr *)&from, &fromLen)) >= 0)
+            {
+                Inject(buf, (uint32_t)len, ntohs(from.sin_port));
+                fromLen = sizeof(from);
+            }
+        }
+        for (int i = 1; i <= 2; i++)
+        {
+            if (pfd[i].revents & POLLIN)
+            {
+                ssize_t len;
+                while ((len = recv(pfd[i].fd, buf, sizeof(buf), MSG_DONTWAIT)) >= 0)
+                {
+                    HandleFrame(pfd[i].fd, buf, (uint32_t)len);
+                }
+            }
+        }
+    }
+}
+
+static uint16_t IpChecksum(const uint8_t *header, uint32_t length)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i + 1 < length; i += 2)
+    {
+        sum += (header[i] << 8) | header[i + 1];
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+static void Put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static void Put32(uint8_t *p, uint32_t v)
+{
+    Put16(p, v >> 16);
+    Put16(p + 2, v & 0xffff);
+}
+
+// Wrap a datagram from the native sender as 10.4.1.2 -> 10.5.1.2 and hand it to left leaf 1.
+// The UDP checksum is left at zero (none); ns-3 does not verify checksums unless ChecksumEnabled.
+void NativeBridge::Inject(const uint8_t *payload, uint32_t length, uint16_t srcPort)
+{
+    uint8_t frame[MAX_FRAME];
+    memcpy(frame, m_ingressMac, 6);
+    memcpy(frame + 6, m_hostMac, 6);
+    Put16(frame + 12, 0x0800);
+
+    uint8_t *ip = frame + ETH_HEADER;
+    memset(ip, 0, IP_HEADER);
+    ip[0] = 0x45;
+    Put16(ip + 2, IP_HEADER + UDP_HEADER + length);
+    Put16(ip + 4, m_ipId++);
+    ip[8] = 64;
+    ip[9] = 17;
+    Put32(ip + 12, INGRESS_HOST);
+    Put32(ip + 16, EGRESS_HOST);
+    Put16(ip + 10, IpChecksum(ip, IP_HEADER));
+
+    uint8_t *udp = ip + IP_HEADER;
+    Put16(udp, srcPort);
+    Put16(udp + 2, SIM_PROBE_PORT);
+    Put16(udp + 4, UDP_HEADER + length);
+    Put16(udp + 6, 0);
+    memcpy(udp + UDP_HEADER, payload, length);
+
+    if (send(m_ingressPair[1], frame, ETH_HEADER + IP_HEADER + UDP_HEADER + length, 0) > 0)
+    {
+        m_injected++;
+    }
+}
+
+void NativeBridge::HandleFrame(int fd, const uint8_t *frame, uint32_t length)
+{
+    if (length < ETH_HEADER)
+    {
+        return;
+    }
+    uint16_t type = (frame[12] << 8) | frame[13];
+    if (type == 0x0806)
+    {
+        ReplyArp(fd, frame, length);
+        return;
+    }
+    if (type != 0x0800 || fd != m_egressPair[1] || length < ETH_HEADER + IP_HEADER + UDP_HEADER)
+    {
+        return;
+    }
+
+    // Only UDP that made it across the dumbbell to the native receiver
+    const uint8_t *ip = frame + ETH_HEADER;
+    uint32_t ihl = (ip[0] & 0x0f) * 4;
+    uint32_t total = (ip[2] << 8) | ip[3];
+    if (ip[9] != 17 || total > length - ETH_HEADER || total < ihl + UDP_HEADER)
+    {
+        return;
+    }
+    const uint8_t *payload = ip + ihl + UDP_HEADER;
+    if (sendto(m_udp, payload, total - ihl - UDP_HEADER, 0, (const sockaddr *)&m_forward, sizeof(m_forward)) >= 0)
+    {
+        m_delivered++;
+    }
+}
+
+// Both leaves ARP for the virtual host on their FdNetDevice before forwarding to it
+void NativeBridge::ReplyArp(int fd, const uint8_t *frame, uint32_t length)
+{
+    const uint8_t *arp = frame + ETH_HEADER;
+    if (length < ETH_HEADER + 28 || ((arp[6] << 8) | arp[7]) != 1)
+    {
+        return;
+    }
+    uint32_t target = (arp[24] << 24) | (arp[25] << 16) | (arp[26] << 8) | arp[27];
+    if (target != INGRESS_HOST && target != EGRESS_HOST)
+    {
+        return;
+    }
+
+    uint8_t reply[ETH_HEADER + 28];
+    memcpy(reply, frame + 6, 6);
+    memcpy(reply + 6, m_hostMac, 6);
+    Put16(reply + 12, 0x0806);
+    uint8_t *r = reply + ETH_HEADER;
+    memcpy(r, arp, 6);              // htype, ptype, hlen, plen
+    Put16(r + 6, 2);
+    memcpy(r + 8, m_hostMac, 6);
+    memcpy(r + 14, arp + 24, 4);    // we are the address that was asked for
+    memcpy(r + 18, arp + 8, 10);    // back to the requester's MAC and IP
+    if (send(fd, reply, sizeof(reply), 0) > 0)
+    {
+        m_arpReplies++;
+    }
+}
+
+//================================================================
+// REAL-TIME LAG MONITOR
+//================================================================
+
+// Samples how far the simulator clock trails the wall clock. With probe trains the scheduler
+// has to keep up with sub-millisecond gaps; once it can't, the simulated dispersion no longer
+// means anything, so the run stops instead of reporting a bogus estimate.
+class LagMonitor
+{
+public:
+    LagMonitor(Time interval, Time maxLag, uint32_t strikes);
+
+    void Start(void);
+    void Report(void) const;
+    bool Aborted(void) const { return m_aborted; }
+
+private:
+    void Sample(void);
+
+    Time m_interval;
+    Time m_maxLag;
+    uint32_t m_strikes;
+    uint32_t m_overLimit;
+    bool m_aborted;
+    Ptr<RealtimeSimulatorImpl> m_impl;
+    vector<int64_t> m_lagUs;
+};
+
+LagMonitor::LagMonitor(Time interval, Time maxLag, uint32_t strikes) :
+    m_interval(interval), m_maxLag(maxLag), m_strikes(strikes), m_overLimit(0), m_aborted(false)
+{
+}
+
+void LagMonitor::Start(void)
+{
+    m_impl = DynamicCast<RealtimeSimulatorImpl>(Simulator::GetImplementation());
+    if (!m_impl)
+    {
+        NS_FATAL_ERROR("LagMonitor :: Start :: needs ns3::RealtimeSimulatorImpl");
+    }
+    m_lagUs.reserve(1 << 16);
+    Simulator::Schedule(m_interval, &LagMonitor::Sample, this);
+}
+
+void LagMonitor::Sample(void)
+{
+    Time lag = m_impl->RealtimeNow() - Simulator::Now();
+    if (m_lagUs.size() < m_lagUs.capacity())
+    {
+        m_lagUs.push_back(lag.GetMicroSeconds());
+    }
+
+    m_overLimit = lag > m_maxLag ? m_overLimit + 1 : 0;
+    if (m_overLimit >= m_strikes)
+    {
+        NS_LOG_UNCOND("LagMonitor :: Sample :: At " << Simulator::Now().GetSeconds() << "s the simulator is "
+            << lag.GetMicroSeconds() << "us behind real time for " << m_strikes << " samples, stopping");
+        m_aborted = true;
+        Simulator::Stop();
+        return;
+    }
+    Simulator::Schedule(m_interval, &LagMonitor::Sample, this);
+}
+
+void LagMonitor::Report(void) const
+{
+    if (m_lagUs.empty())
+    {
+        return;
+    }
+    vector<int64_t> sorted(m_lagUs);
+    sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for (uint32_t i = 0; i < sorted.size(); i++)
+    {
+        sum += sorted[i];
+    }
+    NS_LOG_UNCOND("LagMonitor :: " << sorted.size() << " samples :: mean " << sum / sorted.size() << "us p50 "
+        << sorted[sorted.size() / 2] << "us p99 " << sorted[sorted.size() * 99 / 100] << "us max " << sorted.back()
+        << "us");
+}
+
+//================================================================
+// MAIN
+//================================================================
+
+// Adds an FdNetDevice on node, addressed .1 in network/24, bridged to fd
+static Ptr<FdNetDevice> AttachNative(Ptr<Node> node, int fd, const char *network)
+{
+    FdNetDeviceHelper fdHelper;
+    fdHelper.SetAttribute("EncapsulationMode", StringValue("Dix"));
+    Ptr<FdNetDevice> device = fdHelper.Install(node).Get(0)->GetObject<FdNetDevice>();
+    device->SetFileDescriptor(fd);
+
+    Ipv4AddressHelper address(network, "255.255.255.0");
+    NetDeviceContainer devices;
+    devices.Add(device);
+    address.Assign(devices);
+    return device;
+}
+
+int main(int argc, char *argv[])
+{
+    double stopTime = 120.0;
+    uint32_t listenPort = 9000;
+    std::string forwardHost = "127.0.0.1";
+    uint32_t forwardPort = 8090;
+    std::string crossRate = "7Mbps";
+    uint32_t lagSampleUs = 1000;
+    uint32_t maxLagUs = 5000;
+    uint32_t lagStrikes = 20;
+
+    CommandLine cmd;
+    cmd.AddValue("stopTime", "Seconds of (real) time to run", stopTime);
+    cmd.AddValue("listen", "UDP port the native sender probes", listenPort);
+    cmd.AddValue("forwardHost", "Native receiver address", forwardHost);
+    cmd.AddValue("forwardPort", "Native receiver UDP port", forwardPort);
+    cmd.AddValue("crossRate", "CBR cross traffic over the bottleneck", crossRate);
+    cmd.AddValue("lagSampleUs", "Real-time lag sampling interval", lagSampleUs);
+    cmd.AddValue("maxLagUs", "Lag above which a sample counts against the run", maxLagUs);
+    cmd.AddValue("lagStrikes", "Consecutive samples over maxLagUs before stopping", lagStrikes);
+    cmd.Parse(argc, argv);
+
+    // 실시간 스케줄러. HardLimit는 NS_FATAL로 끝나므로 BestEffort로 두고 LagMonitor가 멈춤
+    GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::RealtimeSimulatorImpl"));
+    Config::SetDefault("ns3::RealtimeSimulatorImpl::SynchronizationMode", StringValue("BestEffort"));
+    GlobalValue::Bind("ChecksumEnabled", BooleanValue(false));
+
+    NativeBridge bridge;
+    if (!bridge.Open(listenPort, forwardHost, forwardPort))
+    {
+        return 1;
+    }
+
+    // Pathload-Simulation.cc와 같은 덤벨
+    PointToPointHelper bottleNeck;
+    bottleNeck.SetDeviceAttribute("DataRate", StringValue("10Mbps"));
+    bottleNeck.SetChannelAttribute("Delay", StringValue("2ms"));
+    bottleNeck.SetQueue("ns3::DropTailQueue", "Mode", StringValue("QUEUE_MODE_PACKETS"));
+
+    PointToPointHelper pointToPointLeaf;
+    pointToPointLeaf.SetDeviceAttribute("DataRate", StringValue("100Mbps"));
+    pointToPointLeaf.SetChannelAttribute("Delay", StringValue("1ms"));
+
+    PointToPointDumbbellHelper dB(2, pointToPointLeaf, 2, pointToPointLeaf, bottleNeck);
+
+    InternetStackHelper stack;
+    dB.InstallStack(stack);
+
+    dB.AssignIpv4Addresses(Ipv4AddressHelper("10.1.1.0", "255.255.255.0"),
+        Ipv4AddressHelper("10.2.1.0", "255.255.255.0"),
+        Ipv4AddressHelper("10.3.1.0", "255.255.255.0"));
+
+    // 네이티브 프로버가 leaf 1 자리에 들어감. 두 fd 서브넷은 채널 없는 stub 네트워크로
+    // 글로벌 라우팅에 잡힘
+    Ptr<FdNetDevice> ingress = AttachNative(dB.GetLeft(1), bridge.IngressDeviceFd(), INGRESS_NETWORK);
+    AttachNative(dB.GetRight(1), bridge.EgressDeviceFd(), EGRESS_NETWORK);
+    bridge.SetIngressMac(Mac48Address::ConvertFrom(ingress->GetAddress()));
+
+    // 경쟁 트래픽
+    uint16_t port = 8100;
+    OnOffHelper onoff1("ns3::UdpSocketFactory", InetSocketAddress(dB.GetRightIpv4Address(0), port));
+    onoff1.SetConstantRate(DataRate(crossRate), 1400);
+    ApplicationContainer cbrApp1 = onoff1.Install(dB.GetLeft(0));
+    cbrApp1.Start(Seconds(0.02));
+    cbrApp1.Stop(Seconds(stopTime));
+
+    PacketSinkHelper cbrSink1("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), port));
+    cbrApp1 = cbrSink1.Install(dB.GetRight(0));
+    cbrApp1.Start(Seconds(0.0));
+    cbrApp1.Stop(Seconds(stopTime));
+
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+    LagMonitor lag(MicroSeconds(lagSampleUs), MicroSeconds(maxLagUs), lagStrikes);
+    lag.Start();
+    bridge.Start();
+
+    NS_LOG_UNCOND("PathloadHybrid :: UDP " << listenPort << " -> dumbbell -> " << forwardHost << ":" << forwardPort
+        << " :: cross " << crossRate << " :: running " << stopTime << "s");
+
+    Simulator::Stop(Seconds(stopTime));
+    Simulator::Run();
+
+    // 브리지 스레드를 먼저 세우고 나서 FdNetDevice를 정리
+    bridge.Stop();
+    lag.Report();
+    NS_LOG_UNCOND("PathloadHybrid :: injected " << bridge.Injected() << " delivered " << bridge.Delivered()
+        << " arp " << bridge.ArpReplies() << (lag.Aborted() ? " :: stopped early, simulator fell behind" : ""));
+    Simulator::Destroy();
+
+    return lag.Aborted() ? 2 : 0;
+}
@@ -9,6 +9,8 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/point-to-point-layout-module.h"
+#include "bw-estimator.h"
+#include "bw-records.h"
 
 using namespace ns3;
 using namespace std;
@@ -21,28 +23,24 @@ bool m_checkTCP;
 bool m_checkUDP;
 
 Time m_cTime;
-Time m_dTime;
-uint32_t m_oneWayDelay;
-uint32_t m_srcGapSum = 0;
-uint32_t m_lastSrcGapSum = 0;
-uint32_t m_dstGapSum = 0;
 uint32_t m_srcGap;
 uint32_t m_srcGapNext;
-uint32_t m_step;
 uint32_t m_gB;
 bool m_isServerStop; //서버에서 트레인 이제 그만 보낼 시점
-uint32_t m_incGapSum;
 float m_b_bw = 10.0; //보틀넥 링크 용량(Mbps)
-float m_c_bw;
-float m_a_bw;
 bool m_isServerSending = false;
 Time m_startTime;
 Time m_finishTime;
-vector<uint32_t> m_depatureTimeArray;
-vector<uint32_t> m_arrivalTimeArray;
-vector<uint32_t> m_oneWayDelayArray;
 uint32_t m_probePcktSize = 700;
 
+// IGI 파라미터. 서버(트레인 전송)와 클라이언트(추정)가 같은 값을 씀. 
+// 추정 로직 자체는 bw-estimator.h에 있고, 네이티브 프로버도 같은 코드를 씀.
+bwest::IgiConfig m_igiConfig;
+
+// --records: 클라이언트 추정기의 입력과 결과를 bw-records.h 로그로 남김 (parity.sh가 네이티브와 비교)
+// --dump: 입력만 bw-capture.h 바이너리로 남김. 임계값 튜닝은 bwprobe offline으로 재시뮬레이션 없이
+bwest::RecordWriter m_records;
+
 //================================================================
 // SERVER APPLICATION
 //================================================================
@@ -100,6 +98,7 @@ private:
     EventId m_probing;
     Time m_lastPacketTime;
     uint32_t m_nextRoundTime;
+    vector<uint8_t> m_probePayload; // 프로브 헤더 + 패딩. Setup에서 한 번만 할당
 
 };
 
@@ -131,13 +130,13 @@ void PathloadServerApp::Setup(Address address, Address addressForUDP, uint32_t p
     m_lastPacketTime = Simulator::Now();
 
     // 패킷 사이즈도 전달받는겨. 패킷 간격이 m_timePeriod
-    m_packetSize = packetSize;
+    m_packetSize = max(packetSize, (uint32_t)bwest::PROBE_HEADER_SIZE);
+    m_probePayload.assign(m_packetSize, 0);
     // m_srcGap = 200; // (us)초기 200마이크로초 갭부터 시작 
-    m_trainSize = 60; // 패캣 트레인은 256개의 패킷으로 구성
-    m_gB = 600; // gB값. 0.6ms (마이크로초)
-    m_srcGap = m_gB / 2; // 초기의 갭값. 
+    m_trainSize = m_igiConfig.trainSize; // 패캣 트레인은 60개의 패킷으로 구성
+    m_gB = m_igiConfig.gBNs / 1000; // gB값. 0.6ms (마이크로초)
+    m_srcGap = m_gB / 2; // 초기의 갭값. 스텝(gB/8)만큼 늘리는 건 클라이언트 추정기가 정함
     m_srcGapNext = m_gB / 2;
-    m_step = m_gB / 8; //스텝값. 
     m_isServerStop = false;
     m_nextRoundTime = 500; //트레인간 간격 1000ms
     m_startTime = Simulator::Now();
@@ -221,17 +220,22 @@ void PathloadServerApp::SendPacketsForUDP(void)
         Simulator::Cancel(m_probing);
     }else{
         m_packetCountForUDP++; // 1개 보낼 때마다 몇 개 보냈는지, m_packetCountForUDP에 저장. 
-        m_srcGapSum = m_srcGap * (m_trainSize -1); // 소스갭 계산
         if(m_packetCountForUDP <= m_trainSize){
             m_isServerSending = true;
-            if(m_packetCountForUDP == 1){ m_srcGapSum = 0;}
-
-            uint32_t bytesSend = m_packetSize;
 
             Time curTime = Simulator::Now();
-            m_depatureTimeArray.push_back(curTime.GetMilliSeconds());
-            //패킷을 지정된 패킷사이즈(750바이트)로 만들어서, Udp 주소로 보낸다. 
-            Ptr<Packet> packet = Create<Packet>((uint8_t*)&bytesSend, bytesSend);
+
+            // 트레인 번호, 순번, 전송 시각을 프로브 헤더에 담음. 클라이언트가 이걸로 추정함. 
+            bwest::ProbeHeader header;
+            header.train = m_trainCount;
+            header.seq = m_packetCountForUDP - 1;
+            header.trainSize = m_trainSize;
+            header.gapNs = m_srcGap * 1000;
+            header.txNs = curTime.GetNanoSeconds();
+            bwest::WriteProbeHeader(&m_probePayload[0], header);
+
+            //패킷을 지정된 패킷사이즈(700바이트)로 만들어서, Udp 주소로 보낸다. 
+            Ptr<Packet> packet = Create<Packet>(&m_probePayload[0], m_packetSize);
             m_socketForUDP->SendTo(packet, 0, adsForUDP);
             m_cTime = curTime;
 
@@ -248,8 +252,7 @@ void PathloadServerApp::SendPacketsForUDP(void)
             m_srcGap = m_srcGapNext;
             m_packetCountForUDP = 0;
             m_trainCount++;
-            m_lastSrcGapSum = m_srcGapSum;
-            NS_LOG_UNCOND(m_trainCount << "번째 트레인 서버에서 전송 완료. m_lastSrcGapSum: " << m_lastSrcGapSum);
+            NS_LOG_UNCOND(m_trainCount << "번째 트레인 서버에서 전송 완료. 소스갭 합: " << m_srcGap * (m_trainSize - 1));
             // Simulator::Cancel(m_probing);
             // Time tNextProcess(MilliSeconds(m_nextRoundTime));
             // Simulator::Schedule(tNextProcess, &PathloadServerApp::SendPeriod, this);
@@ -318,6 +321,8 @@ public:
     virtual ~PathloadClientApp();
 
     void Setup(Address address, Address addressForUDP, uint32_t packetSize);
+    // --replay: 소켓 대신 기록된 로그를 수신 시각에 맞춰 추정기에 넣음
+    void Replay(const bwest::RecordLog &log);
 
 private:
     virtual void StartApplication(void);
@@ -330,6 +335,10 @@ private:
     void RxCallbackForTCP(Ptr<Socket> socket);
     void RxCallbackForUDP(Ptr<Socket> socket);
 
+    void HandleRecord(const bwest::ProbeRecord &record);
+    void HandleEstimate(const bwest::Estimate &estimate);
+    void ReplayEntry(uint32_t index);
+
     void RxDrop(Ptr<const Packet> p);
 
     // Handle periodic request of probing packet
@@ -356,14 +365,12 @@ private:
     uint32_t m_cumulativeSize;
     uint32_t m_packetCountForUDP;
     uint32_t m_trainSize;
-    Time m_lastPacketTime;
     uint32_t m_trainCount;
 
     Address adsForUDP;
-    uint32_t m_oneWayDelay;
-    float m_equalNorm;
-    // uint32_t m_c_bw;
-    float m_a_bw;
+    bwest::IgiEstimator m_igi; // IGI/PTR 추정기 (네이티브 프로버와 같은 코드)
+    vector<uint8_t> m_rxBuffer;
+    bwest::RecordLog m_replayLog;
 
 };
 
@@ -371,7 +378,8 @@ PathloadClientApp::PathloadClientApp() :
     m_socketForTCP(0), m_peer(), m_running(false), m_numOfPackets(0),
     m_sizeOfPackets(0), m_timePeriod(0), m_maxSizeOfPackets(0), m_minSizeOfPackets(0),
     m_rateOfStream(0), m_packetSize(0), m_socketForUDP(0), m_sizeOfRequestPackets(0),
-    m_cumulativeSize(0), m_packetCountForUDP(0), m_trainSize(0),adsForUDP(), m_oneWayDelay(0)
+    m_cumulativeSize(0), m_packetCountForUDP(0), m_trainSize(0), m_trainCount(0), adsForUDP(),
+    m_igi(m_igiConfig)
 {
 
 }
@@ -392,10 +400,13 @@ void PathloadClientApp::Setup(Address address, Address addressForUDP, uint32_t p
 
     m_packetSize = packetSize;
 
-    m_trainSize = 60; //트레인 사이즈 256개
+    m_trainSize = m_igiConfig.trainSize; //트레인 사이즈 60개
     m_timePeriod = 200; // 패킷 간격 100마이크로초
-    m_lastPacketTime = Simulator::Now(); 
     m_trainCount = 0;
+    m_igiConfig.bottleneckMbps = m_b_bw;
+    m_igi = bwest::IgiEstimator(m_igiConfig);
+    m_rxBuffer.assign(bwest::PROBE_HEADER_SIZE, 0);
+    m_records.Config(m_igiConfig);
 
     // Calculate expected stream rate using number of packets, size of packets, and sending period of each packet (unit of rate is 'bps')
     m_rateOfStream = (double)(m_trainSize * m_sizeOfPackets * 8) / ((double)(m_timePeriod * m_trainSize) / pow(10, 6));
@@ -454,50 +465,114 @@ void PathloadClientApp::RxCallbackForUDP(Ptr<Socket> socket)
             break;
         }
         uint32_t m_recvPcktSize = packet->GetSize();
-        m_packetCountForUDP++; // 카운트 1 증가. (초기값 = 0)
-        if(m_packetCountForUDP == 1){m_dstGapSum = 0;} // 첫 패킷일 경우, 지난 목적지 갭 합산값 초기화
-        NS_LOG_UNCOND("클라이언트에 받은 패킷 개수: " << m_packetCountForUDP << " 패킷 사이즈: " << m_recvPcktSize);
         Time curTime = Simulator::Now(); //받은 시간값 저장
-        // 2번째 패킷부터, 목적지 갭 계산 후 합산값에 누적. 
-        if(m_packetCountForUDP > 1 && m_packetCountForUDP <= m_trainSize){
-            uint32_t m_dstGap = curTime.GetMicroSeconds() - m_lastPacketTime.GetMicroSeconds();
-            NS_LOG_UNCOND("클라이언트: 현재 패킷의 목적지 갭: " << m_dstGap);
-            m_dstGapSum += m_dstGap;
+
+        bwest::ProbeHeader header;
+        packet->CopyData(&m_rxBuffer[0], bwest::PROBE_HEADER_SIZE);
+        if(!bwest::ReadProbeHeader(&m_rxBuffer[0], m_recvPcktSize, &header)){
+            continue; // 프로브 패킷 아님
         }
-        m_lastPacketTime = curTime;
-        m_arrivalTimeArray.push_back(m_lastPacketTime.GetMilliSeconds());
-        m_oneWayDelayArray.push_back(m_arrivalTimeArray[m_packetCountForUDP - 1] - m_depatureTimeArray[m_packetCountForUDP - 1]);
-        NS_LOG_UNCOND(m_packetCountForUDP << "번째 패킷의 OnewayDelay: " << m_oneWayDelayArray[m_packetCountForUDP-1]);
-        // 100번째 패킷이 왓을 경우, 
-        if(m_packetCountForUDP == m_trainSize){
-            m_packetCountForUDP = 0;  // 패킷 카운트 초기화
-            m_trainCount++; // 트레인 카운트
-            m_incGapSum = m_dstGapSum - m_srcGapSum; 
-            NS_LOG_UNCOND("srcGapSum: " << m_srcGapSum << " dstGapSum: " << m_dstGapSum);
-            NS_LOG_UNCOND("Increased Gap Sum: " << m_incGapSum);
-            m_equalNorm = ((float) m_incGapSum) / ((float)m_dstGapSum);
-            // NS_LOG_UNCOND("m_equalNorm: " << m_equalNorm);
-
-            if(m_equalNorm < 0.2){ //소스갭합과 목적지갭합이 같을 경우
-                NS_LOG_UNCOND("m_b_bw: " << m_b_bw);
-                m_c_bw = m_b_bw * m_equalNorm; //경쟁 트래픽 스루풋
-                m_a_bw = m_b_bw - m_c_bw; //가용대역폭
-                m_isServerStop = true;
-                m_finishTime = Simulator::Now();
-                uint32_t m_elapsedTime = m_finishTime.GetMilliSeconds() - m_startTime.GetMilliSeconds();
-                float m_ptr = ((float)m_probePcktSize * 8 * (m_trainSize - 1))/ m_dstGapSum;
-                NS_LOG_UNCOND("Train count(trains): " << m_trainCount << "수렴 시간(ms): " << m_elapsedTime);
-                NS_LOG_UNCOND("===============================IGI================================");
-                NS_LOG_UNCOND("경쟁 트래픽(Mbps): " << m_c_bw << "가용대역폭(Mbps): " << m_a_bw);
-                NS_LOG_UNCOND("===============================PTR================================");
-                NS_LOG_UNCOND("경쟁 트래픽(Mbps): " << (m_b_bw - m_ptr) << "가용대역폭(Mbps): " << m_ptr); 
-                NS_LOG_UNCOND("==================================================================");
-                Simulator::Stop();
-            }else{
-                m_srcGapNext += m_step; 
-                NS_LOG_UNCOND("클라이언트에서: 소스갭 다음으로 변경: " << m_srcGapNext);
+        m_packetCountForUDP++; // 카운트 1 증가. (초기값 = 0)
+        NS_LOG_UNCOND("클라이언트에 받은 패킷 개수: " << m_packetCountForUDP << " 패킷 사이즈: " << m_recvPcktSize);
+        NS_LOG_UNCOND(m_packetCountForUDP << "번째 패킷의 OnewayDelay(us): " << (curTime.GetNanoSeconds() - header.txNs) / 1000);
+
+        bwest::ProbeRecord record;
+        record.train = header.train;
+        record.seq = header.seq;
+        record.txNs = header.txNs;
+        record.rxNs = curTime.GetNanoSeconds();
+        record.size = m_recvPcktSize;
+        HandleRecord(record);
+    }
+}
+
+void PathloadClientApp::HandleRecord(const bwest::ProbeRecord &record)
+{
+    m_records.Record(record);
+    m_igi.Push(record);
+
+    // 트레인 마지막 패킷이 왔을 경우, 추정기가 결과를 내놓음
+    bwest::Estimate estimate;
+    if(m_igi.Poll(&estimate)){
+        HandleEstimate(estimate);
+    }
+}
+
+void PathloadClientApp::HandleEstimate(const bwest::Estimate &estimate)
+{
+    m_records.Result(estimate);
+    m_packetCountForUDP = 0;  // 패킷 카운트 초기화
+    m_trainCount++; // 트레인 카운트
+    NS_LOG_UNCOND("srcGapSum: " << estimate.srcGapSumUs << " dstGapSum: " << estimate.dstGapSumUs);
+    NS_LOG_UNCOND("Increased Gap Sum: " << estimate.dstGapSumUs - estimate.srcGapSumUs);
+
+    if(estimate.converged){ //소스갭합과 목적지갭합이 같을 경우
+        NS_LOG_UNCOND("m_b_bw: " << m_b_bw);
+        m_isServerStop = true;
+        m_finishTime = Simulator::Now();
+        uint32_t m_elapsedTime = m_finishTime.GetMilliSeconds() - m_startTime.GetMilliSeconds();
+        NS_LOG_UNCOND("Train count(trains): " << m_trainCount << "수렴 시간(ms): " << m_elapsedTime);
+        NS_LOG_UNCOND("===============================IGI================================");
+        NS_LOG_UNCOND("경쟁 트래픽(Mbps): " << estimate.igiCrossMbps << "가용대역폭(Mbps): " << estimate.igiAvailMbps);
+        NS_LOG_UNCOND("===============================PTR================================");
+        NS_LOG_UNCOND("경쟁 트래픽(Mbps): " << (m_b_bw - estimate.ptrMbps) << "가용대역폭(Mbps): " << estimate.ptrMbps); 
+        NS_LOG_UNCOND("==================================================================");
+        Simulator::Stop();
+    }else{
+        m_srcGapNext = estimate.nextGapNs / 1000; 
+        NS_LOG_UNCOND("클라이언트에서: 소스갭 다음으로 변경: " << m_srcGapNext);
+    }
+}
+
+void PathloadClientApp::Replay(const bwest::RecordLog &log)
+{
+    m_replayLog = log;
+
+    // 첫 레코드의 수신 시각을 0으로. 시각이 뒤로 가는 레코드(네이티브 수신 타임스탬프)와
+    // F/D/X 줄은 직전 시각에 둠. 같은 시각의 이벤트는 스케줄 순서대로 실행됨
+    bool first = true;
+    int64_t base = 0;
+    int64_t at = 0;
+    for (uint32_t i = 0; i < m_replayLog.entries.size(); i++)
+    {
+        const bwest::RecordEntry &entry = m_replayLog.entries[i];
+        if (entry.op == 'R')
+        {
+            if (first)
+            {
+                base = entry.record.rxNs;
+                first = false;
             }
-        }       
+            at = max(at, entry.record.rxNs - base);
+        }
+        Simulator::Schedule(NanoSeconds(at), &PathloadClientApp::ReplayEntry, this, i);
+    }
+}
+
+void PathloadClientApp::ReplayEntry(uint32_t index)
+{
+    const bwest::RecordEntry &entry = m_replayLog.entries[index];
+    bwest::Estimate estimate;
+    switch (entry.op)
+    {
+    case 'R':
+        m_packetCountForUDP++;
+        HandleRecord(entry.record);
+        break;
+    case 'F':
+        m_records.Flush(entry.record.train);
+        if (m_igi.Flush() && m_igi.Poll(&estimate))
+        {
+            HandleEstimate(estimate);
+        }
+        break;
+    case 'D':
+        m_records.Discard(entry.record.train);
+        m_igi.Discard();
+        break;
+    default:
+        m_records.Reset(entry.record.train);
+        m_igi.Reset();
     }
 }
 
@@ -544,10 +619,53 @@ int main(int argc, char *argv[])
 {
 
     float m_stopTime = 300.0;
+    std::string recordsFile;
+    std::string replayFile;
+    std::string dumpFile;
+
+    CommandLine cmd;
+    cmd.AddValue("records", "Write the client estimator's inputs and estimates to this bw-records.h log", recordsFile);
+    cmd.AddValue("replay", "Feed this bw-records.h log to the client estimator instead of simulating the network", replayFile);
+    cmd.AddValue("dump", "Write the client estimator's inputs to this bw-capture.h binary capture (bwprobe offline)", dumpFile);
+    cmd.Parse(argc, argv);
 
     std::string animFile = "dash-animation.xml" ;  // Name of file for animation output
     LogComponentEnable("PathloadApplication", LOG_LEVEL_ALL);
 
+    if (!recordsFile.empty() && !m_records.Open(recordsFile))
+    {
+        NS_LOG_UNCOND("Cannot open " << recordsFile);
+        return 1;
+    }
+    if (!dumpFile.empty() && !m_records.OpenCapture(dumpFile))
+    {
+        NS_LOG_UNCOND("Cannot open " << dumpFile);
+        return 1;
+    }
+
+    // 리플레이: 토폴로지 없이 클라이언트 추정 경로만 실행
+    if (!replayFile.empty())
+    {
+        bwest::RecordLog log;
+        std::string error;
+        if (!bwest::ReadRecordLog(replayFile, &log, &error) || log.kind != bwest::ESTIMATOR_IGI)
+        {
+            NS_LOG_UNCOND("Cannot replay " << replayFile << ": " << (error.empty() ? "not an IGI log" : error));
+            return 1;
+        }
+        m_igiConfig = log.igi;
+        m_b_bw = log.igi.bottleneckMbps;
+
+        Ptr<PathloadClientApp> replayApp = CreateObject<PathloadClientApp>();
+        replayApp->Setup(Address(), Address(), m_probePcktSize);
+        replayApp->Replay(log);
+
+        Simulator::Run();
+        Simulator::Destroy();
+        m_records.Close();
+        return 0;
+    }
+
     PointToPointHelper bottleNeck;
     bottleNeck.SetDeviceAttribute("DataRate", StringValue("10Mbps")); //주의: 맨 위에 전역 변수 m_b_bw값도 넣어주기
     bottleNeck.SetChannelAttribute("Delay", StringValue("2ms"));
@@ -620,6 +738,7 @@ int main(int argc, char *argv[])
     Simulator::Run();
     std::cout << "Animation Trace file created:" << animFile.c_str ()<< std::endl;
     Simulator::Destroy();
+    m_records.Close();
 
     return 0;
 }
\ No newline at end of file
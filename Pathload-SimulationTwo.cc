@@ -9,6 +9,8 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/point-to-point-layout-module.h"
+#include "bw-estimator.h"
+#include "bw-records.h"
 
 using namespace ns3;
 using namespace std;
@@ -18,9 +20,13 @@ NS_LOG_COMPONENT_DEFINE ("PathloadApplication");
 // This simulation is to test the bandwidth measurement tool, pathload
 
 // Global variable to implement SLoPS scheme
-vector<uint32_t> m_depatureTimeArray;
-vector<uint32_t> m_arrivalTimeArray;
-vector<uint32_t> m_oneWayDelayArray;
+// The trend test and the rate search live in bw-estimator.h, shared with the native prober.
+bwest::TrendConfig m_trendConfig;
+uint32_t m_nextTimePeriod = 0; // (us) stream period picked by the client for the next round
+
+// --records: the client estimator's inputs and estimates as a bw-records.h log, for parity.sh
+// --dump: the inputs only, as a bw-capture.h binary for threshold tuning with bwprobe offline
+bwest::RecordWriter m_records;
 
 //================================================================
 // SERVER APPLICATION
@@ -95,6 +101,8 @@ private:
     double m_pairwiseDifferenceIndicator;
     uint32_t m_increasingCountOfComparison;
     uint32_t m_increasingCountOfDifference;
+
+    vector<uint8_t> m_probePayload; // probe header + padding, allocated once in Setup
 };
 
 PathloadServerApp::PathloadServerApp() :
@@ -123,12 +131,13 @@ void PathloadServerApp::Setup(Address address, Address addressForUDP, uint32_t p
     ads = address;
     adsForUDP = addressForUDP;
 
-    m_packetSize = packetSize;
-    m_timePeriod = 100; // (us)
+    m_packetSize = max(packetSize, (uint32_t)bwest::PROBE_HEADER_SIZE);
+    m_probePayload.assign(m_packetSize, 0);
+    m_timePeriod = m_trendConfig.initialGapNs / 1000; // (us)
     m_nextRoundTime = 100000; // (us)
 
-    m_numOfGroup = 10; // 100 packets to the 10 groups
-    m_numOfPacketsAtServer = 100;
+    m_numOfGroup = m_trendConfig.groups; // 100 packets to the 10 groups
+    m_numOfPacketsAtServer = m_trendConfig.trainSize;
 
     NS_LOG_UNCOND("PathloadServerApp :: Setup");
 }
@@ -214,9 +223,17 @@ void PathloadServerApp::TxCallbackForUDP(Ptr<Socket> socket, uint32_t txSpace)
 
 void PathloadServerApp::SendPacketsForUDP(void)
 {
-    uint32_t bytesSend = m_packetSize;
+    m_cTime = Simulator::Now();
 
-    Ptr<Packet> packet = Create<Packet>((uint8_t*)&bytesSend, bytesSend);
+    bwest::ProbeHeader header;
+    header.train = m_fleetCount;
+    header.seq = m_packetCountForUDP;
+    header.trainSize = m_numOfPacketsAtServer;
+    header.gapNs = m_timePeriod * 1000;
+    header.txNs = m_cTime.GetNanoSeconds();
+    bwest::WriteProbeHeader(&m_probePayload[0], header);
+
+    Ptr<Packet> packet = Create<Packet>(&m_probePayload[0], m_packetSize);
     m_socketForUDP->SendTo(packet, 0, adsForUDP);
 
     m_packetCountForUDP++;
@@ -228,16 +245,7 @@ void PathloadServerApp::SendPacketsForUDP(void)
 
     // else {
 
-        if (m_packetCountForUDP > 0)
-        {
-            // NS_LOG_UNCOND("PathloadServerApp :: SendPacketsForUDP :: Probing " << m_packetCountForUDP << "th Packet..");
-
-            m_cTime = Simulator::Now();
-
-            m_depatureTimeArray.push_back(m_cTime.GetMilliSeconds());
-
-            // NS_LOG_UNCOND("PathloadServerApp :: SendPacketsForUDP :: Current Time Check :: " << m_cTime.GetMicroSeconds());
-        }
+        // NS_LOG_UNCOND("PathloadServerApp :: SendPacketsForUDP :: Probing " << m_packetCountForUDP << "th Packet..");
 
     Simulator::ScheduleNow(&PathloadServerApp::SendPeriod, this);
 
@@ -298,77 +306,20 @@ void PathloadServerApp::SendPeriod(void)
     {
         if (m_packetCountForUDP > m_numOfPacketsAtServer - 1) {
 
-            for (uint32_t index = 0; index < m_depatureTimeArray.size(); index++)
-            {
-                // NS_LOG_UNCOND("Depature Time of " << (index + 1) << "th Packet :: " << m_depatureTimeArray[index]);
-            }
-
-            // NS_LOG_UNCOND("Depature :: " << m_depatureTimeArray.size());
-
             m_packetCountForUDP = 0;
 
             m_fleetCount++;
 
-            m_depatureTimeArray.clear();
-
             NS_LOG_UNCOND("PathloadServerApp :: SendPeriod :: Fleet Count At Server :: " << m_fleetCount);
 
             NS_LOG_UNCOND("PathloadServerApp :: SendPeriod :: " << m_fleetCount << "th Probing Round End");
 
-            NS_LOG_UNCOND("PathloadServerApp :: SendPeriod :: OWD Delay Trend Check..");
-
-            // if (m_fleetCount > 1)
-            // {
-            //     m_increasingCountOfComparison = 0;
-            //     m_increasingCountOfDifference = 0;
-
-            //     for (uint32_t biasValue = 0; biasValue < 10; biasValue++)
-            //     {
-            //         m_pairwiseComparisonIndicator = 0.0;
-            //         m_pairwiseDifferenceIndicator = 0.0;
-
-            //         for (uint32_t indexOf = 0 + (biasValue * 10); indexOf < 9 + (biasValue * 10); indexOf++)
-            //         {
-
-            //             if (m_oneWayDelayArray[indexOf + 1] > m_oneWayDelayArray[indexOf])
-            //             {
-            //                 m_pairwiseComparisonIndicator++;
-            //             }
-
-            //             m_pairwiseDifferenceIndicator += abs(m_oneWayDelayArray[indexOf + 1] - m_oneWayDelayArray[indexOf]);
-            //         }
-
-            //         m_pairwiseComparisonIndicator /= ((double)m_numOfGroup - 1);
-
-            //         NS_LOG_UNCOND("PathloadServerApp :: SendPeriod :: Pairwise Comparison of :: " << (biasValue + 1) << "th Group :: " << m_pairwiseComparisonIndicator);
-
-            //         if (m_pairwiseComparisonIndicator > 0.55)
-            //         {
-            //             m_increasingCountOfComparison++;
-            //         }
-
-            //         if (m_pairwiseDifferenceIndicator == 0.0)
-            //         {
-            //             m_pairwiseDifferenceIndicator = 0.0;
-            //         }
-
-            //         else {
-            //             m_pairwiseDifferenceIndicator = 1.0 / m_pairwiseDifferenceIndicator;
-            //         }
-
-            //         m_pairwiseDifferenceIndicator = (m_oneWayDelayArray[(biasValue * 10) + m_numOfGroup - 1] - m_oneWayDelayArray[(biasValue * 10)]) * m_pairwiseDifferenceIndicator;
-
-            //         NS_LOG_UNCOND("PathloadServerApp :: SendPeriod :: Pairwise Difference of :: " << (biasValue + 1) << "th Group :: " << m_pairwiseDifferenceIndicator);
-
-            //         if (m_pairwiseDifferenceIndicator > 0.4)
-            //         {
-            //             m_increasingCountOfDifference++;
-            //         }
-            //     }
-
-            //     NS_LOG_UNCOND("PathloadServerApp :: SendPeriod :: Comparison Count :: " << m_increasingCountOfComparison);
-            //     NS_LOG_UNCOND("PathloadServerApp :: SendPeriod :: Difference Count :: " << m_increasingCountOfDifference);
-            // }
+            // The OWD trend (PCT/PDT) of this stream is judged at the client, which also
+            // picks the stream rate of the next round
+            if (m_nextTimePeriod)
+            {
+                m_timePeriod = m_nextTimePeriod;
+            }
 
             isIdlePeriod = true;
 
@@ -403,6 +354,8 @@ public:
     virtual ~PathloadClientApp();
 
     void Setup(Address address, Address addressForUDP, uint32_t packetSize);
+    // --replay: feed a recorded log to the estimator at its receive times instead of the socket
+    void Replay(const bwest::RecordLog &log);
 
 private:
     virtual void StartApplication(void);
@@ -415,6 +368,9 @@ private:
     void RxCallbackForTCP(Ptr<Socket> socket);
     void RxCallbackForUDP(Ptr<Socket> socket);
 
+    void HandleEstimate(const bwest::Estimate &estimate);
+    void ReplayEntry(uint32_t index);
+
     void RxDrop(Ptr<const Packet> p);
 
     // Handle periodic request of probing packet
@@ -449,6 +405,10 @@ private:
 
     uint32_t m_localFleetCount;
     uint32_t m_defaultPropagationDelay;
+
+    bwest::TrendEstimator m_trend;
+    vector<uint8_t> m_rxBuffer;
+    bwest::RecordLog m_replayLog;
 };
 
 PathloadClientApp::PathloadClientApp() :
@@ -456,7 +416,8 @@ PathloadClientApp::PathloadClientApp() :
     m_sizeOfPackets(0), m_timePeriod(0), m_maxSizeOfPackets(0), m_minSizeOfPackets(0),
     m_rateOfStream(0), m_packetSize(0), m_socketForUDP(0), m_sizeOfRequestPackets(0),
     m_cumulativeSize(0), m_packetCountForUDP(0), adsForUDP(), m_numOfIncrease(0), m_numOfNonIncrease(0),
-    m_thresholdForTrendJudgement(0), m_localFleetCount(0), m_defaultPropagationDelay(0)
+    m_thresholdForTrendJudgement(0), m_localFleetCount(0), m_defaultPropagationDelay(0),
+    m_trend(m_trendConfig)
 {
 
 }
@@ -477,8 +438,8 @@ void PathloadClientApp::Setup(Address address, Address addressForUDP, uint32_t p
 
     m_packetSize = packetSize;
 
-    m_numOfPackets = 100;
-    m_timePeriod = 100;
+    m_numOfPackets = m_trendConfig.trainSize;
+    m_timePeriod = m_trendConfig.initialGapNs / 1000;
 
     m_defaultPropagationDelay = 50; // (ms)
 
@@ -501,6 +462,11 @@ void PathloadClientApp::Setup(Address address, Address addressForUDP, uint32_t p
 
     // Expected stream rate is represented to 'Mbps' unit
     NS_LOG_UNCOND("PathloadClient :: Setup :: Initially Expected Stream Rate :: " << (double)m_rateOfStream / pow(10, 6) << " Mbps" << " Checked At Client");
+
+    m_trendConfig.packetSize = m_sizeOfPackets;
+    m_trend = bwest::TrendEstimator(m_trendConfig);
+    m_rxBuffer.assign(bwest::PROBE_HEADER_SIZE, 0);
+    m_records.Config(m_trendConfig);
 }
 
 void PathloadClientApp::RxDrop(Ptr<const Packet> p)
@@ -551,58 +517,117 @@ void PathloadClientApp::RxCallbackForUDP(Ptr<Socket> socket)
             break;
         }
 
-        m_cumulativeSize += packet->GetSize();
+        bwest::ProbeHeader header;
+        packet->CopyData(&m_rxBuffer[0], bwest::PROBE_HEADER_SIZE);
 
-        if (m_cumulativeSize >= m_sizeOfPackets)
+        if (!bwest::ReadProbeHeader(&m_rxBuffer[0], packet->GetSize(), &header))
         {
-            m_packetCountForUDP++;
+            continue;
+        }
 
-            m_arrivalTimeArray.push_back(Simulator::Now().GetMilliSeconds());
+        m_packetCountForUDP++;
 
-            m_cumulativeSize = 0;
-        }
+        bwest::ProbeRecord record;
+        record.train = header.train;
+        record.seq = header.seq;
+        record.txNs = header.txNs;
+        record.rxNs = Simulator::Now().GetNanoSeconds();
+        record.size = packet->GetSize();
+
+        // NS_LOG_UNCOND("PathloadClientApp :: RxCallbackForUDP :: One-Way Delay Measurement of :: " << (record.seq + 1) << "th Packet :: " << (record.rxNs - record.txNs) / 1000);
+
+        m_records.Record(record);
+        m_trend.Push(record);
     }
 
     // NS_LOG_UNCOND("PathloadClientApp :: RxCallbackForUDP :: Current Time Check :: " << Simulator::Now().GetMilliSeconds());
 
-    if (m_packetCountForUDP > m_numOfPackets - 1)
+    bwest::Estimate estimate;
+
+    if (m_trend.Poll(&estimate))
     {
-        m_packetCountForUDP = 0;
+        HandleEstimate(estimate);
+    }
+}
 
-        m_localFleetCount++;
+void PathloadClientApp::HandleEstimate(const bwest::Estimate &estimate)
+{
+    m_records.Result(estimate);
+    m_packetCountForUDP = 0;
 
-        NS_LOG_UNCOND("PathloadClientApp :: RxCallbackForUDP :: Local Fleet Count ? :: " << m_localFleetCount);
+    m_localFleetCount++;
 
-        NS_LOG_UNCOND("PathloadClientApp :: RxCallbackForUDP :: " << m_localFleetCount << "th Receiving Round End");
+    NS_LOG_UNCOND("PathloadClientApp :: HandleEstimate :: " << m_localFleetCount << "th Receiving Round End");
 
-        for (uint32_t index = 0; index < m_arrivalTimeArray.size(); index++)
-            {
-                // NS_LOG_UNCOND("Arrival Time of " << (index + 1) << "th Packet :: " << m_arrivalTimeArray[index]);
-            }
+    NS_LOG_UNCOND("PathloadClientApp :: HandleEstimate :: Pairwise Comparison :: " << estimate.pct << " :: Pairwise Difference :: " << estimate.pdt
+        << " :: Trend :: " << (estimate.trend == bwest::TREND_INCREASING ? "Increasing" : estimate.trend == bwest::TREND_NON_INCREASING ? "Non-Increasing" : "Ambiguous"));
 
-        // NS_LOG_UNCOND("Arrival :: " << m_arrivalTimeArray.size());
+    NS_LOG_UNCOND("PathloadClientApp :: HandleEstimate :: Available Bandwidth Range :: " << estimate.availLowMbps << " ~ " << estimate.availHighMbps << " Mbps");
 
-        for (uint32_t index = 0; index < m_arrivalTimeArray.size(); index++)
-            {
-                // if (m_depatureTimeArray[index] > m_arrivalTimeArray[index])
-                // {
-                //     m_oneWayDelayArray.push_back(m_defaultPropagationDelay);
-                // }
-
-                // else
-                // {
-                    m_oneWayDelayArray.push_back(m_arrivalTimeArray[index] - m_depatureTimeArray[index]);
-                // }
-            }
+    if (estimate.converged)
+    {
+        NS_LOG_UNCOND("PathloadClientApp :: HandleEstimate :: Converged At " << Simulator::Now().GetSeconds() << " s :: Restart Rate Search");
 
-        for (uint32_t indexTo = 0; indexTo < m_oneWayDelayArray.size(); indexTo++)
+        // Cross traffic changes during the run, so keep tracking it
+        m_trend.Reset();
+        m_records.Reset(estimate.train);
+    }
+
+    m_nextTimePeriod = m_trend.NextGapNs() / 1000;
+}
+
+void PathloadClientApp::Replay(const bwest::RecordLog &log)
+{
+    m_replayLog = log;
+
+    // Receive times are taken relative to the first record. A record that goes back in time
+    // (native receive timestamps) and the F/D/X lines stay at the previous time; events at the
+    // same time run in the order they were scheduled.
+    bool first = true;
+    int64_t base = 0;
+    int64_t at = 0;
+    for (uint32_t i = 0; i < m_replayLog.entries.size(); i++)
+    {
+        const bwest::RecordEntry &entry = m_replayLog.entries[i];
+        if (entry.op == 'R')
+        {
+            if (first)
             {
-                NS_LOG_UNCOND("PathloadClientApp :: RxCallbackForUDP :: One-Way Delay Measurement of :: " << (indexTo + 1) << "th Packet :: " << m_oneWayDelayArray[indexTo]);
+                base = entry.record.rxNs;
+                first = false;
             }
+            at = max(at, entry.record.rxNs - base);
+        }
+        Simulator::Schedule(NanoSeconds(at), &PathloadClientApp::ReplayEntry, this, i);
+    }
+}
 
-            m_arrivalTimeArray.clear();
+void PathloadClientApp::ReplayEntry(uint32_t index)
+{
+    const bwest::RecordEntry &entry = m_replayLog.entries[index];
+    bwest::Estimate estimate;
+    switch (entry.op)
+    {
+    case 'R':
+        m_packetCountForUDP++;
+        m_records.Record(entry.record);
+        m_trend.Push(entry.record);
+        break;
+    case 'F':
+        m_records.Flush(entry.record.train);
+        m_trend.Flush();
+        break;
+    case 'D':
+        m_records.Discard(entry.record.train);
+        m_trend.Discard();
+        break;
+    default:
+        break; // X follows a convergence, and HandleEstimate restarts the search on its own
+    }
 
-            m_oneWayDelayArray.clear();
+    if (m_trend.Poll(&estimate))
+    {
+        HandleEstimate(estimate);
     }
 }
 
@@ -647,9 +672,52 @@ void PathloadClientApp::StopApplication(void)
 
 int main(int argc, char *argv[])
 {
+    std::string recordsFile;
+    std::string replayFile;
+    std::string dumpFile;
+
+    CommandLine cmd;
+    cmd.AddValue("records", "Write the client estimator's inputs and estimates to this bw-records.h log", recordsFile);
+    cmd.AddValue("replay", "Feed this bw-records.h log to the client estimator instead of simulating the network", replayFile);
+    cmd.AddValue("dump", "Write the client estimator's inputs to this bw-capture.h binary capture (bwprobe offline)", dumpFile);
+    cmd.Parse(argc, argv);
+
     std::string animFile = "dash-animation.xml" ;  // Name of file for animation output
     LogComponentEnable("PathloadApplication", LOG_LEVEL_ALL);
 
+    if (!recordsFile.empty() && !m_records.Open(recordsFile))
+    {
+        NS_LOG_UNCOND("Cannot open " << recordsFile);
+        return 1;
+    }
+    if (!dumpFile.empty() && !m_records.OpenCapture(dumpFile))
+    {
+        NS_LOG_UNCOND("Cannot open " << dumpFile);
+        return 1;
+    }
+
+    // Replay: no topology, only the client's estimation path
+    if (!replayFile.empty())
+    {
+        bwest::RecordLog log;
+        std::string error;
+        if (!bwest::ReadRecordLog(replayFile, &log, &error) || log.kind != bwest::ESTIMATOR_TREND)
+        {
+            NS_LOG_UNCOND("Cannot replay " << replayFile << ": " << (error.empty() ? "not a SLoPS log" : error));
+            return 1;
+        }
+        m_trendConfig = log.trend;
+
+        Ptr<PathloadClientApp> replayApp = CreateObject<PathloadClientApp>();
+        replayApp->Setup(Address(), Address(), log.trend.packetSize);
+        replayApp->Replay(log);
+
+        Simulator::Run();
+        Simulator::Destroy();
+        m_records.Close();
+        return 0;
+    }
+
     PointToPointHelper bottleNeck;
     bottleNeck.SetDeviceAttribute("DataRate", StringValue("100Mbps"));
     bottleNeck.SetChannelAttribute("Delay", StringValue("50ms"));
@@ -771,6 +839,7 @@ int main(int argc, char *argv[])
     Simulator::Run();
     std::cout << "Animation Trace file created:" << animFile.c_str ()<< std::endl;
     Simulator::Destroy();
+    m_records.Close();
 
     return 0;
 }
\ No newline at end of file
@@ -3,6 +3,10 @@
 #include <algorithm>
 #include <cmath>
 #include <ctime>
+#include <sstream>
+#include <unordered_map>
+#include <deque>
+#include <sys/resource.h>
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
@@ -10,12 +14,30 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/point-to-point-layout-module.h"
+#include "bw-estimator.h"
+#include "dash-abr.h"
+#include "dash-cache.h"
+#include "dash-manifest.h"
+#include "dash-http.h"
+#include "dash-live.h"
+#include "dash-qoe.h"
+#include "dash-stats.h"
+#include "dash-throughput.h"
 
 using namespace ns3;
 using namespace std;
 
 NS_LOG_COMPONENT_DEFINE("DashApplication");
 
+// Per-chunk statistics (GetStatistics, GetBufferState) and the QoE series, as typed
+// records through dash-stats.h into <--stats>statistics, buffer and qoe files. Off with
+// --monitor=0, which large --clients runs need.
+static bool monitoring = true;
+static dash::StatsSink statsSink;
+static int chunkTable = -1;		// StatsSink table ids, -1 when not monitoring
+static int bufferTable = -1;
+static int qoeTable = -1;
+
 //================================================================
 // SERVER APPLICATION
 //================================================================
@@ -25,41 +47,119 @@ class DashServerApp : public Application
 public:
 	DashServerApp();
 	virtual ~DashServerApp();
+	enum
+	{
+		PIPELINE_DEPTH = 16	// requests a session holds; a client sending more is disconnected
+	};
+
+	// myudp: the clients' probe address; each session probes its peer's IP at that port
 	void Setup(Address address, Address myudp, uint32_t packetSize);
+	// Send IGI/PTR probe trains to the client, one per feedback packet
+	void SetProbe(const bwest::IgiConfig &config, uint32_t probeSize);
+	// Segments are served at their size in the catalog, shared with the clients
+	void SetManifest(const dash::Manifest *manifest);
+	// Live: a segment's bytes go out as the encoder produces its chunks
+	void SetLive(const dash::LiveSchedule &schedule);
+
+protected:
+	// A parsed request's answer waiting to go out (dash-http.h). It goes out once ready:
+	// an edge cache queues it before it has the segment, to keep pipelined answers in order.
+	struct Response
+	{
+		uint64_t id;		// unique over the application's lifetime
+		dash::HttpMessage request;
+		bool ready;
+		char header[256];
+		uint32_t headerLength;
+		bool headerSent;
+		uint32_t size;		// of the segment
+		uint64_t first;		// of the body in the segment
+		uint64_t length;	// of the body
+		uint64_t remainingData;	// body bytes not yet sent
+		uint64_t held;		// of those, bytes the encoder has not produced yet
+		bool close;		// the client asked for Connection: close
+	};
+
+	// One accepted client. Sessions live in a flat table; a closed session's slot is
+	// reused by the next accept, and callbacks find theirs through the socket.
+	struct Session
+	{
+		bool inUse;
+		Ptr<Socket> socket;		// accepted TCP connection
+		Address peer;
+		dash::HttpParser parser;	// over the request stream
+		Response responses[PIPELINE_DEPTH];	// pipelined requests, a ring answered in order
+		uint32_t head;			// the oldest response
+		uint32_t queued;
+		Ptr<Socket> probeSocket;	// UDP to the client's probe port
+		Address probeAddress;
+		EventId sendprobe;
+		uint32_t probeGapNs;
+		uint32_t probeSeq;
+		uint32_t probeTrain;
+	};
 
-private:
 	virtual void StartApplication(void);
 	virtual void StopApplication(void);
 
 	void RxCallback(Ptr<Socket> socket);
 	void RxCallbackUDP(Ptr<Socket> socket);
 	void TxCallback(Ptr<Socket> socket, uint32_t txSpace);
+	void CloseCallback(Ptr<Socket> socket);
 	bool ConnectionCallback(Ptr<Socket> s, const Address& ad);
 	void AcceptCallback(Ptr<Socket> s, const Address& ad);
-	void SendData();
-	void SendRequest(void);
-	void UpdatePacket(void);
+	void SendData(uint32_t session);
+	// Answers a request; the server from the catalog
+	virtual void Respond(uint32_t session, const dash::HttpMessage &request);
+	// Appends a response, not ready yet, to the session's queue, which has room
+	Response &Queue(uint32_t session, const dash::HttpMessage &request);
+	// Makes it ready for a segment of segmentBytes, 0 if there is no such segment
+	void Complete(Response &response, uint32_t segmentBytes);
+	// 0 if the session has no response of that id, e.g. after it closed
+	Response *FindResponse(uint32_t session, uint64_t id);
+	// Live: holds back what is not produced yet and schedules Produce for the next chunk
+	void Hold(uint32_t session, Response &response);
+	void Produce(uint32_t session, uint64_t id);
+	void SendRequest(uint32_t session);
+	void UpdatePacket(uint32_t session);
+	uint32_t OpenSession(void);
+	void CloseSession(uint32_t session);
+	// NO_SESSION if the socket belongs to no open session
+	uint32_t SessionOf(Ptr<Socket> socket) const;
 	bool m_connected;
 	Ptr<Socket> m_socket;
-	Ptr<Socket> p_socket;
-	Ptr<Socket> m_peer_socket;
 
 	Address ads;
 	Address adsUdp;
-	Address m_peer_address;
-	uint32_t m_remainingData;
 	EventId m_sendEvent;
-	EventId sendprobe;
 	uint32_t m_packetSize;
-	uint32_t m_packetCount;
-	uint32_t p_GapTime;
-	Time p_prePacketTime;
+	const dash::Manifest *m_manifest;
+	vector<uint8_t> m_rxBuffer;
+	uint64_t m_nextResponse;
+	bool m_live;
+	dash::LiveSchedule m_schedule;
+
+	vector<Session> m_sessions;
+	vector<uint32_t> m_freeSessions;
+	unordered_map<Socket*, uint32_t> m_sessionOf;	// TCP and probe socket -> slot
+	uint32_t m_openSessions;
+	uint32_t m_peakSessions;
+
+	// Probe trains (bw-estimator.h format)
+	bool m_probing;
+	bwest::IgiConfig m_probeConfig;
+	vector<uint8_t> m_probePayload;
+};
+
+enum
+{
+	NO_SESSION = 0xffffffff
 };
 
 DashServerApp::DashServerApp() :
-	m_connected(false), m_socket(0), p_socket(0), m_peer_socket(0),
-	ads(), adsUdp(), m_peer_address(), m_remainingData(0),
-	m_sendEvent(), sendprobe(), m_packetSize(0), m_packetCount(0), p_GapTime(0),p_prePacketTime()
+	m_connected(false), m_socket(0),
+	ads(), adsUdp(), m_sendEvent(), m_packetSize(0), m_manifest(0), m_nextResponse(0), m_live(false), m_openSessions(0), m_peakSessions(0),
+	m_probing(false), m_probeConfig()
 {
 
 }
@@ -67,7 +167,7 @@ DashServerApp::DashServerApp() :
 DashServerApp::~DashServerApp()
 {
 	m_socket = 0;
-	p_socket = 0;
+	m_sessions.clear();
 }
 
 void DashServerApp::Setup(Address address, Address myudp, uint32_t packetSize)
@@ -77,6 +177,24 @@ void DashServerApp::Setup(Address address, Address myudp, uint32_t packetSize)
 	m_packetSize = packetSize;
 }
 
+void DashServerApp::SetProbe(const bwest::IgiConfig &config, uint32_t probeSize)
+{
+	m_probing = true;
+	m_probeConfig = config;
+	m_probePayload.assign(max(probeSize, (uint32_t)bwest::PROBE_HEADER_SIZE), 0);
+}
+
+void DashServerApp::SetManifest(const dash::Manifest *manifest)
+{
+	m_manifest = manifest;
+}
+
+void DashServerApp::SetLive(const dash::LiveSchedule &schedule)
+{
+	m_live = true;
+	m_schedule = schedule;
+}
+
 void DashServerApp::StartApplication()
 {
 	m_socket = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
@@ -96,9 +214,14 @@ void DashServerApp::StopApplication()
 	{
 		Simulator::Cancel(m_sendEvent);
 	}
-	if (sendprobe.IsRunning()) {
-		Simulator::Cancel(sendprobe);
+	for (uint32_t i = 0; i < m_sessions.size(); i++)
+	{
+		if (m_sessions[i].inUse)
+		{
+			CloseSession(i);
+		}
 	}
+	NS_LOG_UNCOND("Server : node " << GetNode()->GetId() << " peak sessions " << m_peakSessions);
 }
 
 bool DashServerApp::ConnectionCallback(Ptr<Socket> socket, const Address& adss)
@@ -109,391 +232,1651 @@ bool DashServerApp::ConnectionCallback(Ptr<Socket> socket, const Address& adss)
 	return true;
 }
 
+uint32_t DashServerApp::OpenSession(void)
+{
+	uint32_t index;
+	if (!m_freeSessions.empty())
+	{
+		index = m_freeSessions.back();
+		m_freeSessions.pop_back();
+	}
+	else
+	{
+		index = m_sessions.size();
+		m_sessions.push_back(Session());
+	}
+	Session &session = m_sessions[index];
+	session.inUse = true;
+	session.parser.Reset();
+	session.head = 0;
+	session.queued = 0;
+	session.probeGapNs = 0;
+	session.probeSeq = 0;
+	session.probeTrain = 0;
+	m_openSessions++;
+	m_peakSessions = max(m_peakSessions, m_openSessions);
+	return index;
+}
+
+void DashServerApp::CloseSession(uint32_t index)
+{
+	Session &session = m_sessions[index];
+	Simulator::Cancel(session.sendprobe);
+	m_sessionOf.erase(PeekPointer(session.socket));
+	session.socket->Close();
+	session.socket = 0;
+	if (session.probeSocket)
+	{
+		m_sessionOf.erase(PeekPointer(session.probeSocket));
+		session.probeSocket->Close();
+		session.probeSocket = 0;
+	}
+	session.queued = 0;
+	session.inUse = false;
+	m_freeSessions.push_back(index);
+	m_openSessions--;
+}
+
+uint32_t DashServerApp::SessionOf(Ptr<Socket> socket) const
+{
+	unordered_map<Socket*, uint32_t>::const_iterator it = m_sessionOf.find(PeekPointer(socket));
+	return it == m_sessionOf.end() ? (uint32_t)NO_SESSION : it->second;
+}
+
 void DashServerApp::AcceptCallback(Ptr<Socket> socket, const Address& adss)
 {
 	NS_LOG_UNCOND("Server : accept callback ");
 
-	m_peer_address = adss;
-	m_peer_socket = socket;
+	uint32_t index = OpenSession();
+	Session &session = m_sessions[index];
+	session.peer = adss;
+	session.socket = socket;
+	m_sessionOf[PeekPointer(socket)] = index;
 
 	socket->SetRecvCallback(MakeCallback(&DashServerApp::RxCallback, this));
 	socket->SetSendCallback(MakeCallback(&DashServerApp::TxCallback, this));
-
-	p_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId()); //  durl
-	if (~p_socket->Bind()) { 
-		NS_LOG_UNCOND("Server : UDP Bind " << adsUdp);
-		if (~p_socket->Connect(adsUdp)) {
-			p_socket->SetRecvCallback(MakeCallback(&DashServerApp::RxCallbackUDP, this));
-			NS_LOG_UNCOND("Server : UDP Connect " << adsUdp);
-
-			p_GapTime = 2048;
-			Simulator::ScheduleNow(&DashServerApp::UpdatePacket, this);
+	socket->SetCloseCallbacks(
+		MakeCallback(&DashServerApp::CloseCallback, this),
+		MakeCallback(&DashServerApp::CloseCallback, this));
+
+	// The client listens for probes on the probe port of its own address
+	session.probeAddress = InetSocketAddress(InetSocketAddress::ConvertFrom(adss).GetIpv4(),
+		InetSocketAddress::ConvertFrom(adsUdp).GetPort());
+	session.probeSocket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId()); //  durl
+	if (~session.probeSocket->Bind()) { 
+		NS_LOG_UNCOND("Server : UDP Bind " << session.probeAddress);
+		if (~session.probeSocket->Connect(session.probeAddress)) {
+			session.probeSocket->SetRecvCallback(MakeCallback(&DashServerApp::RxCallbackUDP, this));
+			m_sessionOf[PeekPointer(session.probeSocket)] = index;
+			NS_LOG_UNCOND("Server : UDP Connect " << session.probeAddress);
+
+			// The first train starts the IGI gap search at gB/2; the client's feedback
+			// picks the gap of every later one
+			if (m_probing)
+			{
+				session.probeGapNs = m_probeConfig.gBNs / 2;
+				session.probeSeq = 0;
+				Simulator::ScheduleNow(&DashServerApp::UpdatePacket, this, index);
+			}
 		}
 	}
 	else {
 		NS_LOG_UNCOND("Server : UDP Bind Fail");
 	}
 }
-void DashServerApp::RxCallbackUDP(Ptr<Socket> socket) {
 
+void DashServerApp::CloseCallback(Ptr<Socket> socket)
+{
+	uint32_t index = SessionOf(socket);
+	if (index != NO_SESSION)
+	{
+		CloseSession(index);
+	}
 }
-void DashServerApp::UpdatePacket(void) {
-	if (p_GapTime) {
-		Time tNext(MilliSeconds(p_GapTime));
-		sendprobe = Simulator::Schedule(tNext, &DashServerApp::SendRequest, this);
 
-		p_GapTime /= 2;
+void DashServerApp::RxCallbackUDP(Ptr<Socket> socket) {
+	// Feedback from the client: the source gap of the next train, network byte order
+	uint32_t index = SessionOf(socket);
+	Ptr<Packet> packet;
+	while ((packet = socket->Recv()))
+	{
+		uint8_t gap[4];
+		if (!m_probing || index == NO_SESSION || packet->GetSize() < sizeof(gap))
+		{
+			continue;
+		}
+		Session &session = m_sessions[index];
+		packet->CopyData(gap, sizeof(gap));
+		session.probeGapNs = bwest::Read32(gap);
+		session.probeSeq = 0;
+		session.probeTrain++;
+		Simulator::Cancel(session.sendprobe);
+		Simulator::ScheduleNow(&DashServerApp::UpdatePacket, this, index);
 	}
-	else {
-		Simulator::Cancel(sendprobe);
+}
+void DashServerApp::UpdatePacket(uint32_t index) {
+	// Next packet of the current train; the train's first packet goes out right away
+	Session &session = m_sessions[index];
+	if (session.inUse && session.probeSeq < m_probeConfig.trainSize) {
+		Time tNext(NanoSeconds(session.probeSeq ? session.probeGapNs : 0));
+		session.sendprobe = Simulator::Schedule(tNext, &DashServerApp::SendRequest, this, index);
 	}
 }
-void DashServerApp::SendRequest(void)
+void DashServerApp::SendRequest(uint32_t index)
 {
-	//NS_LOG_UNCOND("Gap << " << Simulator::Now().GetMilliSeconds() - p_prePacketTime.GetMilliSeconds());
-	uint32_t bytesReq = 1200;
-	Ptr<Packet> packet = Create<Packet>((uint8_t*)&bytesReq, 1200);
-	p_socket->SendTo(packet, 0, adsUdp);	
-	Simulator::ScheduleNow(&DashServerApp::UpdatePacket, this);
-	p_prePacketTime = Simulator::Now();
+	Session &session = m_sessions[index];
+	bwest::ProbeHeader header;
+	header.train = session.probeTrain;
+	header.seq = session.probeSeq;
+	header.trainSize = m_probeConfig.trainSize;
+	header.gapNs = session.probeGapNs;
+	header.txNs = Simulator::Now().GetNanoSeconds();
+	bwest::WriteProbeHeader(&m_probePayload[0], header);
+
+	Ptr<Packet> packet = Create<Packet>(&m_probePayload[0], m_probePayload.size());
+	session.probeSocket->SendTo(packet, 0, session.probeAddress);
+	session.probeSeq++;
+	Simulator::ScheduleNow(&DashServerApp::UpdatePacket, this, index);
 }
 
 void DashServerApp::RxCallback(Ptr<Socket> socket)
 {
 	Address ads;
-	Ptr<Packet> pckt = socket->RecvFrom(ads);
+	Ptr<Packet> pckt;
+	uint32_t index = SessionOf(socket);
+
+	// The request stream arrives cut at arbitrary points; the parser carries partial
+	// lines over from one read to the next
+	while (index != NO_SESSION && (pckt = socket->RecvFrom(ads)) && pckt->GetSize() > 0)
+	{
+		Session &session = m_sessions[index];
+		if (!(ads == session.peer))
+		{
+			continue;
+		}
+		m_rxBuffer.resize(pckt->GetSize());
+		pckt->CopyData(&m_rxBuffer[0], m_rxBuffer.size());
+
+		size_t at = 0;
+		dash::HttpEvent event;
+		while ((event = session.parser.Next(&m_rxBuffer[0], m_rxBuffer.size(), &at)) != dash::HTTP_MORE)
+		{
+			if (event == dash::HTTP_HEADERS && session.queued == PIPELINE_DEPTH)
+			{
+				NS_LOG_UNCOND("Server : more than " << PIPELINE_DEPTH << " pipelined requests from " <<
+					InetSocketAddress::ConvertFrom(ads).GetIpv4());
+				CloseSession(index);
+				return;
+			}
+			if (event == dash::HTTP_HEADERS)
+			{
+				Respond(index, session.parser.Message());
+			}
+			else if (event == dash::HTTP_ERROR)
+			{
+				NS_LOG_UNCOND("Server : bad request from " << InetSocketAddress::ConvertFrom(ads).GetIpv4() <<
+					", " << session.parser.Error());
+				CloseSession(index);
+				return;
+			}
+		}
+	}
+	if (index != NO_SESSION)
+	{
+		SendData(index);
+	}
+}
+
+void DashServerApp::Respond(uint32_t index, const dash::HttpMessage &request)
+{
+	uint32_t size = m_manifest->SegmentBytes(request.segment, request.representation);
+	if (size == 0)
+	{
+		NS_LOG_UNCOND("Server : no segment " << request.segment << " at representation " << request.representation);
+	}
+	Response &response = Queue(index, request);
+	Complete(response, size);
+	if (m_live)
+	{
+		Hold(index, response);
+	}
+}
+
+DashServerApp::Response &DashServerApp::Queue(uint32_t index, const dash::HttpMessage &request)
+{
+	Session &session = m_sessions[index];
+	Response &response = session.responses[(session.head + session.queued++) % PIPELINE_DEPTH];
+	response.id = m_nextResponse++;
+	response.request = request;
+	response.ready = false;
+	response.headerSent = false;
+	response.size = 0;
+	response.first = 0;
+	response.length = 0;
+	response.remainingData = 0;
+	response.held = 0;
+	response.close = !request.keepAlive;
+	return response;
+}
 
-	if (ads == m_peer_address)
+void DashServerApp::Complete(Response &response, uint32_t size)
+{
+	uint64_t first, length;
+	uint32_t status = dash::ResolveHttpRequest(response.request, size, &first, &length);
+	response.headerLength = dash::FormatHttpResponse(response.header, sizeof(response.header), status, first, length,
+		size, response.request.keepAlive);
+	response.size = size;
+	response.first = first;
+	response.length = length;
+	response.remainingData = length;
+	response.ready = true;
+}
+
+DashServerApp::Response *DashServerApp::FindResponse(uint32_t index, uint64_t id)
+{
+	Session &session = m_sessions[index];
+	if (!session.inUse)
 	{
-		uint32_t data = 0;
-		pckt->CopyData((uint8_t*)&data, 4);
+		return 0;
+	}
+	// A closed and reused session has none of its old ids
+	for (uint32_t r = 0; r < session.queued; r++)
+	{
+		Response &response = session.responses[(session.head + r) % PIPELINE_DEPTH];
+		if (response.id == id)
+		{
+			return &response;
+		}
+	}
+	return 0;
+}
 
-		m_remainingData = data;
-		m_packetCount = 0;
+void DashServerApp::Hold(uint32_t index, Response &response)
+{
+	int64_t now = Simulator::Now().GetMilliSeconds();
+	uint32_t segment = response.request.segment;
+	uint64_t ready = m_schedule.BytesReady(segment, response.size, now);
+	uint64_t available = ready > response.first ? min(ready - response.first, response.length) : 0;
+	response.held = response.length - available;
+	if (response.held > 0)
+	{
+		int64_t next = m_schedule.ChunkReadyMs(segment, m_schedule.ChunksReady(segment, now));
+		Simulator::Schedule(MilliSeconds(next - now), &DashServerApp::Produce, this, index, response.id);
+	}
+}
 
-		//SendData();
-		p_GapTime = 256;
-		Simulator::ScheduleNow(&DashServerApp::UpdatePacket, this);
+void DashServerApp::Produce(uint32_t index, uint64_t id)
+{
+	Response *response = FindResponse(index, id);
+	if (response)
+	{
+		Hold(index, *response);
+		SendData(index);
 	}
 }
 
 void DashServerApp::TxCallback(Ptr<Socket> socket, uint32_t txSpace)
 {
-	if (m_connected)
-		Simulator::ScheduleNow(&DashServerApp::SendData, this);
+	uint32_t index = SessionOf(socket);
+	if (m_connected && index != NO_SESSION && m_sessions[index].queued > 0)
+		Simulator::ScheduleNow(&DashServerApp::SendData, this, index);
 }
 
-void DashServerApp::SendData()
+void DashServerApp::SendData(uint32_t index)
 {
-	while (m_remainingData > 0)
+	Session &session = m_sessions[index];
+	while (session.inUse && session.queued > 0)
 	{
-		// Time to send more
-		uint32_t toSend = min(m_packetSize, m_remainingData);
-		Ptr<Packet> packet = Create<Packet>((uint8_t*)&toSend, 4);
+		Response &response = session.responses[session.head];
+		if (!response.ready)
+		{
+			return;
+		}
+		if (!response.headerSent)
+		{
+			Ptr<Packet> packet = Create<Packet>((const uint8_t*)response.header, response.headerLength);
+			if (session.socket->Send(packet) < 0)
+			{
+				return;
+			}
+			response.headerSent = true;
+		}
+
+		while (response.remainingData > response.held)
+		{
+			// Time to send more
+			uint32_t toSend = min<uint64_t>(m_packetSize, response.remainingData - response.held);
+			Ptr<Packet> packet = Create<Packet>(toSend);
+
+			int actual = session.socket->Send(packet);
 
-		int actual = m_peer_socket->Send(packet);
+			if (actual > 0)
+			{
+				response.remainingData -= toSend;
+			}
 
-		if (actual > 0)
+			if ((unsigned)actual != toSend)
+			{
+				return;
+			}
+		}
+		if (response.remainingData > 0)
 		{
-			m_remainingData -= toSend;
+			return;		// the rest is still being encoded
 		}
 
-		if ((unsigned)actual != toSend)
+		bool close = response.close;
+		session.head = (session.head + 1) % PIPELINE_DEPTH;
+		session.queued--;
+		if (close)
 		{
-			break;
+			CloseSession(index);
+			return;
 		}
 	}
 }
 
 //================================================================
-// CLIENT APPLICATION
+// EDGE CACHE APPLICATION
 //================================================================
 
-class DashClientApp : public Application
+// A DASH server on the clients' side of the bottleneck that answers from a segment cache
+// (dash-cache.h) and fetches the misses from the origin servers, whole segments over
+// kept-alive, pipelined connections. Requests for a segment already on its way wait for
+// that fetch instead of starting another. A miss is stored, then served.
+//
+// A broken origin connection fails the fetches it carried and is reconnected after
+// RECONNECT_MS, up to MAX_RECONNECTS times in a row. Once no connection is left, misses
+// fail at once instead of waiting for one.
+class DashCacheApp : public DashServerApp
 {
 public:
-
-	DashClientApp();
-	virtual ~DashClientApp();
+	DashCacheApp();
+	virtual ~DashCacheApp();
 	enum
 	{
-		MAX_BUFFER_SIZE = 30000
-	}; // 30 seconds
+		RECONNECT_MS = 1000,
+		MAX_RECONNECTS = 3
+	};
 
-	void Setup(Address address, Address address1, uint32_t chunkSize, uint32_t numChunks, string algorithm);
+	// Misses go out over this many connections, spread over the origins
+	void SetOrigins(const vector<Address> &origins, uint32_t connections);
+	void SetCache(uint64_t budgetBytes, dash::CachePolicy policy);
 
 private:
-	virtual void StartApplication(void);
-	virtual void StopApplication(void);
-
-	// Request
-	void SendRequest(void);
-	void RequestNextChunk(void);
-	void GetStatistics(void);
-	void RxCallback(Ptr<Socket> socket);
-
-	void RxCallbackUDP(Ptr<Socket> socket);
-	// Buffer Model
-	void ClientBufferModel(void);
-	void GetBufferState(void);
-	void RxDrop(Ptr<const Packet> p);
-
-	// Rate Adaptation Algorithm
-
-	void Proposed(void);
-	void SendData();
-	// Another
-	uint32_t GetIndexByBitrate(uint32_t bitrate);
-
-	Ptr<Socket> m_socket;
-	Ptr<Socket> p_socket;
-	Address m_peer;
-	Address ads;
-	uint32_t m_chunkSize;
-	uint32_t m_numChunks;
-	uint32_t m_chunkCount;
-	int32_t m_bufferSize;
-	uint32_t m_bufferPercent;
-	uint32_t m_bpsAvg;
-	uint32_t m_bpsLastChunk;
-	vector<uint32_t> m_bitrate_array;
-	EventId m_fetchEvent;
-	EventId m_statisticsEvent;
-	bool m_running;
-	uint32_t m_comulativeSize;
-	uint32_t m_lastRequestedSize;
-	Time m_requestTime;
-	uint32_t m_sessionData;
-	uint32_t m_sessionTime;
+	// A request waiting for a miss, found again through its response's id
+	struct Waiter
+	{
+		uint32_t session;
+		uint64_t response;
+		Time since;
+	};
 
-	EventId m_bufferEvent;
-	EventId m_bufferStateEvent;
-	EventId Recvprobe;
-	uint32_t m_downloadDuration;
-	double m_throughput;
-	uint32_t m_prevBitrate;
-	uint32_t m_nextBitrate;
-	uint32_t m_algorithm;
-	uint32_t m_numOfSwitching;
-	Time recvpreb;
-	clock_t pretime;
-	// Proposed
+	// One kept-alive connection to an origin
+	struct Upstream
+	{
+		Ptr<Socket> socket;
+		dash::HttpParser parser;
+		bool connected;
+		deque<uint64_t> keys;	// segments of the responses still to come, in order
+		uint32_t size;		// of the segment arriving, 0 if the origin has none
+		uint32_t failures;	// in a row
+		EventId reconnect;
+	};
 
+	virtual void StartApplication(void);
+	virtual void StopApplication(void);
+	virtual void Respond(uint32_t session, const dash::HttpMessage &request);
+
+	void Fetch(uint64_t key);
+	// The origin's answer, 0 bytes if it has no such segment
+	void Fetched(uint64_t key, uint32_t size);
+	// The fetch broke off; its waiters get a 404
+	void Lost(uint64_t key);
+	void Answer(uint64_t key, uint32_t size);
+	void Connect(uint32_t upstream);
+	void Disconnect(uint32_t upstream, const char *why);
+	// Whether an upstream connection is up, connecting or about to reconnect
+	bool Reachable(void) const;
+	void UpstreamSucceeded(Ptr<Socket> socket);
+	void UpstreamFailed(Ptr<Socket> socket);
+	void UpstreamClosed(Ptr<Socket> socket);
+	void UpstreamRx(Ptr<Socket> socket);
+	uint32_t UpstreamOf(Ptr<Socket> socket) const;
+
+	dash::SegmentCache m_cache;
+	vector<Address> m_origins;
+	vector<Upstream> m_upstreams;
+	unordered_map<uint64_t, vector<Waiter> > m_waiters;	// per segment in flight
+	deque<uint64_t> m_backlog;	// misses waiting for an upstream connection with room
+	vector<uint8_t> m_upstreamBuffer;
+
+	uint64_t m_servedBytes;		// body bytes to the clients
+	uint64_t m_waits;		// requests that waited for a fetch
+	Time m_waitTime;
 };
 
-DashClientApp::DashClientApp() :
-	m_socket(0), p_socket(0), m_peer(), ads(), m_chunkSize(0), m_numChunks(0), m_chunkCount(0),
-	m_bufferSize(0), m_bufferPercent(0), m_bpsAvg(0), m_bpsLastChunk(0),
-	m_fetchEvent(), m_statisticsEvent(), m_running(false),
-	m_comulativeSize(0), m_lastRequestedSize(0), m_requestTime(), m_sessionData(0), m_sessionTime(0),
-	m_bufferEvent(), m_bufferStateEvent(), Recvprobe(), m_downloadDuration(0), m_throughput(0.0),
-	m_prevBitrate(0), m_nextBitrate(0), m_algorithm(0), m_numOfSwitching(0), recvpreb(), pretime(0)
+DashCacheApp::DashCacheApp() :
+	m_cache(), m_upstreams(1), m_servedBytes(0), m_waits(0), m_waitTime()
 {
 
 }
 
-DashClientApp::~DashClientApp()
+DashCacheApp::~DashCacheApp()
 {
-	m_socket = 0;
-	p_socket = 0;
+	m_upstreams.clear();
 }
 
-void DashClientApp::Setup(Address address, Address myUDP, uint32_t chunkSize,
-	uint32_t numChunks, string algorithm)
+void DashCacheApp::SetOrigins(const vector<Address> &origins, uint32_t connections)
 {
-	m_peer = address;
-	ads = myUDP;
-	m_chunkSize = chunkSize;
-	m_numChunks = numChunks;
-
-	//bitrate profile of the content
-	m_bitrate_array.push_back(700000);
-	m_bitrate_array.push_back(1400000);
-	m_bitrate_array.push_back(2100000);
-	m_bitrate_array.push_back(2800000);
-	m_bitrate_array.push_back(3500000);
-	m_bitrate_array.push_back(4200000);
+	m_origins = origins;
+	m_upstreams.resize(max<uint32_t>(connections, 1));
+}
 
-	m_algorithm = 3;
+void DashCacheApp::SetCache(uint64_t budgetBytes, dash::CachePolicy policy)
+{
+	m_cache = dash::SegmentCache(budgetBytes, policy);
 }
 
-void DashClientApp::RxDrop(Ptr<const Packet> p)
+void DashCacheApp::StartApplication(void)
 {
-	NS_LOG_UNCOND("RxDrop at " << Simulator::Now().GetSeconds());
+	DashServerApp::StartApplication();
+	for (uint32_t c = 0; c < m_upstreams.size(); c++)
+	{
+		m_upstreams[c].failures = 0;
+		Connect(c);
+	}
 }
 
-void DashClientApp::StartApplication(void)
+void DashCacheApp::Connect(uint32_t c)
 {
+	Upstream &upstream = m_upstreams[c];
+	upstream.socket = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
+	upstream.socket->SetConnectCallback(
+		MakeCallback(&DashCacheApp::UpstreamSucceeded, this),
+		MakeCallback(&DashCacheApp::UpstreamFailed, this));
+	upstream.socket->SetCloseCallbacks(
+		MakeCallback(&DashCacheApp::UpstreamClosed, this),
+		MakeCallback(&DashCacheApp::UpstreamClosed, this));
+	upstream.socket->SetRecvCallback(MakeCallback(&DashCacheApp::UpstreamRx, this));
+	upstream.parser = dash::HttpParser(dash::HTTP_RESPONSE);
+	upstream.connected = false;
+	upstream.size = 0;
+	upstream.socket->Bind();
+	upstream.socket->Connect(m_origins[c % m_origins.size()]);
+}
 
-	p_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
-	uint32_t udpflag = p_socket->Bind(ads);
-	if (~udpflag) {
-		p_socket->SetRecvCallback(MakeCallback(&DashClientApp::RxCallbackUDP, this));
-		NS_LOG_UNCOND("Client : UDP Bind " << ads);
+// The socket is dropped before it closes, so its late callbacks find no upstream
+void DashCacheApp::Disconnect(uint32_t c, const char *why)
+{
+	Upstream &upstream = m_upstreams[c];
+	NS_LOG_UNCOND("Edge : origin connection " << c << " " << why);
+	Ptr<Socket> socket = upstream.socket;
+	upstream.socket = 0;
+	upstream.connected = false;
+	socket->Close();
+	deque<uint64_t> lost;
+	lost.swap(upstream.keys);
+	for (uint32_t i = 0; i < lost.size(); i++)
+	{
+		Lost(lost[i]);
+	}
 
-		m_socket = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
-		m_socket->TraceConnectWithoutContext("Drop", MakeCallback(&DashClientApp::RxDrop, this));
-		m_running = true;
-		m_socket->Bind();
-		if (~m_socket->Connect(m_peer)) {
-			NS_LOG_UNCOND("Client : TCP Connect");
+	if (++upstream.failures <= MAX_RECONNECTS)
+	{
+		upstream.reconnect = Simulator::Schedule(MilliSeconds(RECONNECT_MS), &DashCacheApp::Connect, this, c);
+	}
+	else if (!Reachable())
+	{
+		NS_LOG_UNCOND("Edge : no origin connection left, failing " << m_backlog.size() << " waiting misses");
+		deque<uint64_t> backlog;
+		backlog.swap(m_backlog);
+		for (uint32_t i = 0; i < backlog.size(); i++)
+		{
+			Lost(backlog[i]);
 		}
 	}
-	Time tNext("1s");
-	//m_bufferStateEvent = Simulator::Schedule(tNext, &DashClientApp::GetBufferState, this);
 }
 
-
-void DashClientApp::RxCallbackUDP(Ptr<Socket> socket)
+bool DashCacheApp::Reachable(void) const
 {
-	
-	
-		
-	Ptr<Packet> packet;
-	uint32_t _size = 0;
-	while ((packet = socket->Recv()))
+	for (uint32_t c = 0; c < m_upstreams.size(); c++)
 	{
-		if (packet->GetSize() == 0)
+		if (m_upstreams[c].socket || m_upstreams[c].reconnect.IsRunning())
 		{
-			break;
+			return true;
 		}
-		_size += packet->GetSize();
 	}
-	NS_LOG_UNCOND("Packet Size : " << _size);
-	NS_LOG_UNCOND("CurTime :" << Simulator::Now().GetMilliSeconds() << " Recv Gap  : " << Simulator::Now().GetMilliSeconds() - recvpreb.GetMilliSeconds());
-	recvpreb = Simulator::Now();
-	
+	return false;
 }
 
-void DashClientApp::RxCallback(Ptr<Socket> socket)
+void DashCacheApp::StopApplication(void)
 {
-	Ptr<Packet> packet;
-
-	while ((packet = socket->Recv())) {
-		if (packet->GetSize() == 0) {   // EOF
-			break;
-		}
-
-		// For calculate throughput
-		m_comulativeSize += packet->GetSize();
-
-		if (m_comulativeSize >= m_lastRequestedSize)
+	DashServerApp::StopApplication();
+	for (uint32_t c = 0; c < m_upstreams.size(); c++)
+	{
+		Simulator::Cancel(m_upstreams[c].reconnect);
+		Ptr<Socket> socket = m_upstreams[c].socket;
+		m_upstreams[c].socket = 0;
+		if (socket)
 		{
-			// Received the complete chunk
-			// Update the buffer size and initiate the next request
-
-			m_chunkCount++;
-
-			// Estimating
-			m_downloadDuration = Simulator::Now().GetMilliSeconds() - m_requestTime.GetMilliSeconds();
-			m_bpsLastChunk = (m_comulativeSize * 8) / (m_downloadDuration / 1000.0);
-
-			// Update buffer
-			m_bufferSize += m_chunkSize * 1000;
-			m_bufferPercent = (uint32_t)(m_bufferSize * 100) / MAX_BUFFER_SIZE;
-
-			// Scheduling
-			Simulator::ScheduleNow(&DashClientApp::RequestNextChunk, this);
-
-			// Start BufferModel
-			if (m_chunkCount == 1) {
-				Time tNext("100ms");
-				m_bufferEvent = Simulator::Schedule(tNext, &DashClientApp::ClientBufferModel, this);
-			}
-
-			// Monitoring
-			m_statisticsEvent = Simulator::ScheduleNow(&DashClientApp::GetStatistics, this);
-
-			m_comulativeSize = 0;
+			socket->Close();
 		}
 	}
+
+	// Without the cache every served byte would have crossed the bottleneck
+	const dash::CacheStats &stats = m_cache.Stats();
+	NS_LOG_UNCOND("CACHE node=" << GetNode()->GetId() <<
+		" policy=" << dash::CachePolicyName(m_cache.Policy()) <<
+		" budget_mb=" << m_cache.Budget() / 1e6 <<
+		" requests=" << stats.requests <<
+		" hits=" << stats.hits <<
+		" coalesced=" << stats.coalesced <<
+		" misses=" << stats.misses <<
+		" hit_ratio=" << stats.HitRatio() <<
+		" byte_hit_ratio=" << (m_servedBytes ? 1 - (double)stats.fetchedBytes / m_servedBytes : 0) <<
+		" served_mb=" << m_servedBytes / 1e6 <<
+		" origin_mb=" << stats.fetchedBytes / 1e6 <<
+		" saved_mb=" << ((double)m_servedBytes - (double)stats.fetchedBytes) / 1e6 <<
+		" evictions=" << stats.evictions <<
+		" uncacheable=" << stats.uncacheable <<
+		" mean_wait_ms=" << (stats.requests ? m_waitTime.GetMilliSeconds() / (double)stats.requests : 0) <<
+		" mean_miss_wait_ms=" << (m_waits ? m_waitTime.GetMilliSeconds() / (double)m_waits : 0));
 }
 
-void DashClientApp::RequestNextChunk(void)
+void DashCacheApp::Respond(uint32_t index, const dash::HttpMessage &request)
 {
-	Proposed();
+	uint64_t key = dash::SegmentCache::Key(request.segment, request.representation);
+	uint32_t size = 0;
+	dash::CacheLookup lookup = m_cache.Lookup(key, &size);
+	Response &response = Queue(index, request);
+	if (lookup == dash::CACHE_HIT)
+	{
+		Complete(response, size);
+		m_servedBytes += response.remainingData;
+		return;
+	}
+
+	Waiter waiter;
+	waiter.session = index;
+	waiter.response = response.id;
+	waiter.since = Simulator::Now();
+	m_waiters[key].push_back(waiter);
+	if (lookup == dash::CACHE_MISS)
+	{
+		Fetch(key);
+	}
 }
 
-void DashClientApp::Proposed(void)
+// On the connection with the fewest responses outstanding, below what an origin session holds
+void DashCacheApp::Fetch(uint64_t key)
 {
-	// Propose idea code writing!!
+	uint32_t best = m_upstreams.size();
+	for (uint32_t c = 0; c < m_upstreams.size(); c++)
+	{
+		if (m_upstreams[c].connected && m_upstreams[c].keys.size() < PIPELINE_DEPTH &&
+			(best == m_upstreams.size() || m_upstreams[c].keys.size() < m_upstreams[best].keys.size()))
+		{
+			best = c;
+		}
+	}
+	if (best == m_upstreams.size() && !Reachable())
+	{
+		// Not from inside the request's own parse
+		Simulator::ScheduleNow(&DashCacheApp::Lost, this, key);
+		return;
+	}
+	if (best == m_upstreams.size())
+	{
+		m_backlog.push_back(key);
+		return;
+	}
 
+	Upstream &upstream = m_upstreams[best];
+	char request[128];
+	size_t length = dash::FormatHttpRequest(request, sizeof(request), (uint32_t)(key >> 32), (uint32_t)key,
+		0, dash::HTTP_OPEN_RANGE, true);
+	upstream.socket->Send(Create<Packet>((const uint8_t*)request, length));
+	upstream.keys.push_back(key);
 }
 
-uint32_t DashClientApp::GetIndexByBitrate(uint32_t bitrate)
+// The segment is in (or, too large or missing, is not)
+void DashCacheApp::Fetched(uint64_t key, uint32_t size)
 {
-	for (uint32_t i = 0; i < m_bitrate_array.size(); i++) {
-		if (bitrate == m_bitrate_array[i])
-			return i;
-	}
+	m_cache.Fill(key, size);
+	Answer(key, size);
+}
 
-	return -1;
+// The next request for the segment misses again
+void DashCacheApp::Lost(uint64_t key)
+{
+	m_cache.Abandon(key);
+	Answer(key, 0);
 }
 
-void DashClientApp::SendRequest(void)
+// Everyone waiting for the segment
+void DashCacheApp::Answer(uint64_t key, uint32_t size)
 {
-	uint32_t _packetsize = 1500;
-	uint32_t _remain = 1500;
-	while (_remain > 0)
+	unordered_map<uint64_t, vector<Waiter> >::iterator it = m_waiters.find(key);
+	if (it == m_waiters.end())
 	{
-		// Time to send more
-		uint32_t toSend = min(_remain, _packetsize);
-		Ptr<Packet> packet = Create<Packet>(toSend);
-
-		int actual = p_socket->Send(packet);
+		return;
+	}
+	vector<Waiter> waiters;
+	waiters.swap(it->second);
+	m_waiters.erase(it);
 
-		if ((unsigned)actual != toSend)
+	for (uint32_t w = 0; w < waiters.size(); w++)
+	{
+		m_waits++;
+		m_waitTime += Simulator::Now() - waiters[w].since;
+		Response *response = FindResponse(waiters[w].session, waiters[w].response);
+		if (response)
 		{
-			break;
+			Complete(*response, size);
+			m_servedBytes += response->remainingData;
+			SendData(waiters[w].session);
 		}
 	}
 }
 
-void DashClientApp::ClientBufferModel(void)
+void DashCacheApp::UpstreamSucceeded(Ptr<Socket> socket)
 {
-	if (m_running)
+	uint32_t c = UpstreamOf(socket);
+	if (c < m_upstreams.size())
 	{
-		if (m_bufferSize < 100) {
-			m_bufferSize = 0;
-			m_bufferPercent = 0;
-			m_chunkCount = 0;
-
-			Simulator::Cancel(m_bufferEvent);
-			return;
-		}
-
-		m_bufferSize -= 100;
-
-		Time tNext("100ms");
-		m_bufferEvent = Simulator::Schedule(tNext, &DashClientApp::ClientBufferModel, this);
+		m_upstreams[c].connected = true;
+		m_upstreams[c].failures = 0;
+	}
+	deque<uint64_t> backlog;
+	backlog.swap(m_backlog);
+	for (uint32_t i = 0; i < backlog.size(); i++)
+	{
+		Fetch(backlog[i]);
+	}
+}
+
+void DashCacheApp::UpstreamFailed(Ptr<Socket> socket)
+{
+	uint32_t c = UpstreamOf(socket);
+	if (c < m_upstreams.size())
+	{
+		Disconnect(c, "failed");
+	}
+}
+
+// Origins keep connections alive, so any close is a loss
+void DashCacheApp::UpstreamClosed(Ptr<Socket> socket)
+{
+	uint32_t c = UpstreamOf(socket);
+	if (c < m_upstreams.size())
+	{
+		Disconnect(c, "closed");
+	}
+}
+
+uint32_t DashCacheApp::UpstreamOf(Ptr<Socket> socket) const
+{
+	uint32_t c = 0;
+	while (c < m_upstreams.size() && m_upstreams[c].socket != socket)
+	{
+		c++;
+	}
+	return c;
+}
+
+void DashCacheApp::UpstreamRx(Ptr<Socket> socket)
+{
+	uint32_t c = UpstreamOf(socket);
+	Ptr<Packet> packet;
+	while (c < m_upstreams.size() && (packet = socket->Recv()) && packet->GetSize() > 0)
+	{
+		Upstream &upstream = m_upstreams[c];
+		m_upstreamBuffer.resize(packet->GetSize());
+		packet->CopyData(&m_upstreamBuffer[0], m_upstreamBuffer.size());
+		size_t at = 0;
+		dash::HttpEvent event;
+		while ((event = upstream.parser.Next(&m_upstreamBuffer[0], m_upstreamBuffer.size(), &at)) != dash::HTTP_MORE)
+		{
+			if (event == dash::HTTP_ERROR || upstream.keys.empty())
+			{
+				// The waiting requests get a 404 rather than hang
+				Disconnect(c, event == dash::HTTP_ERROR ? upstream.parser.Error() : "sent an unrequested response");
+				return;
+			}
+			if (event == dash::HTTP_HEADERS)
+			{
+				const dash::HttpMessage &response = upstream.parser.Message();
+				upstream.size = response.status == 200 ? (uint32_t)response.contentLength : 0;
+			}
+			else if (event == dash::HTTP_DONE)
+			{
+				uint64_t key = upstream.keys.front();
+				upstream.keys.pop_front();
+				Fetched(key, upstream.size);
+				if (!m_backlog.empty())
+				{
+					Fetch(m_backlog.front());
+					m_backlog.pop_front();
+				}
+			}
+		}
+	}
+}
+
+//================================================================
+// CLIENT APPLICATION
+//================================================================
+
+class DashClientApp : public Application
+{
+public:
+
+	DashClientApp();
+	virtual ~DashClientApp();
+	enum
+	{
+		MAX_BUFFER_SIZE = 30000,	// 30 seconds
+		BUFFER_TICK = 100,		// playback drains the buffer in 100 ms steps
+		MAX_FETCH_ATTEMPTS = 3,		// then the segment is skipped
+		RECONNECT_MS = 1000		// after a connection attempt failed
+	};
+
+	// The segments, their duration and the ladder come from the catalog
+	void Setup(Address address, Address address1, const dash::Manifest *manifest, string algorithm);
+	// Segments split into byte ranges over this many connections, and requested up to
+	// prefetch segments ahead of the one arriving (pipelined, dash-http.h)
+	void SetParallel(uint32_t connections, uint32_t prefetch);
+	// QoE model weights and the spacing of the QoE series (ms, 0 for none)
+	void SetQoe(const dash::QoeWeights &weights, int64_t intervalMs);
+	dash::QoeSummary GetQoe(void) const;
+	// Request (or end of the segment before) to last byte, over the segments
+	double GetMeanDownloadMs(void) const;
+	// Estimator for the server's probe trains, used when the algorithm asks for probes
+	void SetProbe(const bwest::IgiConfig &config);
+	// Live: join at the segment being encoded, play chunks as they arrive and steer the
+	// playback rate toward the latency target
+	void SetLive(const dash::LiveSchedule &schedule, const dash::LiveConfig &config);
+	// Mean capture-to-display latency, 0 when not live
+	double GetMeanLatencyMs(void) const;
+	// Passive estimator the ABR reads (dash-throughput.h); all of them are kept and scored
+	void SetEstimator(const string &name);
+	// Known cross traffic, shared equally by this many clients, to score the estimators against
+	void SetGroundTruth(const dash::CrossTraffic *crossTraffic, uint32_t sharing);
+
+private:
+	virtual void StartApplication(void);
+	virtual void StopApplication(void);
+
+	// Request
+	void SendRequest(void);
+	void RequestNextChunk(void);
+	void GetStatistics(void);
+	// A segment in flight, fetched as one range per connection
+	struct Fetch
+	{
+		uint32_t segment;
+		uint32_t index;		// in the ladder
+		uint32_t bitrate;
+		uint32_t bytes;
+		uint32_t partsLeft;
+		bool failed;		// a part got an error status or its connection broke
+		uint32_t attempts;
+		uint64_t received;
+		Time start;
+		uint32_t playedMs;	// live: media already in the buffer, in whole chunks
+	};
+
+	// One of the kept-alive connections to the server
+	struct Connection
+	{
+		Ptr<Socket> socket;
+		dash::HttpParser parser;
+		bool connected;
+		deque<uint32_t> parts;	// segments of the responses still to come, in order
+		uint64_t bytes;		// body bytes over the session
+		Time busy;		// with a response outstanding
+		Time busySince;
+	};
+
+	void RxCallback(Ptr<Socket> socket);
+	// Requests the fetch's byte ranges, one per connection
+	void SendParts(Fetch &fetch);
+	// Hands on the segments that are in, in request order, and requests failed ones again
+	void CompleteFetches(void);
+	void ChunkReceived(const Fetch &fetch);
+	// Live: credits the whole chunks of the oldest segment in flight to the buffer
+	void LiveProgress(void);
+	uint32_t ConnectionOf(Ptr<Socket> socket) const;
+	void Connect(uint32_t connection);
+	// Fails the parts the connection still owed and opens a new one in its place
+	void Disconnect(uint32_t connection, const char *why);
+	void ConnectionSucceeded(Ptr<Socket> socket);
+	void ConnectionFailed(Ptr<Socket> socket);
+
+	void RxCallbackUDP(Ptr<Socket> socket);
+	void HandleProbeEstimate(const bwest::Estimate &estimate);
+	void ProbeTimeout(void);
+	void SendProbeFeedback(uint32_t gapNs);
+	void SampleQoe(void);
+	// Buffer Model
+	void ClientBufferModel(void);
+	void AddToBuffer(uint32_t ms);
+	void SetPlaybackRate(double rate);
+	void UpdateBuffer(void);
+	void ScheduleStall(void);
+	void GetBufferState(void);
+	void RxDrop(Ptr<const Packet> p);
+
+	// Rate Adaptation Algorithm (dash-abr.h)
+	void RateAdaptation(void);
+	void SendData();
+	// Another
+	uint32_t GetIndexByBitrate(uint32_t bitrate);
+
+	vector<Connection> m_connections;
+	uint32_t m_connected;
+	uint32_t m_prefetch;
+	deque<Fetch> m_fetches;		// oldest first; they complete in this order
+	Time m_lastChunkTime;
+	Ptr<Socket> p_socket;
+	Address m_peer;
+	Address ads;
+	const dash::Manifest *m_manifest;
+	uint32_t m_chunkMs;
+	uint32_t m_numChunks;
+	uint32_t m_chunkCount;
+	int32_t m_bufferSize;
+	uint32_t m_bufferPercent;
+	uint32_t m_bpsAvg;
+	uint32_t m_bpsLastChunk;
+	vector<uint32_t> m_bitrate_array;
+	EventId m_fetchEvent;
+	bool m_running;
+	uint32_t m_comulativeSize;	// body bytes of the last segment
+	vector<uint8_t> m_rxBuffer;
+	uint32_t m_lastRequestedSize;
+	uint32_t m_sessionData;
+	uint32_t m_sessionTime;
+
+	EventId m_bufferEvent;
+	EventId m_bufferStateEvent;
+	bool m_playing;
+	Time m_playStart;
+	int64_t m_ticksApplied;
+	uint32_t m_bufferEvents;
+	EventId Recvprobe;
+	uint32_t m_downloadDuration;
+	uint64_t m_downloadMsSum;
+	uint32_t m_downloads;		// segments in m_downloadMsSum; unlike m_chunkCount, stalls keep it
+	double m_throughput;
+	uint32_t m_prevBitrate;
+	uint32_t m_nextBitrate;
+	uint32_t m_nextIndex;
+	dash::AbrAlgorithm *m_algorithm;
+	dash::ThroughputHistory m_history;
+	vector<dash::ThroughputEstimator*> m_estimators;	// every registered one, side by side
+	uint32_t m_estimator;		// the one the ABR reads
+	vector<dash::EstimatorScore> m_scores;
+	const dash::CrossTraffic *m_crossTraffic;
+	uint32_t m_sharing;
+	dash::AbrStats m_abrStats;
+	uint32_t m_requestedChunks;
+	uint32_t m_fetchFailures;	// parts that failed
+	uint32_t m_skippedSegments;	// failed MAX_FETCH_ATTEMPTS times
+	clock_t pretime;
+
+	// Probe path
+	bwest::IgiEstimator m_probe;
+	vector<uint8_t> m_probeBuffer;
+	Address m_probeServer;
+	EventId m_probeEvent;
+	double m_probeBps;
+	Time m_probeTime;
+	uint32_t m_probeEstimates;
+
+	// Startup, stalls, bitrate and switches, to compare algorithms
+	dash::QoeTracker m_qoe;
+
+	// Live
+	bool m_live;
+	dash::LiveSchedule m_schedule;
+	dash::LiveConfig m_liveConfig;
+	uint32_t m_firstSegment;	// where the client joined; 0 on demand
+	int64_t m_mediaEndMs;		// stream time of the end of the buffer
+	double m_playbackRate;
+	int32_t m_drainMs;		// buffer played per BUFFER_TICK
+	Time m_rateSince;
+	Time m_speedup;
+	Time m_slowdown;
+	dash::ActiveThroughput m_active;
+	dash::LatencyHistogram m_latency;
+	// Proposed
+
+};
+
+DashClientApp::DashClientApp() :
+	m_connections(1), m_connected(0), m_prefetch(0), m_lastChunkTime(), p_socket(0), m_peer(), ads(), m_manifest(0), m_chunkMs(0), m_numChunks(0), m_chunkCount(0),
+	m_bufferSize(0), m_bufferPercent(0), m_bpsAvg(0), m_bpsLastChunk(0),
+	m_fetchEvent(), m_running(false),
+	m_comulativeSize(0), m_lastRequestedSize(0), m_sessionData(0), m_sessionTime(0),
+	m_bufferEvent(), m_bufferStateEvent(), m_playing(false), m_playStart(), m_ticksApplied(0), m_bufferEvents(0),
+	Recvprobe(), m_downloadDuration(0), m_downloadMsSum(0), m_downloads(0), m_throughput(0.0),
+	m_prevBitrate(0), m_nextBitrate(0), m_nextIndex(0), m_algorithm(0), m_estimator(0), m_crossTraffic(0), m_sharing(1),
+	m_requestedChunks(0), m_fetchFailures(0), m_skippedSegments(0),
+	pretime(0), m_probe(bwest::IgiConfig()), m_probeServer(), m_probeEvent(), m_probeBps(0), m_probeTime(),
+	m_probeEstimates(0), m_qoe(), m_live(false), m_firstSegment(0), m_mediaEndMs(0), m_playbackRate(1.0),
+	m_drainMs(BUFFER_TICK)
+{
+	uint32_t count;
+	const dash::EstimatorEntry *entries = dash::EstimatorRegistry(&count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		m_estimators.push_back(entries[i].create());
+	}
+	m_scores.resize(count);
+}
+
+DashClientApp::~DashClientApp()
+{
+	m_connections.clear();
+	p_socket = 0;
+	delete m_algorithm;
+	for (uint32_t i = 0; i < m_estimators.size(); i++)
+	{
+		delete m_estimators[i];
+	}
+}
+
+void DashClientApp::Setup(Address address, Address myUDP, const dash::Manifest *manifest, string algorithm)
+{
+	m_peer = address;
+	ads = myUDP;
+	m_manifest = manifest;
+	m_chunkMs = manifest->SegmentMs();
+	m_numChunks = manifest->Segments();
+
+	//bitrate profile of the content
+	m_bitrate_array = manifest->Bitrates();
+
+	m_algorithm = dash::CreateAbr(algorithm);
+	if (!m_algorithm)
+	{
+		NS_FATAL_ERROR("Client : unknown ABR algorithm " << algorithm << " (" << dash::AbrNames() << ")");
+	}
+}
+
+void DashClientApp::SetParallel(uint32_t connections, uint32_t prefetch)
+{
+	m_connections.resize(max<uint32_t>(connections, 1));
+	m_prefetch = prefetch;
+}
+
+void DashClientApp::SetLive(const dash::LiveSchedule &schedule, const dash::LiveConfig &config)
+{
+	m_live = true;
+	m_schedule = schedule;
+	m_liveConfig = config;
+	m_active = dash::ActiveThroughput(config.idleMs);
+}
+
+double DashClientApp::GetMeanLatencyMs(void) const
+{
+	return m_latency.Mean();
+}
+
+void DashClientApp::SetEstimator(const string &name)
+{
+	m_estimator = 0;
+	while (m_estimator < m_estimators.size() && name != m_estimators[m_estimator]->Name())
+	{
+		m_estimator++;
+	}
+	if (m_estimator == m_estimators.size())
+	{
+		NS_FATAL_ERROR("Client : unknown throughput estimator " << name << " (" << dash::EstimatorNames() << ")");
+	}
+}
+
+void DashClientApp::SetGroundTruth(const dash::CrossTraffic *crossTraffic, uint32_t sharing)
+{
+	m_crossTraffic = crossTraffic;
+	m_sharing = max<uint32_t>(sharing, 1);
+}
+
+void DashClientApp::SetProbe(const bwest::IgiConfig &config)
+{
+	m_probe = bwest::IgiEstimator(config);
+	m_probeBuffer.assign(bwest::PROBE_HEADER_SIZE, 0);
+}
+
+void DashClientApp::RxDrop(Ptr<const Packet> p)
+{
+	NS_LOG_UNCOND("RxDrop at " << Simulator::Now().GetSeconds());
+}
+
+void DashClientApp::StartApplication(void)
+{
+	// Startup delay counts from here, the handshake included
+	m_qoe.Reset(Simulator::Now().GetMilliSeconds());
+
+	// The stream is live from time 0 and ends with the catalog
+	if (m_live)
+	{
+		m_firstSegment = m_schedule.EdgeSegment(Simulator::Now().GetMilliSeconds());
+		if (m_firstSegment >= m_manifest->Segments())
+		{
+			NS_FATAL_ERROR("Client : live stream past the end of the catalog; raise --segments");
+		}
+		m_numChunks = m_manifest->Segments() - m_firstSegment;
+		m_mediaEndMs = (int64_t)m_firstSegment * m_chunkMs;
+		m_rateSince = Simulator::Now();
+	}
+
+	p_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+	uint32_t udpflag = p_socket->Bind(ads);
+	if (~udpflag) {
+		p_socket->SetRecvCallback(MakeCallback(&DashClientApp::RxCallbackUDP, this));
+		NS_LOG_UNCOND("Client : UDP Bind " << ads);
+
+		m_running = true;
+		for (uint32_t c = 0; c < m_connections.size(); c++)
+		{
+			m_connections[c].connected = false;
+			m_connections[c].bytes = 0;
+			Connect(c);
+		}
+	}
+}
+
+void DashClientApp::Connect(uint32_t c)
+{
+	if (!m_running)
+	{
+		return;
+	}
+	Connection &connection = m_connections[c];
+	connection.socket = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
+	connection.socket->TraceConnectWithoutContext("Drop", MakeCallback(&DashClientApp::RxDrop, this));
+	connection.socket->SetConnectCallback(
+		MakeCallback(&DashClientApp::ConnectionSucceeded, this),
+		MakeCallback(&DashClientApp::ConnectionFailed, this));
+	connection.socket->SetRecvCallback(MakeCallback(&DashClientApp::RxCallback, this));
+	connection.parser = dash::HttpParser(dash::HTTP_RESPONSE);
+	connection.socket->Bind();
+	if (~connection.socket->Connect(m_peer)) {
+		NS_LOG_UNCOND("Client : TCP Connect");
+	}
+}
+
+// The socket is dropped before it closes, so its late callbacks find no connection
+void DashClientApp::Disconnect(uint32_t c, const char *why)
+{
+	Connection &connection = m_connections[c];
+	NS_LOG_UNCOND("Client : connection " << c << " " << why << ", reconnecting");
+	Ptr<Socket> socket = connection.socket;
+	connection.socket = 0;
+	socket->Close();
+	if (connection.connected)
+	{
+		connection.connected = false;
+		m_connected--;
+	}
+	if (!connection.parts.empty())
+	{
+		connection.busy += Simulator::Now() - connection.busySince;
+	}
+	for (uint32_t i = 0; i < connection.parts.size(); i++)
+	{
+		Fetch &fetch = m_fetches[connection.parts[i] - m_fetches.front().segment];
+		fetch.failed = true;
+		fetch.partsLeft--;
+		m_fetchFailures++;
+	}
+	connection.parts.clear();
+	Connect(c);
+}
+
+// Segments are requested once every connection is up
+void DashClientApp::ConnectionSucceeded(Ptr<Socket> socket)
+{
+	uint32_t c = ConnectionOf(socket);
+	if (c < m_connections.size() && !m_connections[c].connected)
+	{
+		m_connections[c].connected = true;
+		m_connected++;
+	}
+	if (m_connected == m_connections.size())
+	{
+		NS_LOG_UNCOND("Client : TCP Connected x" << m_connected << ", " << m_algorithm->Name() << " rate adaptation");
+		CompleteFetches();
+		m_fetchEvent = Simulator::ScheduleNow(&DashClientApp::RequestNextChunk, this);
+	}
+}
+
+uint32_t DashClientApp::ConnectionOf(Ptr<Socket> socket) const
+{
+	uint32_t c = 0;
+	while (c < m_connections.size() && m_connections[c].socket != socket)
+	{
+		c++;
+	}
+	return c;
+}
+
+void DashClientApp::ConnectionFailed(Ptr<Socket> socket)
+{
+	NS_LOG_UNCOND("Client : TCP Connection Failed");
+	uint32_t c = ConnectionOf(socket);
+	if (c < m_connections.size())
+	{
+		m_connections[c].socket = 0;
+		Simulator::Schedule(MilliSeconds(RECONNECT_MS), &DashClientApp::Connect, this, c);
+	}
+}
+
+void DashClientApp::RxCallbackUDP(Ptr<Socket> socket)
+{
+	Ptr<Packet> packet;
+	Address from;
+	while ((packet = socket->RecvFrom(from)))
+	{
+		if (packet->GetSize() == 0)
+		{
+			break;
+		}
+		bwest::ProbeHeader header;
+		packet->CopyData(&m_probeBuffer[0], bwest::PROBE_HEADER_SIZE);
+		if (!bwest::ReadProbeHeader(&m_probeBuffer[0], packet->GetSize(), &header))
+		{
+			continue; // not a probe
+		}
+		m_probeServer = from;
+
+		bwest::ProbeRecord record;
+		record.train = header.train;
+		record.seq = header.seq;
+		record.txNs = header.txNs;
+		record.rxNs = Simulator::Now().GetNanoSeconds();
+		record.size = packet->GetSize();
+
+		// A lost tail packet would leave the train open; close it if nothing follows
+		Simulator::Cancel(m_probeEvent);
+		m_probeEvent = Simulator::Schedule(MilliSeconds(200), &DashClientApp::ProbeTimeout, this);
+
+		bwest::Estimate estimate;
+		if (m_probe.Push(record) && m_probe.Poll(&estimate))
+		{
+			HandleProbeEstimate(estimate);
+		}
+	}
+}
+
+void DashClientApp::ProbeTimeout(void)
+{
+	bwest::Estimate estimate;
+	if (m_probe.Flush() && m_probe.Poll(&estimate))
+	{
+		HandleProbeEstimate(estimate);
+	}
+	else
+	{
+		SendProbeFeedback(m_probe.NextGapNs());
+	}
+}
+
+void DashClientApp::HandleProbeEstimate(const bwest::Estimate &estimate)
+{
+	Simulator::Cancel(m_probeEvent);
+	if (!estimate.converged)
+	{
+		SendProbeFeedback(estimate.nextGapNs);
+		return;
+	}
+
+	// PTR: the converged train's arrival rate. Search again one chunk duration later.
+	m_probeBps = estimate.ptrMbps * 1e6;
+	m_probeTime = Simulator::Now();
+	m_probeEstimates++;
+	NS_LOG_UNCOND("Client : probe estimate " << estimate.ptrMbps << " Mbps after " << estimate.trains << " trains");
+	m_probe.Reset();
+	m_probeEvent = Simulator::Schedule(MilliSeconds(m_chunkMs),
+		&DashClientApp::SendProbeFeedback, this, m_probe.NextGapNs());
+}
+
+void DashClientApp::SendProbeFeedback(uint32_t gapNs)
+{
+	if (!m_running)
+	{
+		return;
+	}
+	uint8_t gap[4];
+	bwest::Write32(gap, gapNs);
+	Ptr<Packet> packet = Create<Packet>(gap, sizeof(gap));
+	p_socket->SendTo(packet, 0, m_probeServer);
+}
+
+void DashClientApp::RxCallback(Ptr<Socket> socket)
+{
+	Ptr<Packet> packet;
+
+	while ((packet = socket->Recv())) {
+		if (packet->GetSize() == 0) {   // EOF
+			break;
+		}
+
+		uint32_t c = ConnectionOf(socket);
+		if (c == m_connections.size())
+		{
+			break;
+		}
+		Connection &connection = m_connections[c];
+
+		// Only the headers are looked at; the parser steps over the body
+		m_rxBuffer.resize(packet->GetSize());
+		packet->CopyData(&m_rxBuffer[0], m_rxBuffer.size());
+		size_t at = 0;
+		dash::HttpEvent event;
+		while ((event = connection.parser.Next(&m_rxBuffer[0], m_rxBuffer.size(), &at)) != dash::HTTP_MORE)
+		{
+			if (event == dash::HTTP_ERROR || connection.parts.empty())
+			{
+				Disconnect(c, event == dash::HTTP_ERROR ? connection.parser.Error() : "sent an unrequested response");
+				CompleteFetches();
+				return;
+			}
+			Fetch &fetch = m_fetches[connection.parts.front() - m_fetches.front().segment];
+			if (event == dash::HTTP_HEADERS)
+			{
+				const dash::HttpMessage &response = connection.parser.Message();
+				if (response.status != 200 && response.status != 206)
+				{
+					NS_LOG_UNCOND("Client : segment " << fetch.segment << " failed with " << response.status);
+					fetch.failed = true;
+					m_fetchFailures++;
+				}
+			}
+			else if (event == dash::HTTP_BODY)
+			{
+				// For calculate throughput; an error's body is no part of the segment
+				connection.bytes += connection.parser.BodyBytes();
+				if (!fetch.failed)
+				{
+					fetch.received += connection.parser.BodyBytes();
+					m_active.Add(Simulator::Now().GetMicroSeconds() / 1000.0, connection.parser.BodyBytes());
+				}
+			}
+			else if (event == dash::HTTP_DONE)
+			{
+				connection.parts.pop_front();
+				fetch.partsLeft--;
+				if (connection.parts.empty())
+				{
+					connection.busy += Simulator::Now() - connection.busySince;
+				}
+			}
+		}
+
+		if (m_live)
+		{
+			LiveProgress();
+		}
+		CompleteFetches();
+	}
+}
+
+// Ranges of a later segment can finish first on another connection, but every segment
+// has a part on connection 0, so segments complete in request order. A failed segment
+// is requested again once all of its parts are back and every connection is up; after
+// MAX_FETCH_ATTEMPTS it is skipped and playback goes on with the next one.
+void DashClientApp::CompleteFetches(void)
+{
+	for (uint32_t f = 0; f < m_fetches.size() && m_connected == m_connections.size(); f++)
+	{
+		Fetch &fetch = m_fetches[f];
+		if (fetch.failed && fetch.partsLeft == 0 && fetch.attempts < MAX_FETCH_ATTEMPTS)
+		{
+			SendParts(fetch);
+		}
+	}
+	while (!m_fetches.empty() && m_fetches.front().partsLeft == 0 &&
+		(!m_fetches.front().failed || m_fetches.front().attempts >= MAX_FETCH_ATTEMPTS))
+	{
+		Fetch fetch = m_fetches.front();
+		m_fetches.pop_front();
+		if (!fetch.failed)
+		{
+			ChunkReceived(fetch);
+			continue;
+		}
+		NS_LOG_UNCOND("Client : segment " << fetch.segment << " skipped after " << fetch.attempts << " attempts");
+		m_skippedSegments++;
+		if (m_live)
+		{
+			// The stream moves on without it
+			m_mediaEndMs += m_chunkMs - fetch.playedMs;
+		}
+		Simulator::ScheduleNow(&DashClientApp::RequestNextChunk, this);
+	}
+}
+
+void DashClientApp::LiveProgress(void)
+{
+	if (m_fetches.empty())
+	{
+		return;
+	}
+	Fetch &fetch = m_fetches.front();
+	uint32_t playable = m_schedule.ChunkEndMs(m_schedule.ChunksIn(fetch.received, fetch.bytes));
+	if (playable > fetch.playedMs)
+	{
+		uint32_t ms = playable - fetch.playedMs;
+		fetch.playedMs = playable;
+		AddToBuffer(ms);
+	}
+}
+
+// Received the complete chunk: update the buffer size and initiate the next request
+void DashClientApp::ChunkReceived(const Fetch &fetch)
+{
+	m_chunkCount++;
+	m_qoe.Chunk(fetch.bitrate);
+	m_comulativeSize = fetch.received;
+	m_lastRequestedSize = fetch.bytes;
+
+	// Estimating: all connections together, from the later of the request and the end
+	// of the segment before, so a prefetched segment is not charged for the wait
+	Time start = max(fetch.start, m_lastChunkTime);
+	m_lastChunkTime = Simulator::Now();
+	m_downloadDuration = max<int64_t>((Simulator::Now() - start).GetMilliSeconds(), 1);
+	m_downloadMsSum += m_downloadDuration;
+	m_downloads++;
+
+	// A live segment takes as long as the encoder does; only its bursts tell the path
+	dash::ThroughputSample sample;
+	sample.bytes = m_comulativeSize;
+	sample.durationMs = max((Simulator::Now() - start).GetMicroSeconds() / 1000.0, 0.001);
+	sample.activeBytes = m_active.Bytes();
+	sample.activeMs = m_active.ActiveMs();
+	sample.paced = m_live;
+	m_active.Take();
+	m_bpsLastChunk = sample.Bps();
+	m_history.Add(m_bpsLastChunk);
+
+	// Each estimator is scored before it learns from the segment: the estimate the ABR
+	// had against what the cross traffic left this client meanwhile
+	double truth = m_crossTraffic ? m_crossTraffic->MeanAvailableBps(start.GetMicroSeconds() / 1000.0,
+		Simulator::Now().GetMicroSeconds() / 1000.0) / m_sharing : 0;
+	for (uint32_t e = 0; e < m_estimators.size(); e++)
+	{
+		if (m_crossTraffic)
+		{
+			m_scores[e].Add(m_estimators[e]->Estimate(), truth);
+		}
+		m_estimators[e]->Add(sample);
+	}
+	m_bpsAvg = m_estimators[m_estimator]->Estimate().bps;
+
+	// Update buffer; live chunks already played in are not counted twice
+	AddToBuffer(m_chunkMs - fetch.playedMs);
+
+	// Scheduling
+	Simulator::ScheduleNow(&DashClientApp::RequestNextChunk, this);
+	SampleQoe();
+
+	// Monitoring
+	if (monitoring)
+	{
+		GetStatistics();
+		GetBufferState();
+	}
+
+	m_comulativeSize = 0;
+}
+
+void DashClientApp::RequestNextChunk(void)
+{
+	while (m_running && m_connected == m_connections.size() && m_requestedChunks < m_numChunks &&
+		m_fetches.size() <= m_prefetch)
+	{
+		// Wait until the next chunk fits in the buffer, with those on the way
+		UpdateBuffer();
+		int32_t overflow = m_bufferSize + (int32_t)((m_fetches.size() + 1) * m_chunkMs) - MAX_BUFFER_SIZE;
+		if (overflow > 0)
+		{
+			if (!m_fetchEvent.IsRunning())
+			{
+				m_fetchEvent = Simulator::Schedule(MilliSeconds(overflow), &DashClientApp::RequestNextChunk, this);
+			}
+			return;
+		}
+
+		RateAdaptation();
+		SendRequest();
+	}
+}
+
+void DashClientApp::RateAdaptation(void)
+{
+	dash::AbrContext ctx;
+	ctx.bitrates = &m_bitrate_array;
+	ctx.history = &m_history;
+	dash::ThroughputEstimate estimate = m_estimators[m_estimator]->Estimate();
+	ctx.throughputBps = estimate.bps;
+	ctx.throughputConfidence = estimate.confidence;
+	ctx.chunkMs = m_chunkMs;
+	UpdateBuffer();
+	ctx.bufferMs = m_bufferSize;
+	// A live buffer never holds more than the latency
+	ctx.bufferCapacityMs = m_live ? m_liveConfig.targetLatencyMs : (uint32_t)MAX_BUFFER_SIZE;
+	ctx.lastIndex = m_requestedChunks ? (int32_t)GetIndexByBitrate(m_nextBitrate) : -1;
+	ctx.chunk = m_requestedChunks;
+	ctx.chunks = m_numChunks;
+	ctx.probeBps = m_probeBps;
+	ctx.probeAgeMs = Simulator::Now().GetMilliSeconds() - m_probeTime.GetMilliSeconds();
+	ctx.sizes = m_manifest->SegmentSizes(m_firstSegment + m_requestedChunks);
+
+	// Wall-clock cost of the decision; simulated time stands still meanwhile
+	int64_t start = dash::AbrClockNs();
+	uint32_t index = m_algorithm->Choose(ctx);
+	int64_t elapsed = dash::AbrClockNs() - start;
+
+	m_prevBitrate = m_nextBitrate;
+	m_nextIndex = min<uint32_t>(index, m_bitrate_array.size() - 1);
+	m_nextBitrate = m_bitrate_array[m_nextIndex];
+	bool switched = m_requestedChunks > 0 && m_nextBitrate != m_prevBitrate;
+	m_abrStats.Record(elapsed, switched);
+}
+
+uint32_t DashClientApp::GetIndexByBitrate(uint32_t bitrate)
+{
+	for (uint32_t i = 0; i < m_bitrate_array.size(); i++) {
+		if (bitrate == m_bitrate_array[i])
+			return i;
+	}
+
+	return -1;
+}
+
+void DashClientApp::SendRequest(void)
+{
+	// One byte range per connection, the whole segment when there is one; the server
+	// looks the size up in its copy of the catalog
+	Fetch fetch;
+	fetch.segment = m_firstSegment + m_requestedChunks;
+	fetch.index = m_nextIndex;
+	fetch.bitrate = m_nextBitrate;
+	fetch.bytes = m_manifest->SegmentBytes(fetch.segment, m_nextIndex);
+	fetch.attempts = 0;
+	fetch.start = Simulator::Now();
+	fetch.playedMs = 0;
+	SendParts(fetch);
+	m_fetches.push_back(fetch);
+	m_requestedChunks++;
+}
+
+void DashClientApp::SendParts(Fetch &fetch)
+{
+	fetch.partsLeft = min<uint32_t>(m_connections.size(), max<uint32_t>(fetch.bytes, 1));
+	fetch.received = 0;
+	fetch.failed = false;
+	fetch.attempts++;
+	for (uint32_t c = 0; c < fetch.partsLeft; c++)
+	{
+		uint64_t first = 0;
+		uint64_t last = dash::HTTP_OPEN_RANGE;
+		if (fetch.partsLeft > 1)
+		{
+			first = (uint64_t)fetch.bytes * c / fetch.partsLeft;
+			last = (uint64_t)fetch.bytes * (c + 1) / fetch.partsLeft - 1;
+		}
+		char request[160];
+		size_t length = dash::FormatHttpRequest(request, sizeof(request), fetch.segment, fetch.index, first, last, true);
+		Ptr<Packet> packet = Create<Packet>((uint8_t*)request, length);
+
+		Connection &connection = m_connections[c];
+		if (connection.parts.empty())
+		{
+			connection.busySince = Simulator::Now();
+		}
+		connection.parts.push_back(fetch.segment);
+		connection.socket->Send(packet);
+	}
+}
+
+// The buffer level is not ticked down by events: while playing it is the level at the
+// last update minus m_drainMs for every tick since (UpdateBuffer), and the only event
+// is the predicted stall (ScheduleStall). Ticks fall every BUFFER_TICK after playback
+// (re)started, and the stall is the first tick that finds less than m_drainMs left,
+// so levels and stall times are those of a 100 ms polling loop. m_drainMs is
+// BUFFER_TICK but for a live client playing faster or slower than real time.
+void DashClientApp::UpdateBuffer(void)
+{
+	if (!m_playing)
+	{
+		return;
+	}
+	int64_t ticks = (Simulator::Now() - m_playStart).GetMilliSeconds() / BUFFER_TICK;
+	if (ticks > m_ticksApplied)
+	{
+		// Never below 0: the stall event fires one tick after the buffer ran empty
+		m_bufferSize = (int32_t)max<int64_t>(m_bufferSize - (ticks - m_ticksApplied) * m_drainMs, 0);
+		m_ticksApplied = ticks;
+	}
+}
+
+void DashClientApp::ScheduleStall(void)
+{
+	Simulator::Cancel(m_bufferEvent);
+	if (!m_playing)
+	{
+		return;
+	}
+	Time stall = m_playStart + MilliSeconds((m_ticksApplied + m_bufferSize / m_drainMs + 1) * BUFFER_TICK);
+	m_bufferEvent = Simulator::Schedule(stall - Simulator::Now(), &DashClientApp::ClientBufferModel, this);
+	m_bufferEvents++;
+}
+
+// Media arrived: playback starts with the first of it, after startup or a stall
+void DashClientApp::AddToBuffer(uint32_t ms)
+{
+	UpdateBuffer();
+	m_bufferSize += ms;
+	m_bufferPercent = (uint32_t)(m_bufferSize * 100) / MAX_BUFFER_SIZE;
+
+	// Start playback; it drains from here on in BUFFER_TICK steps
+	if (!m_playing && m_bufferSize > 0) {
+		m_qoe.Play(Simulator::Now().GetMilliSeconds());
+		m_playing = true;
+		m_playStart = Simulator::Now();
+		m_ticksApplied = 0;
+	}
+
+	// Live: the frame on screen was captured at the end of the buffer minus the buffer
+	if (m_live && ms > 0)
+	{
+		m_mediaEndMs += ms;
+		double latency = Simulator::Now().GetMilliSeconds() - (m_mediaEndMs - m_bufferSize);
+		m_latency.Add(latency);
+		SetPlaybackRate(dash::LivePlaybackRate(m_liveConfig, latency, m_bufferSize));
+	}
+	ScheduleStall();
+}
+
+// Takes effect from the next tick on; UpdateBuffer has applied the ticks before
+void DashClientApp::SetPlaybackRate(double rate)
+{
+	Time now = Simulator::Now();
+	if (m_playbackRate > 1)
+	{
+		m_speedup += now - m_rateSince;
+	}
+	else if (m_playbackRate < 1)
+	{
+		m_slowdown += now - m_rateSince;
+	}
+	m_rateSince = now;
+	m_playbackRate = rate;
+	m_drainMs = max<int32_t>((int32_t)(BUFFER_TICK * rate + 0.5), 1);
+}
+
+// Runs at the predicted stall
+void DashClientApp::ClientBufferModel(void)
+{
+	if (m_running)
+	{
+		UpdateBuffer();
+		m_bufferSize = 0;
+		m_bufferPercent = 0;
+		m_chunkCount = 0;
+		m_playing = false;
+		SetPlaybackRate(1.0);
+		// Running dry after the last chunk is the end of the video, not a stall
+		if (m_qoe.Chunks() < m_numChunks)
+		{
+			m_qoe.Stall(Simulator::Now().GetMilliSeconds());
+		}
+		SampleQoe();
+	}
+}
+
+void DashClientApp::SampleQoe(void)
+{
+	dash::QoeStats r;
+	if (qoeTable >= 0 && m_qoe.Sample(Simulator::Now().GetMilliSeconds(), m_bufferSize, &r.sample))
+	{
+		r.node = GetNode()->GetId();
+		statsSink.Write(qoeTable, r);
 	}
 }
 
 void DashClientApp::GetStatistics()
 {
-	NS_LOG_UNCOND("=======START=========== " << GetNode() << " =================");
-	NS_LOG_UNCOND("Time: " << Simulator::Now().GetMilliSeconds() <<
-		" bpsAverage: " << m_bpsAvg <<
-		" bpsLastChunk: " << m_bpsLastChunk / 1000 <<
-		" nextBitrate: " << m_nextBitrate <<
-		" chunkCount: " << m_chunkCount <<
-		" totalChunks: " << m_numChunks <<
-		" downloadDuration: " << m_downloadDuration);
+	dash::ChunkStats r;
+	r.time = Simulator::Now().GetSeconds();
+	r.node = GetNode()->GetId();
+	r.bpsAverage = m_bpsAvg;
+	r.kbpsLastChunk = m_bpsLastChunk / 1000;
+	r.nextBitrate = m_nextBitrate;
+	r.chunkCount = m_chunkCount;
+	r.totalChunks = m_numChunks;
+	r.downloadMs = m_downloadDuration;
+	statsSink.Write(chunkTable, r);
 }
 
 void DashClientApp::GetBufferState()
 {
+	UpdateBuffer();
 	m_throughput = m_comulativeSize * 8 / 1 / 1000;
 
-	NS_LOG_UNCOND("=======BUFFER========== " << GetNode() << " =================");
-	NS_LOG_UNCOND("Time: " << Simulator::Now().GetMilliSeconds() <<
-		" bufferSize: " << m_bufferSize / 1000 <<
-		" hasThroughput: " << m_throughput <<
-		" estimatedBW: " << m_bpsLastChunk / 1000.0 <<
-		" videoLevel: " << (m_lastRequestedSize * 8) / m_chunkSize / 1000);
-
-	Time tNext("1s");
-	m_bufferStateEvent = Simulator::Schedule(tNext, &DashClientApp::GetBufferState, this);
+	dash::BufferStats r;
+	r.time = Simulator::Now().GetSeconds();
+	r.node = GetNode()->GetId();
+	r.bufferS = m_bufferSize / 1000;
+	r.throughputKbps = m_throughput;
+	r.estimatedKbps = m_bpsLastChunk / 1000.0;
+	r.videoKbps = (uint32_t)((uint64_t)m_lastRequestedSize * 8 / m_chunkMs);
+	statsSink.Write(bufferTable, r);
 }
 
 void DashClientApp::StopApplication(void)
@@ -510,22 +1893,106 @@ void DashClientApp::StopApplication(void)
 		Simulator::Cancel(m_fetchEvent);
 	}
 
-	if (m_statisticsEvent.IsRunning())
+	if (m_bufferStateEvent.IsRunning())
 	{
-		Simulator::Cancel(m_statisticsEvent);
+		Simulator::Cancel(m_bufferStateEvent);
 	}
 
-	if (m_bufferStateEvent.IsRunning())
+	if (m_probeEvent.IsRunning())
 	{
-		Simulator::Cancel(m_bufferStateEvent);
+		Simulator::Cancel(m_probeEvent);
 	}
 
-	if (m_socket)
+	std::ostringstream perConnection;
+	for (uint32_t c = 0; c < m_connections.size(); c++)
 	{
-		m_socket->Close();
+		Connection &connection = m_connections[c];
+		if (connection.socket)
+		{
+			connection.socket->Close();
+		}
+		if (!connection.parts.empty())
+		{
+			connection.busy += Simulator::Now() - connection.busySince;
+		}
+		double busy = connection.busy.GetSeconds();
+		perConnection << (c ? "/" : "") << (busy > 0 ? connection.bytes * 8 / busy / 1000 : 0);
+	}
+
+	// A stall still running at the end counts up to now
+	m_qoe.End(Simulator::Now().GetMilliSeconds());
+	SetPlaybackRate(1.0);
+	dash::QoeSummary qoe = m_qoe.Summary();
+	NS_LOG_UNCOND("ABR node=" << GetNode()->GetId() <<
+		" algorithm=" << m_algorithm->Name() <<
+		" decisions=" << m_abrStats.decisions <<
+		" switches=" << m_abrStats.switches <<
+		" decision_mean_us=" << m_abrStats.MeanUs() <<
+		" decision_max_us=" << m_abrStats.maxNs / 1000.0 <<
+		" probe_estimates=" << m_probeEstimates <<
+		" fetch_failures=" << m_fetchFailures <<
+		" skipped_segments=" << m_skippedSegments <<
+		" buffer_events=" << m_bufferEvents <<
+		" connections=" << m_connections.size() <<
+		" prefetch=" << m_prefetch <<
+		" connection_kbps=" << perConnection.str());
+	NS_LOG_UNCOND("QOE node=" << GetNode()->GetId() <<
+		" algorithm=" << m_algorithm->Name() <<
+		" qoe=" << qoe.qoe <<
+		" qoe_per_chunk=" << qoe.qoePerChunk <<
+		" startup_ms=" << qoe.startupMs <<
+		" stalls=" << qoe.stalls <<
+		" stall_ms=" << qoe.stallMs <<
+		" chunks=" << qoe.chunks <<
+		" avg_kbps=" << qoe.avgBitrateKbps <<
+		" switches=" << qoe.switches <<
+		" switch_kbps=" << qoe.switchKbps);
+	if (m_live)
+	{
+		NS_LOG_UNCOND("LIVE node=" << GetNode()->GetId() <<
+			" algorithm=" << m_algorithm->Name() <<
+			" first_segment=" << m_firstSegment <<
+			" chunk_ms=" << m_schedule.ChunkMs() <<
+			" target_ms=" << m_liveConfig.targetLatencyMs <<
+			" latency_samples=" << m_latency.Count() <<
+			" latency_mean_ms=" << m_latency.Mean() <<
+			" latency_p50_ms=" << m_latency.Percentile(0.5) <<
+			" latency_p90_ms=" << m_latency.Percentile(0.9) <<
+			" latency_p99_ms=" << m_latency.Percentile(0.99) <<
+			" latency_max_ms=" << m_latency.Max() <<
+			" speedup_s=" << m_speedup.GetSeconds() <<
+			" slowdown_s=" << m_slowdown.GetSeconds());
+	}
+	// Error as a share of this client's part of the bottleneck
+	for (uint32_t e = 0; m_crossTraffic && e < m_estimators.size(); e++)
+	{
+		const dash::EstimatorScore &score = m_scores[e];
+		NS_LOG_UNCOND("ESTIMATOR node=" << GetNode()->GetId() <<
+			" name=" << m_estimators[e]->Name() <<
+			" driving=" << (e == m_estimator) <<
+			" samples=" << score.samples <<
+			" mae_kbps=" << score.MeanAbsErrorBps() / 1000 <<
+			" bias_kbps=" << score.BiasBps() / 1000 <<
+			" error_share=" << score.MeanAbsErrorBps() * m_sharing / m_crossTraffic->CapacityBps() <<
+			" confidence=" << score.MeanConfidence());
 	}
 }
 
+void DashClientApp::SetQoe(const dash::QoeWeights &weights, int64_t intervalMs)
+{
+	m_qoe = dash::QoeTracker(weights, intervalMs);
+}
+
+dash::QoeSummary DashClientApp::GetQoe(void) const
+{
+	return m_qoe.Summary();
+}
+
+double DashClientApp::GetMeanDownloadMs(void) const
+{
+	return m_downloads ? m_downloadMsSum / (double)m_downloads : 0;
+}
+
 //=================================================================
 // SIMULATION
 //================================================================
@@ -536,11 +2003,182 @@ int main(int argc, char* argv[])
 
     std::string animFile = "dash-animation.xml" ;  // Name of file for animation output
 
-	algorithm = "Proposed";
+	algorithm = "throughput";
+	string estimator = "harmonic";
+	uint32_t clients = 1;
+	uint32_t servers = 0;
+	uint32_t staggerMs = 100;
+	double duration = 20.0;
+	double bottleneckMbps = 2.0;
+	int animate = -1;
+	dash::QoeWeights qoeWeights;
+	int64_t qoeIntervalMs = 1000;
+	uint32_t connections = 1;
+	uint32_t prefetch = 0;
+	uint32_t parallelClients = 0;
+	string statsPrefix;
+	string statsFormat = "csv";
+	string manifestFile;
+	string writeManifest;
+	uint32_t segments = 512;
+	uint32_t segmentMs = 2000;
+	double vbr = 0;
+	double cacheMb = 0;
+	string cachePolicyName = "lru";
+	uint32_t cacheConnections = 4;
+	bool live = false;
+	uint32_t chunkMs = 500;
+	dash::LiveConfig liveConfig;
+
+	CommandLine cmd;
+	cmd.AddValue("abr", "Rate adaptation algorithm: " + dash::AbrNames(), algorithm);
+	cmd.AddValue("estimator", "Passive throughput estimator the ABR reads: " + dash::EstimatorNames(), estimator);
+	cmd.AddValue("clients", "DASH clients sharing the bottleneck", clients);
+	cmd.AddValue("servers", "DASH server nodes, client k uses server k % servers (default: one per client, one behind a cache)", servers);
+	cmd.AddValue("stagger", "Start of client k is k times this (ms)", staggerMs);
+	cmd.AddValue("duration", "Session length of each client (s)", duration);
+	cmd.AddValue("bottleneck", "Bottleneck rate (Mbps)", bottleneckMbps);
+	cmd.AddValue("monitor", "Per-chunk statistics and QoE series files", monitoring);
+	cmd.AddValue("stats", "Path prefix of the statistics, buffer and qoe files", statsPrefix);
+	cmd.AddValue("stats-format", "Statistics files: csv, bin or both", statsFormat);
+	cmd.AddValue("qoe-interval", "Spacing of the per-client QoE series (ms, 0 for none)", qoeIntervalMs);
+	cmd.AddValue("qoe-lambda", "QoE penalty per Mbps of bitrate switch", qoeWeights.lambda);
+	cmd.AddValue("qoe-mu", "QoE penalty per second of stall and of startup delay", qoeWeights.mu);
+	cmd.AddValue("manifest", "Segment catalog (dash-manifest.h); default: synthesized from the flags below", manifestFile);
+	cmd.AddValue("segments", "Segments of the synthesized catalog", segments);
+	cmd.AddValue("segment-ms", "Segment duration of the synthesized catalog (ms)", segmentMs);
+	cmd.AddValue("vbr", "Spread of the synthesized segment sizes (0: constant bitrate)", vbr);
+	cmd.AddValue("write-manifest", "Write the synthesized catalog to this file and exit", writeManifest);
+	cmd.AddValue("connections", "TCP connections per client, each segment split into one byte range per connection", connections);
+	cmd.AddValue("prefetch", "Segments a client requests ahead of the one arriving", prefetch);
+	cmd.AddValue("parallel-clients", "Clients 0..N-1 use --connections and --prefetch, the rest one plain connection (default: all)", parallelClients);
+	cmd.AddValue("cache-mb", "Edge cache on the clients' side of the bottleneck, serving all clients (MB, 0: none; not with a probing --abr)", cacheMb);
+	cmd.AddValue("cache-policy", "Edge cache eviction: lru or popularity", cachePolicyName);
+	cmd.AddValue("cache-connections", "Edge cache connections to the origin servers", cacheConnections);
+	cmd.AddValue("live", "Live stream from time 0, segments delivered chunk by chunk as encoded", live);
+	cmd.AddValue("live-chunk-ms", "Live encoder chunk duration (ms)", chunkMs);
+	cmd.AddValue("live-latency", "Live latency target, capture to display (ms; at least two segments with bola)", liveConfig.targetLatencyMs);
+	cmd.AddValue("live-rate", "Live playback rate stays within 1 +- this", liveConfig.maxRateChange);
+	cmd.AddValue("live-idle", "Live download gaps longer than this are not counted for throughput (ms)", liveConfig.idleMs);
+	cmd.AddValue("anim", "NetAnim trace (default: only with one client)", animate);
+	cmd.Parse(argc, argv);
+	qoeWeights.muStartup = qoeWeights.mu;
+	clients = max<uint32_t>(clients, 1);
+	parallelClients = parallelClients ? min(parallelClients, clients) : clients;
+	bool caching = cacheMb > 0;
+	if (live && connections > 1)
+	{
+		// Chunks are played in order as they arrive, which byte ranges would break up
+		std::cerr << "--live uses one connection per client, ignoring --connections=" << connections << std::endl;
+		connections = 1;
+	}
+	if (prefetch >= DashServerApp::PIPELINE_DEPTH)
+	{
+		// A server disconnects a client with more requests outstanding
+		std::cerr << "--prefetch is at most " << DashServerApp::PIPELINE_DEPTH - 1 << ", ignoring --prefetch=" <<
+			prefetch << std::endl;
+		prefetch = DashServerApp::PIPELINE_DEPTH - 1;
+	}
+	servers = servers ? min(servers, clients) : caching ? 1 : clients;
+	dash::CachePolicy cachePolicy;
+	if (!dash::ParseCachePolicy(cachePolicyName, &cachePolicy))
+	{
+		std::cerr << "unknown --cache-policy " << cachePolicyName << ", expected lru or popularity" << std::endl;
+		return 1;
+	}
+
+	dash::AbrAlgorithm *check = dash::CreateAbr(algorithm);
+	if (!check)
+	{
+		std::cerr << "unknown --abr " << algorithm << ", expected " << dash::AbrNames() << std::endl;
+		return 1;
+	}
+	bool probing = check->UsesProbe();
+	delete check;
+	if (probing && caching)
+	{
+		// Probe trains go to a session's peer: the cache's would cross only its leaf link,
+		// never the bottleneck, and the origins' only peer is the cache
+		std::cerr << "--abr=" << algorithm << " probes the bottleneck, which an edge cache hides; drop --cache-mb" <<
+			std::endl;
+		return 1;
+	}
+	dash::ThroughputEstimator *checkEstimator = dash::CreateEstimator(estimator);
+	if (!checkEstimator)
+	{
+		std::cerr << "unknown --estimator " << estimator << ", expected " << dash::EstimatorNames() << std::endl;
+		return 1;
+	}
+	delete checkEstimator;
+
+	// Content: 700 kbps to 4.2 Mbps unless the catalog says otherwise
+	dash::Manifest manifest;
+	if (!manifestFile.empty())
+	{
+		string error;
+		if (!manifest.Open(manifestFile, &error))
+		{
+			std::cerr << error << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		vector<uint32_t> ladder;
+		for (uint32_t kbps = 700; kbps <= 4200; kbps += 700)
+		{
+			ladder.push_back(kbps * 1000);
+		}
+		manifest.Synthesize(ladder, max<uint32_t>(segments, 1), max<uint32_t>(segmentMs, 1), vbr, 1);
+	}
+	if (!writeManifest.empty())
+	{
+		if (!manifest.Write(writeManifest))
+		{
+			std::cerr << "cannot write " << writeManifest << std::endl;
+			return 1;
+		}
+		std::cout << "Manifest " << writeManifest << ": " << manifest.Representations() << " representations x " <<
+			manifest.Segments() << " segments of " << manifest.SegmentMs() << " ms" << std::endl;
+		return 0;
+	}
+	dash::LiveSchedule schedule(manifest.SegmentMs(), chunkMs);
+	if (live && algorithm == "bola" && liveConfig.targetLatencyMs < 2 * manifest.SegmentMs())
+	{
+		// BOLA's buffer capacity is the latency target; under two segments it has no room
+		// to trade buffer for quality
+		std::cerr << "--abr=bola needs --live-latency of at least two segments (" << 2 * manifest.SegmentMs() <<
+			" ms)" << std::endl;
+		return 1;
+	}
+
+	if (monitoring)
+	{
+		uint32_t formats = statsFormat == "bin" ? dash::STATS_BINARY :
+			statsFormat == "both" ? dash::STATS_CSV | dash::STATS_BINARY : dash::STATS_CSV;
+		chunkTable = statsSink.AddTable<dash::ChunkStats>(statsPrefix + "statistics", dash::CHUNK_STATS_COLUMNS, formats);
+		bufferTable = statsSink.AddTable<dash::BufferStats>(statsPrefix + "buffer", dash::BUFFER_STATS_COLUMNS, formats);
+		qoeTable = statsSink.AddTable<dash::QoeStats>(statsPrefix + "qoe", dash::QOE_STATS_COLUMNS, formats);
+		if (chunkTable < 0 || bufferTable < 0 || qoeTable < 0)
+		{
+			std::cerr << "cannot create the statistics files at --stats=" << statsPrefix << std::endl;
+			return 1;
+		}
+	}
+
 	LogComponentEnable("DashApplication", LOG_LEVEL_ALL);
 
+	// Probe trains for the probe-assisted algorithm: IGI/PTR from bw-estimator.h, with gB
+	// the probe packet's transmission time on the bottleneck
+	uint32_t probeSize = 1200;
+	bwest::IgiConfig probeConfig;
+	probeConfig.bottleneckMbps = bottleneckMbps;
+	probeConfig.trainSize = 20;
+	probeConfig.gBNs = (uint32_t)(probeSize * 8 * 1000 / bottleneckMbps);
+	probeConfig.stepNs = probeConfig.gBNs / 8;
+
 	PointToPointHelper bottleNeck;
-	bottleNeck.SetDeviceAttribute("DataRate", StringValue("2Mbps"));
+	bottleNeck.SetDeviceAttribute("DataRate", DataRateValue(DataRate((uint64_t)(bottleneckMbps * 1e6))));
 	bottleNeck.SetChannelAttribute("Delay", StringValue("10ms"));
 	//bottleNeck.SetQueue("ns3::DropTailQueue", "Mode", StringValue ("QUEUE_MODE_BYTES"));
 
@@ -548,17 +2186,25 @@ int main(int argc, char* argv[])
 	pointToPointLeaf.SetDeviceAttribute("DataRate", StringValue("100Mbps"));
 	pointToPointLeaf.SetChannelAttribute("Delay", StringValue("1ms"));
 
-	PointToPointDumbbellHelper dB(10, pointToPointLeaf, 10, pointToPointLeaf,
+	// Leaf 0 carries the cross traffic and right leaf 1 holds the edge cache; clients take
+	// the leaves from the top down, so a single client keeps leaf 9 of 10
+	uint32_t leaves = max<uint32_t>(10, clients + (caching ? 2 : 1));
+	PointToPointDumbbellHelper dB(leaves, pointToPointLeaf, leaves, pointToPointLeaf,
 		bottleNeck);
 
 	// install stack
 	InternetStackHelper stack;
 	dB.InstallStack(stack);
 
-	// assign IP addresses
+	// assign IP addresses, one /24 per leaf; past 255 leaves the left and right ranges
+	// move apart so they do not overlap
+	uint32_t span = (leaves + 255) / 256;
+	std::ostringstream rightBase, routerBase;
+	rightBase << "10." << 1 + span << ".1.0";
+	routerBase << "10." << 1 + 2 * span << ".1.0";
 	dB.AssignIpv4Addresses(Ipv4AddressHelper("10.1.1.0", "255.255.255.0"),
-		Ipv4AddressHelper("10.2.1.0", "255.255.255.0"),
-		Ipv4AddressHelper("10.3.1.0", "255.255.255.0"));
+		Ipv4AddressHelper(rightBase.str().c_str(), "255.255.255.0"),
+		Ipv4AddressHelper(routerBase.str().c_str(), "255.255.255.0"));
 
 	uint16_t TCPserverPort = 9999;
 	uint16_t UDPserverPort = 8888;
@@ -575,23 +2221,23 @@ int main(int argc, char* argv[])
 	 srcApp1.Start(Seconds(1.0));
 	 srcApp1.Stop(Seconds(800.0));*/
 
-	// Scenario 2 (Drastic Bandwidth Decrease -> Increase)
-	OnOffHelper crossTrafficSrc1("ns3::UdpSocketFactory", InetSocketAddress(dB.GetRightIpv4Address(0), UDPserverPort));
-	crossTrafficSrc1.SetAttribute("OnTime", StringValue("ns3::ConstantRandomVariable[Constant=2000]"));
-	crossTrafficSrc1.SetAttribute("OffTime", StringValue("ns3::ConstantRandomVariable[Constant=0]"));
-	crossTrafficSrc1.SetAttribute("DataRate", DataRateValue(DataRate("3000kb/s")));
-	crossTrafficSrc1.SetAttribute("PacketSize", UintegerValue(512));
-	ApplicationContainer srcApp1 = crossTrafficSrc1.Install(dB.GetLeft(0));
-	srcApp1.Start(Seconds(0.0));
-	srcApp1.Stop(Seconds(20.0));
-	OnOffHelper crossTrafficSrc2("ns3::UdpSocketFactory", InetSocketAddress(dB.GetRightIpv4Address(0), UDPserverPort));
-	crossTrafficSrc2.SetAttribute("OnTime", StringValue("ns3::ConstantRandomVariable[Constant=10]"));
-	crossTrafficSrc2.SetAttribute("OffTime", StringValue("ns3::ConstantRandomVariable[Constant=0]"));
-	crossTrafficSrc2.SetAttribute("DataRate", DataRateValue(DataRate("1000kb/s")));
-	crossTrafficSrc2.SetAttribute("PacketSize", UintegerValue(512));
-	ApplicationContainer srcApp2 = crossTrafficSrc2.Install(dB.GetLeft(0));
-	srcApp2.Start(Seconds(10.0));
-	srcApp2.Stop(Seconds(20.0));
+	// Scenario 2 (Drastic Bandwidth Decrease -> Increase): constant-rate sources, which are
+	// also the ground truth the clients' throughput estimators are scored against
+	dash::CrossTraffic crossTraffic(bottleneckMbps * 1e6);
+	crossTraffic.Add(0, 20000, 3000000);
+	crossTraffic.Add(10000, 20000, 1000000);
+	for (size_t i = 0; i < crossTraffic.Sources(); i++)
+	{
+		const dash::CrossTraffic::Source &source = crossTraffic.GetSource(i);
+		OnOffHelper crossTrafficSrc("ns3::UdpSocketFactory", InetSocketAddress(dB.GetRightIpv4Address(0), UDPserverPort));
+		crossTrafficSrc.SetAttribute("OnTime", StringValue("ns3::ConstantRandomVariable[Constant=2000]"));
+		crossTrafficSrc.SetAttribute("OffTime", StringValue("ns3::ConstantRandomVariable[Constant=0]"));
+		crossTrafficSrc.SetAttribute("DataRate", DataRateValue(DataRate(source.bps)));
+		crossTrafficSrc.SetAttribute("PacketSize", UintegerValue(512));
+		ApplicationContainer srcApp = crossTrafficSrc.Install(dB.GetLeft(0));
+		srcApp.Start(MilliSeconds(source.startMs));
+		srcApp.Stop(MilliSeconds(source.stopMs));
+	}
 
 	// Scenario 3 (Drastic Bandwidth Decrease -> Maintain)
 	// OnOffHelper crossTrafficSrc1("ns3::UdpSocketFactory", InetSocketAddress (dB.GetRightIpv4Address(0), serverPort));
@@ -605,40 +2251,154 @@ int main(int argc, char* argv[])
 
 
 	Address TCPBindAddress(InetSocketAddress(Ipv4Address::GetAny(), TCPserverPort));
-	Address TCPServerAddress(InetSocketAddress(dB.GetLeftIpv4Address(9), TCPserverPort));
 	Address UDPBindAddress(InetSocketAddress(Ipv4Address::GetAny(), UDPserverPort));
-	Address UDPServerAddress(InetSocketAddress(dB.GetRightIpv4Address(9), UDPserverPort));
-
-	// DASH server
-	Ptr<DashServerApp> serverApp1 = CreateObject<DashServerApp>();
-	serverApp1->Setup(TCPBindAddress, UDPServerAddress, 512);
-	dB.GetLeft(9)->AddApplication(serverApp1);
-	serverApp1->SetStartTime(Seconds(0.0));
-	serverApp1->SetStopTime(Seconds(25.0));
-
-	// DASH client
-	Ptr<DashClientApp> clientApp1 = CreateObject<DashClientApp>();
-	clientApp1->Setup(TCPServerAddress, UDPBindAddress, 2, 512, algorithm);
-	dB.GetRight(9)->AddApplication(clientApp1);
-	clientApp1->SetStartTime(Seconds(0.0));
-	clientApp1->SetStopTime(Seconds(20.0));
-
-    // Set the bounding box for animation
-    dB.BoundingBox (1, 1, 100, 100);
- 
-    // Create the animation object and configure for specified output
-    AnimationInterface anim (animFile);
-    anim.EnablePacketMetadata (); // Optional
-    anim.EnableIpv4L3ProtocolCounters (Seconds (0), Seconds (3)); // Optional 
 
+	// Client k on right leaf (top - k), starting k * stagger, served by the server on left
+	// leaf (top - k % servers); a server serves all its clients from one node. With a
+	// cache every client goes to it, and the servers, all up from the start, are its origins.
+	double end = (clients - 1) * staggerMs / 1000.0 + duration;
+	vector<Address> origins;
+	for (uint32_t k = 0; k < servers; k++)
+	{
+		uint32_t leaf = leaves - 1 - k;
+
+		// DASH server
+		Ptr<DashServerApp> serverApp = CreateObject<DashServerApp>();
+		serverApp->Setup(TCPBindAddress, UDPBindAddress, 512);
+		serverApp->SetManifest(&manifest);
+		if (live)
+		{
+			serverApp->SetLive(schedule);
+		}
+		if (probing)
+		{
+			serverApp->SetProbe(probeConfig, probeSize);
+		}
+		dB.GetLeft(leaf)->AddApplication(serverApp);
+		serverApp->SetStartTime(Seconds(caching ? 0 : k * staggerMs / 1000.0));
+		serverApp->SetStopTime(Seconds(end + 5));
+		origins.push_back(InetSocketAddress(dB.GetLeftIpv4Address(leaf), TCPserverPort));
+	}
+
+	if (caching)
+	{
+		Ptr<DashCacheApp> cacheApp = CreateObject<DashCacheApp>();
+		cacheApp->Setup(TCPBindAddress, UDPBindAddress, 512);
+		cacheApp->SetOrigins(origins, cacheConnections);
+		cacheApp->SetCache((uint64_t)(cacheMb * 1e6), cachePolicy);
+		dB.GetRight(1)->AddApplication(cacheApp);
+		cacheApp->SetStartTime(Seconds(0));
+		cacheApp->SetStopTime(Seconds(end + 5));
+	}
+
+	vector<Ptr<DashClientApp> > clientApps;
+	for (uint32_t k = 0; k < clients; k++)
+	{
+		uint32_t leaf = leaves - 1 - k;
+		double start = k * staggerMs / 1000.0;
+		Address TCPServerAddress(caching ? InetSocketAddress(dB.GetRightIpv4Address(1), TCPserverPort) :
+			InetSocketAddress(dB.GetLeftIpv4Address(leaves - 1 - k % servers), TCPserverPort));
+
+		// DASH client
+		Ptr<DashClientApp> clientApp = CreateObject<DashClientApp>();
+		clientApp->Setup(TCPServerAddress, UDPBindAddress, &manifest, algorithm);
+		clientApp->SetProbe(probeConfig);
+		clientApp->SetEstimator(estimator);
+		clientApp->SetGroundTruth(&crossTraffic, clients);
+		clientApp->SetQoe(qoeWeights, qoeIntervalMs);
+		if (live)
+		{
+			clientApp->SetLive(schedule, liveConfig);
+		}
+		if (k < parallelClients)
+		{
+			clientApp->SetParallel(connections, prefetch);
+		}
+		dB.GetRight(leaf)->AddApplication(clientApp);
+		clientApp->SetStartTime(Seconds(start));
+		clientApp->SetStopTime(Seconds(start + duration));
+		clientApps.push_back(clientApp);
+	}
+
+	AnimationInterface *anim = 0;
+	if (animate > 0 || (animate < 0 && clients == 1))
+	{
+	    // Set the bounding box for animation
+	    dB.BoundingBox (1, 1, 100, 100);
+	 
+	    // Create the animation object and configure for specified output
+	    anim = new AnimationInterface (animFile);
+	    anim->EnablePacketMetadata (); // Optional
+	    anim->EnableIpv4L3ProtocolCounters (Seconds (0), Seconds (3)); // Optional 
+	}
 
 	Ipv4GlobalRoutingHelper::PopulateRoutingTables();
 
-	Simulator::Stop(Seconds(25.0));
+	Simulator::Stop(Seconds(end + 5));
 
+	int64_t wallStart = dash::AbrClockNs();
 	Simulator::Run();
-    std::cout << "Animation Trace file created:" << animFile.c_str ()<< std::endl;
+	double wallSec = (dash::AbrClockNs() - wallStart) / 1e9;
+	statsSink.Close();
+	if (monitoring)
+	{
+		NS_LOG_UNCOND("STATS records=" << statsSink.Records() <<
+			" batches=" << statsSink.Batches() <<
+			" max_queued=" << statsSink.MaxQueued());
+	}
+	uint64_t events = Simulator::GetEventCount();
+
+	// Jain's fairness index over the clients' mean bitrates: 1 when all got the same,
+	// 1/N when one got everything
+	double sum = 0, sumSquares = 0, rebufferMs = 0, startupMs = 0, qoe = 0, parallelSum = 0, downloadMs = 0,
+		latencyMs = 0;
+	uint32_t started = 0;
+	for (uint32_t k = 0; k < clientApps.size(); k++)
+	{
+		dash::QoeSummary s = clientApps[k]->GetQoe();
+		sum += s.avgBitrateKbps;
+		parallelSum += k < parallelClients ? s.avgBitrateKbps : 0;
+		sumSquares += s.avgBitrateKbps * s.avgBitrateKbps;
+		rebufferMs += s.stallMs;
+		qoe += s.qoe;
+		downloadMs += clientApps[k]->GetMeanDownloadMs();
+		latencyMs += clientApps[k]->GetMeanLatencyMs();
+		if (s.startupMs >= 0)
+		{
+			startupMs += s.startupMs;
+			started++;
+		}
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	NS_LOG_UNCOND("SCALE clients=" << clients <<
+		" servers=" << servers <<
+		" algorithm=" << algorithm <<
+		" estimator=" << estimator <<
+		" jain=" << (sumSquares > 0 ? sum * sum / (clients * sumSquares) : 0) <<
+		" mean_kbps=" << sum / clients <<
+		" connections=" << connections <<
+		" prefetch=" << prefetch <<
+		" parallel_kbps=" << parallelSum / parallelClients <<
+		" plain_kbps=" << (clients > parallelClients ? (sum - parallelSum) / (clients - parallelClients) : 0) <<
+		" mean_startup_ms=" << (started ? startupMs / started : -1) <<
+		" mean_rebuffer_ms=" << rebufferMs / clients <<
+		" mean_qoe=" << qoe / clients <<
+		" mean_download_ms=" << downloadMs / clients <<
+		" cache_mb=" << cacheMb <<
+		" mean_latency_ms=" << latencyMs / clients <<
+		" sim_s=" << end + 5 <<
+		" wall_s=" << wallSec <<
+		" events=" << events <<
+		" events_per_s=" << (wallSec > 0 ? events / wallSec : 0) <<
+		" peak_rss_mb=" << usage.ru_maxrss / 1024.0);
+
 	Simulator::Destroy();
+	if (anim)
+	{
+	    delete anim;
+	    std::cout << "Animation Trace file created:" << animFile.c_str ()<< std::endl;
+	}
 
 	return 0;
 }
\ No newline at end of file
@@ -1,3 +1,72 @@
 #!/bin/bash
+# ./as.sh [throughput|bba|bola|mpc|probe]
+# ./as.sh compare [algorithms...]    ABR and QOE summary lines of each algorithm on the same scenario
+# ./as.sh scale [client counts...]   SCALE line per client count, bottleneck 2 Mbps per client
+# ./as.sh parallel [connections...]  4 clients on 8 Mbps: all plain, then client 0 with K range
+#                                    connections and one segment of prefetch against 3 plain ones,
+#                                    then all 4 like that
+# ./as.sh cache [budgets MB...]      20 clients watching the same content over 10 Mbps: no cache,
+#                                    then an edge cache of each budget under lru and popularity
+# ./as.sh estimators [names...]      the cross traffic on 8 Mbps with each throughput estimator
+#                                    driving the ABR, ESTIMATOR error lines for all of them
+# ./as.sh live [targets ms...]       4 clients on 8 Mbps, on demand and then live at each latency
+#                                    target, QOE and LIVE lines per client
 
-../waf --run ./as
+if [ "$1" == "compare" ]; then
+    shift
+    for abr in ${@:-throughput probe}; do
+        ../waf --run "as --abr=$abr" 2>&1 | grep -E "^(ABR|QOE) "
+    done
+    exit 0
+fi
+
+if [ "$1" == "parallel" ]; then
+    shift
+    ../waf --run "as --abr=${ABR:-throughput} --clients=4 --bottleneck=8 --monitor=0" 2>&1 | grep "^SCALE "
+    for k in ${@:-1 2 4}; do
+        for mix in 1 4; do
+            ../waf --run "as --abr=${ABR:-throughput} --clients=4 --bottleneck=8 --monitor=0 --connections=$k --prefetch=1 --parallel-clients=$mix" 2>&1 | grep "^SCALE "
+        done
+    done
+    exit 0
+fi
+
+if [ "$1" == "cache" ]; then
+    shift
+    run="as --abr=${ABR:-throughput} --clients=20 --bottleneck=10 --monitor=0 --qoe-interval=0"
+    ../waf --run "$run" 2>&1 | grep "^SCALE "
+    for mb in ${@:-4 32}; do
+        for policy in lru popularity; do
+            ../waf --run "$run --cache-mb=$mb --cache-policy=$policy" 2>&1 | grep -E "^(CACHE|SCALE) "
+        done
+    done
+    exit 0
+fi
+
+if [ "$1" == "estimators" ]; then
+    shift
+    for estimator in ${@:-harmonic ewma active}; do
+        ../waf --run "as --abr=${ABR:-throughput} --bottleneck=8 --estimator=$estimator --monitor=0" 2>&1 | grep -E "^(ESTIMATOR|SCALE) "
+    done
+    exit 0
+fi
+
+if [ "$1" == "live" ]; then
+    shift
+    run="as --abr=${ABR:-throughput} --clients=4 --bottleneck=8 --monitor=0"
+    ../waf --run "$run" 2>&1 | grep -E "^(QOE|SCALE) "
+    for target in ${@:-2000 3000 5000}; do
+        ../waf --run "$run --live --live-latency=$target" 2>&1 | grep -E "^(QOE|LIVE|SCALE) "
+    done
+    exit 0
+fi
+
+if [ "$1" == "scale" ]; then
+    shift
+    for n in ${@:-10 50 100 200 500 1000}; do
+        ../waf --run "as --abr=${ABR:-throughput} --clients=$n --bottleneck=$((n * 2)) --monitor=0 --qoe-interval=0" 2>&1 | grep "^SCALE "
+    done
+    exit 0
+fi
+
+../waf --run "as --abr=${1:-throughput}"
@@ -0,0 +1,473 @@
+// Binary probe captures: the raw records a receiver fed its estimator, written once and
+// replayed offline as often as needed. The file is a fixed header, the records in arrival
+// order, and a train index at the end, all host byte order so the whole thing can be
+// mmap'ed and walked in place.
+//
+//   CaptureFileHeader   136 bytes, the run's estimator configuration included
+//   CaptureRecord[]     32 bytes each: probes plus flush / discard / reset markers
+//   CaptureTrain[]      16 bytes each: one contiguous run of records of a train
+//
+// A file whose writer never got to Close (killed run) has no index; the reader rebuilds
+// one from the records that made it to disk.
+//
+// Replaying a capture with different thresholds is exact up to the train the original
+// run stopped at: the senders' gap sequence only depends on earlier trains not having
+// converged, which a stricter threshold can only move later, not change.
+#ifndef BW_CAPTURE_H
+#define BW_CAPTURE_H
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "bw-estimator.h"
+
+namespace bwest {
+
+enum
+{
+    CAPTURE_MAGIC = 0x42574350, // "BWCP"; reads byte-swapped on a host of the other endianness
+    CAPTURE_VERSION = 1,
+    CAPTURE_TRAINS_SORTED = 1   // header flag: index ascending by train, FindTrain can bisect
+};
+
+enum CaptureOp
+{
+    CAPTURE_PROBE = 0,
+    CAPTURE_FLUSH = 1,
+    CAPTURE_DISCARD = 2,
+    CAPTURE_RESET = 3
+};
+
+struct CaptureFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;          // EstimatorKind of the run
+    uint32_t recordSize;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t recordCount;
+    uint64_t indexOffset;   // 0 until the writer closes the file
+    uint64_t trainCount;
+
+    double igiBottleneckMbps;
+    uint32_t igiTrainSize;
+    uint32_t igiGBNs;
+    uint32_t igiStepNs;
+    uint32_t igiReserved;
+    double igiThreshold;
+
+    double trendBottleneckMbps;
+    uint32_t trendTrainSize;
+    uint32_t trendGroups;
+    uint32_t trendPacketSize;
+    uint32_t trendInitialGapNs;
+    double trendPctThreshold;
+    double trendPdtThreshold;
+    double trendResolutionMbps;
+    uint32_t trendMaxAmbiguous;
+    uint32_t trendReserved;
+};
+
+struct CaptureRecord
+{
+    uint32_t train;
+    uint32_t seq;
+    int64_t txNs;
+    int64_t rxNs;
+    uint32_t size;
+    uint32_t op;            // CaptureOp
+};
+
+struct CaptureTrain
+{
+    uint32_t train;
+    uint32_t count;
+    uint64_t first;         // index of the run's first record
+};
+
+static_assert(sizeof(CaptureFileHeader) == 136, "capture header layout");
+static_assert(sizeof(CaptureRecord) == 32, "capture record layout");
+static_assert(sizeof(CaptureTrain) == 16, "capture index layout");
+
+//================================================================
+// WRITER
+//================================================================
+
+class CaptureWriter
+{
+public:
+    CaptureWriter() :
+        m_file(0), m_sorted(true)
+    {
+        memset(&m_header, 0, sizeof(m_header));
+    }
+
+    ~CaptureWriter()
+    {
+        Close();
+    }
+
+    bool Open(const std::string &path)
+    {
+        Close();
+        m_file = fopen(path.c_str(), "w+b");
+        if (!m_file)
+        {
+            return false;
+        }
+        setvbuf(m_file, 0, _IOFBF, 1 << 20);
+        memset(&m_header, 0, sizeof(m_header));
+        m_header.magic = CAPTURE_MAGIC;
+        m_header.version = CAPTURE_VERSION;
+        m_header.recordSize = sizeof(CaptureRecord);
+        m_index.clear();
+        m_sorted = true;
+        return fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+    }
+
+    // Writes the index and the final header. Safe to call twice.
+    void Close(void)
+    {
+        if (!m_file)
+        {
+            return;
+        }
+        m_header.indexOffset = sizeof(m_header) + m_header.recordCount * sizeof(CaptureRecord);
+        m_header.trainCount = m_index.size();
+        m_header.flags = m_sorted ? CAPTURE_TRAINS_SORTED : 0;
+        if (!m_index.empty())
+        {
+            fwrite(&m_index[0], sizeof(CaptureTrain), m_index.size(), m_file);
+        }
+        fseek(m_file, 0, SEEK_SET);
+        fwrite(&m_header, sizeof(m_header), 1, m_file);
+        fclose(m_file);
+        m_file = 0;
+    }
+
+    bool IsOpen(void) const { return m_file != 0; }
+
+    void Config(const IgiConfig &c)
+    {
+        m_header.kind = ESTIMATOR_IGI;
+        m_header.igiBottleneckMbps = c.bottleneckMbps;
+        m_header.igiTrainSize = c.trainSize;
+        m_header.igiGBNs = c.gBNs;
+        m_header.igiStepNs = c.stepNs;
+        m_header.igiThreshold = c.threshold;
+        RewriteHeader();
+    }
+
+    void Config(const TrendConfig &c)
+    {
+        m_header.kind = ESTIMATOR_TREND;
+        m_header.trendBottleneckMbps = c.bottleneckMbps;
+        m_header.trendTrainSize = c.trainSize;
+        m_header.trendGroups = c.groups;
+        m_header.trendPacketSize = c.packetSize;
+        m_header.trendInitialGapNs = c.initialGapNs;
+        m_header.trendPctThreshold = c.pctThreshold;
+        m_header.trendPdtThreshold = c.pdtThreshold;
+        m_header.trendResolutionMbps = c.resolutionMbps;
+        m_header.trendMaxAmbiguous = c.maxAmbiguous;
+        RewriteHeader();
+    }
+
+    void Record(const ProbeRecord &r)
+    {
+        Append(r.train, r.seq, r.txNs, r.rxNs, r.size, CAPTURE_PROBE);
+    }
+
+    void Flush(uint32_t train) { Append(train, 0, 0, 0, 0, CAPTURE_FLUSH); }
+    void Discard(uint32_t train) { Append(train, 0, 0, 0, 0, CAPTURE_DISCARD); }
+    void Reset(uint32_t train) { Append(train, 0, 0, 0, 0, CAPTURE_RESET); }
+
+private:
+    // So that a capture cut short by a killed run still carries its configuration
+    void RewriteHeader(void)
+    {
+        if (m_file)
+        {
+            long end = ftell(m_file);
+            fseek(m_file, 0, SEEK_SET);
+            fwrite(&m_header, sizeof(m_header), 1, m_file);
+            fseek(m_file, end, SEEK_SET);
+        }
+    }
+
+    void Append(uint32_t train, uint32_t seq, int64_t txNs, int64_t rxNs, uint32_t size, uint32_t op)
+    {
+        if (!m_file)
+        {
+            return;
+        }
+        CaptureRecord r;
+        r.train = train;
+        r.seq = seq;
+        r.txNs = txNs;
+        r.rxNs = rxNs;
+        r.size = size;
+        r.op = op;
+        fwrite(&r, sizeof(r), 1, m_file);
+
+        if (m_index.empty() || m_index.back().train != train)
+        {
+            if (!m_index.empty() && train < m_index.back().train)
+            {
+                m_sorted = false;
+            }
+            CaptureTrain t;
+            t.train = train;
+            t.count = 0;
+            t.first = m_header.recordCount;
+            m_index.push_back(t);
+        }
+        m_index.back().count++;
+        m_header.recordCount++;
+    }
+
+    FILE *m_file;
+    CaptureFileHeader m_header;
+    std::vector<CaptureTrain> m_index;
+    bool m_sorted;
+};
+
+//================================================================
+// READER
+//================================================================
+
+class CaptureFile
+{
+public:
+    CaptureFile() :
+        m_base(0), m_length(0), m_header(0), m_records(0), m_recordCount(0), m_trains(0), m_trainCount(0),
+        m_sorted(false)
+    {
+    }
+
+    ~CaptureFile()
+    {
+        Close();
+    }
+
+    // Maps the file read-only. Returns false with a reason in *error.
+    bool Open(const std::string &path, std::string *error)
+    {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            *error = "cannot open " + path;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CaptureFileHeader))
+        {
+            close(fd);
+            *error = path + ": too short for a capture";
+            return false;
+        }
+        m_length = st.st_size;
+        void *base = mmap(0, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            *error = "cannot map " + path;
+            return false;
+        }
+        m_base = (const uint8_t *)base;
+        madvise(base, m_length, MADV_SEQUENTIAL);
+
+        m_header = (const CaptureFileHeader *)m_base;
+        if (m_header->magic != CAPTURE_MAGIC || m_header->version != CAPTURE_VERSION ||
+            m_header->recordSize != sizeof(CaptureRecord))
+        {
+            Close();
+            *error = path + ": not a version 1 capture of this byte order";
+            return false;
+        }
+        m_records = (const CaptureRecord *)(m_base + sizeof(CaptureFileHeader));
+        uint64_t onDisk = (m_length - sizeof(CaptureFileHeader)) / sizeof(CaptureRecord);
+        if (m_header->indexOffset == 0 ||
+            m_header->indexOffset != sizeof(CaptureFileHeader) + m_header->recordCount * sizeof(CaptureRecord) ||
+            m_header->indexOffset + m_header->trainCount * sizeof(CaptureTrain) > m_length)
+        {
+            // Never closed, or cut short since: keep whatever whole records are there
+            m_recordCount = std::min<uint64_t>(onDisk, m_header->indexOffset ? m_header->recordCount : onDisk);
+            RebuildIndex();
+            return true;
+        }
+        m_recordCount = m_header->recordCount;
+        m_trainCount = m_header->trainCount;
+        m_trains = (const CaptureTrain *)(m_base + m_header->indexOffset);
+        m_sorted = (m_header->flags & CAPTURE_TRAINS_SORTED) != 0;
+        return true;
+    }
+
+    void Close(void)
+    {
+        if (m_base)
+        {
+            munmap((void *)m_base, m_length);
+        }
+        m_base = 0;
+        m_length = 0;
+        m_header = 0;
+        m_records = 0;
+        m_recordCount = 0;
+        m_trains = 0;
+        m_trainCount = 0;
+        m_sorted = false;
+        m_rebuilt.clear();
+    }
+
+    EstimatorKind Kind(void) const { return (EstimatorKind)m_header->kind; }
+
+    IgiConfig Igi(void) const
+    {
+        IgiConfig c;
+        c.bottleneckMbps = m_header->igiBottleneckMbps;
+        c.trainSize = m_header->igiTrainSize;
+        c.gBNs = m_header->igiGBNs;
+        c.stepNs = m_header->igiStepNs;
+        c.threshold = m_header->igiThreshold;
+        return c;
+    }
+
+    TrendConfig Trend(void) const
+    {
+        TrendConfig c;
+        c.bottleneckMbps = m_header->trendBottleneckMbps;
+        c.trainSize = m_header->trendTrainSize;
+        c.groups = m_header->trendGroups;
+        c.packetSize = m_header->trendPacketSize;
+        c.initialGapNs = m_header->trendInitialGapNs;
+        c.pctThreshold = m_header->trendPctThreshold;
+        c.pdtThreshold = m_header->trendPdtThreshold;
+        c.resolutionMbps = m_header->trendResolutionMbps;
+        c.maxAmbiguous = m_header->trendMaxAmbiguous;
+        return c;
+    }
+
+    const CaptureRecord *Records(void) const { return m_records; }
+    uint64_t RecordCount(void) const { return m_recordCount; }
+    const CaptureTrain *Trains(void) const { return m_trains; }
+    uint64_t TrainCount(void) const { return m_trainCount; }
+
+    // First run of records of a train, or 0
+    const CaptureTrain *FindTrain(uint32_t train) const
+    {
+        if (m_sorted)
+        {
+            uint64_t lo = 0;
+            uint64_t hi = m_trainCount;
+            while (lo < hi)
+            {
+                uint64_t mid = (lo + hi) / 2;
+                if (m_trains[mid].train < train)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            return lo < m_trainCount && m_trains[lo].train == train ? &m_trains[lo] : 0;
+        }
+        for (uint64_t i = 0; i < m_trainCount; i++)
+        {
+            if (m_trains[i].train == train)
+            {
+                return &m_trains[i];
+            }
+        }
+        return 0;
+    }
+
+private:
+    void RebuildIndex(void)
+    {
+        m_sorted = true;
+        for (uint64_t i = 0; i < m_recordCount; i++)
+        {
+            if (m_rebuilt.empty() || m_rebuilt.back().train != m_records[i].train)
+            {
+                if (!m_rebuilt.empty() && m_records[i].train < m_rebuilt.back().train)
+                {
+                    m_sorted = false;
+                }
+                CaptureTrain t;
+                t.train = m_records[i].train;
+                t.count = 0;
+                t.first = i;
+                m_rebuilt.push_back(t);
+            }
+            m_rebuilt.back().count++;
+        }
+        m_trains = m_rebuilt.empty() ? 0 : &m_rebuilt[0];
+        m_trainCount = m_rebuilt.size();
+    }
+
+    const uint8_t *m_base;
+    size_t m_length;
+    const CaptureFileHeader *m_header;
+    const CaptureRecord *m_records;
+    uint64_t m_recordCount;
+    const CaptureTrain *m_trains;
+    uint64_t m_trainCount;
+    bool m_sorted;
+    std::vector<CaptureTrain> m_rebuilt;
+};
+
+// Runs records [first, first + count) through an estimator, the way the receiver did, and
+// appends every estimate to *out. Stops early once the estimator converges if asked to.
+inline void ReplayCapture(const CaptureRecord *records, uint64_t count, Estimator *est,
+    std::vector<Estimate> *out, bool stopOnConvergence)
+{
+    Estimate e;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const CaptureRecord &c = records[i];
+        switch (c.op)
+        {
+        case CAPTURE_PROBE:
+        {
+            ProbeRecord r;
+            r.train = c.train;
+            r.seq = c.seq;
+            r.txNs = c.txNs;
+            r.rxNs = c.rxNs;
+            r.size = c.size;
+            est->Push(r);
+            break;
+        }
+        case CAPTURE_FLUSH:
+            est->Flush();
+            break;
+        case CAPTURE_DISCARD:
+            est->Discard();
+            break;
+        default:
+            est->Reset();
+        }
+        if (est->Poll(&e))
+        {
+            out->push_back(e);
+            if (e.converged && stopOnConvergence)
+            {
+                return;
+            }
+        }
+    }
+}
+
+} // namespace bwest
+
+#endif // BW_CAPTURE_H
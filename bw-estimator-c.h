@@ -0,0 +1,252 @@
+/*
+ * C ABI over bw-estimator.h, for services that cannot link C++ directly.
+ *
+ * Exactly one C++ translation unit must define BWEST_C_IMPLEMENTATION before
+ * including this header to emit the function bodies; everyone else gets the
+ * declarations only.
+ */
+#ifndef BW_ESTIMATOR_C_H
+#define BW_ESTIMATOR_C_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bwest_estimator bwest_estimator;
+
+typedef struct bwest_record
+{
+    uint32_t train;
+    uint32_t seq;
+    int64_t tx_ns;
+    int64_t rx_ns;
+    uint32_t size;
+} bwest_record;
+
+typedef struct bwest_igi_config
+{
+    double bottleneck_mbps;
+    uint32_t train_size;
+    uint32_t gb_ns;
+    uint32_t step_ns;
+    double threshold;
+} bwest_igi_config;
+
+typedef struct bwest_trend_config
+{
+    double bottleneck_mbps;
+    uint32_t train_size;
+    uint32_t groups;
+    uint32_t packet_size;
+    uint32_t initial_gap_ns;
+    double pct_threshold;
+    double pdt_threshold;
+    double resolution_mbps;
+    uint32_t max_ambiguous;
+} bwest_trend_config;
+
+typedef struct bwest_estimate
+{
+    uint32_t kind;
+    uint32_t train;
+    uint32_t trains;
+    uint32_t packets;
+    int converged;
+    double src_gap_sum_us;
+    double dst_gap_sum_us;
+    double equal_norm;
+    double igi_cross_mbps;
+    double igi_avail_mbps;
+    double ptr_mbps;
+    int trend;
+    double pct;
+    double pdt;
+    double avail_low_mbps;
+    double avail_high_mbps;
+    uint32_t next_gap_ns;
+} bwest_estimate;
+
+/* Fill a config with the defaults the ns-3 scenarios use */
+void bwest_igi_config_default(bwest_igi_config *config);
+void bwest_trend_config_default(bwest_trend_config *config);
+
+/* NULL on allocation failure */
+bwest_estimator *bwest_igi_create(const bwest_igi_config *config);
+bwest_estimator *bwest_trend_create(const bwest_trend_config *config);
+void bwest_destroy(bwest_estimator *est);
+
+/* 1 when the record completed a train and an estimate is ready, 0 otherwise */
+int bwest_push(bwest_estimator *est, const bwest_record *record);
+int bwest_flush(bwest_estimator *est);
+void bwest_discard(bwest_estimator *est);
+/* 1 and fills *out when an estimate was pending, 0 otherwise; never blocks */
+int bwest_poll(bwest_estimator *est, bwest_estimate *out);
+uint32_t bwest_next_gap_ns(const bwest_estimator *est);
+int bwest_converged(const bwest_estimator *est);
+void bwest_reset(bwest_estimator *est);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__cplusplus) && defined(BWEST_C_IMPLEMENTATION)
+
+#include <new>
+#include "bw-estimator.h"
+
+struct bwest_estimator
+{
+    bwest::Estimator *impl;
+};
+
+extern "C" {
+
+void bwest_igi_config_default(bwest_igi_config *config)
+{
+    bwest::IgiConfig d;
+    config->bottleneck_mbps = d.bottleneckMbps;
+    config->train_size = d.trainSize;
+    config->gb_ns = d.gBNs;
+    config->step_ns = d.stepNs;
+    config->threshold = d.threshold;
+}
+
+void bwest_trend_config_default(bwest_trend_config *config)
+{
+    bwest::TrendConfig d;
+    config->bottleneck_mbps = d.bottleneckMbps;
+    config->train_size = d.trainSize;
+    config->groups = d.groups;
+    config->packet_size = d.packetSize;
+    config->initial_gap_ns = d.initialGapNs;
+    config->pct_threshold = d.pctThreshold;
+    config->pdt_threshold = d.pdtThreshold;
+    config->resolution_mbps = d.resolutionMbps;
+    config->max_ambiguous = d.maxAmbiguous;
+}
+
+static bwest_estimator *bwest_wrap(bwest::Estimator *impl)
+{
+    if (!impl)
+    {
+        return 0;
+    }
+    bwest_estimator *est = new (std::nothrow) bwest_estimator;
+    if (!est)
+    {
+        delete impl;
+        return 0;
+    }
+    est->impl = impl;
+    return est;
+}
+
+bwest_estimator *bwest_igi_create(const bwest_igi_config *config)
+{
+    bwest::IgiConfig c;
+    c.bottleneckMbps = config->bottleneck_mbps;
+    c.trainSize = config->train_size;
+    c.gBNs = config->gb_ns;
+    c.stepNs = config->step_ns;
+    c.threshold = config->threshold;
+    return bwest_wrap(new (std::nothrow) bwest::IgiEstimator(c));
+}
+
+bwest_estimator *bwest_trend_create(const bwest_trend_config *config)
+{
+    bwest::TrendConfig c;
+    c.bottleneckMbps = config->bottleneck_mbps;
+    c.trainSize = config->train_size;
+    c.groups = config->groups;
+    c.packetSize = config->packet_size;
+    c.initialGapNs = config->initial_gap_ns;
+    c.pctThreshold = config->pct_threshold;
+    c.pdtThreshold = config->pdt_threshold;
+    c.resolutionMbps = config->resolution_mbps;
+    c.maxAmbiguous = config->max_ambiguous;
+    if (c.trainSize == 0 || c.groups == 0 || c.groups > c.trainSize || c.initialGapNs == 0)
+    {
+        return 0;
+    }
+    return bwest_wrap(new (std::nothrow) bwest::TrendEstimator(c));
+}
+
+void bwest_destroy(bwest_estimator *est)
+{
+    if (est)
+    {
+        delete est->impl;
+        delete est;
+    }
+}
+
+int bwest_push(bwest_estimator *est, const bwest_record *record)
+{
+    bwest::ProbeRecord r;
+    r.train = record->train;
+    r.seq = record->seq;
+    r.txNs = record->tx_ns;
+    r.rxNs = record->rx_ns;
+    r.size = record->size;
+    return est->impl->Push(r) ? 1 : 0;
+}
+
+int bwest_flush(bwest_estimator *est)
+{
+    return est->impl->Flush() ? 1 : 0;
+}
+
+void bwest_discard(bwest_estimator *est)
+{
+    est->impl->Discard();
+}
+
+int bwest_poll(bwest_estimator *est, bwest_estimate *out)
+{
+    bwest::Estimate e;
+    if (!est->impl->Poll(&e))
+    {
+        return 0;
+    }
+    out->kind = e.kind;
+    out->train = e.train;
+    out->trains = e.trains;
+    out->packets = e.packets;
+    out->converged = e.converged;
+    out->src_gap_sum_us = e.srcGapSumUs;
+    out->dst_gap_sum_us = e.dstGapSumUs;
+    out->equal_norm = e.equalNorm;
+    out->igi_cross_mbps = e.igiCrossMbps;
+    out->igi_avail_mbps = e.igiAvailMbps;
+    out->ptr_mbps = e.ptrMbps;
+    out->trend = e.trend;
+    out->pct = e.pct;
+    out->pdt = e.pdt;
+    out->avail_low_mbps = e.availLowMbps;
+    out->avail_high_mbps = e.availHighMbps;
+    out->next_gap_ns = e.nextGapNs;
+    return 1;
+}
+
+uint32_t bwest_next_gap_ns(const bwest_estimator *est)
+{
+    return est->impl->NextGapNs();
+}
+
+int bwest_converged(const bwest_estimator *est)
+{
+    return est->impl->Converged() ? 1 : 0;
+}
+
+void bwest_reset(bwest_estimator *est)
+{
+    est->impl->Reset();
+}
+
+} // extern "C"
+
+#endif /* BWEST_C_IMPLEMENTATION */
+
+#endif /* BW_ESTIMATOR_C_H */
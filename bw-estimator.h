@@ -0,0 +1,564 @@
+// Bandwidth estimation core shared by the ns-3 scenarios and the native prober.
+//
+// Nothing in here depends on ns-3: estimators are fed (train, seq, tx_ns, rx_ns, size)
+// records and hand back estimates through a non-blocking Push/Poll interface.
+// All buffers are sized when an estimator is constructed, so the per-packet path
+// (Push) never allocates. A thin C ABI lives in bw-estimator-c.h.
+#ifndef BW_ESTIMATOR_H
+#define BW_ESTIMATOR_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+namespace bwest {
+
+//================================================================
+// PROBE FORMAT
+//================================================================
+
+// Header written at the start of every UDP probe payload, network byte order.
+// The rest of the payload is padding up to the probe packet size.
+struct ProbeHeader
+{
+    uint32_t train;     // train (stream) number, starts at 0
+    uint32_t seq;       // packet index within the train
+    uint32_t trainSize; // packets in this train
+    uint32_t gapNs;     // source gap the sender aimed for
+    int64_t txNs;       // sender timestamp
+};
+
+enum
+{
+    PROBE_MAGIC = 0x42575052, // "BWPR"
+    PROBE_HEADER_SIZE = 32
+};
+
+inline void Write32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);  p[3] = (uint8_t)v;
+}
+
+inline uint32_t Read32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline void Write64(uint8_t *p, uint64_t v)
+{
+    Write32(p, (uint32_t)(v >> 32));
+    Write32(p + 4, (uint32_t)v);
+}
+
+inline uint64_t Read64(const uint8_t *p)
+{
+    return ((uint64_t)Read32(p) << 32) | (uint64_t)Read32(p + 4);
+}
+
+inline void WriteProbeHeader(uint8_t *buf, const ProbeHeader &h)
+{
+    Write32(buf, PROBE_MAGIC);
+    Write32(buf + 4, h.train);
+    Write32(buf + 8, h.seq);
+    Write32(buf + 12, h.trainSize);
+    Write32(buf + 16, h.gapNs);
+    Write32(buf + 20, 0);
+    Write64(buf + 24, (uint64_t)h.txNs);
+}
+
+// Returns false if the buffer is too short or is not a probe
+inline bool ReadProbeHeader(const uint8_t *buf, uint32_t len, ProbeHeader *h)
+{
+    if (len < PROBE_HEADER_SIZE || Read32(buf) != PROBE_MAGIC)
+    {
+        return false;
+    }
+    h->train = Read32(buf + 4);
+    h->seq = Read32(buf + 8);
+    h->trainSize = Read32(buf + 12);
+    h->gapNs = Read32(buf + 16);
+    h->txNs = (int64_t)Read64(buf + 24);
+    return true;
+}
+
+//================================================================
+// RECORDS AND ESTIMATES
+//================================================================
+
+// One received probe
+struct ProbeRecord
+{
+    uint32_t train;
+    uint32_t seq;
+    int64_t txNs;
+    int64_t rxNs;
+    uint32_t size;
+};
+
+enum EstimatorKind
+{
+    ESTIMATOR_IGI = 1,
+    ESTIMATOR_TREND = 2
+};
+
+enum Trend
+{
+    TREND_NONE = 0,
+    TREND_INCREASING = 1,
+    TREND_NON_INCREASING = 2,
+    TREND_AMBIGUOUS = 3
+};
+
+// Result of one complete train. Fields that do not apply to the estimator are zero.
+struct Estimate
+{
+    uint32_t kind;          // EstimatorKind
+    uint32_t train;         // train that produced this estimate
+    uint32_t trains;        // trains consumed so far
+    uint32_t packets;       // packets of the train that arrived
+    int converged;          // search finished, the estimate is final
+
+    // IGI / PTR
+    double srcGapSumUs;
+    double dstGapSumUs;
+    double equalNorm;       // (dst - src) / dst
+    double igiCrossMbps;
+    double igiAvailMbps;
+    double ptrMbps;
+
+    // SLoPS trend test
+    int trend;              // Trend
+    double pct;
+    double pdt;
+    double availLowMbps;
+    double availHighMbps;
+
+    uint32_t nextGapNs;     // gap the sender should use for the next train
+};
+
+// Common interface so both estimators can sit behind the C ABI and the native tools
+class Estimator
+{
+public:
+    virtual ~Estimator() {}
+
+    // Feed one record. Returns true when it completed a train and an estimate is ready.
+    virtual bool Push(const ProbeRecord &r) = 0;
+    // Close the current train early (timeout, loss). Returns true if an estimate is ready.
+    virtual bool Flush(void) = 0;
+    // Drop the current train without an estimate, e.g. when the sender could not pace it.
+    virtual void Discard(void) = 0;
+    // Copy out the pending estimate, if any. Never blocks.
+    virtual bool Poll(Estimate *out) = 0;
+    virtual uint32_t NextGapNs(void) const = 0;
+    virtual bool Converged(void) const = 0;
+    virtual void Reset(void) = 0;
+};
+
+//================================================================
+// IGI / PTR
+//================================================================
+
+struct IgiConfig
+{
+    double bottleneckMbps;  // capacity of the tight link
+    uint32_t trainSize;     // packets per train
+    uint32_t gBNs;          // bottleneck gap gB; the search starts at gB/2
+    uint32_t stepNs;        // gap increase per train, gB/8
+    double threshold;       // converged once (dst - src) / dst drops below this
+
+    IgiConfig() :
+        bottleneckMbps(10.0), trainSize(60), gBNs(600000), stepNs(600000 / 8), threshold(0.2)
+    {
+    }
+};
+
+// Initial gap search of IGI: send trains with an increasing source gap until the
+// destination gap sum no longer exceeds the source gap sum by more than the threshold.
+// Then IGI gives the competing traffic from the gap increase and PTR gives the
+// available bandwidth from the train's arrival rate.
+class IgiEstimator : public Estimator
+{
+public:
+    explicit IgiEstimator(const IgiConfig &config) :
+        m_config(config)
+    {
+        Reset();
+    }
+
+    const IgiConfig &Config(void) const { return m_config; }
+
+    virtual void Reset(void)
+    {
+        m_gapNs = m_config.gBNs / 2;
+        m_trains = 0;
+        m_converged = false;
+        m_ready = false;
+        m_open = false;
+        m_train = 0;
+        m_count = 0;
+        m_bytes = 0;
+        memset(&m_first, 0, sizeof(m_first));
+        memset(&m_last, 0, sizeof(m_last));
+        memset(&m_estimate, 0, sizeof(m_estimate));
+    }
+
+    virtual bool Push(const ProbeRecord &r)
+    {
+        bool done = false;
+        if (m_open && r.train != m_train)
+        {
+            done = Finish();
+        }
+        if (!m_open)
+        {
+            m_open = true;
+            m_train = r.train;
+            m_count = 0;
+            m_bytes = 0;
+            m_first = r;
+        }
+        if (m_count > 0)
+        {
+            m_bytes += r.size;
+        }
+        m_count++;
+        m_last = r;
+
+        if (r.seq + 1 >= m_config.trainSize)
+        {
+            done = Finish() || done;
+        }
+        return done;
+    }
+
+    virtual bool Flush(void)
+    {
+        return m_open && Finish();
+    }
+
+    virtual void Discard(void)
+    {
+        m_open = false;
+    }
+
+    virtual bool Poll(Estimate *out)
+    {
+        if (!m_ready)
+        {
+            return false;
+        }
+        *out = m_estimate;
+        m_ready = false;
+        return true;
+    }
+
+    virtual uint32_t NextGapNs(void) const { return m_gapNs; }
+    virtual bool Converged(void) const { return m_converged; }
+
+private:
+    bool Finish(void)
+    {
+        m_open = false;
+        if (m_count < 2 || m_last.seq <= m_first.seq)
+        {
+            return false;
+        }
+        m_trains++;
+
+        // Gap sums over the packets that made it, so a lost packet does not skew the ratio
+        int64_t src = m_last.txNs - m_first.txNs;
+        int64_t dst = m_last.rxNs - m_first.rxNs;
+        int64_t inc = dst - src;
+
+        Estimate &e = m_estimate;
+        memset(&e, 0, sizeof(e));
+        e.kind = ESTIMATOR_IGI;
+        e.train = m_train;
+        e.trains = m_trains;
+        e.packets = m_count;
+        e.srcGapSumUs = src / 1000.0;
+        e.dstGapSumUs = dst / 1000.0;
+        e.equalNorm = dst > 0 ? (double)inc / (double)dst : 1.0;
+
+        // A negative increase means the train was not stretched at all, which the
+        // scenarios never treat as convergence; keep that behaviour.
+        if (dst > 0 && inc >= 0 && e.equalNorm < m_config.threshold)
+        {
+            e.igiCrossMbps = m_config.bottleneckMbps * e.equalNorm;
+            e.igiAvailMbps = m_config.bottleneckMbps - e.igiCrossMbps;
+            e.ptrMbps = (double)m_bytes * 8 / e.dstGapSumUs;
+            e.converged = 1;
+            m_converged = true;
+        }
+        else
+        {
+            m_gapNs += m_config.stepNs;
+        }
+        e.nextGapNs = m_gapNs;
+        m_ready = true;
+        return true;
+    }
+
+    IgiConfig m_config;
+    uint32_t m_gapNs;
+    uint32_t m_trains;
+    bool m_converged;
+
+    bool m_open;
+    uint32_t m_train;
+    uint32_t m_count;
+    uint64_t m_bytes;
+    ProbeRecord m_first;
+    ProbeRecord m_last;
+
+    bool m_ready;
+    Estimate m_estimate;
+};
+
+//================================================================
+// SLoPS TREND TEST
+//================================================================
+
+struct TrendConfig
+{
+    double bottleneckMbps;  // upper bound of the rate search
+    uint32_t trainSize;     // packets per stream
+    uint32_t groups;        // one-way delays are reduced to one median per group, 2..trainSize
+    uint32_t packetSize;    // bytes, to turn a gap into a stream rate
+    uint32_t initialGapNs;
+    double pctThreshold;    // pairwise comparison test
+    double pdtThreshold;    // pairwise difference test
+    double resolutionMbps;  // stop once the rate bracket is this narrow
+    uint32_t maxAmbiguous;  // or after this many ambiguous streams in a row (grey region)
+
+    TrendConfig() :
+        bottleneckMbps(100.0), trainSize(100), groups(10), packetSize(800), initialGapNs(100000),
+        pctThreshold(0.55), pdtThreshold(0.4), resolutionMbps(1.0), maxAmbiguous(3)
+    {
+    }
+};
+
+// Self-loading periodic streams: decide whether the one-way delays of a stream show an
+// increasing trend (stream rate above the available bandwidth) and bisect the rate.
+class TrendEstimator : public Estimator
+{
+public:
+    explicit TrendEstimator(const TrendConfig &config) :
+        m_config(Clamped(config)), m_owd(m_config.trainSize), m_received(m_config.trainSize),
+        m_medians(m_config.groups), m_scratch(m_config.trainSize)
+    {
+        Reset();
+    }
+
+    // The trend tests need two groups of at least one packet each; a config outside that
+    // is pulled into it (the C ABI rejects it instead)
+    static TrendConfig Clamped(const TrendConfig &config)
+    {
+        TrendConfig c = config;
+        c.trainSize = std::max<uint32_t>(c.trainSize, 2);
+        c.groups = std::min(std::max<uint32_t>(c.groups, 2), c.trainSize);
+        return c;
+    }
+
+    const TrendConfig &Config(void) const { return m_config; }
+
+    virtual void Reset(void)
+    {
+        m_gapNs = m_config.initialGapNs;
+        m_low = 0.0;
+        m_high = m_config.bottleneckMbps;
+        m_ambiguous = 0;
+        m_trains = 0;
+        m_converged = false;
+        m_ready = false;
+        m_open = false;
+        memset(&m_estimate, 0, sizeof(m_estimate));
+    }
+
+    virtual bool Push(const ProbeRecord &r)
+    {
+        bool done = false;
+        if (m_open && r.train != m_train)
+        {
+            done = Finish();
+        }
+        if (!m_open)
+        {
+            m_open = true;
+            m_train = r.train;
+            m_count = 0;
+            std::fill(m_received.begin(), m_received.end(), 0);
+        }
+        if (r.seq < m_config.trainSize && !m_received[r.seq])
+        {
+            m_owd[r.seq] = r.rxNs - r.txNs;
+            m_received[r.seq] = 1;
+            m_count++;
+        }
+        if (r.seq + 1 >= m_config.trainSize)
+        {
+            done = Finish() || done;
+        }
+        return done;
+    }
+
+    virtual bool Flush(void)
+    {
+        return m_open && Finish();
+    }
+
+    virtual void Discard(void)
+    {
+        m_open = false;
+    }
+
+    virtual bool Poll(Estimate *out)
+    {
+        if (!m_ready)
+        {
+            return false;
+        }
+        *out = m_estimate;
+        m_ready = false;
+        return true;
+    }
+
+    virtual uint32_t NextGapNs(void) const { return m_gapNs; }
+    virtual bool Converged(void) const { return m_converged; }
+
+private:
+    bool Finish(void)
+    {
+        m_open = false;
+
+        // Median one-way delay of each group of consecutive packets
+        uint32_t perGroup = m_config.trainSize / m_config.groups;
+        uint32_t groups = 0;
+        for (uint32_t g = 0; g < m_config.groups && perGroup > 0; g++)
+        {
+            uint32_t n = 0;
+            for (uint32_t i = g * perGroup; i < (g + 1) * perGroup; i++)
+            {
+                if (m_received[i])
+                {
+                    m_scratch[n++] = m_owd[i];
+                }
+            }
+            if (n == 0)
+            {
+                continue;
+            }
+            std::nth_element(m_scratch.begin(), m_scratch.begin() + n / 2, m_scratch.begin() + n);
+            m_medians[groups++] = m_scratch[n / 2];
+        }
+        if (groups < 2)
+        {
+            return false;
+        }
+        m_trains++;
+
+        uint32_t increases = 0;
+        double absSum = 0;
+        for (uint32_t k = 1; k < groups; k++)
+        {
+            if (m_medians[k] > m_medians[k - 1])
+            {
+                increases++;
+            }
+            absSum += m_medians[k] > m_medians[k - 1] ? m_medians[k] - m_medians[k - 1] : m_medians[k - 1] - m_medians[k];
+        }
+
+        Estimate &e = m_estimate;
+        memset(&e, 0, sizeof(e));
+        e.kind = ESTIMATOR_TREND;
+        e.train = m_train;
+        e.trains = m_trains;
+        e.packets = m_count;
+        e.pct = (double)increases / (groups - 1);
+        e.pdt = absSum > 0 ? (double)(m_medians[groups - 1] - m_medians[0]) / absSum : 0.0;
+
+        bool pctUp = e.pct > m_config.pctThreshold;
+        bool pdtUp = e.pdt > m_config.pdtThreshold;
+        if (pctUp && pdtUp)
+        {
+            e.trend = TREND_INCREASING;
+        }
+        else if (!pctUp && !pdtUp)
+        {
+            e.trend = TREND_NON_INCREASING;
+        }
+        else
+        {
+            e.trend = TREND_AMBIGUOUS;
+        }
+
+        // Bisect the stream rate. An ambiguous stream leaves the bracket alone and is
+        // retried; a run of them means the rate sits in the grey region of the path.
+        double rate = StreamRateMbps(m_gapNs);
+        if (e.trend == TREND_INCREASING)
+        {
+            m_high = std::min(m_high, rate);
+            m_ambiguous = 0;
+        }
+        else if (e.trend == TREND_NON_INCREASING)
+        {
+            m_low = std::max(m_low, rate);
+            m_ambiguous = 0;
+        }
+        else
+        {
+            m_ambiguous++;
+        }
+        if (m_high - m_low < m_config.resolutionMbps || m_ambiguous >= m_config.maxAmbiguous)
+        {
+            m_converged = true;
+            e.converged = 1;
+        }
+        else if (e.trend != TREND_AMBIGUOUS)
+        {
+            m_gapNs = GapNsForRate((m_low + m_high) / 2);
+        }
+        e.availLowMbps = m_low;
+        e.availHighMbps = m_high;
+        e.nextGapNs = m_gapNs;
+        m_ready = true;
+        return true;
+    }
+
+    double StreamRateMbps(uint32_t gapNs) const
+    {
+        return (double)m_config.packetSize * 8 * 1000 / gapNs;
+    }
+
+    uint32_t GapNsForRate(double mbps) const
+    {
+        return (uint32_t)((double)m_config.packetSize * 8 * 1000 / mbps);
+    }
+
+    TrendConfig m_config;
+    std::vector<int64_t> m_owd;
+    std::vector<uint8_t> m_received;
+    std::vector<int64_t> m_medians;
+    std::vector<int64_t> m_scratch;
+
+    uint32_t m_gapNs;
+    double m_low;
+    double m_high;
+    uint32_t m_ambiguous;
+    uint32_t m_trains;
+    bool m_converged;
+
+    bool m_open;
+    uint32_t m_train;
+    uint32_t m_count;
+
+    bool m_ready;
+    Estimate m_estimate;
+};
+
+} // namespace bwest
+
+#endif // BW_ESTIMATOR_H
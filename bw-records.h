@@ -0,0 +1,364 @@
+// Probe record logs: what an estimator was fed and what it handed back, in one text format
+// written by the ns-3 clients and by bwprobe alike. Replaying either side's log through
+// the other side's code path and comparing the estimates is how the native prober is kept
+// honest against the simulation (see parity.sh).
+//
+//   # bwrecords 1
+//   C igi <bottleneck_mbps> <train_size> <gb_ns> <step_ns> <threshold>
+//   C slops <bottleneck_mbps> <train_size> <groups> <packet_size> <initial_gap_ns> <pct> <pdt>
+//           <resolution_mbps> <max_ambiguous>
+//   R <train> <seq> <tx_ns> <rx_ns> <size>      Push
+//   F <train>                                   Flush (train closed on a timeout)
+//   D <train>                                   Discard (sender pacing, capture overflow)
+//   X <train>                                   Reset (search restarted after convergence)
+//   E <kind> <train> <trains> <packets> <converged> <src_us> <dst_us> <norm> <igi_cross>
+//     <igi_avail> <ptr> <trend> <pct> <pdt> <low> <high> <next_gap_ns>
+//
+// The same writer can also (or instead) produce a binary capture of the inputs only,
+// see bw-capture.h; that is the format to use for offline tuning.
+#ifndef BW_RECORDS_H
+#define BW_RECORDS_H
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "bw-estimator.h"
+#include "bw-capture.h"
+
+namespace bwest {
+
+struct RecordEntry
+{
+    char op;            // 'R', 'F', 'D' or 'X'
+    ProbeRecord record; // train only for F, D and X
+};
+
+struct RecordLog
+{
+    EstimatorKind kind;
+    IgiConfig igi;
+    TrendConfig trend;
+    std::vector<RecordEntry> entries;
+    std::vector<Estimate> estimates;
+
+    RecordLog() :
+        kind(ESTIMATOR_IGI)
+    {
+    }
+};
+
+class RecordWriter
+{
+public:
+    RecordWriter() :
+        m_file(0)
+    {
+    }
+
+    ~RecordWriter()
+    {
+        Close();
+    }
+
+    bool Open(const std::string &path)
+    {
+        Close();
+        m_file = fopen(path.c_str(), "w");
+        if (m_file)
+        {
+            fprintf(m_file, "# bwrecords 1\n");
+        }
+        return m_file != 0;
+    }
+
+    bool OpenCapture(const std::string &path)
+    {
+        return m_capture.Open(path);
+    }
+
+    void Close(void)
+    {
+        if (m_file)
+        {
+            fclose(m_file);
+            m_file = 0;
+        }
+        m_capture.Close();
+    }
+
+    bool IsOpen(void) const { return m_file != 0 || m_capture.IsOpen(); }
+
+    void Config(const IgiConfig &c)
+    {
+        m_capture.Config(c);
+        if (m_file)
+        {
+            fprintf(m_file, "C igi %.17g %u %u %u %.17g\n", c.bottleneckMbps, c.trainSize, c.gBNs, c.stepNs,
+                c.threshold);
+        }
+    }
+
+    void Config(const TrendConfig &c)
+    {
+        m_capture.Config(c);
+        if (m_file)
+        {
+            fprintf(m_file, "C slops %.17g %u %u %u %u %.17g %.17g %.17g %u\n", c.bottleneckMbps, c.trainSize,
+                c.groups, c.packetSize, c.initialGapNs, c.pctThreshold, c.pdtThreshold, c.resolutionMbps,
+                c.maxAmbiguous);
+        }
+    }
+
+    void Record(const ProbeRecord &r)
+    {
+        m_capture.Record(r);
+        if (m_file)
+        {
+            fprintf(m_file, "R %u %u %lld %lld %u\n", r.train, r.seq, (long long)r.txNs, (long long)r.rxNs, r.size);
+        }
+    }
+
+    void Flush(uint32_t train)
+    {
+        m_capture.Flush(train);
+        if (m_file)
+        {
+            fprintf(m_file, "F %u\n", train);
+        }
+    }
+
+    void Discard(uint32_t train)
+    {
+        m_capture.Discard(train);
+        if (m_file)
+        {
+            fprintf(m_file, "D %u\n", train);
+        }
+    }
+
+    void Reset(uint32_t train)
+    {
+        m_capture.Reset(train);
+        if (m_file)
+        {
+            fprintf(m_file, "X %u\n", train);
+        }
+    }
+
+    void Result(const Estimate &e)
+    {
+        if (m_file)
+        {
+            fprintf(m_file, "E %u %u %u %u %d %.17g %.17g %.17g %.17g %.17g %.17g %d %.17g %.17g %.17g %.17g %u\n",
+                e.kind, e.train, e.trains, e.packets, e.converged, e.srcGapSumUs, e.dstGapSumUs, e.equalNorm,
+                e.igiCrossMbps, e.igiAvailMbps, e.ptrMbps, e.trend, e.pct, e.pdt, e.availLowMbps, e.availHighMbps,
+                e.nextGapNs);
+            fflush(m_file); // a killed run still leaves a log that ends on a whole estimate
+        }
+    }
+
+private:
+    FILE *m_file;
+    CaptureWriter m_capture;
+};
+
+// Returns false with a reason in *error on a malformed or unreadable log
+inline bool ReadRecordLog(const std::string &path, RecordLog *log, std::string *error)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+    {
+        *error = "cannot open " + path;
+        return false;
+    }
+    char line[512];
+    uint32_t lineNo = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f))
+    {
+        lineNo++;
+        if (!strchr(line, '\n'))
+        {
+            break; // cut off by a killed writer
+        }
+        char method[16];
+        RecordEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        long long tx, rx;
+        switch (line[0])
+        {
+        case '#':
+        case '\n':
+            break;
+        case 'C':
+            ok = sscanf(line, "C %15s", method) == 1;
+            if (ok && strcmp(method, "igi") == 0)
+            {
+                IgiConfig &c = log->igi;
+                log->kind = ESTIMATOR_IGI;
+                ok = sscanf(line, "C igi %lf %u %u %u %lf", &c.bottleneckMbps, &c.trainSize, &c.gBNs, &c.stepNs,
+                    &c.threshold) == 5;
+            }
+            else if (ok && strcmp(method, "slops") == 0)
+            {
+                TrendConfig &c = log->trend;
+                log->kind = ESTIMATOR_TREND;
+                ok = sscanf(line, "C slops %lf %u %u %u %u %lf %lf %lf %u", &c.bottleneckMbps, &c.trainSize,
+                    &c.groups, &c.packetSize, &c.initialGapNs, &c.pctThreshold, &c.pdtThreshold, &c.resolutionMbps,
+                    &c.maxAmbiguous) == 9;
+            }
+            else
+            {
+                ok = false;
+            }
+            break;
+        case 'R':
+            entry.op = 'R';
+            ok = sscanf(line, "R %u %u %lld %lld %u", &entry.record.train, &entry.record.seq, &tx, &rx,
+                &entry.record.size) == 5;
+            entry.record.txNs = tx;
+            entry.record.rxNs = rx;
+            log->entries.push_back(entry);
+            break;
+        case 'F':
+        case 'D':
+        case 'X':
+            entry.op = line[0];
+            ok = sscanf(line + 1, " %u", &entry.record.train) == 1;
+            log->entries.push_back(entry);
+            break;
+        case 'E':
+        {
+            Estimate e;
+            memset(&e, 0, sizeof(e));
+            ok = sscanf(line, "E %u %u %u %u %d %lf %lf %lf %lf %lf %lf %d %lf %lf %lf %lf %u", &e.kind, &e.train,
+                &e.trains, &e.packets, &e.converged, &e.srcGapSumUs, &e.dstGapSumUs, &e.equalNorm, &e.igiCrossMbps,
+                &e.igiAvailMbps, &e.ptrMbps, &e.trend, &e.pct, &e.pdt, &e.availLowMbps, &e.availHighMbps,
+                &e.nextGapNs) == 17;
+            log->estimates.push_back(e);
+            break;
+        }
+        default:
+            ok = false;
+        }
+    }
+    fclose(f);
+    if (!ok)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s:%u: malformed line", path.c_str(), lineNo);
+        *error = buf;
+    }
+    return ok;
+}
+
+// Feeds a log's inputs through a fresh estimator with the log's configuration and returns
+// every estimate it produces, in order.
+inline std::vector<Estimate> ReplayRecordLog(const RecordLog &log)
+{
+    IgiEstimator igi(log.igi);
+    TrendEstimator trend(log.trend);
+    Estimator *est = log.kind == ESTIMATOR_TREND ? (Estimator *)&trend : (Estimator *)&igi;
+
+    std::vector<Estimate> out;
+    Estimate e;
+    for (size_t i = 0; i < log.entries.size(); i++)
+    {
+        const RecordEntry &entry = log.entries[i];
+        if (entry.op == 'R')
+        {
+            est->Push(entry.record);
+        }
+        else if (entry.op == 'F')
+        {
+            est->Flush();
+        }
+        else if (entry.op == 'D')
+        {
+            est->Discard();
+        }
+        else
+        {
+            est->Reset();
+        }
+        if (est->Poll(&e))
+        {
+            out.push_back(e);
+        }
+    }
+    return out;
+}
+
+struct ParityTolerance
+{
+    double mbps;    // rates
+    double us;      // gap sums
+    double ratio;   // norm, PCT, PDT
+
+    ParityTolerance() :
+        mbps(0.001), us(0.01), ratio(1e-6)
+    {
+    }
+};
+
+// True if both runs produced the same estimates in the same order. *why names the first
+// difference otherwise.
+inline bool CompareEstimates(const std::vector<Estimate> &a, const std::vector<Estimate> &b,
+    const ParityTolerance &tol, std::string *why)
+{
+    char buf[160];
+    if (a.size() != b.size())
+    {
+        snprintf(buf, sizeof(buf), "%zu estimates vs %zu", a.size(), b.size());
+        *why = buf;
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        const Estimate &x = a[i];
+        const Estimate &y = b[i];
+        struct Field
+        {
+            const char *name;
+            double a;
+            double b;
+            double tol;
+        } fields[] = {
+            { "kind", (double)x.kind, (double)y.kind, 0 },
+            { "train", (double)x.train, (double)y.train, 0 },
+            { "trains", (double)x.trains, (double)y.trains, 0 },
+            { "packets", (double)x.packets, (double)y.packets, 0 },
+            { "converged", (double)x.converged, (double)y.converged, 0 },
+            { "src_us", x.srcGapSumUs, y.srcGapSumUs, tol.us },
+            { "dst_us", x.dstGapSumUs, y.dstGapSumUs, tol.us },
+            { "norm", x.equalNorm, y.equalNorm, tol.ratio },
+            { "igi_cross", x.igiCrossMbps, y.igiCrossMbps, tol.mbps },
+            { "igi_avail", x.igiAvailMbps, y.igiAvailMbps, tol.mbps },
+            { "ptr", x.ptrMbps, y.ptrMbps, tol.mbps },
+            { "trend", (double)x.trend, (double)y.trend, 0 },
+            { "pct", x.pct, y.pct, tol.ratio },
+            { "pdt", x.pdt, y.pdt, tol.ratio },
+            { "low", x.availLowMbps, y.availLowMbps, tol.mbps },
+            { "high", x.availHighMbps, y.availHighMbps, tol.mbps },
+            { "next_gap_ns", (double)x.nextGapNs, (double)y.nextGapNs, 0 }
+        };
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+        {
+            if (fabs(fields[f].a - fields[f].b) > fields[f].tol)
+            {
+                snprintf(buf, sizeof(buf), "estimate %zu (train %u): %s %.9g vs %.9g", i, x.train, fields[f].name,
+                    fields[f].a, fields[f].b);
+                *why = buf;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace bwest
+
+#endif // BW_RECORDS_H
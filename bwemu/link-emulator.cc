@@ -0,0 +1,369 @@
+#include "link-emulator.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "../bwprobe/probe-common.h"
+
+namespace bwemu {
+
+using bwprobe::MonotonicNs;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void OnSignal(int)
+{
+    g_stop = 1;
+}
+
+// Wake up this long before an event and spin the rest, like the prober's pacer
+static const int64_t SPIN_NS = 50000;
+
+bool ParseCrossTraffic(const std::string &text, std::vector<CrossTrafficConfig> *out)
+{
+    std::string::size_type pos = 0;
+    while (pos < text.size())
+    {
+        std::string::size_type end = text.find(';', pos);
+        std::string item = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? text.size() : end + 1;
+        if (item.empty())
+        {
+            continue;
+        }
+
+        double v[6] = { 0, 512, 0, 0, 0, 0 };
+        int n = sscanf(item.c_str(), "%lf,%lf,%lf,%lf,%lf,%lf", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]);
+        if (n < 2 || v[0] <= 0 || v[1] < 1 || v[1] > 65507)
+        {
+            return false;
+        }
+        CrossTrafficConfig c;
+        c.rateMbps = v[0];
+        c.packetSize = (uint32_t)v[1];
+        c.onS = v[2];
+        c.offS = v[3];
+        c.startS = v[4];
+        c.stopS = v[5];
+        out->push_back(c);
+    }
+    return true;
+}
+
+LinkEmulator::LinkEmulator(const EmulatorConfig &config) :
+    m_config(config), m_fd(-1), m_haveClient(false),
+    m_data((size_t)config.slots * MAX_PACKET), m_slots(config.slots), m_queue(config.queuePackets),
+    m_queueHead(0), m_queueCount(0), m_busy(false), m_timers(config.slots + config.cross.size() + 16),
+    m_startNs(0), m_realtimeOffsetNs(0), m_forwarded(0), m_dropped(0), m_crossSent(0), m_crossDropped(0), m_reverse(0), m_maxQueue(0)
+{
+    memset(&m_forward, 0, sizeof(m_forward));
+    memset(&m_client, 0, sizeof(m_client));
+    m_free.reserve(config.slots);
+    for (uint32_t i = config.slots; i > 0; i--)
+    {
+        m_free.push_back(i - 1);
+    }
+}
+
+LinkEmulator::~LinkEmulator()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+int64_t LinkEmulator::WireTimeNs(uint32_t bytes) const
+{
+    return (int64_t)((double)(bytes + m_config.overheadBytes) * 8 * 1000 / m_config.rateMbps);
+}
+
+int LinkEmulator::Run(void)
+{
+    if (!bwprobe::ParseEndpoint(m_config.forwardTo, 8090, &m_forward))
+    {
+        fprintf(stderr, "bwemu: cannot resolve %s\n", m_config.forwardTo.c_str());
+        return 1;
+    }
+    m_fd = bwprobe::CreateUdpSocket(m_config.listenPort);
+    if (m_fd < 0)
+    {
+        perror("bwemu: bind");
+        return 1;
+    }
+    // Queue packets at the time the kernel saw them, not when this loop got around to reading
+    // them, so a late wakeup shifts the forwarding but not the link model
+    int on = 1;
+    setsockopt(m_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    m_realtimeOffsetNs = bwprobe::RealtimeNs() - MonotonicNs();
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    printf("LinkEmulator :: UDP %u -> %s :: %.3f Mbps, %u us, DropTail %u packets, %zu cross sources\n",
+        m_config.listenPort, bwprobe::FormatAddress(m_forward).c_str(), m_config.rateMbps, m_config.delayUs,
+        m_config.queuePackets, m_config.cross.size());
+    fflush(stdout);
+
+    m_startNs = MonotonicNs();
+    for (uint32_t i = 0; i < m_config.cross.size(); i++)
+    {
+        CrossSource s;
+        s.config = m_config.cross[i];
+        s.intervalNs = (int64_t)((double)s.config.packetSize * 8 * 1000 / s.config.rateMbps);
+        int64_t start = m_startNs + (int64_t)(s.config.startS * 1e9);
+        s.onEndNs = s.config.onS > 0 ? start + (int64_t)(s.config.onS * 1e9) : INT64_MAX;
+        s.stopNs = s.config.stopS > 0 ? m_startNs + (int64_t)(s.config.stopS * 1e9) : INT64_MAX;
+        m_sources.push_back(s);
+        ScheduleCross(i, start);
+    }
+    int64_t endNs = m_config.durationS > 0 ? m_startNs + (int64_t)(m_config.durationS * 1e9) : INT64_MAX;
+
+    while (!g_stop)
+    {
+        int64_t now = MonotonicNs();
+        if (now >= endNs)
+        {
+            break;
+        }
+        ReceivePackets(now);
+        while (!m_timers.Empty() && m_timers.Top().when <= now)
+        {
+            TimerHeap<Event>::Entry e = m_timers.Pop();
+            HandleEvent(e.event, e.when);
+        }
+
+        int64_t next = m_timers.Empty() ? now + 100000000 : m_timers.Top().when;
+        int64_t wait = std::min(next, endNs) - now - SPIN_NS;
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        struct timespec ts;
+        ts.tv_sec = wait > 0 ? wait / 1000000000LL : 0;
+        ts.tv_nsec = wait > 0 ? wait % 1000000000LL : 0;
+        int n = ppoll(&pfd, 1, &ts, 0);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("bwemu: ppoll");
+            return 1;
+        }
+        if (n > 0)
+        {
+            // Handled at the top of the loop, before any timer that is due after them
+            continue;
+        }
+        if (wait <= 0)
+        {
+            // Close to the next event: spin instead of sleeping past it
+            while (MonotonicNs() < next && !g_stop)
+            {
+            }
+        }
+    }
+    PrintStats();
+    return 0;
+}
+
+void LinkEmulator::ReceivePackets(int64_t now)
+{
+    for (;;)
+    {
+        if (m_free.empty())
+        {
+            // Out of buffers: read and drop so the socket does not back up
+            uint8_t scratch[MAX_PACKET];
+            if (recv(m_fd, scratch, sizeof(scratch), MSG_DONTWAIT) < 0)
+            {
+                return;
+            }
+            m_dropped++;
+            continue;
+        }
+        uint32_t slot = m_free.back();
+        sockaddr_in from;
+        char control[64];
+        struct iovec iov;
+        iov.iov_base = Data(slot);
+        iov.iov_len = MAX_PACKET;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t len = recvmsg(m_fd, &msg, MSG_DONTWAIT);
+        if (len < 0)
+        {
+            return;
+        }
+
+        // Replies from the far end go straight back; the reverse path is never the bottleneck
+        if (from.sin_addr.s_addr == m_forward.sin_addr.s_addr && from.sin_port == m_forward.sin_port)
+        {
+            if (m_haveClient)
+            {
+                sendto(m_fd, Data(slot), len, 0, (const sockaddr *)&m_client, sizeof(m_client));
+                m_reverse++;
+            }
+            continue;
+        }
+        m_client = from;
+        m_haveClient = true;
+
+        int64_t when = now;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+        {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+            {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                when = std::min(now, (int64_t)(ts.tv_sec * 1000000000LL + ts.tv_nsec) - m_realtimeOffsetNs);
+            }
+        }
+
+        m_free.pop_back();
+        m_slots[slot].length = (uint32_t)len;
+        m_slots[slot].wireBytes = (uint32_t)len;
+        m_slots[slot].real = true;
+        Event e;
+        e.type = EVENT_INGRESS;
+        e.index = slot;
+        m_timers.Push(when, e);
+    }
+}
+
+void LinkEmulator::Enqueue(uint32_t slot, int64_t now)
+{
+    bool real = m_slots[slot].real;
+    if (m_queueCount >= m_config.queuePackets)
+    {
+        if (real)
+        {
+            m_dropped++;
+        }
+        else
+        {
+            m_crossDropped++;
+        }
+        m_free.push_back(slot);
+        return;
+    }
+    m_queue[(m_queueHead + m_queueCount) % m_config.queuePackets] = slot;
+    m_queueCount++;
+    m_maxQueue = std::max(m_maxQueue, m_queueCount);
+    if (!m_busy)
+    {
+        StartTransmission(now);
+    }
+}
+
+void LinkEmulator::StartTransmission(int64_t now)
+{
+    if (m_queueCount == 0)
+    {
+        m_busy = false;
+        return;
+    }
+    uint32_t slot = m_queue[m_queueHead];
+    m_queueHead = (m_queueHead + 1) % m_config.queuePackets;
+    m_queueCount--;
+    m_busy = true;
+
+    Event e;
+    e.type = EVENT_DEPART;
+    e.index = slot;
+    m_timers.Push(now + WireTimeNs(m_slots[slot].wireBytes), e);
+}
+
+void LinkEmulator::ScheduleCross(uint32_t source, int64_t when)
+{
+    CrossSource &s = m_sources[source];
+    if (when >= s.onEndNs)
+    {
+        // Skip the off period; a zero off time just starts the next on period
+        int64_t cycle = (int64_t)((s.config.onS + s.config.offS) * 1e9);
+        int64_t offStart = s.onEndNs;
+        while (when >= s.onEndNs)
+        {
+            s.onEndNs += cycle;
+        }
+        int64_t onStart = s.onEndNs - (int64_t)(s.config.onS * 1e9);
+        when = std::max(when, std::max(onStart, offStart));
+    }
+    if (when >= s.stopNs)
+    {
+        return;
+    }
+    Event e;
+    e.type = EVENT_CROSS;
+    e.index = source;
+    m_timers.Push(when, e);
+}
+
+void LinkEmulator::HandleEvent(const Event &event, int64_t when)
+{
+    switch (event.type)
+    {
+    case EVENT_INGRESS:
+        Enqueue(event.index, when);
+        break;
+    case EVENT_CROSS:
+    {
+        CrossSource &s = m_sources[event.index];
+        if (!m_free.empty())
+        {
+            uint32_t slot = m_free.back();
+            m_free.pop_back();
+            m_slots[slot].length = 0;
+            m_slots[slot].wireBytes = s.config.packetSize;
+            m_slots[slot].real = false;
+            m_crossSent++;
+            Enqueue(slot, when);
+        }
+        ScheduleCross(event.index, when + s.intervalNs);
+        break;
+    }
+    case EVENT_DEPART:
+    {
+        // The link is free again; the packet still has the propagation delay ahead of it
+        Event arrive;
+        arrive.type = EVENT_ARRIVE;
+        arrive.index = event.index;
+        m_timers.Push(when + (int64_t)m_config.delayUs * 1000, arrive);
+        StartTransmission(when);
+        break;
+    }
+    case EVENT_ARRIVE:
+    {
+        Slot &slot = m_slots[event.index];
+        if (slot.real)
+        {
+            sendto(m_fd, Data(event.index), slot.length, 0, (const sockaddr *)&m_forward, sizeof(m_forward));
+            m_forwarded++;
+        }
+        m_free.push_back(event.index);
+        break;
+    }
+    }
+}
+
+void LinkEmulator::PrintStats(void) const
+{
+    double elapsed = (MonotonicNs() - m_startNs) / 1e9;
+    printf("LinkEmulator :: %.1f s :: forwarded %llu dropped %llu :: cross sent %llu dropped %llu :: reverse %llu :: max queue %u\n",
+        elapsed, (unsigned long long)m_forwarded, (unsigned long long)m_dropped, (unsigned long long)m_crossSent,
+        (unsigned long long)m_crossDropped, (unsigned long long)m_reverse, m_maxQueue);
+    fflush(stdout);
+}
+
+} // namespace bwemu
@@ -0,0 +1,137 @@
+// Userspace stand-in for the dumbbell bottleneck of the ns-3 scenarios: a UDP forwarder
+// with a link rate, a propagation delay and a DropTail queue, shared with synthetic cross
+// traffic shaped like the scenarios' OnOffHelper sources. Everything runs off one timer
+// heap with nanosecond serialization times, so a run is reproducible on any host.
+#ifndef BWEMU_LINK_EMULATOR_H
+#define BWEMU_LINK_EMULATOR_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+#include "timer-heap.h"
+
+namespace bwemu {
+
+// OnOffHelper equivalent: rateMbps while on, nothing while off. onS == 0 means always on
+// (SetConstantRate). stopS == 0 means until the emulator exits.
+struct CrossTrafficConfig
+{
+    double rateMbps;
+    uint32_t packetSize;
+    double onS;
+    double offS;
+    double startS;
+    double stopS;
+
+    CrossTrafficConfig() :
+        rateMbps(0), packetSize(512), onS(0), offS(0), startS(0), stopS(0)
+    {
+    }
+};
+
+// "rate_mbps,size[,on_s,off_s[,start_s,stop_s]]", several separated by ';'
+bool ParseCrossTraffic(const std::string &text, std::vector<CrossTrafficConfig> *out);
+
+struct EmulatorConfig
+{
+    uint16_t listenPort;
+    std::string forwardTo;
+    double rateMbps;
+    uint32_t delayUs;
+    uint32_t queuePackets;      // DropTail limit, ns-3's default is 100 packets
+    uint32_t overheadBytes;     // IPv4 + UDP + PPP headers the ns-3 link also serializes
+    uint32_t slots;             // packet buffers for queued and in-flight packets
+    double durationS;           // 0 = until SIGINT
+    std::vector<CrossTrafficConfig> cross;
+
+    EmulatorConfig() :
+        listenPort(9000), forwardTo("127.0.0.1:8090"), rateMbps(10), delayUs(2000), queuePackets(100),
+        overheadBytes(30), slots(4096), durationS(0)
+    {
+    }
+};
+
+class LinkEmulator
+{
+public:
+    explicit LinkEmulator(const EmulatorConfig &config);
+    ~LinkEmulator();
+
+    int Run(void);
+
+private:
+    enum EventType
+    {
+        EVENT_INGRESS = 0,  // index = slot received from the sender, queued at its kernel timestamp
+        EVENT_CROSS = 1,    // index = cross traffic source
+        EVENT_DEPART = 2,   // index = slot that finished serializing
+        EVENT_ARRIVE = 3    // index = slot that reached the far end
+    };
+
+    struct Event
+    {
+        uint32_t type;
+        uint32_t index;
+    };
+
+    struct Slot
+    {
+        uint32_t length;
+        uint32_t wireBytes;
+        bool real;
+    };
+
+    struct CrossSource
+    {
+        CrossTrafficConfig config;
+        int64_t intervalNs;
+        int64_t onEndNs;
+        int64_t stopNs;
+    };
+
+    void HandleEvent(const Event &event, int64_t when);
+    void ReceivePackets(int64_t now);
+    void Enqueue(uint32_t slot, int64_t now);
+    void StartTransmission(int64_t now);
+    void ScheduleCross(uint32_t source, int64_t when);
+    int64_t WireTimeNs(uint32_t bytes) const;
+    uint8_t *Data(uint32_t slot) { return &m_data[(size_t)slot * MAX_PACKET]; }
+    void PrintStats(void) const;
+
+    enum
+    {
+        MAX_PACKET = 2048
+    };
+
+    EmulatorConfig m_config;
+    int m_fd;
+    sockaddr_in m_forward;
+    sockaddr_in m_client;
+    bool m_haveClient;
+
+    std::vector<uint8_t> m_data;
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;
+    std::vector<uint32_t> m_queue;  // ring of slot indices waiting for the link
+    uint32_t m_queueHead;
+    uint32_t m_queueCount;
+    bool m_busy;
+
+    std::vector<CrossSource> m_sources;
+    TimerHeap<Event> m_timers;
+    int64_t m_startNs;
+    int64_t m_realtimeOffsetNs;     // CLOCK_REALTIME - CLOCK_MONOTONIC, for SO_TIMESTAMPNS
+
+    uint64_t m_forwarded;
+    uint64_t m_dropped;
+    uint64_t m_crossSent;
+    uint64_t m_crossDropped;
+    uint64_t m_reverse;
+    uint32_t m_maxQueue;
+};
+
+} // namespace bwemu
+
+#endif // BWEMU_LINK_EMULATOR_H
@@ -0,0 +1,48 @@
+// bwemu: userspace bottleneck for testing bwprobe without root or tc netem.
+//
+//   bwemu [--listen 9000] [--forward 127.0.0.1:8090] [--rate 10] [--delay-us 2000]
+//         [--queue 100] [--overhead 30] [--duration 0] [--cross "7,1400"]
+//
+// --cross takes "rate_mbps,size[,on_s,off_s[,start_s,stop_s]]" per source, ';' separated.
+// The defaults are the Pathload-Simulation.cc bottleneck; add --cross "7,1400" for its CBR.
+//
+//   ./bwemu --cross "7,1400" &
+//   ./bwprobe server --probe-to 127.0.0.1:9000 &
+//   ./bwprobe client        # IGI/PTR should land near the 3 Mbps left by the cross traffic
+#include <stdio.h>
+
+#include "link-emulator.h"
+#include "../bwprobe/probe-common.h"
+
+int main(int argc, char *argv[])
+{
+    bwprobe::Options opts(argc, argv, 1);
+    if (opts.Has("help"))
+    {
+        fprintf(stderr, "usage: bwemu [--listen 9000] [--forward host:port] [--rate mbps] [--delay-us us]\n"
+            "             [--queue packets] [--overhead bytes] [--duration s] [--cross \"rate,size[,on,off[,start,stop]]\"]\n");
+        return 2;
+    }
+
+    bwemu::EmulatorConfig config;
+    config.listenPort = (uint16_t)opts.GetUint("listen", config.listenPort);
+    config.forwardTo = opts.GetString("forward", config.forwardTo);
+    config.rateMbps = opts.GetDouble("rate", config.rateMbps);
+    config.delayUs = opts.GetUint("delay-us", config.delayUs);
+    config.queuePackets = opts.GetUint("queue", config.queuePackets);
+    config.overheadBytes = opts.GetUint("overhead", config.overheadBytes);
+    config.durationS = opts.GetDouble("duration", config.durationS);
+    if (!bwemu::ParseCrossTraffic(opts.GetString("cross", ""), &config.cross))
+    {
+        fprintf(stderr, "bwemu: bad --cross, expected rate_mbps,size[,on_s,off_s[,start_s,stop_s]]\n");
+        return 2;
+    }
+    if (config.rateMbps <= 0 || config.queuePackets == 0)
+    {
+        fprintf(stderr, "bwemu: need a positive --rate and --queue\n");
+        return 2;
+    }
+
+    bwemu::LinkEmulator emulator(config);
+    return emulator.Run();
+}
@@ -0,0 +1,3 @@
+// waf builds each scratch subdirectory from its own *.cc only; pull in the socket and
+// option helpers bwemu shares with the prober.
+#include "../bwprobe/probe-common.cc"
@@ -0,0 +1,63 @@
+// Min-heap of timed events for the emulator. Events due at the same nanosecond come out
+// in the order they were scheduled, like the ns-3 scheduler.
+#ifndef BWEMU_TIMER_HEAP_H
+#define BWEMU_TIMER_HEAP_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+namespace bwemu {
+
+template <typename T>
+class TimerHeap
+{
+public:
+    struct Entry
+    {
+        int64_t when;
+        uint64_t order;
+        T event;
+    };
+
+    explicit TimerHeap(size_t reserve) :
+        m_order(0)
+    {
+        m_entries.reserve(reserve);
+    }
+
+    bool Empty(void) const { return m_entries.empty(); }
+    size_t Size(void) const { return m_entries.size(); }
+    const Entry &Top(void) const { return m_entries.front(); }
+
+    void Push(int64_t when, const T &event)
+    {
+        Entry e;
+        e.when = when;
+        e.order = m_order++;
+        e.event = event;
+        m_entries.push_back(e);
+        std::push_heap(m_entries.begin(), m_entries.end(), Later);
+    }
+
+    Entry Pop(void)
+    {
+        std::pop_heap(m_entries.begin(), m_entries.end(), Later);
+        Entry e = m_entries.back();
+        m_entries.pop_back();
+        return e;
+    }
+
+private:
+    static bool Later(const Entry &a, const Entry &b)
+    {
+        return a.when != b.when ? a.when > b.when : a.order > b.order;
+    }
+
+    std::vector<Entry> m_entries;
+    uint64_t m_order;
+};
+
+} // namespace bwemu
+
+#endif // BWEMU_TIMER_HEAP_H
@@ -0,0 +1,7 @@
+#!/bin/bash
+# Builds the native prober and the bottleneck emulator outside waf (no ns-3 needed).
+# waf also builds them as scratch/bwprobe and scratch/bwemu: ../waf --run "bwprobe client"
+
+mkdir -p ../build/native
+g++ -std=c++11 -O2 -Wall -pthread -o ../build/native/bwprobe bwprobe/*.cc
+g++ -std=c++11 -O2 -Wall -pthread -o ../build/native/bwemu bwemu/*.cc
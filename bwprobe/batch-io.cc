@@ -0,0 +1,127 @@
+#include "batch-io.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+BatchReceiver::BatchReceiver(int fd, bool batched, uint32_t batch, uint32_t maxLength) :
+    m_fd(fd), m_batched(batched), m_kernelTimestamps(false), m_batch(batched ? batch : 1),
+    m_maxLength(maxLength), m_buffers((size_t)m_batch * maxLength), m_control((size_t)m_batch * CMSG_SPACE(sizeof(struct timespec))),
+    m_headers(m_batch), m_iovecs(m_batch), m_lengths(m_batch), m_rxNs(m_batch), m_from(m_batch)
+{
+    if (m_batched)
+    {
+        int one = 1;
+        m_kernelTimestamps = setsockopt(m_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == 0;
+    }
+}
+
+uint32_t BatchReceiver::Receive(void)
+{
+    if (!m_batched)
+    {
+        m_stats.syscalls++;
+        socklen_t fromLength = sizeof(m_from[0]);
+        ssize_t len = recvfrom(m_fd, &m_buffers[0], m_maxLength, MSG_DONTWAIT, (sockaddr *)&m_from[0], &fromLength);
+        if (len < 0)
+        {
+            return 0;
+        }
+        m_lengths[0] = (uint32_t)len;
+        m_rxNs[0] = MonotonicNs();
+        m_stats.packets++;
+        return 1;
+    }
+
+    size_t controlSize = CMSG_SPACE(sizeof(struct timespec));
+    for (uint32_t i = 0; i < m_batch; i++)
+    {
+        m_iovecs[i].iov_base = &m_buffers[(size_t)i * m_maxLength];
+        m_iovecs[i].iov_len = m_maxLength;
+        memset(&m_headers[i], 0, sizeof(m_headers[i]));
+        m_headers[i].msg_hdr.msg_name = &m_from[i];
+        m_headers[i].msg_hdr.msg_namelen = sizeof(m_from[i]);
+        m_headers[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_headers[i].msg_hdr.msg_iovlen = 1;
+        m_headers[i].msg_hdr.msg_control = &m_control[i * controlSize];
+        m_headers[i].msg_hdr.msg_controllen = controlSize;
+    }
+
+    m_stats.syscalls++;
+    int n = recvmmsg(m_fd, &m_headers[0], m_batch, MSG_DONTWAIT, 0);
+    if (n <= 0)
+    {
+        return 0;
+    }
+    // Fallback for datagrams without a timestamp; only used if the option was refused
+    int64_t userNs = MonotonicNs();
+    for (int i = 0; i < n; i++)
+    {
+        m_lengths[i] = m_headers[i].msg_len;
+        m_rxNs[i] = userNs;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&m_headers[i].msg_hdr); c; c = CMSG_NXTHDR(&m_headers[i].msg_hdr, c))
+        {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+            {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                m_rxNs[i] = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+            }
+        }
+    }
+    m_stats.packets += n;
+    return (uint32_t)n;
+}
+
+BatchSender::BatchSender(int fd, bool batched, uint32_t batch, uint32_t length) :
+    m_fd(fd), m_batched(batched), m_batch(batched ? batch : 1), m_length(length),
+    m_buffers((size_t)m_batch * length), m_headers(m_batch), m_iovecs(m_batch)
+{
+}
+
+uint32_t BatchSender::Send(uint32_t count, const sockaddr_in &addr)
+{
+    if (!m_batched || count == 1)
+    {
+        uint32_t sent = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            m_stats.syscalls++;
+            if (sendto(m_fd, Slot(i), m_length, 0, (const sockaddr *)&addr, sizeof(addr)) == (ssize_t)m_length)
+            {
+                sent++;
+            }
+        }
+        m_stats.packets += sent;
+        return sent;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        m_iovecs[i].iov_base = Slot(i);
+        m_iovecs[i].iov_len = m_length;
+        memset(&m_headers[i], 0, sizeof(m_headers[i]));
+        m_headers[i].msg_hdr.msg_name = (void *)&addr;
+        m_headers[i].msg_hdr.msg_namelen = sizeof(addr);
+        m_headers[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_headers[i].msg_hdr.msg_iovlen = 1;
+    }
+    uint32_t sent = 0;
+    while (sent < count)
+    {
+        m_stats.syscalls++;
+        int n = sendmmsg(m_fd, &m_headers[sent], count - sent, 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        sent += n;
+    }
+    m_stats.packets += sent;
+    return sent;
+}
+
+} // namespace bwprobe
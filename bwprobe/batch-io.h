@@ -0,0 +1,88 @@
+// Batched UDP I/O for the prober. The receiver drains the socket with recvmmsg and takes
+// the kernel's software receive timestamp (SO_TIMESTAMPNS) of every datagram instead of
+// reading the clock in user space after each recv; the sender hands runs of back-to-back
+// probes to sendmmsg. "simple" mode keeps one syscall per packet for comparison.
+#ifndef BWPROBE_BATCH_IO_H
+#define BWPROBE_BATCH_IO_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+namespace bwprobe {
+
+struct IoStats
+{
+    uint64_t syscalls;
+    uint64_t packets;
+
+    IoStats() :
+        syscalls(0), packets(0)
+    {
+    }
+
+    double SyscallsPerPacket(void) const
+    {
+        return packets ? (double)syscalls / packets : 0.0;
+    }
+};
+
+class BatchReceiver
+{
+public:
+    BatchReceiver(int fd, bool batched, uint32_t batch, uint32_t maxLength);
+
+    // Reads whatever is queued, up to one batch, without blocking. Returns the count.
+    uint32_t Receive(void);
+
+    const uint8_t *Data(uint32_t i) const { return &m_buffers[(size_t)i * m_maxLength]; }
+    uint32_t Length(uint32_t i) const { return m_lengths[i]; }
+    int64_t RxNs(uint32_t i) const { return m_rxNs[i]; }
+    const sockaddr_in &From(uint32_t i) const { return m_from[i]; }
+    bool KernelTimestamps(void) const { return m_kernelTimestamps; }
+    bool Batched(void) const { return m_batched; }
+    uint32_t Batch(void) const { return m_batch; }
+    const IoStats &Stats(void) const { return m_stats; }
+
+private:
+    int m_fd;
+    bool m_batched;
+    bool m_kernelTimestamps;
+    uint32_t m_batch;
+    uint32_t m_maxLength;
+    std::vector<uint8_t> m_buffers;
+    std::vector<uint8_t> m_control;
+    std::vector<struct mmsghdr> m_headers;
+    std::vector<struct iovec> m_iovecs;
+    std::vector<uint32_t> m_lengths;
+    std::vector<int64_t> m_rxNs;
+    std::vector<sockaddr_in> m_from;
+    IoStats m_stats;
+};
+
+class BatchSender
+{
+public:
+    BatchSender(int fd, bool batched, uint32_t batch, uint32_t length);
+
+    uint32_t Batch(void) const { return m_batched ? m_batch : 1; }
+    uint8_t *Slot(uint32_t i) { return &m_buffers[(size_t)i * m_length]; }
+    // Sends slots [0, count) to addr. Returns how many went out.
+    uint32_t Send(uint32_t count, const sockaddr_in &addr);
+    const IoStats &Stats(void) const { return m_stats; }
+
+private:
+    int m_fd;
+    bool m_batched;
+    uint32_t m_batch;
+    uint32_t m_length;
+    std::vector<uint8_t> m_buffers;
+    std::vector<struct mmsghdr> m_headers;
+    std::vector<struct iovec> m_iovecs;
+    IoStats m_stats;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_BATCH_IO_H
@@ -0,0 +1,165 @@
+#include "capture.h"
+
+#include <math.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/eventfd.h>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+CaptureThread::CaptureThread(int udpFd, bool batched, uint32_t batch, uint32_t ringSize, DropPolicy policy) :
+    m_fd(udpFd), m_wakeFd(-1), m_receiver(udpFd, batched, batch, 2048), m_ring(ringSize), m_policy(policy),
+    m_captured(0), m_enqueued(0), m_dropped(0), m_fullEvents(0), m_highWater(0), m_latencySquares(0),
+    m_running(false)
+{
+    for (uint32_t i = 0; i < DAMAGE_SLOTS; i++)
+    {
+        m_damaged[i] = 0;
+    }
+}
+
+CaptureThread::~CaptureThread()
+{
+    Stop();
+    if (m_wakeFd >= 0)
+    {
+        close(m_wakeFd);
+    }
+}
+
+bool CaptureThread::Start(void)
+{
+    m_wakeFd = eventfd(0, EFD_NONBLOCK);
+    if (m_wakeFd < 0)
+    {
+        return false;
+    }
+    m_running = true;
+    m_thread = std::thread(&CaptureThread::Loop, this);
+    return true;
+}
+
+void CaptureThread::Stop(void)
+{
+    if (m_running.exchange(false))
+    {
+        m_thread.join();
+    }
+}
+
+void CaptureThread::Acknowledge(void)
+{
+    uint64_t value;
+    if (read(m_wakeFd, &value, sizeof(value)) < 0)
+    {
+        // Nothing was signalled; fine for a non-blocking eventfd
+    }
+}
+
+bool CaptureThread::Damaged(uint32_t train) const
+{
+    return m_damaged[train % DAMAGE_SLOTS].load(std::memory_order_acquire) == train + 1;
+}
+
+CaptureStats CaptureThread::Stats(void) const
+{
+    CaptureStats s;
+    s.captured = m_captured.load(std::memory_order_relaxed);
+    s.enqueued = m_enqueued.load(std::memory_order_relaxed);
+    s.dropped = m_dropped.load(std::memory_order_relaxed);
+    s.fullEvents = m_fullEvents.load(std::memory_order_relaxed);
+    s.highWater = m_highWater.load(std::memory_order_relaxed);
+    return s;
+}
+
+double CaptureThread::LatencyStddevNs(void) const
+{
+    if (m_latency.samples == 0)
+    {
+        return 0.0;
+    }
+    double mean = m_latency.MeanNs();
+    return sqrt(std::max(0.0, m_latencySquares / m_latency.samples - mean * mean));
+}
+
+void CaptureThread::Loop(void)
+{
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        // Short timeout only so Stop() is noticed
+        if (poll(&pfd, 1, 100) <= 0)
+        {
+            continue;
+        }
+
+        uint32_t n;
+        while ((n = m_receiver.Receive()) > 0)
+        {
+            // Hand-off time on the clock the receive stamps are on
+            int64_t now = m_receiver.KernelTimestamps() ? RealtimeNs() : MonotonicNs();
+            bool full = false;
+            uint32_t pushed = 0;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                bwest::ProbeHeader header;
+                if (!bwest::ReadProbeHeader(m_receiver.Data(i), m_receiver.Length(i), &header))
+                {
+                    continue;
+                }
+                bwest::ProbeRecord record;
+                record.train = header.train;
+                record.seq = header.seq;
+                record.txNs = header.txNs;
+                record.rxNs = m_receiver.RxNs(i);
+                record.size = m_receiver.Length(i);
+                m_captured.fetch_add(1, std::memory_order_relaxed);
+
+                if (!m_ring.Push(record))
+                {
+                    full = true;
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    if (m_policy == DROP_TRAIN)
+                    {
+                        m_damaged[record.train % DAMAGE_SLOTS].store(record.train + 1, std::memory_order_release);
+                    }
+                    continue;
+                }
+                pushed++;
+                int64_t latency = now - record.rxNs;
+                m_latency.Add(latency);
+                m_latencySquares += (double)latency * latency;
+            }
+
+            if (pushed > 0)
+            {
+                m_enqueued.fetch_add(pushed, std::memory_order_relaxed);
+                uint32_t depth = m_ring.SizeApprox();
+                if (depth > m_highWater.load(std::memory_order_relaxed))
+                {
+                    m_highWater.store(depth, std::memory_order_relaxed);
+                }
+                uint64_t one = 1;
+                if (write(m_wakeFd, &one, sizeof(one)) < 0)
+                {
+                    // Counter saturated; the estimator is awake anyway
+                }
+            }
+            if (full)
+            {
+                m_fullEvents.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (m_receiver.Batched() && n < m_receiver.Batch())
+            {
+                break;
+            }
+        }
+    }
+}
+
+} // namespace bwprobe
@@ -0,0 +1,89 @@
+// Capture stage of the native receiver. A dedicated thread drains the probe socket, turns
+// each datagram into a compact ProbeRecord and hands it to the estimator thread through an
+// SPSC ring; it never parses more than the probe header, logs or estimates, so the time
+// from the kernel timestamp to the hand-off stays flat however slow the estimator is.
+#ifndef BWPROBE_CAPTURE_H
+#define BWPROBE_CAPTURE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#include "../bw-estimator.h"
+#include "batch-io.h"
+#include "pacer.h"
+#include "spsc-queue.h"
+
+namespace bwprobe {
+
+// What the capture thread does with a record when the ring is full
+enum DropPolicy
+{
+    DROP_NEWEST = 1,    // lose the record; the estimator works with what got through
+    DROP_TRAIN = 2      // lose the record and mark its train, which the estimator then throws away
+};
+
+struct CaptureStats
+{
+    uint64_t captured;      // probes read off the socket
+    uint64_t enqueued;
+    uint64_t dropped;       // ring full
+    uint64_t fullEvents;    // batches that hit a full ring at least once
+    uint32_t highWater;     // deepest the ring got
+};
+
+class CaptureThread
+{
+public:
+    CaptureThread(int udpFd, bool batched, uint32_t batch, uint32_t ringSize, DropPolicy policy);
+    ~CaptureThread();
+
+    bool Start(void);
+    void Stop(void);
+
+    // Readable whenever records were enqueued since the last Acknowledge()
+    int WakeFd(void) const { return m_wakeFd; }
+    void Acknowledge(void);
+    bool Pop(bwest::ProbeRecord *record) { return m_ring.Pop(record); }
+    bool Pending(void) const { return m_ring.SizeApprox() > 0; }
+    // True if a record of this train was dropped under DROP_TRAIN
+    bool Damaged(uint32_t train) const;
+
+    // Counters are read from the estimator thread; exact once the thread has stopped
+    CaptureStats Stats(void) const;
+    // Kernel receive to hand-off, in the same histogram the pacer uses
+    const PacingHistogram &Latency(void) const { return m_latency; }
+    double LatencyStddevNs(void) const;
+    bool KernelTimestamps(void) const { return m_receiver.KernelTimestamps(); }
+    const IoStats &Io(void) const { return m_receiver.Stats(); }
+
+private:
+    enum
+    {
+        DAMAGE_SLOTS = 64
+    };
+
+    void Loop(void);
+
+    int m_fd;
+    int m_wakeFd;
+    BatchReceiver m_receiver;
+    SpscQueue<bwest::ProbeRecord> m_ring;
+    DropPolicy m_policy;
+    std::atomic<uint32_t> m_damaged[DAMAGE_SLOTS]; // train + 1, by train % DAMAGE_SLOTS
+
+    std::atomic<uint64_t> m_captured;
+    std::atomic<uint64_t> m_enqueued;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_fullEvents;
+    std::atomic<uint32_t> m_highWater;
+    PacingHistogram m_latency;
+    double m_latencySquares;
+
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_CAPTURE_H
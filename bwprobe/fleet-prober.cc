@@ -0,0 +1,574 @@
+#include "fleet-prober.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void OnSignal(int)
+{
+    g_stop = 1;
+}
+
+//================================================================
+// WORKER
+//================================================================
+
+FleetWorker::FleetWorker(uint32_t index, const FleetConfig &config, const std::vector<FleetTarget> &targets,
+    const std::vector<uint32_t> &assigned) :
+    m_index(index), m_config(config), m_targets(targets), m_assigned(assigned), m_load(0), m_fd(-1),
+    m_nextTrain(0), m_wheel((uint32_t)assigned.size(), config.tickUs * 1000LL, MonotonicNs()),
+    m_pacer(config.pacer), m_probe(config.packetSize, 0), m_receiver(0), m_estimates(config.queueSize),
+    m_running(false)
+{
+    m_slots.reserve(assigned.size());
+    for (uint32_t i = 0; i < assigned.size(); i++)
+    {
+        m_slots.push_back(TargetSlot(config.igi));
+        m_slots.back().target = assigned[i];
+        m_load += targets[assigned[i]].load;
+    }
+    m_active.reserve(config.concurrent);
+    InflightTrain free = { 0, NO_TRAIN };
+    m_inflight.assign(std::max<size_t>(assigned.size(), 1), free);
+}
+
+FleetWorker::~FleetWorker()
+{
+    Stop();
+    delete m_receiver;
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+bool FleetWorker::Open(void)
+{
+    m_fd = CreateUdpSocket(0);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+    int sndbuf = 4 * 1024 * 1024;
+    setsockopt(m_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    m_receiver = new BatchReceiver(m_fd, true, 32, REPORT_HEADER_SIZE + REPORT_RECORDS * REPORT_RECORD_SIZE);
+    if (m_config.pacer.spinNs == 0)
+    {
+        m_pacer.Calibrate();
+    }
+
+    // Spread the first trains over one interval so the workers do not start in lockstep
+    int64_t now = MonotonicNs();
+    for (uint32_t i = 0; i < m_slots.size(); i++)
+    {
+        uint32_t intervalMs = m_targets[m_slots[i].target].intervalMs;
+        Reschedule(i, now + (int64_t)intervalMs * 1000000 * i / m_slots.size());
+    }
+    return true;
+}
+
+void FleetWorker::Start(void)
+{
+    m_running = true;
+    m_thread = std::thread(&FleetWorker::Loop, this);
+}
+
+void FleetWorker::Stop(void)
+{
+    if (m_running.exchange(false))
+    {
+        m_thread.join();
+    }
+}
+
+void FleetWorker::Reschedule(uint32_t local, int64_t whenNs)
+{
+    m_slots[local].state = TARGET_IDLE;
+    m_wheel.Schedule(local, whenNs);
+}
+
+void FleetWorker::Loop(void)
+{
+    if (m_config.pin)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(m_index % sysconf(_SC_NPROCESSORS_ONLN), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    std::vector<uint32_t> expired;
+    expired.reserve(m_slots.size());
+    int64_t spinNs = m_pacer.SpinNs();
+
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        int64_t now = MonotonicNs();
+        m_wheel.Advance(now, &expired);
+        for (uint32_t i = 0; i < expired.size(); i++)
+        {
+            uint32_t local = expired[i];
+            if (m_slots[local].state == TARGET_IDLE)
+            {
+                m_slots[local].state = TARGET_READY;
+                m_ready.push_back(local);
+            }
+            else if (m_slots[local].state == TARGET_AWAITING)
+            {
+                m_counters.trainsTimedOut++;
+                CompleteTrain(local, true);
+            }
+        }
+        expired.clear();
+
+        while (m_active.size() < m_config.concurrent && !m_ready.empty())
+        {
+            StartTrain(m_ready.front(), now + spinNs);
+            m_ready.pop_front();
+        }
+
+        DrainReports();
+
+        // Earliest probe due among the trains in flight
+        uint32_t next = 0;
+        int64_t deadline = INT64_MAX;
+        for (uint32_t i = 0; i < m_active.size(); i++)
+        {
+            int64_t due = m_active[i].startNs + (int64_t)m_active[i].seq * m_active[i].gapNs;
+            if (due < deadline)
+            {
+                deadline = due;
+                next = i;
+            }
+        }
+
+        // Block on reports while there is slack; the pacer takes over for the last stretch
+        int64_t wake = std::min<int64_t>(m_wheel.NextDueNs(), now + 10000000LL);
+        if (!m_active.empty())
+        {
+            wake = std::min(wake, deadline - spinNs);
+        }
+        now = MonotonicNs();
+        if (wake - now > 20000)
+        {
+            struct pollfd pfd;
+            pfd.fd = m_fd;
+            pfd.events = POLLIN;
+            struct timespec ts;
+            ts.tv_sec = (wake - now) / 1000000000LL;
+            ts.tv_nsec = (wake - now) % 1000000000LL;
+            ppoll(&pfd, 1, &ts, 0);
+            continue;
+        }
+        if (!m_active.empty())
+        {
+            SendNext(m_active[next]);
+            if (m_active[next].seq >= m_config.igi.trainSize)
+            {
+                m_active[next] = m_active.back();
+                m_active.pop_back();
+            }
+        }
+    }
+}
+
+void FleetWorker::StartTrain(uint32_t local, int64_t startNs)
+{
+    TargetSlot &s = m_slots[local];
+    s.state = TARGET_SENDING;
+    // Ids skip over taken entries; one is free within a table's length, since this
+    // target has no train in flight
+    while (m_inflight[m_nextTrain % m_inflight.size()].local != NO_TRAIN)
+    {
+        m_nextTrain++;
+    }
+    s.train = m_nextTrain++;
+    s.discard = false;
+    InflightTrain &inflight = m_inflight[s.train % m_inflight.size()];
+    inflight.train = s.train;
+    inflight.local = local;
+
+    ActiveTrain a;
+    a.local = local;
+    a.seq = 0;
+    a.gapNs = s.igi.NextGapNs();
+    a.startNs = startNs;
+    a.maxErrorNs = 0;
+    m_active.push_back(a);
+    m_counters.trainsSent++;
+}
+
+void FleetWorker::SendNext(ActiveTrain &a)
+{
+    TargetSlot &s = m_slots[a.local];
+    int64_t deadline = a.startNs + (int64_t)a.seq * a.gapNs;
+    bool ok;
+    m_pacer.BeginTrain();
+    int64_t sendNs = m_pacer.WaitUntil(deadline, &ok);
+    int64_t error = sendNs - deadline;
+    m_pacing.Add(error);
+    a.maxErrorNs = std::max(a.maxErrorNs, error);
+    if (error > (int64_t)m_config.pacer.maxErrorNs)
+    {
+        m_counters.latePackets++;
+    }
+
+    bwest::ProbeHeader h;
+    h.train = s.train;
+    h.seq = a.seq;
+    h.trainSize = m_config.igi.trainSize;
+    h.gapNs = a.gapNs;
+    h.txNs = sendNs;
+    bwest::WriteProbeHeader(&m_probe[0], h);
+    const sockaddr_in &to = m_targets[s.target].addr;
+    sendto(m_fd, &m_probe[0], m_probe.size(), 0, (const sockaddr *)&to, sizeof(to));
+    m_counters.packets++;
+
+    a.seq++;
+    if (a.seq >= m_config.igi.trainSize)
+    {
+        // Same rule as the single-peer server: one late packet spoils the train's gap sums
+        s.discard = a.maxErrorNs > (int64_t)m_config.pacer.maxErrorNs;
+        s.state = TARGET_AWAITING;
+        m_wheel.Schedule(a.local, sendNs + (int64_t)m_config.timeoutMs * 1000000);
+    }
+}
+
+void FleetWorker::DrainReports(void)
+{
+    uint32_t count;
+    while ((count = m_receiver->Receive()) > 0)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            HandleReport(m_receiver->Data(i), m_receiver->Length(i));
+        }
+        if (count < m_receiver->Batch())
+        {
+            break;
+        }
+    }
+}
+
+void FleetWorker::HandleReport(const uint8_t *data, uint32_t length)
+{
+    if (length < REPORT_HEADER_SIZE || bwest::Read32(data) != REPORT_MAGIC)
+    {
+        return;
+    }
+    uint32_t train = bwest::Read32(data + 4);
+    uint32_t records = bwest::Read32(data + 8);
+    uint32_t flags = bwest::Read32(data + 12);
+    // records comes off the wire: compared by division, so no product can wrap
+    if (records > REPORT_RECORDS || records > (length - REPORT_HEADER_SIZE) / REPORT_RECORD_SIZE)
+    {
+        return;
+    }
+    const InflightTrain &inflight = m_inflight[train % m_inflight.size()];
+    if (inflight.local == NO_TRAIN || inflight.train != train)
+    {
+        return; // late report for a train that already timed out
+    }
+    uint32_t local = inflight.local;
+    TargetSlot &s = m_slots[local];
+
+    if (!s.discard)
+    {
+        const uint8_t *r = data + REPORT_HEADER_SIZE;
+        for (uint32_t i = 0; i < records; i++, r += REPORT_RECORD_SIZE)
+        {
+            bwest::ProbeRecord record;
+            record.train = train;
+            record.seq = bwest::Read32(r);
+            record.size = bwest::Read32(r + 4);
+            record.txNs = (int64_t)bwest::Read64(r + 8);
+            record.rxNs = (int64_t)bwest::Read64(r + 16);
+            s.igi.Push(record);
+        }
+    }
+    if ((flags & REPORT_LAST) && s.state == TARGET_AWAITING)
+    {
+        CompleteTrain(local, false);
+    }
+}
+
+void FleetWorker::CompleteTrain(uint32_t local, bool timedOut)
+{
+    TargetSlot &s = m_slots[local];
+    m_wheel.Cancel(local);
+    m_inflight[s.train % m_inflight.size()].local = NO_TRAIN;
+    int64_t now = MonotonicNs();
+
+    bwest::Estimate e;
+    if (s.discard)
+    {
+        s.igi.Discard();
+        s.igi.Poll(&e);
+        m_counters.trainsDiscarded++;
+        Reschedule(local, now + m_config.settleUs * 1000LL);
+        return;
+    }
+    if (timedOut)
+    {
+        s.igi.Flush();
+    }
+    if (!s.igi.Poll(&e))
+    {
+        // Too little of the train arrived to say anything
+        s.igi.Discard();
+        Reschedule(local, now + m_config.settleUs * 1000LL);
+        return;
+    }
+    m_counters.trainsDone++;
+
+    if (!e.converged && e.trains < m_config.maxTrains)
+    {
+        Reschedule(local, now + m_config.settleUs * 1000LL);
+        return;
+    }
+    FleetEstimate f;
+    f.target = s.target;
+    f.worker = m_index;
+    f.atNs = now;
+    f.estimate = e;
+    if (m_estimates.Push(f))
+    {
+        m_counters.estimates++;
+    }
+    else
+    {
+        m_counters.queueFull++;
+    }
+    s.igi.Reset();
+    Reschedule(local, now + (int64_t)m_targets[s.target].intervalMs * 1000000);
+}
+
+//================================================================
+// COLLECTOR
+//================================================================
+
+FleetProber::FleetProber(const FleetConfig &config) :
+    m_config(config)
+{
+}
+
+FleetProber::~FleetProber()
+{
+    for (uint32_t i = 0; i < m_workers.size(); i++)
+    {
+        delete m_workers[i];
+    }
+}
+
+bool FleetProber::LoadTargets(void)
+{
+    // Fraction of a worker's time one target's trains take: the gap search tops out
+    // around gB per packet
+    double trainNs = (double)m_config.igi.trainSize * m_config.igi.gBNs;
+
+    if (m_config.targetsFile.empty())
+    {
+        for (uint32_t i = 0; i < m_config.syntheticTargets; i++)
+        {
+            FleetTarget t;
+            memset(&t.addr, 0, sizeof(t.addr));
+            t.addr.sin_family = AF_INET;
+            t.addr.sin_port = htons(m_config.udpPort);
+            t.addr.sin_addr.s_addr = htonl(0x7f000000 | ((1 + i / 250) << 8) | (1 + i % 250));
+            t.intervalMs = m_config.intervalMs;
+            t.load = trainNs / (t.intervalMs * 1e6);
+            m_targets.push_back(t);
+        }
+        return m_config.syntheticTargets <= 250 * 254;
+    }
+
+    std::ifstream in(m_config.targetsFile.c_str());
+    if (!in)
+    {
+        fprintf(stderr, "bwprobe fleet: cannot open %s\n", m_config.targetsFile.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string endpoint;
+        if (!(fields >> endpoint) || endpoint[0] == '#')
+        {
+            continue;
+        }
+        FleetTarget t;
+        if (!ParseEndpoint(endpoint, m_config.udpPort, &t.addr))
+        {
+            fprintf(stderr, "bwprobe fleet: cannot resolve %s\n", endpoint.c_str());
+            return false;
+        }
+        t.intervalMs = m_config.intervalMs;
+        fields >> t.intervalMs;
+        t.load = trainNs / (std::max<uint32_t>(t.intervalMs, 1) * 1e6);
+        m_targets.push_back(t);
+    }
+    return !m_targets.empty();
+}
+
+void FleetProber::Place(uint32_t workers, std::vector<std::vector<uint32_t> > *assigned) const
+{
+    std::vector<uint32_t> order(m_targets.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return m_targets[a].load > m_targets[b].load;
+    });
+
+    std::vector<double> load(workers, 0.0);
+    assigned->assign(workers, std::vector<uint32_t>());
+    for (uint32_t i = 0; i < order.size(); i++)
+    {
+        uint32_t w = (uint32_t)(std::min_element(load.begin(), load.end()) - load.begin());
+        load[w] += m_targets[order[i]].load;
+        (*assigned)[w].push_back(order[i]);
+    }
+}
+
+int FleetProber::Run(void)
+{
+    if (!LoadTargets())
+    {
+        return 2;
+    }
+    uint32_t workers = m_config.workers;
+    if (workers == 0)
+    {
+        workers = (uint32_t)std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    workers = std::min<uint32_t>(workers, m_targets.size());
+
+    std::vector<std::vector<uint32_t> > assigned;
+    Place(workers, &assigned);
+    for (uint32_t w = 0; w < workers; w++)
+    {
+        m_workers.push_back(new FleetWorker(w, m_config, m_targets, assigned[w]));
+        if (!m_workers.back()->Open())
+        {
+            perror("bwprobe fleet: socket");
+            return 1;
+        }
+        printf("FleetProber :: Worker %u :: %u targets :: load %.3f :: spin %u us\n", w, m_workers.back()->Targets(),
+            m_workers.back()->Load(), m_workers.back()->SpinNs() / 1000);
+    }
+    m_estimatesPerTarget.assign(m_targets.size(), 0);
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    int64_t startNs = MonotonicNs();
+    for (uint32_t w = 0; w < workers; w++)
+    {
+        m_workers[w]->Start();
+    }
+
+    int64_t endNs = startNs + (int64_t)(m_config.durationS * 1e9);
+    int64_t nextProgress = startNs + 1000000000LL;
+    while (!g_stop && MonotonicNs() < endNs)
+    {
+        Collect();
+        if (MonotonicNs() >= nextProgress)
+        {
+            uint64_t trains = 0, estimates = 0;
+            for (uint32_t w = 0; w < workers; w++)
+            {
+                trains += m_workers[w]->Counters().trainsSent.load(std::memory_order_relaxed);
+                estimates += m_workers[w]->Counters().estimates.load(std::memory_order_relaxed);
+            }
+            printf("FleetProber :: %.0f s :: %llu trains :: %llu estimates\n", (MonotonicNs() - startNs) / 1e9,
+                (unsigned long long)trains, (unsigned long long)estimates);
+            fflush(stdout);
+            nextProgress += 1000000000LL;
+        }
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, 0);
+    }
+    for (uint32_t w = 0; w < workers; w++)
+    {
+        m_workers[w]->Stop();
+    }
+    Collect();
+    Report((MonotonicNs() - startNs) / 1e9);
+    return 0;
+}
+
+void FleetProber::Collect(void)
+{
+    for (uint32_t w = 0; w < m_workers.size(); w++)
+    {
+        FleetEstimate f;
+        while (m_workers[w]->Estimates().Pop(&f))
+        {
+            m_estimatesPerTarget[f.target]++;
+            if (m_config.verbose)
+            {
+                const bwest::Estimate &e = f.estimate;
+                printf("FleetProber :: %s (worker %u) :: %s IGI %.3f Mbps PTR %.3f Mbps after %u trains\n",
+                    FormatAddress(m_targets[f.target].addr).c_str(), f.worker, e.converged ? "converged" : "gave up",
+                    e.igiAvailMbps, e.ptrMbps, e.trains);
+            }
+        }
+    }
+}
+
+void FleetProber::Report(double elapsedS) const
+{
+    uint64_t sent = 0, done = 0, discarded = 0, timedOut = 0, packets = 0, late = 0, estimates = 0, queueFull = 0;
+    PacingHistogram pacing;
+    for (uint32_t w = 0; w < m_workers.size(); w++)
+    {
+        const FleetCounters &c = m_workers[w]->Counters();
+        sent += c.trainsSent;
+        done += c.trainsDone;
+        discarded += c.trainsDiscarded;
+        timedOut += c.trainsTimedOut;
+        packets += c.packets;
+        late += c.latePackets;
+        estimates += c.estimates;
+        queueFull += c.queueFull;
+        pacing.Merge(m_workers[w]->Pacing());
+        printf("FleetProber :: Worker %u :: %u targets :: %llu trains :: pacing %s\n", w, m_workers[w]->Targets(),
+            (unsigned long long)c.trainsSent.load(), m_workers[w]->Pacing().Format().c_str());
+    }
+    uint32_t covered = 0;
+    for (uint32_t i = 0; i < m_estimatesPerTarget.size(); i++)
+    {
+        covered += m_estimatesPerTarget[i] > 0;
+    }
+
+    printf("FleetProber :: %.1f s :: trains sent %llu done %llu discarded %llu timed out %llu :: estimates %llu"
+        " (queue full %llu) :: %u/%zu targets estimated\n", elapsedS, (unsigned long long)sent,
+        (unsigned long long)done, (unsigned long long)discarded, (unsigned long long)timedOut,
+        (unsigned long long)estimates, (unsigned long long)queueFull, covered, m_targets.size());
+    printf("FleetProber :: pacing %s\n", pacing.Format().c_str());
+    printf("FLEET targets=%zu workers=%zu concurrent=%u trains_per_s=%.1f estimates_per_s=%.1f "
+        "pace_mean_us=%.2f pace_max_us=%.2f late_pct=%.2f coverage=%.3f\n", m_targets.size(), m_workers.size(),
+        m_config.concurrent, sent / elapsedS, estimates / elapsedS, pacing.MeanNs() / 1000.0, pacing.maxNs / 1000.0,
+        packets ? 100.0 * late / packets : 0.0, m_targets.empty() ? 0.0 : (double)covered / m_targets.size());
+    fflush(stdout);
+}
+
+} // namespace bwprobe
@@ -0,0 +1,202 @@
+// Sender-side IGI/PTR for many destinations at once. Targets are spread over one worker
+// thread per core by expected probing load; each worker keeps its targets' next-train
+// instants in a TimerWheel, interleaves up to `concurrent` paced trains on one socket and
+// estimates from the receive times a Reflector sends back. Finished estimates go to the
+// collector (the calling thread) through one SpscQueue per worker.
+#ifndef BWPROBE_FLEET_PROBER_H
+#define BWPROBE_FLEET_PROBER_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../bw-estimator.h"
+#include "batch-io.h"
+#include "pacer.h"
+#include "spsc-queue.h"
+#include "timer-wheel.h"
+
+namespace bwprobe {
+
+struct FleetTarget
+{
+    sockaddr_in addr;
+    uint32_t intervalMs;    // pause between converged estimates
+    double load;            // share of a core its trains take, for placement
+};
+
+struct FleetConfig
+{
+    std::string targetsFile;    // "host[:port] [interval_ms]" per line
+    uint32_t syntheticTargets;  // otherwise 127.0.x.y stand-ins, all served by one reflector
+    uint16_t udpPort;
+    uint32_t workers;           // 0 = one per online CPU
+    uint32_t concurrent;        // trains in flight per worker
+    uint32_t intervalMs;
+    uint32_t settleUs;          // pause after a train that did not converge
+    uint32_t timeoutMs;         // give up waiting for a train's last report
+    uint32_t maxTrains;         // restart the gap search if it has not converged by then
+    uint32_t packetSize;
+    uint32_t tickUs;            // timer wheel resolution
+    uint32_t queueSize;         // per-worker estimate queue
+    double durationS;
+    bool pin;                   // pin worker i to CPU i
+    bool verbose;               // print every estimate
+    PacerConfig pacer;
+    bwest::IgiConfig igi;
+
+    FleetConfig() :
+        syntheticTargets(100), udpPort(8090), workers(0), concurrent(4), intervalMs(1000), settleUs(10000),
+        timeoutMs(500), maxTrains(20), packetSize(700), tickUs(100), queueSize(4096), durationS(10), pin(false), verbose(false)
+    {
+    }
+};
+
+struct FleetEstimate
+{
+    uint32_t target;
+    uint32_t worker;
+    int64_t atNs;
+    bwest::Estimate estimate;
+};
+
+struct FleetCounters
+{
+    std::atomic<uint64_t> trainsSent;
+    std::atomic<uint64_t> trainsDone;       // got an estimate out of the train
+    std::atomic<uint64_t> trainsDiscarded;  // sender missed the pacing bound
+    std::atomic<uint64_t> trainsTimedOut;   // no final report in time
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> latePackets;      // sent later than pacer.maxErrorNs
+    std::atomic<uint64_t> estimates;
+    std::atomic<uint64_t> queueFull;        // estimates dropped because the collector fell behind
+
+    FleetCounters() :
+        trainsSent(0), trainsDone(0), trainsDiscarded(0), trainsTimedOut(0), packets(0), latePackets(0), estimates(0), queueFull(0)
+    {
+    }
+};
+
+class FleetWorker
+{
+public:
+    FleetWorker(uint32_t index, const FleetConfig &config, const std::vector<FleetTarget> &targets,
+        const std::vector<uint32_t> &assigned);
+    ~FleetWorker();
+
+    bool Open(void);
+    void Start(void);
+    void Stop(void);
+
+    SpscQueue<FleetEstimate> &Estimates(void) { return m_estimates; }
+    const FleetCounters &Counters(void) const { return m_counters; }
+    // Only valid after Stop()
+    const PacingHistogram &Pacing(void) const { return m_pacing; }
+    double Load(void) const { return m_load; }
+    uint32_t SpinNs(void) const { return m_pacer.SpinNs(); }
+    uint32_t Targets(void) const { return (uint32_t)m_assigned.size(); }
+
+private:
+    enum TargetState
+    {
+        TARGET_IDLE,        // timer = next train
+        TARGET_READY,       // waiting for a free train slot
+        TARGET_SENDING,
+        TARGET_AWAITING     // timer = report timeout
+    };
+
+    struct TargetSlot
+    {
+        uint32_t target;
+        TargetState state;
+        uint32_t train;
+        bool discard;
+        bwest::IgiEstimator igi;
+
+        explicit TargetSlot(const bwest::IgiConfig &config) :
+            target(0), state(TARGET_IDLE), train(0), discard(false), igi(config)
+        {
+        }
+    };
+
+    // A train awaiting reports, found by its id modulo the table size
+    struct InflightTrain
+    {
+        uint32_t train;
+        uint32_t local;     // NO_TRAIN when the entry is free
+    };
+
+    enum
+    {
+        NO_TRAIN = 0xffffffff
+    };
+
+    struct ActiveTrain
+    {
+        uint32_t local;
+        uint32_t seq;
+        uint32_t gapNs;
+        int64_t startNs;
+        int64_t maxErrorNs;
+    };
+
+    void Loop(void);
+    void StartTrain(uint32_t local, int64_t now);
+    void SendNext(ActiveTrain &a);
+    void DrainReports(void);
+    void HandleReport(const uint8_t *data, uint32_t length);
+    void CompleteTrain(uint32_t local, bool timedOut);
+    void Reschedule(uint32_t local, int64_t whenNs);
+
+    uint32_t m_index;
+    FleetConfig m_config;
+    const std::vector<FleetTarget> &m_targets;
+    std::vector<uint32_t> m_assigned;
+    double m_load;
+
+    int m_fd;
+    std::vector<TargetSlot> m_slots;
+    std::vector<ActiveTrain> m_active;
+    std::deque<uint32_t> m_ready;
+    std::vector<InflightTrain> m_inflight;  // one entry per target, the most trains in flight
+    uint32_t m_nextTrain;
+    TimerWheel m_wheel;
+    Pacer m_pacer;
+    PacingHistogram m_pacing;
+    std::vector<uint8_t> m_probe;
+    BatchReceiver *m_receiver;
+
+    SpscQueue<FleetEstimate> m_estimates;
+    FleetCounters m_counters;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+};
+
+class FleetProber
+{
+public:
+    explicit FleetProber(const FleetConfig &config);
+    ~FleetProber();
+
+    int Run(void);
+
+private:
+    bool LoadTargets(void);
+    // Longest-processing-time placement: heaviest target first, onto the least loaded worker
+    void Place(uint32_t workers, std::vector<std::vector<uint32_t> > *assigned) const;
+    void Collect(void);
+    void Report(double elapsedS) const;
+
+    FleetConfig m_config;
+    std::vector<FleetTarget> m_targets;
+    std::vector<FleetWorker *> m_workers;
+    std::vector<uint64_t> m_estimatesPerTarget;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_FLEET_PROBER_H
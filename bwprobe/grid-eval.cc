@@ -0,0 +1,429 @@
+#include "grid-eval.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+GridEvaluator::GridEvaluator(const GridConfig &config) :
+    m_config(config)
+{
+}
+
+GridEvaluator::~GridEvaluator()
+{
+    for (size_t i = 0; i < m_traces.size(); i++)
+    {
+        delete m_traces[i];
+    }
+}
+
+bool GridEvaluator::Load(std::string *error)
+{
+    if (m_config.traces.empty())
+    {
+        *error = "no traces";
+        return false;
+    }
+    for (size_t i = 0; i < m_config.traces.size(); i++)
+    {
+        GridTrace *trace = new GridTrace;
+        m_traces.push_back(trace);
+        // One cross rate for all traces, or one per trace
+        double cross = m_config.crossMbps.empty() ? 0.0 : m_config.crossMbps[std::min(i, m_config.crossMbps.size() - 1)];
+        if (!LoadGridTrace(m_config.traces[i], cross, trace, error))
+        {
+            return false;
+        }
+    }
+    BuildPoints();
+    return true;
+}
+
+bool LoadGridTrace(const std::string &path, double crossMbps, GridTrace *trace, std::string *error)
+{
+    trace->path = path;
+    trace->crossMbps = crossMbps;
+    if (!trace->file.Open(trace->path, error))
+    {
+        return false;
+    }
+    if (trace->file.Kind() != bwest::ESTIMATOR_IGI && trace->file.Kind() != bwest::ESTIMATOR_TREND)
+    {
+        *error = trace->path + ": capture has no estimator configuration";
+        return false;
+    }
+
+    const bwest::CaptureFile &file = trace->file;
+    const bwest::CaptureRecord *records = file.Records();
+    trace->trainSize = file.Kind() == bwest::ESTIMATOR_TREND ? file.Trend().trainSize : file.Igi().trainSize;
+
+    // Source gap of every usable run of records; trains the receiver discarded are skipped
+    std::vector<std::pair<uint32_t, uint32_t> > byGap;
+    for (uint64_t t = 0; t < file.TrainCount(); t++)
+    {
+        const bwest::CaptureTrain &run = file.Trains()[t];
+        const bwest::CaptureRecord *first = 0;
+        const bwest::CaptureRecord *last = 0;
+        uint32_t packets = 0;
+        bool discarded = false;
+        for (uint64_t i = run.first; i < run.first + run.count; i++)
+        {
+            if (records[i].op == bwest::CAPTURE_DISCARD)
+            {
+                discarded = true;
+            }
+            else if (records[i].op == bwest::CAPTURE_PROBE)
+            {
+                first = first ? first : &records[i];
+                last = &records[i];
+                packets++;
+            }
+        }
+        if (discarded || packets < 2 || last->seq <= first->seq)
+        {
+            continue;
+        }
+        GridTrace::Train train;
+        train.first = run.first;
+        train.count = run.count;
+        train.packets = packets;
+        uint32_t gapNs = (uint32_t)((last->txNs - first->txNs) / (last->seq - first->seq));
+        byGap.push_back(std::make_pair(gapNs, (uint32_t)trace->trains.size()));
+        trace->trains.push_back(train);
+    }
+
+    // Measured gaps jitter around the gap the sender aimed for; trains within 1% are one gap
+    std::stable_sort(byGap.begin(), byGap.end(),
+        [](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) { return a.first < b.first; });
+    for (size_t i = 0; i < byGap.size(); i++)
+    {
+        if (trace->gaps.empty() || byGap[i].first > trace->gaps.back().gapNs + trace->gaps.back().gapNs / 100)
+        {
+            GridTrace::Gap gap;
+            gap.gapNs = byGap[i].first;
+            trace->gaps.push_back(gap);
+        }
+        trace->gaps.back().trains.push_back(byGap[i].second);
+    }
+    for (size_t g = 0; g < trace->gaps.size(); g++)
+    {
+        std::sort(trace->gaps[g].trains.begin(), trace->gaps[g].trains.end());
+    }
+    if (trace->gaps.empty())
+    {
+        *error = trace->path + ": no usable trains";
+        return false;
+    }
+    return true;
+}
+
+void GridEvaluator::BuildPoints(void)
+{
+    const GridAxes &axes = m_config.axes;
+    bool haveIgi = false;
+    bool haveTrend = false;
+    bwest::IgiConfig igi;
+    bwest::TrendConfig trend;
+    for (size_t i = 0; i < m_traces.size(); i++)
+    {
+        // The first trace of each method supplies the values of the axes left unset
+        if (m_traces[i]->file.Kind() == bwest::ESTIMATOR_IGI && !haveIgi)
+        {
+            igi = m_traces[i]->file.Igi();
+            haveIgi = true;
+        }
+        if (m_traces[i]->file.Kind() == bwest::ESTIMATOR_TREND && !haveTrend)
+        {
+            trend = m_traces[i]->file.Trend();
+            haveTrend = true;
+        }
+    }
+
+    if (haveIgi)
+    {
+        std::vector<double> thresholds = axes.thresholds.empty() ? std::vector<double>(1, igi.threshold) : axes.thresholds;
+        std::vector<uint32_t> steps = axes.stepsNs.empty() ? std::vector<uint32_t>(1, igi.stepNs) : axes.stepsNs;
+        std::vector<uint32_t> gbs = axes.gbNs.empty() ? std::vector<uint32_t>(1, igi.gBNs) : axes.gbNs;
+        std::vector<uint32_t> sizes = axes.trainSizes.empty() ? std::vector<uint32_t>(1, igi.trainSize) : axes.trainSizes;
+        for (size_t a = 0; a < thresholds.size(); a++)
+        for (size_t b = 0; b < steps.size(); b++)
+        for (size_t c = 0; c < gbs.size(); c++)
+        for (size_t d = 0; d < sizes.size(); d++)
+        {
+            GridPoint p;
+            p.kind = bwest::ESTIMATOR_IGI;
+            p.igi = igi;
+            p.igi.threshold = thresholds[a];
+            p.igi.stepNs = steps[b];
+            p.igi.gBNs = gbs[c];
+            p.igi.trainSize = sizes[d];
+            m_points.push_back(p);
+        }
+    }
+    if (haveTrend)
+    {
+        std::vector<double> pct = axes.pct.empty() ? std::vector<double>(1, trend.pctThreshold) : axes.pct;
+        std::vector<double> pdt = axes.pdt.empty() ? std::vector<double>(1, trend.pdtThreshold) : axes.pdt;
+        std::vector<uint32_t> groups = axes.groups.empty() ? std::vector<uint32_t>(1, trend.groups) : axes.groups;
+        std::vector<uint32_t> sizes = axes.trainSizes.empty() ? std::vector<uint32_t>(1, trend.trainSize) : axes.trainSizes;
+        for (size_t a = 0; a < pct.size(); a++)
+        for (size_t b = 0; b < pdt.size(); b++)
+        for (size_t c = 0; c < groups.size(); c++)
+        for (size_t d = 0; d < sizes.size(); d++)
+        {
+            if (groups[c] == 0 || groups[c] > sizes[d])
+            {
+                continue;
+            }
+            GridPoint p;
+            p.kind = bwest::ESTIMATOR_TREND;
+            p.trend = trend;
+            p.trend.pctThreshold = pct[a];
+            p.trend.pdtThreshold = pdt[b];
+            p.trend.groups = groups[c];
+            p.trend.trainSize = sizes[d];
+            m_points.push_back(p);
+        }
+    }
+}
+
+GridResult EvaluateGridPoint(const GridTrace &trace, const GridPoint &point, uint32_t maxTrains, double gapTolerance)
+{
+    const bwest::CaptureRecord *records = trace.file.Records();
+
+    GridResult result;
+    memset(&result, 0, sizeof(result));
+    double bottleneck = point.kind == bwest::ESTIMATOR_TREND ? point.trend.bottleneckMbps : point.igi.bottleneckMbps;
+    result.truthMbps = bottleneck - trace.crossMbps;
+
+    uint32_t trainSize = point.kind == bwest::ESTIMATOR_TREND ? point.trend.trainSize : point.igi.trainSize;
+    if (point.kind != trace.file.Kind() || trainSize > trace.trainSize)
+    {
+        result.uncovered = 1; // recorded trains are too short for this configuration
+        return result;
+    }
+
+    bwest::IgiEstimator igi(point.igi);
+    bwest::TrendEstimator trend(point.trend);
+    bwest::Estimator *est = point.kind == bwest::ESTIMATOR_TREND ? (bwest::Estimator *)&trend : (bwest::Estimator *)&igi;
+    std::vector<uint32_t> served(trace.gaps.size(), 0);
+
+    bwest::Estimate e;
+    for (uint32_t n = 0; n < maxTrains; n++)
+    {
+        // Closest recorded gap to the one the estimator asks for
+        uint32_t want = est->NextGapNs();
+        size_t k = std::lower_bound(trace.gaps.begin(), trace.gaps.end(), want,
+            [](const GridTrace::Gap &g, uint32_t v) { return g.gapNs < v; }) - trace.gaps.begin();
+        if (k == trace.gaps.size() || (k > 0 && want - trace.gaps[k - 1].gapNs < trace.gaps[k].gapNs - want))
+        {
+            k--;
+        }
+        const GridTrace::Gap &gap = trace.gaps[k];
+        if (fabs((double)gap.gapNs - (double)want) > gapTolerance * want)
+        {
+            result.uncovered = 1;
+            break;
+        }
+        const GridTrace::Train &train = trace.trains[gap.trains[served[k]++ % gap.trains.size()]];
+
+        int64_t firstTx = 0;
+        int64_t lastTx = 0;
+        for (uint64_t i = train.first; i < train.first + train.count; i++)
+        {
+            const bwest::CaptureRecord &c = records[i];
+            if (c.op != bwest::CAPTURE_PROBE || c.seq >= trainSize)
+            {
+                continue;
+            }
+            firstTx = firstTx ? firstTx : c.txNs;
+            lastTx = c.txNs;
+            result.probeBytes += c.size;
+            bwest::ProbeRecord r;
+            r.train = n;
+            r.seq = c.seq;
+            r.txNs = c.txNs;
+            r.rxNs = c.rxNs;
+            r.size = c.size;
+            est->Push(r);
+        }
+        result.trainsSent++;
+        result.probeNs += lastTx - firstTx;
+        est->Flush();
+        if (!est->Poll(&e))
+        {
+            continue;
+        }
+        result.trains = e.trains;
+        if (e.converged)
+        {
+            result.converged = 1;
+            result.estimateMbps = e.kind == bwest::ESTIMATOR_TREND ? (e.availLowMbps + e.availHighMbps) / 2 : e.igiAvailMbps;
+            result.errorMbps = result.estimateMbps - result.truthMbps;
+            break;
+        }
+    }
+    return result;
+}
+
+double GridEvaluator::RunGrid(WorkPool *pool)
+{
+    uint32_t points = (uint32_t)m_points.size();
+    m_results.assign(m_traces.size() * points, GridResult());
+    int64_t start = MonotonicNs();
+    pool->Run((uint32_t)m_results.size(), [this, points](uint32_t job, uint32_t worker) {
+        (void)worker;
+        GridResult &r = m_results[job];
+        r = EvaluateGridPoint(*m_traces[job / points], m_points[job % points], m_config.maxTrains, m_config.gapTolerance);
+        r.trace = job / points;
+        r.point = job % points;
+    });
+    return (MonotonicNs() - start) / 1e6;
+}
+
+int GridEvaluator::Run(void)
+{
+    WorkPool pool(m_config.threads);
+    double elapsedMs = RunGrid(&pool);
+    Report(elapsedMs, &pool);
+
+    if (m_config.scaling)
+    {
+        double base = 0;
+        for (uint32_t threads = 1; ; threads = std::min(threads * 2, pool.Threads()))
+        {
+            WorkPool scaled(threads);
+            double ms = RunGrid(&scaled);
+            base = threads == 1 ? ms : base;
+            printf("GRID-SCALING threads=%u elapsed_ms=%.1f speedup=%.2f efficiency=%.2f\n", threads, ms, base / ms,
+                base / ms / threads);
+            if (threads == pool.Threads())
+            {
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+void GridEvaluator::Report(double elapsedMs, WorkPool *pool)
+{
+    uint32_t points = (uint32_t)m_points.size();
+
+    if (!m_config.out.empty())
+    {
+        FILE *out = fopen(m_config.out.c_str(), "w");
+        if (!out)
+        {
+            perror("bwprobe grid: result table");
+        }
+        else
+        {
+            fprintf(out, "trace,method,threshold,step_us,gb_us,train,pct,pdt,groups,trains,converged,uncovered,"
+                "estimate_mbps,truth_mbps,error_mbps,probe_bytes,probe_ms\n");
+            for (size_t j = 0; j < m_results.size(); j++)
+            {
+                const GridResult &r = m_results[j];
+                const GridPoint &p = m_points[r.point];
+                bool trend = p.kind == bwest::ESTIMATOR_TREND;
+                fprintf(out, "%s,%s,%g,%g,%g,%u,%g,%g,%u,%u,%d,%d,%.4f,%.4f,%.4f,%llu,%.3f\n", m_traces[r.trace]->path.c_str(),
+                    trend ? "slops" : "igi", trend ? 0.0 : p.igi.threshold, trend ? 0.0 : p.igi.stepNs / 1000.0,
+                    trend ? 0.0 : p.igi.gBNs / 1000.0, trend ? p.trend.trainSize : p.igi.trainSize,
+                    trend ? p.trend.pctThreshold : 0.0, trend ? p.trend.pdtThreshold : 0.0, trend ? p.trend.groups : 0,
+                    r.trains, r.converged, r.uncovered, r.estimateMbps, r.truthMbps, r.errorMbps,
+                    (unsigned long long)r.probeBytes, r.probeNs / 1e6);
+            }
+            fclose(out);
+        }
+    }
+
+    // Per configuration over all traces of its method: how often it converges, how far off
+    struct Score
+    {
+        uint32_t point;
+        uint32_t traces;
+        uint32_t converged;
+        uint32_t uncovered;
+        double absError;
+        double trains;
+    };
+    std::vector<Score> scores(points);
+    for (uint32_t p = 0; p < points; p++)
+    {
+        memset(&scores[p], 0, sizeof(Score));
+        scores[p].point = p;
+    }
+    for (size_t j = 0; j < m_results.size(); j++)
+    {
+        const GridResult &r = m_results[j];
+        if (m_traces[r.trace]->file.Kind() != m_points[r.point].kind)
+        {
+            continue;
+        }
+        Score &s = scores[r.point];
+        s.traces++;
+        s.uncovered += r.uncovered;
+        if (r.converged)
+        {
+            s.converged++;
+            s.absError += fabs(r.errorMbps);
+            s.trains += r.trains;
+        }
+    }
+    for (uint32_t p = 0; p < points; p++)
+    {
+        if (scores[p].converged > 0)
+        {
+            scores[p].absError /= scores[p].converged;
+            scores[p].trains /= scores[p].converged;
+        }
+    }
+    std::sort(scores.begin(), scores.end(), [](const Score &a, const Score &b) {
+        double ca = a.traces ? (double)a.converged / a.traces : 0;
+        double cb = b.traces ? (double)b.converged / b.traces : 0;
+        if (ca != cb)
+        {
+            return ca > cb;
+        }
+        return a.absError != b.absError ? a.absError < b.absError : a.trains < b.trains;
+    });
+
+    for (uint32_t i = 0; i < std::min<uint32_t>(m_config.top, points); i++)
+    {
+        const Score &s = scores[i];
+        const GridPoint &p = m_points[s.point];
+        if (p.kind == bwest::ESTIMATOR_TREND)
+        {
+            printf("Grid :: #%u slops pct=%.3f pdt=%.3f groups=%u train=%u", i + 1, p.trend.pctThreshold,
+                p.trend.pdtThreshold, p.trend.groups, p.trend.trainSize);
+        }
+        else
+        {
+            printf("Grid :: #%u igi threshold=%.3f step_us=%.1f gb_us=%.1f train=%u", i + 1, p.igi.threshold,
+                p.igi.stepNs / 1000.0, p.igi.gBNs / 1000.0, p.igi.trainSize);
+        }
+        printf(" :: converged %u/%u (uncovered %u) :: mean |error| %.3f Mbps :: trains %.1f\n", s.converged, s.traces,
+            s.uncovered, s.absError, s.trains);
+    }
+
+    uint64_t steals = 0;
+    double minBusy = 0;
+    double maxBusy = 0;
+    for (uint32_t w = 0; w < pool->Threads(); w++)
+    {
+        WorkerStats stats = pool->Stats(w);
+        steals += stats.steals;
+        minBusy = w == 0 ? stats.busyNs : std::min(minBusy, (double)stats.busyNs);
+        maxBusy = std::max(maxBusy, (double)stats.busyNs);
+    }
+    printf("GRID traces=%zu points=%u jobs=%zu threads=%u elapsed_ms=%.1f jobs_per_s=%.0f steals=%llu busy_balance=%.2f\n",
+        m_traces.size(), points, m_results.size(), pool->Threads(), elapsedMs,
+        elapsedMs > 0 ? m_results.size() / (elapsedMs / 1000) : 0.0, (unsigned long long)steals,
+        maxBusy > 0 ? minBusy / maxBusy : 1.0);
+}
+
+} // namespace bwprobe
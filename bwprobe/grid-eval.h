@@ -0,0 +1,129 @@
+// Offline scoring of estimator configurations against recorded probe captures
+// (bw-capture.h). Every (trace x configuration) pair is one job on a WorkPool; the
+// traces are mapped read-only once and shared by all workers.
+//
+// A job drives a fresh estimator the way a live run would, except that each train the
+// estimator asks for (NextGapNs) is served from the trace: the recorded train whose
+// source gap is closest, cycling through the trains recorded at that gap. Shorter trains
+// are the recorded trains' prefixes. A job ends when the estimator converges, after
+// maxTrains trains, or when the trace has no train within gapTolerance of the asked gap.
+#ifndef BWPROBE_GRID_EVAL_H
+#define BWPROBE_GRID_EVAL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../bw-capture.h"
+#include "work-pool.h"
+
+namespace bwprobe {
+
+// The search axes; every combination is one configuration. Axes that do not apply to a
+// trace's method are ignored for it.
+struct GridAxes
+{
+    std::vector<double> thresholds;     // IGI
+    std::vector<uint32_t> stepsNs;      // IGI gap step
+    std::vector<uint32_t> gbNs;         // IGI bottleneck gap, the search starts at half of it
+    std::vector<uint32_t> trainSizes;
+    std::vector<double> pct;            // SLoPS
+    std::vector<double> pdt;
+    std::vector<uint32_t> groups;
+};
+
+struct GridConfig
+{
+    std::vector<std::string> traces;
+    std::vector<double> crossMbps;      // known cross traffic per trace (the scenario's)
+    GridAxes axes;
+    uint32_t threads;                   // 0 = one per online CPU
+    uint32_t maxTrains;
+    double gapTolerance;                // relative
+    std::string out;                    // CSV of every job, empty for none
+    uint32_t top;                       // best configurations to print
+    bool scaling;                       // also time the grid on 1, 2, 4 ... threads
+
+    GridConfig() :
+        threads(0), maxTrains(100), gapTolerance(0.1), top(10), scaling(false)
+    {
+    }
+};
+
+// One estimator configuration of the grid
+struct GridPoint
+{
+    bwest::EstimatorKind kind;
+    bwest::IgiConfig igi;
+    bwest::TrendConfig trend;
+};
+
+struct GridResult
+{
+    uint32_t trace;
+    uint32_t point;
+    uint32_t trains;        // trains the configuration needed
+    uint32_t trainsSent;    // including the ones that gave no estimate
+    uint64_t probeBytes;
+    int64_t probeNs;        // summed send time of those trains, turnarounds not included
+    int converged;
+    int uncovered;          // stopped because the trace had no train near the asked gap
+    double estimateMbps;    // available bandwidth; IGI, or the middle of the SLoPS range
+    double truthMbps;
+    double errorMbps;       // estimate - truth, when converged
+};
+
+// A trace's trains, grouped by the source gap they were sent with
+struct GridTrace
+{
+    struct Train
+    {
+        uint64_t first;
+        uint32_t count;
+        uint32_t packets;   // probe records among them
+    };
+    struct Gap
+    {
+        uint32_t gapNs;
+        std::vector<uint32_t> trains;   // into trains, in recorded order
+    };
+
+    std::string path;
+    double crossMbps;
+    bwest::CaptureFile file;
+    std::vector<Train> trains;
+    std::vector<Gap> gaps;              // ascending
+    uint32_t trainSize;                 // as recorded
+};
+
+// Maps a capture and groups its trains by gap; false with a reason in *error
+bool LoadGridTrace(const std::string &path, double crossMbps, GridTrace *trace, std::string *error);
+
+// One job: drives a fresh estimator with `point` over `trace` (see the top of this file).
+// trace and point of the result are left for the caller.
+GridResult EvaluateGridPoint(const GridTrace &trace, const GridPoint &point, uint32_t maxTrains, double gapTolerance);
+
+class GridEvaluator
+{
+public:
+    explicit GridEvaluator(const GridConfig &config);
+    ~GridEvaluator();
+
+    // Maps the traces and builds the grid; false with a reason in *error
+    bool Load(std::string *error);
+    int Run(void);
+
+private:
+    void BuildPoints(void);
+    double RunGrid(WorkPool *pool);
+    void Report(double elapsedMs, WorkPool *pool);
+
+    GridConfig m_config;
+    std::vector<GridTrace *> m_traces;
+    std::vector<GridPoint> m_points;
+    std::vector<GridResult> m_results;  // job = trace * points + point
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_GRID_EVAL_H
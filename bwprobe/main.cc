@@ -0,0 +1,404 @@
+// bwprobe: native Pathload/IGI prober over real sockets.
+//
+//   bwprobe server [--port 8080] [--probe-to host:port] [--idle-us 10000] [--once]
+//                  [--spin-us 0 (calibrate)] [--max-pace-error-us 10] [--io batched|simple]
+//                  [--batch-window-us 2]
+//   bwprobe client [--server 127.0.0.1] [--port 8080] [--udp-port 8090] [--method igi|slops]
+//                  [--size 700] [--bottleneck 10] [--train 60] [--gb-us 600] [--step-us gb/8]
+//                  [--threshold 0.2] [--groups 10] [--pct 0.55] [--pdt 0.4] [--max-trains 200] [--io batched|simple]
+//                  [--pipeline on|off] [--ring 4096] [--drop train|newest] [--estimator-cost-us 0]
+//                  [--record file] [--dump file]
+//   bwprobe replay --log file [--against file] [--tolerance-mbps 0.001]
+//   bwprobe offline --from file [--threshold x] [--pct x] [--pdt x] [--bottleneck x] [--all]
+//                  [--repeat 1] [--verbose]
+//   bwprobe grid   --traces a.bwc,b.bwc [--cross 7 | --cross 7,3] [--threads 0 (per CPU)]
+//                  [--thresholds 0.1,0.2] [--steps-us 50,75] [--gb-us 600] [--trains 30,60]
+//                  [--pct 0.5,0.55] [--pdt 0.3,0.4] [--groups 5,10] [--max-trains 100]
+//                  [--gap-tolerance 0.1] [--out grid.csv] [--top 10] [--scaling]
+//   bwprobe tune   --traces a.bwc,b.bwc [--cross 7 | --cross 7,3] [--classes c | --classes c1,c2]
+//                  [--samples 81] [--eta 3] [--max-trains 100] [--top 3] [--threads 0] [--seed 1]
+//                  [--error-weight 1] [--bytes-weight 0.05] [--time-weight 0.1] [--rtt-ms 8]
+//                  [--gap-tolerance 0.1] [--out tuned.txt]
+//   bwprobe reflect [--udp-port 8090] [--idle-us 50000]
+//   bwprobe fleet  [--targets 100 | --targets-file f] [--udp-port 8090] [--workers 0 (per CPU)]
+//                  [--concurrent 4] [--interval-ms 1000] [--duration 10] [--timeout-ms 500]
+//                  [--size 700] [--bottleneck 10] [--train 60] [--gb-us 600] [--threshold 0.2]
+//                  [--spin-us 0] [--max-pace-error-us 10] [--tick-us 100] [--pin] [--verbose]
+//
+// The estimation itself is bw-estimator.h, the same code the ns-3 scenarios run.
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "probe-common.h"
+#include "probe-client.h"
+#include "probe-server.h"
+#include "reflector.h"
+#include "fleet-prober.h"
+#include "grid-eval.h"
+#include "tuner.h"
+
+using namespace bwprobe;
+
+static int Usage(void)
+{
+    fprintf(stderr,
+        "usage: bwprobe server [--port 8080] [--probe-to host:port] [--idle-us 10000] [--once]\n"
+        "                      [--spin-us 0] [--max-pace-error-us 10] [--io batched|simple] [--batch-window-us 2]\n"
+        "       bwprobe client [--server host] [--port 8080] [--udp-port 8090] [--method igi|slops]\n"
+        "                      [--size 700] [--bottleneck 10] [--train 60] [--gb-us 600] [--step-us gb/8]\n"
+        "                      [--threshold 0.2] [--groups 10] [--pct 0.55] [--pdt 0.4] [--max-trains 200] [--io batched|simple]\n"
+        "                      [--pipeline on|off] [--ring 4096] [--drop train|newest] [--estimator-cost-us 0]\n"
+        "                      [--record file] [--dump file]\n"
+        "       bwprobe replay --log file [--against file] [--tolerance-mbps 0.001]\n"
+        "       bwprobe offline --from file [--threshold x] [--pct x] [--pdt x] [--bottleneck x] [--all]\n"
+        "                       [--repeat 1] [--verbose]\n"
+        "       bwprobe grid --traces a.bwc,b.bwc [--cross 7 | --cross 7,3] [--threads 0]\n"
+        "                    [--thresholds 0.1,0.2] [--steps-us 50,75] [--gb-us 600] [--trains 30,60]\n"
+        "                    [--pct 0.5,0.55] [--pdt 0.3,0.4] [--groups 5,10] [--max-trains 100]\n"
+        "                    [--gap-tolerance 0.1] [--out grid.csv] [--top 10] [--scaling]\n"
+        "       bwprobe tune --traces a.bwc,b.bwc [--cross 7 | --cross 7,3] [--classes c | --classes c1,c2]\n"
+        "                    [--samples 81] [--eta 3] [--max-trains 100] [--top 3] [--threads 0] [--seed 1]\n"
+        "                    [--error-weight 1] [--bytes-weight 0.05] [--time-weight 0.1] [--rtt-ms 8]\n"
+        "                    [--gap-tolerance 0.1] [--out tuned.txt]\n"
+        "       bwprobe reflect [--udp-port 8090] [--idle-us 50000]\n"
+        "       bwprobe fleet [--targets 100 | --targets-file f] [--udp-port 8090] [--workers 0]\n"
+        "                     [--concurrent 4] [--interval-ms 1000] [--duration 10] [--timeout-ms 500]\n"
+        "                     [--size 700] [--bottleneck 10] [--train 60] [--gb-us 600] [--threshold 0.2]\n"
+        "                     [--spin-us 0] [--max-pace-error-us 10] [--tick-us 100] [--pin] [--verbose]\n");
+    return 2;
+}
+
+static int RunServer(const Options &opts)
+{
+    ServerConfig config;
+    config.tcpPort = (uint16_t)opts.GetUint("port", config.tcpPort);
+    config.probeTo = opts.GetString("probe-to", "");
+    config.idleUs = opts.GetUint("idle-us", config.idleUs);
+    config.once = opts.Has("once");
+    config.pacer.spinNs = opts.GetUint("spin-us", 0) * 1000;
+    config.pacer.maxErrorNs = (uint32_t)(opts.GetDouble("max-pace-error-us", config.pacer.maxErrorNs / 1000.0) * 1000);
+    config.batchedIo = opts.GetString("io", "batched") != "simple";
+    config.batchWindowNs = (uint32_t)(opts.GetDouble("batch-window-us", config.batchWindowNs / 1000.0) * 1000);
+
+    ProbeServer server(config);
+    return server.Run();
+}
+
+static int RunClient(const Options &opts)
+{
+    ClientConfig config;
+    config.server = opts.GetString("server", config.server);
+    config.tcpPort = (uint16_t)opts.GetUint("port", config.tcpPort);
+    config.udpPort = (uint16_t)opts.GetUint("udp-port", config.udpPort);
+    config.method = opts.GetString("method", config.method);
+    config.packetSize = std::min<uint32_t>(std::max<uint32_t>(opts.GetUint("size", config.packetSize),
+        bwest::PROBE_HEADER_SIZE), MAX_PROBE_SIZE);
+    config.maxTrains = opts.GetUint("max-trains", config.maxTrains);
+    config.batchedIo = opts.GetString("io", "batched") != "simple";
+    config.pipeline = opts.GetString("pipeline", "on") != "off";
+    config.ringSize = std::max<uint32_t>(opts.GetUint("ring", config.ringSize), 2);
+    config.dropPolicy = opts.GetString("drop", "train") == "newest" ? DROP_NEWEST : DROP_TRAIN;
+    config.estimatorCostUs = opts.GetUint("estimator-cost-us", config.estimatorCostUs);
+    config.recordPath = opts.GetString("record", "");
+    config.dumpPath = opts.GetString("dump", "");
+
+    config.igi.bottleneckMbps = opts.GetDouble("bottleneck", config.igi.bottleneckMbps);
+    config.igi.trainSize = opts.GetUint("train", config.igi.trainSize);
+    config.igi.gBNs = opts.GetUint("gb-us", config.igi.gBNs / 1000) * 1000;
+    config.igi.stepNs = opts.GetUint("step-us", config.igi.gBNs / 8000) * 1000;
+    config.igi.threshold = opts.GetDouble("threshold", config.igi.threshold);
+
+    config.trend.bottleneckMbps = opts.GetDouble("bottleneck", config.trend.bottleneckMbps);
+    config.trend.trainSize = opts.GetUint("train", config.trend.trainSize);
+    config.trend.groups = opts.GetUint("groups", config.trend.groups);
+    config.trend.initialGapNs = opts.GetUint("gap-us", config.trend.initialGapNs / 1000) * 1000;
+    config.trend.pctThreshold = opts.GetDouble("pct", config.trend.pctThreshold);
+    config.trend.pdtThreshold = opts.GetDouble("pdt", config.trend.pdtThreshold);
+
+    if (config.method != "igi" && config.method != "slops")
+    {
+        return Usage();
+    }
+    if (config.trend.groups == 0 || config.trend.groups > config.trend.trainSize || config.trend.initialGapNs == 0)
+    {
+        fprintf(stderr, "bwprobe client: need 0 < groups <= train and a non-zero gap\n");
+        return 2;
+    }
+
+    ProbeClient client(config);
+    return client.Run();
+}
+
+// Runs a record log's inputs through bw-estimator.h and checks the estimates against the
+// ones the log recorded, or against another log's (the other side of parity.sh)
+static int RunReplay(const Options &opts)
+{
+    std::string path = opts.GetString("log", "");
+    std::string against = opts.GetString("against", "");
+    if (path.empty())
+    {
+        return Usage();
+    }
+    bwest::RecordLog log;
+    bwest::RecordLog other;
+    std::string error;
+    if (!bwest::ReadRecordLog(path, &log, &error) || (!against.empty() && !bwest::ReadRecordLog(against, &other, &error)))
+    {
+        fprintf(stderr, "bwprobe replay: %s\n", error.c_str());
+        return 2;
+    }
+    bwest::ParityTolerance tol;
+    tol.mbps = opts.GetDouble("tolerance-mbps", tol.mbps);
+
+    std::vector<bwest::Estimate> replayed = bwest::ReplayRecordLog(log);
+    const std::vector<bwest::Estimate> &expected = against.empty() ? log.estimates : other.estimates;
+    std::string why;
+    bool ok = bwest::CompareEstimates(replayed, expected, tol, &why);
+
+    uint32_t records = 0;
+    for (size_t i = 0; i < log.entries.size(); i++)
+    {
+        records += log.entries[i].op == 'R';
+    }
+    const char *finalMbps = "-";
+    char buf[64];
+    if (!replayed.empty())
+    {
+        const bwest::Estimate &e = replayed.back();
+        snprintf(buf, sizeof(buf), "%.3f", e.kind == bwest::ESTIMATOR_IGI ? e.igiAvailMbps : e.availLowMbps);
+        finalMbps = buf;
+    }
+    printf("PARITY %s method=%s records=%u replayed=%zu expected=%zu final_mbps=%s%s%s\n", ok ? "ok" : "mismatch",
+        log.kind == bwest::ESTIMATOR_TREND ? "slops" : "igi", records, replayed.size(), expected.size(), finalMbps,
+        ok ? "" : " :: ", why.c_str());
+    return ok ? 0 : 1;
+}
+
+// Re-runs a binary capture (client --dump, or a simulation's --dump) through the estimator
+// with the run's configuration, or with overridden thresholds, straight from the mapping
+static int RunOffline(const Options &opts)
+{
+    std::string path = opts.GetString("from", "");
+    if (path.empty())
+    {
+        return Usage();
+    }
+    bwest::CaptureFile capture;
+    std::string error;
+    if (!capture.Open(path, &error))
+    {
+        fprintf(stderr, "bwprobe offline: %s\n", error.c_str());
+        return 2;
+    }
+    bool trend = capture.Kind() == bwest::ESTIMATOR_TREND;
+    bwest::IgiConfig igi = capture.Igi();
+    igi.bottleneckMbps = opts.GetDouble("bottleneck", igi.bottleneckMbps);
+    igi.threshold = opts.GetDouble("threshold", igi.threshold);
+    bwest::TrendConfig slops = capture.Trend();
+    slops.bottleneckMbps = opts.GetDouble("bottleneck", slops.bottleneckMbps);
+    slops.pctThreshold = opts.GetDouble("pct", slops.pctThreshold);
+    slops.pdtThreshold = opts.GetDouble("pdt", slops.pdtThreshold);
+    if (trend && (slops.trainSize == 0 || slops.groups == 0 || slops.groups > slops.trainSize))
+    {
+        fprintf(stderr, "bwprobe offline: %s has no usable SLoPS configuration\n", path.c_str());
+        return 2;
+    }
+    // By default a pass ends where the live run would have stopped probing
+    bool all = opts.Has("all");
+    uint32_t repeat = std::max<uint32_t>(opts.GetUint("repeat", 1), 1);
+
+    std::vector<bwest::Estimate> estimates;
+    int64_t start = MonotonicNs();
+    for (uint32_t pass = 0; pass < repeat; pass++)
+    {
+        bwest::IgiEstimator igiEstimator(igi);
+        bwest::TrendEstimator trendEstimator(slops);
+        bwest::Estimator *est = trend ? (bwest::Estimator *)&trendEstimator : (bwest::Estimator *)&igiEstimator;
+        estimates.clear();
+        bwest::ReplayCapture(capture.Records(), capture.RecordCount(), est, &estimates, !all);
+    }
+    double passUs = (MonotonicNs() - start) / 1000.0 / repeat;
+
+    int converged = -1;
+    for (size_t i = 0; i < estimates.size(); i++)
+    {
+        const bwest::Estimate &e = estimates[i];
+        if (opts.Has("verbose"))
+        {
+            printf("Offline :: Train %u :: norm %.4f :: PCT %.2f :: PDT %.2f :: avail %.3f (%.3f ~ %.3f) Mbps%s\n",
+                e.train, e.equalNorm, e.pct, e.pdt, e.igiAvailMbps, e.availLowMbps, e.availHighMbps,
+                e.converged ? " :: converged" : "");
+        }
+        if (e.converged && converged < 0)
+        {
+            converged = (int)i;
+        }
+    }
+    const bwest::Estimate *last = estimates.empty() ? 0 : &estimates[converged >= 0 ? converged : estimates.size() - 1];
+    printf("OFFLINE method=%s records=%llu trains=%llu estimates=%zu converged=%d train=%d avail_mbps=%.3f "
+        "low_mbps=%.3f high_mbps=%.3f pass_us=%.1f records_per_s=%.0f\n",
+        trend ? "slops" : "igi", (unsigned long long)capture.RecordCount(), (unsigned long long)capture.TrainCount(),
+        estimates.size(), converged >= 0 ? 1 : 0, last ? (int)last->train : -1, last ? last->igiAvailMbps : 0.0,
+        last ? last->availLowMbps : 0.0, last ? last->availHighMbps : 0.0, passUs,
+        passUs > 0 ? capture.RecordCount() / (passUs / 1e6) : 0.0);
+    return 0;
+}
+
+static std::vector<uint32_t> UsList(const Options &opts, const std::string &key)
+{
+    std::vector<double> us = opts.GetDoubleList(key, "");
+    std::vector<uint32_t> ns;
+    for (size_t i = 0; i < us.size(); i++)
+    {
+        ns.push_back((uint32_t)(us[i] * 1000));
+    }
+    return ns;
+}
+
+static std::vector<uint32_t> UintList(const Options &opts, const std::string &key)
+{
+    std::vector<double> values = opts.GetDoubleList(key, "");
+    return std::vector<uint32_t>(values.begin(), values.end());
+}
+
+static int RunGrid(const Options &opts)
+{
+    GridConfig config;
+    config.traces = opts.GetList("traces", "");
+    config.crossMbps = opts.GetDoubleList("cross", "0");
+    config.threads = opts.GetUint("threads", config.threads);
+    config.maxTrains = std::max<uint32_t>(opts.GetUint("max-trains", config.maxTrains), 1);
+    config.gapTolerance = opts.GetDouble("gap-tolerance", config.gapTolerance);
+    config.out = opts.GetString("out", "");
+    config.top = opts.GetUint("top", config.top);
+    config.scaling = opts.Has("scaling");
+    config.axes.thresholds = opts.GetDoubleList("thresholds", "");
+    config.axes.stepsNs = UsList(opts, "steps-us");
+    config.axes.gbNs = UsList(opts, "gb-us");
+    config.axes.trainSizes = UintList(opts, "trains");
+    config.axes.pct = opts.GetDoubleList("pct", "");
+    config.axes.pdt = opts.GetDoubleList("pdt", "");
+    config.axes.groups = UintList(opts, "groups");
+
+    GridEvaluator grid(config);
+    std::string error;
+    if (!grid.Load(&error))
+    {
+        fprintf(stderr, "bwprobe grid: %s\n", error.c_str());
+        return 2;
+    }
+    return grid.Run();
+}
+
+static int RunTune(const Options &opts)
+{
+    TuneConfig config;
+    config.traces = opts.GetList("traces", "");
+    config.crossMbps = opts.GetDoubleList("cross", "0");
+    config.classes = opts.GetList("classes", "");
+    config.samples = std::max<uint32_t>(opts.GetUint("samples", config.samples), 1);
+    config.eta = opts.GetUint("eta", config.eta);
+    config.maxTrains = std::max<uint32_t>(opts.GetUint("max-trains", config.maxTrains), 2);
+    config.top = std::max<uint32_t>(opts.GetUint("top", config.top), 1);
+    config.threads = opts.GetUint("threads", config.threads);
+    config.seed = opts.GetUint("seed", config.seed);
+    config.gapTolerance = opts.GetDouble("gap-tolerance", config.gapTolerance);
+    config.errorWeight = opts.GetDouble("error-weight", config.errorWeight);
+    config.bytesWeight = opts.GetDouble("bytes-weight", config.bytesWeight);
+    config.timeWeight = opts.GetDouble("time-weight", config.timeWeight);
+    config.rttMs = opts.GetDouble("rtt-ms", config.rttMs);
+    config.out = opts.GetString("out", "");
+
+    Tuner tuner(config);
+    std::string error;
+    if (!tuner.Load(&error))
+    {
+        fprintf(stderr, "bwprobe tune: %s\n", error.c_str());
+        return 2;
+    }
+    return tuner.Run();
+}
+
+static int RunReflector(const Options &opts)
+{
+    ReflectorConfig config;
+    config.udpPort = (uint16_t)opts.GetUint("udp-port", config.udpPort);
+    config.idleUs = opts.GetUint("idle-us", config.idleUs);
+
+    Reflector reflector(config);
+    return reflector.Run();
+}
+
+static int RunFleet(const Options &opts)
+{
+    FleetConfig config;
+    config.targetsFile = opts.GetString("targets-file", "");
+    config.syntheticTargets = opts.GetUint("targets", config.syntheticTargets);
+    config.udpPort = (uint16_t)opts.GetUint("udp-port", config.udpPort);
+    config.workers = opts.GetUint("workers", config.workers);
+    config.concurrent = std::max<uint32_t>(opts.GetUint("concurrent", config.concurrent), 1);
+    config.intervalMs = opts.GetUint("interval-ms", config.intervalMs);
+    config.timeoutMs = opts.GetUint("timeout-ms", config.timeoutMs);
+    config.durationS = opts.GetDouble("duration", config.durationS);
+    config.packetSize = std::min<uint32_t>(std::max<uint32_t>(opts.GetUint("size", config.packetSize),
+        bwest::PROBE_HEADER_SIZE), MAX_PROBE_SIZE);
+    config.tickUs = std::max<uint32_t>(opts.GetUint("tick-us", config.tickUs), 1);
+    config.pin = opts.Has("pin");
+    config.verbose = opts.Has("verbose");
+    config.pacer.spinNs = opts.GetUint("spin-us", 0) * 1000;
+    config.pacer.maxErrorNs = (uint32_t)(opts.GetDouble("max-pace-error-us", config.pacer.maxErrorNs / 1000.0) * 1000);
+
+    config.igi.bottleneckMbps = opts.GetDouble("bottleneck", config.igi.bottleneckMbps);
+    config.igi.trainSize = std::max<uint32_t>(opts.GetUint("train", config.igi.trainSize), 2);
+    config.igi.gBNs = opts.GetUint("gb-us", config.igi.gBNs / 1000) * 1000;
+    config.igi.stepNs = config.igi.gBNs / 8;
+    config.igi.threshold = opts.GetDouble("threshold", config.igi.threshold);
+
+    FleetProber fleet(config);
+    return fleet.Run();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        return Usage();
+    }
+    Options opts(argc, argv, 2);
+    if (strcmp(argv[1], "server") == 0)
+    {
+        return RunServer(opts);
+    }
+    if (strcmp(argv[1], "client") == 0)
+    {
+        return RunClient(opts);
+    }
+    if (strcmp(argv[1], "replay") == 0)
+    {
+        return RunReplay(opts);
+    }
+    if (strcmp(argv[1], "offline") == 0)
+    {
+        return RunOffline(opts);
+    }
+    if (strcmp(argv[1], "grid") == 0)
+    {
+        return RunGrid(opts);
+    }
+    if (strcmp(argv[1], "tune") == 0)
+    {
+        return RunTune(opts);
+    }
+    if (strcmp(argv[1], "reflect") == 0)
+    {
+        return RunReflector(opts);
+    }
+    if (strcmp(argv[1], "fleet") == 0)
+    {
+        return RunFleet(opts);
+    }
+    return Usage();
+}
@@ -0,0 +1,149 @@
+#include "pacer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+static inline void CpuRelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void SleepUntil(int64_t deadlineNs)
+{
+    struct timespec ts;
+    ts.tv_sec = deadlineNs / 1000000000LL;
+    ts.tv_nsec = deadlineNs % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+    {
+    }
+}
+
+PacingHistogram::PacingHistogram()
+{
+    Clear();
+}
+
+void PacingHistogram::Clear(void)
+{
+    memset(counts, 0, sizeof(counts));
+    samples = 0;
+    maxNs = 0;
+    sumNs = 0;
+}
+
+int64_t PacingHistogram::UpperBoundNs(uint32_t bucket)
+{
+    return 250LL << bucket;
+}
+
+void PacingHistogram::Add(int64_t errorNs)
+{
+    if (errorNs < 0)
+    {
+        errorNs = 0;
+    }
+    uint32_t b = 0;
+    while (b + 1 < BUCKETS && errorNs >= UpperBoundNs(b))
+    {
+        b++;
+    }
+    counts[b]++;
+    samples++;
+    sumNs += errorNs;
+    maxNs = std::max(maxNs, errorNs);
+}
+
+void PacingHistogram::Merge(const PacingHistogram &other)
+{
+    for (uint32_t b = 0; b < BUCKETS; b++)
+    {
+        counts[b] += other.counts[b];
+    }
+    samples += other.samples;
+    sumNs += other.sumNs;
+    maxNs = std::max(maxNs, other.maxNs);
+}
+
+double PacingHistogram::MeanNs(void) const
+{
+    return samples ? (double)sumNs / samples : 0.0;
+}
+
+std::string PacingHistogram::Format(void) const
+{
+    std::string out;
+    char buf[64];
+    for (uint32_t b = 0; b < BUCKETS; b++)
+    {
+        if (b + 1 < BUCKETS)
+        {
+            snprintf(buf, sizeof(buf), "<%gus:%u ", UpperBoundNs(b) / 1000.0, counts[b]);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), ">=%gus:%u ", UpperBoundNs(b - 1) / 1000.0, counts[b]);
+        }
+        out += buf;
+    }
+    snprintf(buf, sizeof(buf), "mean %.2fus max %.2fus", MeanNs() / 1000.0, maxNs / 1000.0);
+    out += buf;
+    return out;
+}
+
+Pacer::Pacer(const PacerConfig &config) :
+    m_config(config)
+{
+}
+
+void Pacer::Calibrate(void)
+{
+    // Overshoot of short absolute sleeps; the 99th percentile plus a little headroom
+    // is how early we have to wake up to never miss a deadline by sleeping.
+    const uint32_t rounds = 200;
+    std::vector<int64_t> overshoot(rounds);
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        int64_t deadline = MonotonicNs() + 100000;
+        SleepUntil(deadline);
+        overshoot[i] = MonotonicNs() - deadline;
+    }
+    std::sort(overshoot.begin(), overshoot.end());
+    int64_t p99 = overshoot[rounds * 99 / 100];
+    m_config.spinNs = (uint32_t)std::min<int64_t>(std::max<int64_t>(p99 + 5000, 10000), 500000);
+}
+
+void Pacer::BeginTrain(void)
+{
+    m_train.Clear();
+}
+
+int64_t Pacer::WaitUntil(int64_t deadlineNs, bool *ok)
+{
+    int64_t now = MonotonicNs();
+    if (deadlineNs - now > (int64_t)m_config.spinNs)
+    {
+        SleepUntil(deadlineNs - m_config.spinNs);
+        now = MonotonicNs();
+    }
+    while (now < deadlineNs)
+    {
+        CpuRelax();
+        now = MonotonicNs();
+    }
+    int64_t error = now - deadlineNs;
+    m_train.Add(error);
+    *ok = m_train.maxNs <= (int64_t)m_config.maxErrorNs;
+    return now;
+}
+
+} // namespace bwprobe
@@ -0,0 +1,69 @@
+// Pacing engine for the probe sender. Probe gaps are 100-300 us, far below what a plain
+// sleep can hold, so each wait sleeps with clock_nanosleep until a calibrated margin
+// before the deadline and spins on the clock for the rest. Every wait's lateness goes
+// into a per-train histogram so badly paced trains can be thrown away.
+#ifndef BWPROBE_PACER_H
+#define BWPROBE_PACER_H
+
+#include <stdint.h>
+#include <string>
+
+namespace bwprobe {
+
+struct PacerConfig
+{
+    uint32_t spinNs;        // spin this long before each deadline; 0 = calibrate at startup
+    uint32_t maxErrorNs;    // a train with any send later than this is discarded
+
+    PacerConfig() :
+        spinNs(0), maxErrorNs(10000)
+    {
+    }
+};
+
+// Lateness of each send against its deadline, log2 buckets from 250 ns up to 64 us
+struct PacingHistogram
+{
+    enum
+    {
+        BUCKETS = 10
+    };
+
+    uint32_t counts[BUCKETS];
+    uint32_t samples;
+    int64_t maxNs;
+    int64_t sumNs;
+
+    PacingHistogram();
+    void Clear(void);
+    void Add(int64_t errorNs);
+    void Merge(const PacingHistogram &other);
+    double MeanNs(void) const;
+    std::string Format(void) const;
+
+    static int64_t UpperBoundNs(uint32_t bucket);
+};
+
+class Pacer
+{
+public:
+    explicit Pacer(const PacerConfig &config);
+
+    // Measures how far clock_nanosleep overshoots on this host and sets the spin margin
+    void Calibrate(void);
+    uint32_t SpinNs(void) const { return m_config.spinNs; }
+
+    void BeginTrain(void);
+    // Blocks until deadlineNs (CLOCK_MONOTONIC). Returns the time it woke up at and
+    // records the lateness; false in *ok once the train exceeded the error threshold.
+    int64_t WaitUntil(int64_t deadlineNs, bool *ok);
+    const PacingHistogram &Train(void) const { return m_train; }
+
+private:
+    PacerConfig m_config;
+    PacingHistogram m_train;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_PACER_H
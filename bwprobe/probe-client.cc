@@ -0,0 +1,433 @@
+#include "probe-client.h"
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/socket.h>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+ProbeClient::ProbeClient(const ClientConfig &config) :
+    m_config(config), m_udpFd(-1), m_controlFd(-1), m_estimator(0), m_train(0), m_trainSize(0), m_gapNs(0),
+    m_trainEnded(false), m_settleDeadline(0), m_startNs(0), m_received(0),
+    m_discarded(0), m_receiver(0), m_capture(0), m_trainDamaged(false), m_havePrevious(false), m_noiseSamples(0), m_noiseSum(0), m_noiseSquares(0)
+{
+    if (m_config.method == "slops")
+    {
+        m_config.trend.packetSize = m_config.packetSize;
+        m_estimator = new bwest::TrendEstimator(m_config.trend);
+        m_trainSize = m_config.trend.trainSize;
+    }
+    else
+    {
+        m_estimator = new bwest::IgiEstimator(m_config.igi);
+        m_trainSize = m_config.igi.trainSize;
+    }
+}
+
+ProbeClient::~ProbeClient()
+{
+    delete m_capture;
+    delete m_estimator;
+    delete m_receiver;
+    if (m_udpFd >= 0)
+    {
+        close(m_udpFd);
+    }
+    if (m_controlFd >= 0)
+    {
+        close(m_controlFd);
+    }
+}
+
+int ProbeClient::Run(void)
+{
+    m_udpFd = CreateUdpSocket(m_config.udpPort);
+    if (m_udpFd < 0)
+    {
+        perror("bwprobe client: udp bind");
+        return 1;
+    }
+    if (!m_config.recordPath.empty() || !m_config.dumpPath.empty())
+    {
+        if (!m_config.recordPath.empty() && !m_records.Open(m_config.recordPath))
+        {
+            perror("bwprobe client: record log");
+            return 1;
+        }
+        if (!m_config.dumpPath.empty() && !m_records.OpenCapture(m_config.dumpPath))
+        {
+            perror("bwprobe client: capture dump");
+            return 1;
+        }
+        if (m_config.method == "slops")
+        {
+            m_records.Config(m_config.trend);
+        }
+        else
+        {
+            m_records.Config(m_config.igi);
+        }
+    }
+    if (m_config.pipeline)
+    {
+        m_capture = new CaptureThread(m_udpFd, m_config.batchedIo, m_config.batch, m_config.ringSize,
+            m_config.dropPolicy);
+        if (!m_capture->Start())
+        {
+            perror("bwprobe client: capture thread");
+            return 1;
+        }
+    }
+    else
+    {
+        m_receiver = new BatchReceiver(m_udpFd, m_config.batchedIo, m_config.batch, 2048);
+    }
+
+    sockaddr_in server;
+    if (!ResolveAddress(m_config.server, m_config.tcpPort, &server))
+    {
+        fprintf(stderr, "bwprobe client: cannot resolve %s\n", m_config.server.c_str());
+        return 1;
+    }
+    m_controlFd = ConnectTcp(server);
+    if (m_controlFd < 0)
+    {
+        perror("bwprobe client: connect");
+        return 1;
+    }
+    printf("ProbeClient :: Connected to %s, probes on UDP %u\n", FormatAddress(server).c_str(), m_config.udpPort);
+
+    ControlMessage hello;
+    hello.type = CONTROL_HELLO;
+    hello.train = m_config.method == "slops" ? bwest::ESTIMATOR_TREND : bwest::ESTIMATOR_IGI;
+    hello.value = m_config.packetSize;
+    hello.extra = m_config.udpPort;
+    if (!SendControl(m_controlFd, hello))
+    {
+        perror("bwprobe client: hello");
+        return 1;
+    }
+
+    m_startNs = MonotonicNs();
+    if (!RequestTrain())
+    {
+        return 1;
+    }
+
+    for (;;)
+    {
+        struct pollfd fds[2];
+        fds[0].fd = m_capture ? m_capture->WakeFd() : m_udpFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = m_controlFd;
+        fds[1].events = POLLIN;
+
+        int timeoutMs = -1;
+        if (m_trainEnded)
+        {
+            int64_t left = m_settleDeadline - MonotonicNs();
+            timeoutMs = left > 0 ? (int)(left / 1000000) + 1 : 0;
+        }
+        if (m_capture && m_capture->Pending())
+        {
+            timeoutMs = 0; // records left behind after the last completed train
+        }
+        int n = poll(fds, 2, timeoutMs);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("bwprobe client: poll");
+            return 1;
+        }
+
+        if (m_capture)
+        {
+            if (n > 0 && (fds[0].revents & POLLIN))
+            {
+                m_capture->Acknowledge();
+            }
+            DrainRing();
+        }
+        else if (n > 0 && (fds[0].revents & POLLIN))
+        {
+            DrainProbes();
+        }
+
+        bwest::Estimate estimate;
+        if (m_estimator->Poll(&estimate))
+        {
+            if (HandleEstimate(estimate))
+            {
+                return 0;
+            }
+            continue;
+        }
+
+        if (n > 0 && (fds[1].revents & (POLLIN | POLLHUP)))
+        {
+            ControlMessage msg;
+            if (RecvControl(m_controlFd, &msg) != 1)
+            {
+                fprintf(stderr, "bwprobe client: server closed the control channel\n");
+                return 1;
+            }
+            if (msg.type == CONTROL_TRAIN_END && msg.train == m_train && msg.extra)
+            {
+                // The sender could not hold the gap; the same gap is tried again
+                m_estimator->Discard();
+                m_records.Discard(m_train);
+                m_discarded++;
+                printf("ProbeClient :: Train %u discarded by the sender (pacing), retrying\n", m_train);
+                m_train++;
+                if (!RequestTrain())
+                {
+                    return 1;
+                }
+                continue;
+            }
+            if (msg.type == CONTROL_TRAIN_END && msg.train == m_train)
+            {
+                m_trainEnded = true;
+                m_settleDeadline = MonotonicNs() + (int64_t)m_config.settleMs * 1000000;
+            }
+        }
+
+        // The train is over but its last packet never showed up: close it with what arrived
+        if (m_trainEnded && MonotonicNs() >= m_settleDeadline)
+        {
+            // A lost tail leaves no later record for DrainRing to notice the damage by
+            if (m_capture && m_capture->Damaged(m_train))
+            {
+                DiscardDamaged();
+            }
+            if (m_trainDamaged)
+            {
+                m_discarded++;
+                printf("ProbeClient :: Train %u discarded (capture ring overflow), retrying\n", m_train);
+                m_train++;
+                if (!RequestTrain())
+                {
+                    return 1;
+                }
+            }
+            else if (m_estimator->Flush() && m_estimator->Poll(&estimate))
+            {
+                m_records.Flush(m_train);
+                if (HandleEstimate(estimate))
+                {
+                    return 0;
+                }
+            }
+            else
+            {
+                m_records.Flush(m_train);
+                printf("ProbeClient :: Train %u lost (%u packets), retrying\n", m_train, m_received);
+                m_train++;
+                if (!RequestTrain())
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+}
+
+bool ProbeClient::RequestTrain(void)
+{
+    ControlMessage next;
+    next.type = CONTROL_NEXT;
+    next.train = m_train;
+    m_gapNs = m_estimator->NextGapNs();
+    next.value = m_gapNs;
+    next.extra = m_trainSize;
+    m_trainEnded = false;
+    m_trainDamaged = false;
+    m_received = 0;
+    if (!SendControl(m_controlFd, next))
+    {
+        perror("bwprobe client: request train");
+        return false;
+    }
+    return true;
+}
+
+void ProbeClient::DrainProbes(void)
+{
+    uint32_t n;
+    while ((n = m_receiver->Receive()) > 0)
+    {
+        bool done = false;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            bwest::ProbeHeader header;
+            if (!bwest::ReadProbeHeader(m_receiver->Data(i), m_receiver->Length(i), &header) || header.train != m_train)
+            {
+                continue; // not a probe, or a straggler of an earlier train
+            }
+            bwest::ProbeRecord record;
+            record.train = header.train;
+            record.seq = header.seq;
+            record.txNs = header.txNs;
+            record.rxNs = m_receiver->RxNs(i);
+            record.size = m_receiver->Length(i);
+            int64_t now = m_receiver->KernelTimestamps() ? RealtimeNs() : MonotonicNs();
+            m_inlineLatency.Add(now - record.rxNs);
+            // Anything after the train's last packet belongs to no train yet
+            done = Estimate(record) || done;
+        }
+        // A short batch means the socket is empty; poll() tells us when more arrive,
+        // which saves the extra syscall that would only return EAGAIN
+        if (done || (m_receiver->Batched() && n < m_receiver->Batch()))
+        {
+            return;
+        }
+    }
+}
+
+void ProbeClient::DrainRing(void)
+{
+    bwest::ProbeRecord record;
+    while (m_capture->Pop(&record))
+    {
+        if (record.train != m_train)
+        {
+            continue; // straggler of an earlier train
+        }
+        if (m_capture->Damaged(record.train))
+        {
+            // Part of this train never made it through the ring; retried once the server is done
+            DiscardDamaged();
+            continue;
+        }
+        if (Estimate(record))
+        {
+            return; // the estimate is handled before the next train's records
+        }
+    }
+}
+
+void ProbeClient::DiscardDamaged(void)
+{
+    if (!m_trainDamaged)
+    {
+        m_estimator->Discard();
+        m_records.Discard(m_train);
+        m_trainDamaged = true;
+    }
+}
+
+bool ProbeClient::Estimate(const bwest::ProbeRecord &record)
+{
+    m_received++;
+    AddNoiseSample(record);
+    if (m_config.estimatorCostUs > 0)
+    {
+        int64_t until = MonotonicNs() + m_config.estimatorCostUs * 1000LL;
+        while (MonotonicNs() < until)
+        {
+        }
+    }
+    m_records.Record(record);
+    return m_estimator->Push(record);
+}
+
+void ProbeClient::AddNoiseSample(const bwest::ProbeRecord &record)
+{
+    if (m_havePrevious && m_previous.train == record.train && m_previous.seq + 1 == record.seq)
+    {
+        double d = (double)((record.rxNs - m_previous.rxNs) - (record.txNs - m_previous.txNs));
+        m_noiseSamples++;
+        m_noiseSum += d;
+        m_noiseSquares += d * d;
+    }
+    m_previous = record;
+    m_havePrevious = true;
+}
+
+bool ProbeClient::HandleEstimate(const bwest::Estimate &e)
+{
+    m_records.Result(e);
+    if (e.kind == bwest::ESTIMATOR_IGI)
+    {
+        printf("ProbeClient :: Train %u :: gap %u us :: srcGapSum %.0f us :: dstGapSum %.0f us :: norm %.3f\n",
+            e.train, m_gapNs / 1000, e.srcGapSumUs, e.dstGapSumUs, e.equalNorm);
+    }
+    else
+    {
+        printf("ProbeClient :: Train %u :: PCT %.2f :: PDT %.2f :: trend %d :: range %.2f ~ %.2f Mbps\n",
+            e.train, e.pct, e.pdt, e.trend, e.availLowMbps, e.availHighMbps);
+    }
+    fflush(stdout);
+
+    if (e.converged || e.trains >= m_config.maxTrains)
+    {
+        Report(e);
+        ControlMessage stop;
+        memset(&stop, 0, sizeof(stop));
+        stop.type = CONTROL_STOP;
+        SendControl(m_controlFd, stop);
+        return true;
+    }
+    m_train++;
+    return !RequestTrain();
+}
+
+void ProbeClient::Report(const bwest::Estimate &e)
+{
+    double elapsedMs = (MonotonicNs() - m_startNs) / 1e6;
+    double mean = m_noiseSamples ? m_noiseSum / m_noiseSamples : 0.0;
+    double stddev = m_noiseSamples ? sqrt(std::max(0.0, m_noiseSquares / m_noiseSamples - mean * mean)) : 0.0;
+    if (m_capture)
+    {
+        m_capture->Stop();
+        CaptureStats c = m_capture->Stats();
+        const PacingHistogram &latency = m_capture->Latency();
+        printf("ProbeClient :: io=%s%s %.3f syscalls/packet :: gap noise mean %.2f us stddev %.2f us over %llu gaps\n",
+            m_config.batchedIo ? "batched" : "simple", m_capture->KernelTimestamps() ? "+SO_TIMESTAMPNS" : "",
+            m_capture->Io().SyscallsPerPacket(), mean / 1000, stddev / 1000, (unsigned long long)m_noiseSamples);
+        printf("ProbeClient :: ring %u :: captured %llu enqueued %llu dropped %llu (%llu full batches) high water %u"
+            " :: policy %s\n", m_config.ringSize, (unsigned long long)c.captured, (unsigned long long)c.enqueued,
+            (unsigned long long)c.dropped, (unsigned long long)c.fullEvents, c.highWater,
+            m_config.dropPolicy == DROP_TRAIN ? "train" : "newest");
+        printf("ProbeClient :: capture latency %s stddev %.2fus\n", latency.Format().c_str(),
+            m_capture->LatencyStddevNs() / 1000);
+    }
+    else
+    {
+        printf("ProbeClient :: io=%s%s %.3f syscalls/packet :: gap noise mean %.2f us stddev %.2f us over %llu gaps\n",
+            m_config.batchedIo ? "batched" : "simple", m_receiver->KernelTimestamps() ? "+SO_TIMESTAMPNS" : "",
+            m_receiver->Stats().SyscallsPerPacket(), mean / 1000, stddev / 1000, (unsigned long long)m_noiseSamples);
+        printf("ProbeClient :: inline latency %s\n", m_inlineLatency.Format().c_str());
+    }
+
+    if (e.kind == bwest::ESTIMATOR_IGI)
+    {
+        double bottleneck = m_config.igi.bottleneckMbps;
+        printf("Train count(trains): %u Convergence time(ms): %.1f\n", e.trains, elapsedMs);
+        printf("===============================IGI================================\n");
+        printf("Cross traffic(Mbps): %.3f Available bandwidth(Mbps): %.3f\n", e.igiCrossMbps, e.igiAvailMbps);
+        printf("===============================PTR================================\n");
+        printf("Cross traffic(Mbps): %.3f Available bandwidth(Mbps): %.3f\n", bottleneck - e.ptrMbps, e.ptrMbps);
+        printf("==================================================================\n");
+        printf("RESULT method=igi converged=%d trains=%u discarded=%u elapsed_ms=%.1f igi_mbps=%.3f ptr_mbps=%.3f\n",
+            e.converged, e.trains, m_discarded, elapsedMs, e.igiAvailMbps, e.ptrMbps);
+    }
+    else
+    {
+        printf("Stream count(streams): %u Convergence time(ms): %.1f\n", e.trains, elapsedMs);
+        printf("==============================SLoPS===============================\n");
+        printf("Available bandwidth(Mbps): %.3f ~ %.3f\n", e.availLowMbps, e.availHighMbps);
+        printf("==================================================================\n");
+        printf("RESULT method=slops converged=%d trains=%u discarded=%u elapsed_ms=%.1f low_mbps=%.3f high_mbps=%.3f\n",
+            e.converged, e.trains, m_discarded, elapsedMs, e.availLowMbps, e.availHighMbps);
+    }
+    fflush(stdout);
+}
+
+} // namespace bwprobe
@@ -0,0 +1,96 @@
+// Native counterpart of PathloadClientApp: binds UDP 8090, asks the server for trains
+// over the TCP control channel and runs every received probe through bw-estimator.h.
+#ifndef BWPROBE_PROBE_CLIENT_H
+#define BWPROBE_PROBE_CLIENT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "batch-io.h"
+#include "capture.h"
+#include "pacer.h"
+#include "../bw-estimator.h"
+#include "../bw-records.h"
+
+namespace bwprobe {
+
+struct ClientConfig
+{
+    std::string server;
+    uint16_t tcpPort;
+    uint16_t udpPort;
+    std::string method;         // "igi" or "slops"
+    uint32_t packetSize;
+    uint32_t maxTrains;
+    uint32_t settleMs;          // wait for stragglers after the server reports the train sent
+    bool batchedIo;             // recvmmsg + kernel timestamps instead of recv + clock_gettime
+    uint32_t batch;
+    bool pipeline;              // capture thread + SPSC ring instead of estimating in the receive loop
+    uint32_t ringSize;
+    DropPolicy dropPolicy;
+    uint32_t estimatorCostUs;   // extra busy work per record, to load the estimator stage in tests
+    std::string recordPath;     // bw-records.h log of everything the estimator saw, for parity.sh
+    std::string dumpPath;       // the same inputs as a bw-capture.h binary capture, for offline runs
+    bwest::IgiConfig igi;
+    bwest::TrendConfig trend;
+
+    ClientConfig() :
+        server("127.0.0.1"), tcpPort(8080), udpPort(8090), method("igi"), packetSize(700),
+        maxTrains(200), settleMs(200), batchedIo(true), batch(64), pipeline(true), ringSize(4096),
+        dropPolicy(DROP_TRAIN), estimatorCostUs(0)
+    {
+    }
+};
+
+class ProbeClient
+{
+public:
+    explicit ProbeClient(const ClientConfig &config);
+    ~ProbeClient();
+
+    int Run(void);
+
+private:
+    bool RequestTrain(void);
+    void DrainProbes(void);
+    void DrainRing(void);
+    // Drops the current train's samples once the capture ring lost part of it
+    void DiscardDamaged(void);
+    // Returns true when the record completed a train
+    bool Estimate(const bwest::ProbeRecord &record);
+    // Returns true when the session is over
+    bool HandleEstimate(const bwest::Estimate &estimate);
+    void Report(const bwest::Estimate &estimate);
+    void AddNoiseSample(const bwest::ProbeRecord &record);
+
+    ClientConfig m_config;
+    int m_udpFd;
+    int m_controlFd;
+    bwest::Estimator *m_estimator;
+
+    uint32_t m_train;
+    uint32_t m_trainSize;
+    uint32_t m_gapNs;
+    bool m_trainEnded;
+    int64_t m_settleDeadline;
+    int64_t m_startNs;
+    uint32_t m_received;
+    uint32_t m_discarded;
+    BatchReceiver *m_receiver;
+    CaptureThread *m_capture;
+    bool m_trainDamaged;
+    PacingHistogram m_inlineLatency;    // receive to estimator, when there is no capture thread
+    bwest::RecordWriter m_records;
+
+    // Receive timestamp noise: how far each arrival gap strays from its send gap
+    bwest::ProbeRecord m_previous;
+    bool m_havePrevious;
+    uint64_t m_noiseSamples;
+    double m_noiseSum;
+    double m_noiseSquares;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_PROBE_CLIENT_H
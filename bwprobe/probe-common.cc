@@ -0,0 +1,275 @@
+#include "probe-common.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "../bw-estimator.h"
+
+namespace bwprobe {
+
+int64_t MonotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t RealtimeNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+bool SendControl(int fd, const ControlMessage &msg)
+{
+    uint8_t buf[CONTROL_MESSAGE_SIZE];
+    bwest::Write32(buf, msg.type);
+    bwest::Write32(buf + 4, msg.train);
+    bwest::Write32(buf + 8, msg.value);
+    bwest::Write32(buf + 12, msg.extra);
+
+    size_t sent = 0;
+    while (sent < sizeof(buf))
+    {
+        ssize_t n = send(fd, buf + sent, sizeof(buf) - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+int RecvControl(int fd, ControlMessage *msg)
+{
+    uint8_t buf[CONTROL_MESSAGE_SIZE];
+    size_t got = 0;
+    while (got < sizeof(buf))
+    {
+        ssize_t n = recv(fd, buf + got, sizeof(buf) - got, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == 0)
+        {
+            return 0;
+        }
+        if (n < 0)
+        {
+            return -1;
+        }
+        got += n;
+    }
+    msg->type = bwest::Read32(buf);
+    msg->train = bwest::Read32(buf + 4);
+    msg->value = bwest::Read32(buf + 8);
+    msg->extra = bwest::Read32(buf + 12);
+    return 1;
+}
+
+bool ResolveAddress(const std::string &host, uint16_t port, sockaddr_in *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &out->sin_addr) == 1)
+    {
+        return true;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo *res = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(host.c_str(), 0, &hints, &res) != 0 || !res)
+    {
+        return false;
+    }
+    out->sin_addr = ((sockaddr_in *)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+    return true;
+}
+
+bool ParseEndpoint(const std::string &text, uint16_t defaultPort, sockaddr_in *out)
+{
+    std::string::size_type colon = text.rfind(':');
+    if (colon == std::string::npos)
+    {
+        return ResolveAddress(text, defaultPort, out);
+    }
+    return ResolveAddress(text.substr(0, colon), (uint16_t)atoi(text.c_str() + colon + 1), out);
+}
+
+std::string FormatAddress(const sockaddr_in &addr)
+{
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+    char buf[INET_ADDRSTRLEN + 8];
+    snprintf(buf, sizeof(buf), "%s:%u", host, ntohs(addr.sin_port));
+    return buf;
+}
+
+int CreateTcpListener(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ConnectTcp(const sockaddr_in &addr)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    // Control messages are tiny and latency matters more than throughput
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+int CreateUdpSocket(uint16_t bindPort)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // Room for a whole train even if the reader falls behind
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(bindPort);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+Options::Options(int argc, char *argv[], int first)
+{
+    for (int i = first; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            continue;
+        }
+        arg = arg.substr(2);
+        std::string::size_type eq = arg.find('=');
+        if (eq != std::string::npos)
+        {
+            m_values[arg.substr(0, eq)] = arg.substr(eq + 1);
+        }
+        else if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+        {
+            m_values[arg] = argv[++i];
+        }
+        else
+        {
+            m_values[arg] = "1";
+        }
+    }
+}
+
+bool Options::Has(const std::string &key) const
+{
+    return m_values.count(key) != 0;
+}
+
+std::string Options::GetString(const std::string &key, const std::string &def) const
+{
+    std::map<std::string, std::string>::const_iterator it = m_values.find(key);
+    return it == m_values.end() ? def : it->second;
+}
+
+uint32_t Options::GetUint(const std::string &key, uint32_t def) const
+{
+    std::map<std::string, std::string>::const_iterator it = m_values.find(key);
+    return it == m_values.end() ? def : (uint32_t)strtoul(it->second.c_str(), 0, 10);
+}
+
+double Options::GetDouble(const std::string &key, double def) const
+{
+    std::map<std::string, std::string>::const_iterator it = m_values.find(key);
+    return it == m_values.end() ? def : strtod(it->second.c_str(), 0);
+}
+
+std::vector<std::string> Options::GetList(const std::string &key, const std::string &def) const
+{
+    std::string value = GetString(key, def);
+    std::vector<std::string> items;
+    std::string::size_type start = 0;
+    while (start <= value.size() && !value.empty())
+    {
+        std::string::size_type comma = value.find(',', start);
+        if (comma == std::string::npos)
+        {
+            comma = value.size();
+        }
+        if (comma > start)
+        {
+            items.push_back(value.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return items;
+}
+
+std::vector<double> Options::GetDoubleList(const std::string &key, const std::string &def) const
+{
+    std::vector<std::string> items = GetList(key, def);
+    std::vector<double> values;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        values.push_back(strtod(items[i].c_str(), 0));
+    }
+    return values;
+}
+
+} // namespace bwprobe
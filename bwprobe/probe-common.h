@@ -0,0 +1,110 @@
+// Pieces shared by the native prober's server (train sender) and client (receiver):
+// clocks, the TCP control channel and socket setup.
+#ifndef BWPROBE_PROBE_COMMON_H
+#define BWPROBE_PROBE_COMMON_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bwprobe {
+
+int64_t MonotonicNs(void);
+int64_t RealtimeNs(void);
+
+//================================================================
+// CONTROL CHANNEL (TCP 8080)
+//================================================================
+
+// The client drives the session, like PathloadClientApp does through the shared
+// globals in the simulation: it says hello, then asks for one train at a time.
+//
+//   client -> server  HELLO      train = method, value = probe size, extra = UDP port
+//   client -> server  NEXT       train = train id, value = gap (ns), extra = train size
+//   server -> client  TRAIN_END  train = train id, value = packets sent,
+//                                extra = 1 if the train was cut short for bad pacing
+//   client -> server  STOP
+enum ControlType
+{
+    CONTROL_HELLO = 1,
+    CONTROL_NEXT = 2,
+    CONTROL_TRAIN_END = 3,
+    CONTROL_STOP = 4
+};
+
+struct ControlMessage
+{
+    uint32_t type;
+    uint32_t train;
+    uint32_t value;
+    uint32_t extra;
+};
+
+enum
+{
+    CONTROL_MESSAGE_SIZE = 16,
+    MAX_PROBE_SIZE = 65507      // largest UDP payload over IPv4
+};
+
+bool SendControl(int fd, const ControlMessage &msg);
+// 1 on success, 0 when the peer closed the connection, -1 on error
+int RecvControl(int fd, ControlMessage *msg);
+
+//================================================================
+// REFLECTOR REPORTS
+//================================================================
+
+// The fleet prober estimates at the sender, so the reflector at each target sends the
+// receive times back: one datagram per REPORT_RECORDS probes of a train, network order.
+//
+//   header  magic "BWRR", train, record count, flags (REPORT_LAST once the train is closed)
+//   record  seq, size, tx_ns echoed from the probe, rx_ns
+enum
+{
+    REPORT_MAGIC = 0x42575252,
+    REPORT_HEADER_SIZE = 16,
+    REPORT_RECORD_SIZE = 24,
+    REPORT_RECORDS = 48,
+    REPORT_LAST = 1
+};
+
+//================================================================
+// SOCKETS
+//================================================================
+
+bool ResolveAddress(const std::string &host, uint16_t port, sockaddr_in *out);
+// host:port, port falls back to defaultPort when omitted
+bool ParseEndpoint(const std::string &text, uint16_t defaultPort, sockaddr_in *out);
+std::string FormatAddress(const sockaddr_in &addr);
+
+int CreateTcpListener(uint16_t port);
+int ConnectTcp(const sockaddr_in &addr);
+int CreateUdpSocket(uint16_t bindPort);
+
+//================================================================
+// COMMAND LINE
+//================================================================
+
+// "--key value" pairs and bare "--flag"s
+class Options
+{
+public:
+    Options(int argc, char *argv[], int first);
+
+    bool Has(const std::string &key) const;
+    std::string GetString(const std::string &key, const std::string &def) const;
+    uint32_t GetUint(const std::string &key, uint32_t def) const;
+    double GetDouble(const std::string &key, double def) const;
+    // Comma-separated values ("0.1,0.2,0.3"); def when the option is absent
+    std::vector<std::string> GetList(const std::string &key, const std::string &def) const;
+    std::vector<double> GetDoubleList(const std::string &key, const std::string &def) const;
+
+private:
+    std::map<std::string, std::string> m_values;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_PROBE_COMMON_H
@@ -0,0 +1,195 @@
+#include "probe-server.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "probe-common.h"
+#include "../bw-estimator.h"
+
+namespace bwprobe {
+
+static void SleepUntilNs(int64_t deadline)
+{
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+    {
+    }
+}
+
+ProbeServer::ProbeServer(const ServerConfig &config) :
+    m_config(config), m_listenFd(-1), m_udpFd(-1), m_packetSize(0), m_sender(0), m_pacer(config.pacer),
+    m_discarded(0)
+{
+    memset(&m_probeAddress, 0, sizeof(m_probeAddress));
+}
+
+ProbeServer::~ProbeServer()
+{
+    delete m_sender;
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+    }
+    if (m_udpFd >= 0)
+    {
+        close(m_udpFd);
+    }
+}
+
+int ProbeServer::Run(void)
+{
+    m_listenFd = CreateTcpListener(m_config.tcpPort);
+    if (m_listenFd < 0)
+    {
+        perror("bwprobe server: listen");
+        return 1;
+    }
+    m_udpFd = CreateUdpSocket(0);
+    if (m_udpFd < 0)
+    {
+        perror("bwprobe server: udp socket");
+        return 1;
+    }
+    if (m_config.pacer.spinNs == 0)
+    {
+        m_pacer.Calibrate();
+    }
+    printf("ProbeServer :: Pacing spin %.1f us, discard trains late by more than %.1f us\n",
+        m_pacer.SpinNs() / 1000.0, m_config.pacer.maxErrorNs / 1000.0);
+    printf("ProbeServer :: Listening on TCP %u\n", m_config.tcpPort);
+    fflush(stdout);
+
+    for (;;)
+    {
+        sockaddr_in peer;
+        socklen_t len = sizeof(peer);
+        int fd = accept(m_listenFd, (sockaddr *)&peer, &len);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("bwprobe server: accept");
+            return 1;
+        }
+        Serve(fd, peer);
+        close(fd);
+        if (m_config.once)
+        {
+            return 0;
+        }
+    }
+}
+
+void ProbeServer::Serve(int controlFd, const sockaddr_in &peer)
+{
+    printf("ProbeServer :: Accept %s\n", FormatAddress(peer).c_str());
+
+    ControlMessage msg;
+    if (RecvControl(controlFd, &msg) != 1 || msg.type != CONTROL_HELLO)
+    {
+        printf("ProbeServer :: No hello from client\n");
+        return;
+    }
+
+    if (msg.value < (uint32_t)bwest::PROBE_HEADER_SIZE || msg.value > (uint32_t)MAX_PROBE_SIZE)
+    {
+        printf("ProbeServer :: Bad probe size %u from client, expected %u to %u\n", msg.value,
+            (uint32_t)bwest::PROBE_HEADER_SIZE, (uint32_t)MAX_PROBE_SIZE);
+        return;
+    }
+    m_packetSize = msg.value;
+    delete m_sender;
+    m_sender = new BatchSender(m_udpFd, m_config.batchedIo, m_config.batch, m_packetSize);
+
+    m_probeAddress = peer;
+    m_probeAddress.sin_port = htons((uint16_t)msg.extra);
+    if (!m_config.probeTo.empty() && !ParseEndpoint(m_config.probeTo, (uint16_t)msg.extra, &m_probeAddress))
+    {
+        printf("ProbeServer :: Cannot resolve %s\n", m_config.probeTo.c_str());
+        return;
+    }
+    printf("ProbeServer :: Probing %s with %u byte packets\n", FormatAddress(m_probeAddress).c_str(), m_packetSize);
+
+    uint32_t trains = 0;
+    m_discarded = 0;
+    while (RecvControl(controlFd, &msg) == 1 && msg.type == CONTROL_NEXT)
+    {
+        if (m_config.idleUs)
+        {
+            SleepUntilNs(MonotonicNs() + (int64_t)m_config.idleUs * 1000);
+        }
+        bool paced = true;
+        uint32_t sent = SendTrain(msg.train, msg.value, msg.extra, &paced);
+        printf("ProbeServer :: Train %u gap %.1f us pacing %s%s\n", msg.train, msg.value / 1000.0,
+            m_pacer.Train().Format().c_str(), paced ? "" : " :: DISCARDED");
+        if (!paced)
+        {
+            m_discarded++;
+        }
+
+        ControlMessage end;
+        end.type = CONTROL_TRAIN_END;
+        end.train = msg.train;
+        end.value = sent;
+        end.extra = paced ? 0 : 1;
+        if (!SendControl(controlFd, end))
+        {
+            break;
+        }
+        trains++;
+    }
+    printf("ProbeServer :: Session end after %u trains, %u discarded for pacing\n", trains, m_discarded);
+    printf("ProbeServer :: io=%s %llu packets %.3f syscalls/packet\n", m_config.batchedIo ? "batched" : "simple",
+        (unsigned long long)m_sender->Stats().packets, m_sender->Stats().SyscallsPerPacket());
+    fflush(stdout);
+}
+
+uint32_t ProbeServer::SendTrain(uint32_t train, uint32_t gapNs, uint32_t trainSize, bool *paced)
+{
+    bwest::ProbeHeader header;
+    header.train = train;
+    header.trainSize = trainSize;
+    header.gapNs = gapNs;
+
+    uint32_t sent = 0;
+    m_pacer.BeginTrain();
+    *paced = true;
+    int64_t start = MonotonicNs();
+    uint32_t seq = 0;
+    while (seq < trainSize)
+    {
+        // Absolute deadlines so that a late packet does not push back the rest of the train.
+        // Once one send is too late the dispersion would measure us, not the path: stop.
+        int64_t now = m_pacer.WaitUntil(start + (int64_t)seq * gapNs, paced);
+        if (!*paced)
+        {
+            break;
+        }
+
+        // Probes due within the batch window of this one leave in the same syscall
+        uint32_t count = 1;
+        while (seq + count < trainSize && count < m_sender->Batch() && (uint64_t)count * gapNs <= m_config.batchWindowNs)
+        {
+            count++;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            header.seq = seq + i;
+            header.txNs = now;
+            bwest::WriteProbeHeader(m_sender->Slot(i), header);
+        }
+        sent += m_sender->Send(count, m_probeAddress);
+        seq += count;
+    }
+    return sent;
+}
+
+} // namespace bwprobe
@@ -0,0 +1,58 @@
+// Native counterpart of PathloadServerApp: accepts the control connection on TCP 8080
+// and sends paced UDP probe trains to the client's port 8090.
+#ifndef BWPROBE_PROBE_SERVER_H
+#define BWPROBE_PROBE_SERVER_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+#include "batch-io.h"
+#include "pacer.h"
+
+namespace bwprobe {
+
+struct ServerConfig
+{
+    uint16_t tcpPort;
+    std::string probeTo;    // send probes here instead of the client (e.g. through bwemu)
+    uint32_t idleUs;        // pause before each train so the path queue drains
+    bool once;              // exit after the first session
+    PacerConfig pacer;
+    bool batchedIo;         // sendmmsg for probes due within batchWindowNs of each other
+    uint32_t batchWindowNs;
+    uint32_t batch;
+
+    ServerConfig() :
+        tcpPort(8080), idleUs(10000), once(false), batchedIo(true), batchWindowNs(2000), batch(32)
+    {
+    }
+};
+
+class ProbeServer
+{
+public:
+    explicit ProbeServer(const ServerConfig &config);
+    ~ProbeServer();
+
+    int Run(void);
+
+private:
+    void Serve(int controlFd, const sockaddr_in &peer);
+    // Returns the packets sent; *paced is false if the train was cut short
+    uint32_t SendTrain(uint32_t train, uint32_t gapNs, uint32_t trainSize, bool *paced);
+
+    ServerConfig m_config;
+    int m_listenFd;
+    int m_udpFd;
+    sockaddr_in m_probeAddress;
+    uint32_t m_packetSize;
+    BatchSender *m_sender;
+    Pacer m_pacer;
+    uint32_t m_discarded;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_PROBE_SERVER_H
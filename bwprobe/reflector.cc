@@ -0,0 +1,166 @@
+#include "reflector.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../bw-estimator.h"
+
+namespace bwprobe {
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void OnSignal(int)
+{
+    g_stop = 1;
+}
+
+Reflector::Reflector(const ReflectorConfig &config) :
+    m_config(config), m_fd(-1), m_receiver(0), m_probes(0), m_trains(0), m_reportsSent(0), m_expired(0)
+{
+}
+
+Reflector::~Reflector()
+{
+    delete m_receiver;
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+int Reflector::Run(void)
+{
+    m_fd = CreateUdpSocket(m_config.udpPort);
+    if (m_fd < 0)
+    {
+        perror("bwprobe reflect: bind");
+        return 1;
+    }
+    m_receiver = new BatchReceiver(m_fd, true, m_config.batch, 2048);
+    m_reports.reserve(4096);
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    printf("Reflector :: UDP %u :: %s timestamps :: idle close %u us\n", m_config.udpPort,
+        m_receiver->KernelTimestamps() ? "kernel" : "user", m_config.idleUs);
+    fflush(stdout);
+
+    int64_t nextExpire = MonotonicNs() + m_config.idleUs * 1000LL / 4;
+    while (!g_stop)
+    {
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        int n = poll(&pfd, 1, m_reports.empty() ? 200 : (int)(m_config.idleUs / 4000) + 1);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("bwprobe reflect: poll");
+            return 1;
+        }
+        int64_t now = MonotonicNs();
+        if (n > 0)
+        {
+            uint32_t count;
+            while ((count = m_receiver->Receive()) > 0)
+            {
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    Handle(m_receiver->Data(i), m_receiver->Length(i), m_receiver->RxNs(i), m_receiver->From(i), now);
+                }
+                if (count < m_receiver->Batch())
+                {
+                    break;
+                }
+            }
+        }
+        if (now >= nextExpire)
+        {
+            ExpireIdle(now);
+            nextExpire = now + m_config.idleUs * 1000LL / 4;
+        }
+    }
+
+    printf("Reflector :: %llu probes in %llu trains :: %llu reports :: %llu trains closed idle\n",
+        (unsigned long long)m_probes, (unsigned long long)m_trains, (unsigned long long)m_reportsSent,
+        (unsigned long long)m_expired);
+    return 0;
+}
+
+void Reflector::Handle(const uint8_t *data, uint32_t length, int64_t rxNs, const sockaddr_in &from, int64_t now)
+{
+    bwest::ProbeHeader h;
+    if (!bwest::ReadProbeHeader(data, length, &h))
+    {
+        return;
+    }
+    m_probes++;
+
+    TrainKey key;
+    key.addr = from.sin_addr.s_addr;
+    key.port = from.sin_port;
+    key.train = h.train;
+    ReportTable::iterator it = m_reports.find(key);
+    if (it == m_reports.end())
+    {
+        it = m_reports.insert(std::make_pair(key, PendingReport())).first;
+        it->second.from = from;
+        it->second.count = 0;
+        m_trains++;
+    }
+    PendingReport &report = it->second;
+    report.lastRxNs = now;
+
+    uint8_t *r = report.buffer + REPORT_HEADER_SIZE + report.count * REPORT_RECORD_SIZE;
+    bwest::Write32(r, h.seq);
+    bwest::Write32(r + 4, length);
+    bwest::Write64(r + 8, (uint64_t)h.txNs);
+    bwest::Write64(r + 16, (uint64_t)rxNs);
+    report.count++;
+
+    bool last = h.seq + 1 >= h.trainSize;
+    if (last || report.count == REPORT_RECORDS)
+    {
+        Send(key, report, last);
+    }
+    if (last)
+    {
+        m_reports.erase(it);
+    }
+}
+
+void Reflector::Send(const TrainKey &key, PendingReport &report, bool last)
+{
+    bwest::Write32(report.buffer, REPORT_MAGIC);
+    bwest::Write32(report.buffer + 4, key.train);
+    bwest::Write32(report.buffer + 8, report.count);
+    bwest::Write32(report.buffer + 12, last ? REPORT_LAST : 0);
+    sendto(m_fd, report.buffer, REPORT_HEADER_SIZE + report.count * REPORT_RECORD_SIZE, 0,
+        (const sockaddr *)&report.from, sizeof(report.from));
+    report.count = 0;
+    m_reportsSent++;
+}
+
+// Trains whose last packet was lost still get a final report
+void Reflector::ExpireIdle(int64_t now)
+{
+    for (ReportTable::iterator it = m_reports.begin(); it != m_reports.end();)
+    {
+        if (now - it->second.lastRxNs > (int64_t)m_config.idleUs * 1000)
+        {
+            Send(it->first, it->second, true);
+            m_expired++;
+            it = m_reports.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+} // namespace bwprobe
@@ -0,0 +1,85 @@
+// Receiving end for the fleet prober: takes probe trains from any number of senders on one
+// UDP port and returns each packet's receive time in REPORT datagrams. Bound to the
+// wildcard address it also stands in for thousands of targets on loopback, since every
+// 127.x.y.z reaches it.
+#ifndef BWPROBE_REFLECTOR_H
+#define BWPROBE_REFLECTOR_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <unordered_map>
+
+#include "batch-io.h"
+#include "probe-common.h"
+
+namespace bwprobe {
+
+struct ReflectorConfig
+{
+    uint16_t udpPort;
+    uint32_t idleUs;        // close a train that has been quiet this long (lost tail)
+    uint32_t batch;
+
+    ReflectorConfig() :
+        udpPort(8090), idleUs(50000), batch(64)
+    {
+    }
+};
+
+class Reflector
+{
+public:
+    explicit Reflector(const ReflectorConfig &config);
+    ~Reflector();
+
+    int Run(void);
+
+private:
+    struct TrainKey
+    {
+        uint32_t addr;
+        uint32_t port;
+        uint32_t train;
+
+        bool operator==(const TrainKey &o) const
+        {
+            return addr == o.addr && port == o.port && train == o.train;
+        }
+    };
+
+    struct TrainKeyHash
+    {
+        size_t operator()(const TrainKey &k) const
+        {
+            uint64_t h = ((uint64_t)k.addr << 32 | k.port) * 0x9e3779b97f4a7c15ULL;
+            return (size_t)(h ^ (k.train * 0xc2b2ae3d27d4eb4fULL));
+        }
+    };
+
+    struct PendingReport
+    {
+        sockaddr_in from;
+        uint32_t count;
+        int64_t lastRxNs;
+        uint8_t buffer[REPORT_HEADER_SIZE + REPORT_RECORDS * REPORT_RECORD_SIZE];
+    };
+
+    typedef std::unordered_map<TrainKey, PendingReport, TrainKeyHash> ReportTable;
+
+    void Handle(const uint8_t *data, uint32_t length, int64_t rxNs, const sockaddr_in &from, int64_t now);
+    void Send(const TrainKey &key, PendingReport &report, bool last);
+    void ExpireIdle(int64_t now);
+
+    ReflectorConfig m_config;
+    int m_fd;
+    BatchReceiver *m_receiver;
+    ReportTable m_reports;
+    uint64_t m_probes;
+    uint64_t m_trains;
+    uint64_t m_reportsSent;
+    uint64_t m_expired;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_REFLECTOR_H
@@ -0,0 +1,93 @@
+// Bounded single-producer/single-consumer ring. Workers hand finished estimates to the
+// collector through one of these each, so neither side ever takes a lock or allocates:
+// the producer only writes m_tail, the consumer only writes m_head, and each keeps a
+// cached copy of the other's index to avoid touching the shared cache line per element.
+#ifndef BWPROBE_SPSC_QUEUE_H
+#define BWPROBE_SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace bwprobe {
+
+template<typename T>
+class SpscQueue
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscQueue(uint32_t capacity) :
+        m_head(0), m_cachedTail(0), m_tail(0), m_cachedHead(0)
+    {
+        uint32_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_items.resize(size);
+        m_mask = size - 1;
+    }
+
+    uint32_t Capacity(void) const { return m_mask + 1; }
+
+    // Producer side. False when the ring is full; the caller decides what to drop.
+    bool Push(const T &item)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead > m_mask)
+            {
+                return false;
+            }
+        }
+        m_items[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool Pop(T *out)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+            {
+                return false;
+            }
+        }
+        *out = m_items[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; only a snapshot
+    uint32_t SizeApprox(void) const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+private:
+    enum
+    {
+        CACHE_LINE = 64
+    };
+
+    std::vector<T> m_items;
+    uint32_t m_mask;
+
+    char m_pad0[CACHE_LINE];
+    std::atomic<uint32_t> m_head;   // written by the consumer
+    uint32_t m_cachedTail;
+    char m_pad1[CACHE_LINE];
+    std::atomic<uint32_t> m_tail;   // written by the producer
+    uint32_t m_cachedHead;
+    char m_pad2[CACHE_LINE];
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_SPSC_QUEUE_H
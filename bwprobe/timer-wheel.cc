@@ -0,0 +1,152 @@
+#include "timer-wheel.h"
+
+namespace bwprobe {
+
+TimerWheel::TimerWheel(uint32_t timers, int64_t tickNs, int64_t nowNs) :
+    m_nodes(timers), m_heads(LEVELS * SLOTS, (uint32_t)NONE), m_tickNs(tickNs),
+    m_current((uint64_t)(nowNs / tickNs)), m_count(0)
+{
+    for (uint32_t i = 0; i < timers; i++)
+    {
+        m_nodes[i].level = NONE;
+    }
+}
+
+void TimerWheel::Schedule(uint32_t id, int64_t whenNs)
+{
+    if (Pending(id))
+    {
+        Unlink(id);
+    }
+    // Round up so a timer never fires early; anything already due goes into the next tick
+    uint64_t tick = whenNs > 0 ? (uint64_t)((whenNs + m_tickNs - 1) / m_tickNs) : 0;
+    m_nodes[id].tick = tick > m_current ? tick : m_current + 1;
+    Link(id);
+}
+
+void TimerWheel::Cancel(uint32_t id)
+{
+    if (Pending(id))
+    {
+        Unlink(id);
+    }
+}
+
+void TimerWheel::Link(uint32_t id)
+{
+    Node &n = m_nodes[id];
+    uint64_t delta = n.tick - m_current;
+    uint32_t level = 0;
+    while (level + 1 < LEVELS && delta >= (1ULL << (SLOT_BITS * (level + 1))))
+    {
+        level++;
+    }
+    uint64_t tick = n.tick;
+    if (level == LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * LEVELS)))
+    {
+        // Beyond the wheel: park in the farthest slot, it cascades back down and re-links
+        tick = m_current + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+    }
+    n.level = level;
+    n.slot = (uint32_t)((tick >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+    uint32_t &head = m_heads[level * SLOTS + n.slot];
+    n.prev = NONE;
+    n.next = head;
+    if (head != NONE)
+    {
+        m_nodes[head].prev = id;
+    }
+    head = id;
+    m_count++;
+}
+
+void TimerWheel::Unlink(uint32_t id)
+{
+    Node &n = m_nodes[id];
+    if (n.prev != NONE)
+    {
+        m_nodes[n.prev].next = n.next;
+    }
+    else
+    {
+        m_heads[n.level * SLOTS + n.slot] = n.next;
+    }
+    if (n.next != NONE)
+    {
+        m_nodes[n.next].prev = n.prev;
+    }
+    n.level = NONE;
+    m_count--;
+}
+
+void TimerWheel::Cascade(uint32_t level)
+{
+    uint32_t slot = (uint32_t)((m_current >> (SLOT_BITS * level)) & (SLOTS - 1));
+    uint32_t id = m_heads[level * SLOTS + slot];
+    m_heads[level * SLOTS + slot] = NONE;
+    while (id != NONE)
+    {
+        uint32_t next = m_nodes[id].next;
+        m_count--;
+        if (m_nodes[id].tick < m_current)
+        {
+            m_nodes[id].tick = m_current;
+        }
+        Link(id);
+        id = next;
+    }
+}
+
+void TimerWheel::Advance(int64_t nowNs, std::vector<uint32_t> *expired)
+{
+    uint64_t target = (uint64_t)(nowNs / m_tickNs);
+    while (m_current < target && m_count > 0)
+    {
+        m_current++;
+        // Whenever a level wraps, pull the next slot of the level above down
+        for (uint32_t level = 1; level < LEVELS; level++)
+        {
+            if ((m_current & ((1ULL << (SLOT_BITS * level)) - 1)) != 0)
+            {
+                break;
+            }
+            Cascade(level);
+        }
+
+        uint32_t &head = m_heads[m_current & (SLOTS - 1)];
+        uint32_t id = head;
+        head = NONE;
+        while (id != NONE)
+        {
+            uint32_t next = m_nodes[id].next;
+            m_nodes[id].level = NONE;
+            m_count--;
+            expired->push_back(id);
+            id = next;
+        }
+    }
+    if (m_count == 0 && m_current < target)
+    {
+        m_current = target;
+    }
+}
+
+int64_t TimerWheel::NextDueNs(void) const
+{
+    for (uint64_t tick = m_current + 1; tick <= m_current + SLOTS; tick++)
+    {
+        if (m_heads[tick & (SLOTS - 1)] != NONE)
+        {
+            return (int64_t)tick * m_tickNs;
+        }
+        if ((tick & (SLOTS - 1)) == 0 && m_count > 0)
+        {
+            // Higher levels cascade here and may land anywhere from this tick on
+            return (int64_t)tick * m_tickNs;
+        }
+    }
+    return m_count > 0 ? (int64_t)(m_current + SLOTS) * m_tickNs : INT64_MAX;
+}
+
+} // namespace bwprobe
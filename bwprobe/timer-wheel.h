@@ -0,0 +1,61 @@
+// Hierarchical timing wheel holding the fleet prober's next-train instants. Every target
+// owns exactly one timer that is re-armed after each train, so timers are preallocated
+// nodes indexed by target and scheduling or cancelling is an O(1) list operation. Level 0
+// slots are one tick wide and each further level is SLOTS times coarser; timers cascade
+// down a level whenever the level below wraps around.
+#ifndef BWPROBE_TIMER_WHEEL_H
+#define BWPROBE_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace bwprobe {
+
+class TimerWheel
+{
+public:
+    enum
+    {
+        LEVELS = 4,
+        SLOT_BITS = 8,
+        SLOTS = 1 << SLOT_BITS,
+        NONE = 0xffffffff
+    };
+
+    TimerWheel(uint32_t timers, int64_t tickNs, int64_t nowNs);
+
+    // Arms (or re-arms) timer id. It fires on the first tick at or after whenNs.
+    void Schedule(uint32_t id, int64_t whenNs);
+    void Cancel(uint32_t id);
+    bool Pending(uint32_t id) const { return m_nodes[id].level != NONE; }
+    uint32_t Size(void) const { return m_count; }
+
+    // Moves every timer that is due by nowNs into *expired, in no particular order
+    void Advance(int64_t nowNs, std::vector<uint32_t> *expired);
+    // No timer fires before this; exact for level 0, a cascade point otherwise
+    int64_t NextDueNs(void) const;
+
+private:
+    struct Node
+    {
+        uint64_t tick;
+        uint32_t next;
+        uint32_t prev;
+        uint32_t level;
+        uint32_t slot;
+    };
+
+    void Link(uint32_t id);
+    void Unlink(uint32_t id);
+    void Cascade(uint32_t level);
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_heads;  // LEVELS x SLOTS list heads
+    int64_t m_tickNs;
+    uint64_t m_current;             // last tick that was processed
+    uint32_t m_count;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_TIMER_WHEEL_H
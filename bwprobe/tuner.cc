@@ -0,0 +1,297 @@
+#include "tuner.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+Tuner::Tuner(const TuneConfig &config) :
+    m_config(config), m_pool(0), m_jobs(0), m_budget(0)
+{
+}
+
+Tuner::~Tuner()
+{
+    delete m_pool;
+    for (size_t i = 0; i < m_traces.size(); i++)
+    {
+        delete m_traces[i];
+    }
+}
+
+bool Tuner::Load(std::string *error)
+{
+    if (m_config.traces.empty())
+    {
+        *error = "no traces";
+        return false;
+    }
+    for (size_t i = 0; i < m_config.traces.size(); i++)
+    {
+        GridTrace *trace = new GridTrace;
+        m_traces.push_back(trace);
+        double cross = m_config.crossMbps.empty() ? 0.0 : m_config.crossMbps[std::min(i, m_config.crossMbps.size() - 1)];
+        if (!LoadGridTrace(m_config.traces[i], cross, trace, error))
+        {
+            return false;
+        }
+
+        std::string name = m_config.classes.empty() ? "all" : m_config.classes[std::min(i, m_config.classes.size() - 1)];
+        size_t g = 0;
+        while (g < m_groups.size() && (m_groups[g].name != name || m_groups[g].kind != trace->file.Kind()))
+        {
+            g++;
+        }
+        if (g == m_groups.size())
+        {
+            Group group;
+            group.name = name;
+            group.kind = trace->file.Kind();
+            m_groups.push_back(group);
+        }
+        m_groups[g].traces.push_back((uint32_t)i);
+    }
+    m_pool = new WorkPool(m_config.threads);
+    return true;
+}
+
+std::vector<GridPoint> Tuner::Sample(const Group &group)
+{
+    // Seeded per class so adding a class does not reshuffle the others
+    uint32_t seed = m_config.seed;
+    for (size_t i = 0; i < group.name.size(); i++)
+    {
+        seed = seed * 31 + (uint8_t)group.name[i];
+    }
+    std::mt19937 rng(seed + group.kind);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // Recorded trains bound the train length; the recorded configuration is the baseline
+    const GridTrace &first = *m_traces[group.traces[0]];
+    uint32_t maxTrain = first.trainSize;
+    for (size_t i = 0; i < group.traces.size(); i++)
+    {
+        maxTrain = std::min(maxTrain, m_traces[group.traces[i]]->trainSize);
+    }
+    GridPoint base;
+    base.kind = group.kind;
+    base.igi = first.file.Igi();
+    base.trend = first.file.Trend();
+    base.igi.trainSize = std::min(base.igi.trainSize, maxTrain);
+    base.trend.trainSize = std::min(base.trend.trainSize, maxTrain);
+
+    // IGI can only be served gaps that were recorded: the search starts at one of them
+    // (gB / 2) and steps by a multiple of the recorded step
+    std::vector<uint32_t> starts;
+    for (size_t i = 0; i < first.gaps.size(); i++)
+    {
+        if (first.gaps[i].gapNs >= 100000)
+        {
+            starts.push_back(first.gaps[i].gapNs);
+        }
+    }
+    if (starts.empty())
+    {
+        starts.push_back(base.igi.gBNs / 2);
+    }
+
+    std::vector<GridPoint> points(1, base);
+    while (points.size() < m_config.samples)
+    {
+        GridPoint p = base;
+        if (group.kind == bwest::ESTIMATOR_IGI)
+        {
+            p.igi.threshold = 0.02 + unit(rng) * 0.38;
+            p.igi.gBNs = starts[std::min(starts.size() - 1, (size_t)(unit(rng) * starts.size()))] * 2;
+            p.igi.stepNs = base.igi.stepNs * (1 + (uint32_t)(unit(rng) * 3));
+            p.igi.trainSize = std::min<uint32_t>(maxTrain, 10 + (uint32_t)(unit(rng) * (maxTrain - 9)));
+        }
+        else
+        {
+            p.trend.pctThreshold = 0.5 + unit(rng) * 0.25;
+            p.trend.pdtThreshold = 0.2 + unit(rng) * 0.4;
+            p.trend.groups = 4 + (uint32_t)(unit(rng) * 17);
+            uint32_t low = std::min(maxTrain, std::max<uint32_t>(p.trend.groups * 2, 20));
+            p.trend.trainSize = std::min<uint32_t>(maxTrain, low + (uint32_t)(unit(rng) * (maxTrain - low + 1)));
+            p.trend.groups = std::min(p.trend.groups, p.trend.trainSize);
+        }
+        points.push_back(p);
+    }
+    return points;
+}
+
+std::vector<TuneScore> Tuner::Evaluate(const Group &group, const std::vector<GridPoint> &points,
+    const std::vector<uint32_t> &alive, uint32_t budget)
+{
+    uint32_t traces = (uint32_t)group.traces.size();
+    std::vector<GridResult> results(alive.size() * traces);
+    m_pool->Run((uint32_t)results.size(), [&](uint32_t job, uint32_t worker) {
+        (void)worker;
+        results[job] = EvaluateGridPoint(*m_traces[group.traces[job % traces]], points[alive[job / traces]], budget,
+            m_config.gapTolerance);
+    });
+    m_jobs += results.size();
+    m_budget += (uint64_t)results.size() * budget;
+
+    std::vector<TuneScore> scores(alive.size());
+    for (size_t a = 0; a < alive.size(); a++)
+    {
+        TuneScore &s = scores[a];
+        memset(&s, 0, sizeof(s));
+        s.point = alive[a];
+        s.traces = traces;
+        for (uint32_t t = 0; t < traces; t++)
+        {
+            const GridResult &r = results[a * traces + t];
+            // A configuration the trace cannot serve ranks below one that merely ran out of trains
+            double err = r.uncovered ? 2.0 : 1.0;
+            if (r.converged)
+            {
+                err = std::min(1.0, fabs(r.errorMbps) / std::max(r.truthMbps, 0.1));
+                s.relError += err;
+                s.converged++;
+            }
+            double mb = r.probeBytes / 1e6;
+            double sec = r.probeNs / 1e9 + r.trainsSent * m_config.rttMs / 1000;
+            s.megabytes += mb / traces;
+            s.seconds += sec / traces;
+            s.objective += (m_config.errorWeight * err + m_config.bytesWeight * mb + m_config.timeWeight * sec) / traces;
+        }
+        if (s.converged > 0)
+        {
+            s.relError /= s.converged;
+        }
+    }
+    std::stable_sort(scores.begin(), scores.end(),
+        [](const TuneScore &a, const TuneScore &b) { return a.objective < b.objective; });
+    return scores;
+}
+
+int Tuner::Run(void)
+{
+    FILE *out = 0;
+    if (!m_config.out.empty() && !(out = fopen(m_config.out.c_str(), "w")))
+    {
+        perror("bwprobe tune: output");
+        return 1;
+    }
+
+    int64_t start = MonotonicNs();
+    uint64_t exhaustive = 0;
+    for (size_t g = 0; g < m_groups.size(); g++)
+    {
+        const Group &group = m_groups[g];
+        std::vector<GridPoint> points = Sample(group);
+        std::vector<uint32_t> alive;
+        for (uint32_t i = 0; i < points.size(); i++)
+        {
+            alive.push_back(i);
+        }
+        exhaustive += (uint64_t)points.size() * group.traces.size() * m_config.maxTrains;
+
+        // Rungs needed to get from all samples down to the reported few
+        uint32_t eta = std::max<uint32_t>(m_config.eta, 2);
+        uint32_t rungs = 0;
+        for (size_t n = points.size(); n > m_config.top; n = std::max<size_t>(m_config.top, n / eta))
+        {
+            rungs++;
+        }
+
+        std::vector<TuneScore> scores;
+        for (uint32_t r = 0; r <= rungs; r++)
+        {
+            uint32_t budget = m_config.maxTrains;
+            for (uint32_t k = r; k < rungs; k++)
+            {
+                budget /= eta;
+            }
+            budget = std::max<uint32_t>(budget, 2);
+
+            // The last rung also re-runs the recorded configuration for comparison
+            bool last = r == rungs;
+            if (last && std::find(alive.begin(), alive.end(), 0u) == alive.end())
+            {
+                alive.push_back(0);
+            }
+            scores = Evaluate(group, points, alive, budget);
+            printf("Tune :: %s %s :: rung %u :: %zu configurations x %zu traces at %u trains :: best %.4f\n",
+                group.name.c_str(), group.kind == bwest::ESTIMATOR_TREND ? "slops" : "igi", r, alive.size(),
+                group.traces.size(), budget, scores[0].objective);
+            if (!last)
+            {
+                alive.clear();
+                for (size_t i = 0; i < std::max<size_t>(m_config.top, scores.size() / eta) && i < scores.size(); i++)
+                {
+                    alive.push_back(scores[i].point);
+                }
+            }
+        }
+
+        TuneScore baseline;
+        memset(&baseline, 0, sizeof(baseline));
+        std::vector<TuneScore> best;
+        for (size_t i = 0; i < scores.size(); i++)
+        {
+            if (scores[i].point == 0)
+            {
+                baseline = scores[i];
+            }
+            if (best.size() < m_config.top)
+            {
+                best.push_back(scores[i]);
+            }
+        }
+        Emit(group, points, best, baseline, out);
+    }
+    double ms = (MonotonicNs() - start) / 1e6;
+    printf("TUNE classes=%zu jobs=%llu train_budget=%llu exhaustive_budget=%llu threads=%u elapsed_ms=%.1f\n",
+        m_groups.size(), (unsigned long long)m_jobs, (unsigned long long)m_budget, (unsigned long long)exhaustive,
+        m_pool->Threads(), ms);
+    if (out)
+    {
+        fclose(out);
+    }
+    return 0;
+}
+
+void Tuner::Emit(const Group &group, const std::vector<GridPoint> &points, const std::vector<TuneScore> &best,
+    const TuneScore &baseline, FILE *out)
+{
+    for (size_t i = 0; i <= best.size(); i++)
+    {
+        // Best first, then the recorded configuration as the reference
+        const TuneScore &s = i < best.size() ? best[i] : baseline;
+        const GridPoint &p = points[s.point];
+        char params[160];
+        char command[200];
+        if (p.kind == bwest::ESTIMATOR_TREND)
+        {
+            snprintf(params, sizeof(params), "method=slops pct=%.3f pdt=%.3f groups=%u train=%u", p.trend.pctThreshold,
+                p.trend.pdtThreshold, p.trend.groups, p.trend.trainSize);
+            snprintf(command, sizeof(command), "bwprobe client --method slops --pct %.3f --pdt %.3f --groups %u --train %u",
+                p.trend.pctThreshold, p.trend.pdtThreshold, p.trend.groups, p.trend.trainSize);
+        }
+        else
+        {
+            snprintf(params, sizeof(params), "method=igi threshold=%.3f gb_us=%u step_us=%u train=%u", p.igi.threshold,
+                p.igi.gBNs / 1000, p.igi.stepNs / 1000, p.igi.trainSize);
+            snprintf(command, sizeof(command), "bwprobe client --method igi --threshold %.3f --gb-us %u --step-us %u --train %u",
+                p.igi.threshold, p.igi.gBNs / 1000, p.igi.stepNs / 1000, p.igi.trainSize);
+        }
+        char line[512];
+        snprintf(line, sizeof(line), "TUNED class=%s rank=%s %s objective=%.4f error_pct=%.2f probe_mb=%.3f "
+            "converge_ms=%.1f converged=%u/%u :: %s\n", group.name.c_str(), i < best.size() ? std::to_string(i + 1).c_str() : "recorded",
+            params, s.objective, s.relError * 100, s.megabytes, s.seconds * 1000, s.converged, s.traces, command);
+        fputs(line, stdout);
+        if (out)
+        {
+            fputs(line, out);
+        }
+    }
+}
+
+} // namespace bwprobe
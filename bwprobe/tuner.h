@@ -0,0 +1,98 @@
+// Automatic tuning of the estimators' hand-picked constants (IGI gB, gap step, stop
+// threshold and train length; SLoPS PCT, PDT, groups and train length) against recorded
+// captures. Traces are grouped into scenario classes; for each class and method the
+// tuner runs successive halving: many random configurations get a small train budget,
+// the best 1/eta move on to eta times the budget, until the survivors run at the full
+// budget. Every rung is one WorkPool batch of (configuration x trace) jobs through
+// EvaluateGridPoint, so the search uses the same replay rules as bwprobe grid.
+//
+// The objective, lower is better, averaged over the class's traces:
+//   errorWeight * |estimate - truth| / truth     (1 when the run did not converge, 2 when
+//                                                 the trace has no train at an asked gap)
+//   + bytesWeight * probe megabytes
+//   + timeWeight * seconds to converge           (send time plus one RTT per train)
+#ifndef BWPROBE_TUNER_H
+#define BWPROBE_TUNER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "grid-eval.h"
+#include "work-pool.h"
+
+namespace bwprobe {
+
+struct TuneConfig
+{
+    std::vector<std::string> traces;
+    std::vector<double> crossMbps;      // known cross traffic, one for all or one per trace
+    std::vector<std::string> classes;   // scenario class per trace, one for all or one per trace
+    uint32_t samples;                   // configurations in the first rung, the recorded one included
+    uint32_t eta;                       // keep 1/eta per rung
+    uint32_t maxTrains;                 // budget of the last rung
+    uint32_t top;                       // configurations reported per class
+    uint32_t threads;
+    uint32_t seed;
+    double gapTolerance;
+    double errorWeight;
+    double bytesWeight;                 // per MB
+    double timeWeight;                  // per second
+    double rttMs;                       // turnaround between trains
+    std::string out;                    // TUNED lines, empty for stdout only
+
+    TuneConfig() :
+        samples(81), eta(3), maxTrains(100), top(3), threads(0), seed(1), gapTolerance(0.1), errorWeight(1.0),
+        bytesWeight(0.05), timeWeight(0.1), rttMs(8.0)
+    {
+    }
+};
+
+struct TuneScore
+{
+    uint32_t point;
+    double objective;
+    double relError;        // over the converged traces
+    double megabytes;
+    double seconds;
+    uint32_t converged;
+    uint32_t traces;
+};
+
+class Tuner
+{
+public:
+    explicit Tuner(const TuneConfig &config);
+    ~Tuner();
+
+    // Maps the traces; false with a reason in *error
+    bool Load(std::string *error);
+    int Run(void);
+
+private:
+    // Traces of one class recorded with one method
+    struct Group
+    {
+        std::string name;
+        bwest::EstimatorKind kind;
+        std::vector<uint32_t> traces;
+    };
+
+    std::vector<GridPoint> Sample(const Group &group);
+    std::vector<TuneScore> Evaluate(const Group &group, const std::vector<GridPoint> &points,
+        const std::vector<uint32_t> &alive, uint32_t budget);
+    void Emit(const Group &group, const std::vector<GridPoint> &points, const std::vector<TuneScore> &best,
+        const TuneScore &baseline, FILE *out);
+
+    TuneConfig m_config;
+    WorkPool *m_pool;
+    std::vector<GridTrace *> m_traces;
+    std::vector<Group> m_groups;
+    uint64_t m_jobs;
+    uint64_t m_budget;      // trains granted over all jobs, against samples x traces x maxTrains
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_TUNER_H
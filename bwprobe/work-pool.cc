@@ -0,0 +1,196 @@
+#include "work-pool.h"
+
+#include <unistd.h>
+#include <algorithm>
+
+#include "probe-common.h"
+
+namespace bwprobe {
+
+WorkPool::WorkPool(uint32_t threads) :
+    m_job(0), m_generation(0), m_busy(0), m_stop(false)
+{
+    if (threads == 0)
+    {
+        threads = (uint32_t)std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        Slot *slot = new Slot;
+        slot->next = 0;
+        slot->end = 0;
+        m_slots.push_back(slot);
+    }
+    for (uint32_t i = 1; i < threads; i++)
+    {
+        m_threads.push_back(std::thread(&WorkPool::Loop, this, i));
+    }
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (size_t i = 0; i < m_threads.size(); i++)
+    {
+        m_threads[i].join();
+    }
+    for (size_t i = 0; i < m_slots.size(); i++)
+    {
+        delete m_slots[i];
+    }
+}
+
+void WorkPool::Run(uint32_t jobs, const Job &job)
+{
+    uint32_t n = Threads();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        std::lock_guard<std::mutex> guard(m_slots[i]->lock);
+        m_slots[i]->next = (uint32_t)((uint64_t)jobs * i / n);
+        m_slots[i]->end = (uint32_t)((uint64_t)jobs * (i + 1) / n);
+    }
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_job = &job;
+        m_busy = n - 1;
+        m_generation++;
+    }
+    m_start.notify_all();
+
+    Work(0);
+
+    std::unique_lock<std::mutex> wait(m_mutex);
+    m_done.wait(wait, [this] { return m_busy == 0; });
+    m_job = 0;
+}
+
+WorkerStats WorkPool::Stats(uint32_t worker) const
+{
+    std::lock_guard<std::mutex> guard(m_slots[worker]->lock);
+    return m_slots[worker]->stats;
+}
+
+void WorkPool::ResetStats(void)
+{
+    for (size_t i = 0; i < m_slots.size(); i++)
+    {
+        std::lock_guard<std::mutex> guard(m_slots[i]->lock);
+        m_slots[i]->stats = WorkerStats();
+    }
+}
+
+void WorkPool::Loop(uint32_t worker)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> wait(m_mutex);
+            m_start.wait(wait, [this, seen] { return m_stop || m_generation != seen; });
+            if (m_stop)
+            {
+                return;
+            }
+            seen = m_generation;
+        }
+        Work(worker);
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_busy--;
+        }
+        m_done.notify_one();
+    }
+}
+
+void WorkPool::Work(uint32_t worker)
+{
+    Slot &own = *m_slots[worker];
+    uint32_t job;
+    for (;;)
+    {
+        while (Take(worker, &job))
+        {
+            int64_t start = MonotonicNs();
+            (*m_job)(job, worker);
+            int64_t busy = MonotonicNs() - start;
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.stats.jobs++;
+            own.stats.busyNs += busy;
+        }
+        // Jobs never spawn jobs, so once nobody has anything left to steal the batch is done
+        if (!Steal(worker))
+        {
+            return;
+        }
+    }
+}
+
+bool WorkPool::Take(uint32_t worker, uint32_t *job)
+{
+    Slot &own = *m_slots[worker];
+    std::lock_guard<std::mutex> guard(own.lock);
+    uint32_t next = own.next.load(std::memory_order_relaxed);
+    if (next >= own.end.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    *job = next;
+    own.next.store(next + 1, std::memory_order_relaxed);
+    return true;
+}
+
+bool WorkPool::Steal(uint32_t worker)
+{
+    uint32_t n = Threads();
+    for (;;)
+    {
+        // Unlocked peek for the victim with the most left; the range is re-checked under its lock
+        uint32_t victim = n;
+        uint32_t most = 0;
+        for (uint32_t k = 1; k < n; k++)
+        {
+            uint32_t v = (worker + k) % n;
+            uint32_t next = m_slots[v]->next.load(std::memory_order_relaxed);
+            uint32_t end = m_slots[v]->end.load(std::memory_order_relaxed);
+            if (end > next && end - next > most)
+            {
+                most = end - next;
+                victim = v;
+            }
+        }
+        if (victim == n)
+        {
+            return false;
+        }
+
+        uint32_t from, to;
+        {
+            std::lock_guard<std::mutex> guard(m_slots[victim]->lock);
+            Slot &v = *m_slots[victim];
+            uint32_t next = v.next.load(std::memory_order_relaxed);
+            uint32_t end = v.end.load(std::memory_order_relaxed);
+            if (next >= end)
+            {
+                continue; // raced with its owner or another thief; look again
+            }
+            // Leave the victim the lower half (it is working from the bottom); a single
+            // remaining job goes to the thief
+            uint32_t mid = next + (end - next) / 2;
+            from = mid;
+            to = end;
+            v.end.store(mid, std::memory_order_relaxed);
+        }
+        Slot &own = *m_slots[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        own.next.store(from, std::memory_order_relaxed);
+        own.end.store(to, std::memory_order_relaxed);
+        own.stats.steals++;
+        return true;
+    }
+}
+
+} // namespace bwprobe
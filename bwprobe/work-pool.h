@@ -0,0 +1,80 @@
+// Fixed set of worker threads for batches of independent, CPU-bound jobs (offline estimator
+// runs). A batch is numbered 0..jobs-1 and split into one contiguous range per worker;
+// a worker that runs dry steals the upper half of the fullest-looking victim's range, so
+// uneven job costs even out without a shared queue everybody contends on. The calling
+// thread works as worker 0, and the threads stay up between batches.
+#ifndef BWPROBE_WORK_POOL_H
+#define BWPROBE_WORK_POOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bwprobe {
+
+struct WorkerStats
+{
+    uint64_t jobs;
+    uint64_t steals;        // ranges taken from another worker
+    uint64_t busyNs;        // time spent inside jobs
+
+    WorkerStats() :
+        jobs(0), steals(0), busyNs(0)
+    {
+    }
+};
+
+class WorkPool
+{
+public:
+    typedef std::function<void(uint32_t job, uint32_t worker)> Job;
+
+    // threads = 0: one per online CPU
+    explicit WorkPool(uint32_t threads);
+    ~WorkPool();
+
+    uint32_t Threads(void) const { return (uint32_t)m_slots.size(); }
+
+    // Runs job(0..jobs-1) across the pool and returns once all of them are done
+    void Run(uint32_t jobs, const Job &job);
+
+    WorkerStats Stats(uint32_t worker) const;
+    void ResetStats(void);
+
+private:
+    // One worker's share of the current batch, [next, end). Changed under the lock only;
+    // atomic so thieves can size up victims without taking it. Allocated one by one and
+    // padded so that owners popping their own ranges do not share cache lines.
+    struct Slot
+    {
+        std::mutex lock;
+        std::atomic<uint32_t> next;
+        std::atomic<uint32_t> end;
+        WorkerStats stats;
+        char pad[64];
+    };
+
+    void Loop(uint32_t worker);
+    void Work(uint32_t worker);
+    bool Take(uint32_t worker, uint32_t *job);
+    bool Steal(uint32_t worker);
+
+    std::vector<Slot *> m_slots;
+    std::vector<std::thread> m_threads;
+    const Job *m_job;
+
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    uint64_t m_generation;
+    uint32_t m_busy;            // helper threads still inside the current batch
+    bool m_stop;
+};
+
+} // namespace bwprobe
+
+#endif // BWPROBE_WORK_POOL_H
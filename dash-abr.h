@@ -0,0 +1,522 @@
+// Rate adaptation (ABR) algorithms for the DASH client in as.cc.
+//
+// Nothing in here depends on ns-3: an algorithm reads an AbrContext (buffer level,
+// per-chunk throughput history, the passive estimate of dash-throughput.h and the
+// bitrate ladder) and returns the ladder index of the next chunk. A decision is
+// O(levels), or a lookahead bounded by a fixed horizon, and never allocates. Algorithms
+// are created by name from the registry at the bottom.
+// Algorithms that want active measurements (UsesProbe) also get the latest
+// available-bandwidth estimate of the UDP probe path.
+#ifndef DASH_ABR_H
+#define DASH_ABR_H
+
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+namespace dash {
+
+//================================================================
+// INPUTS
+//================================================================
+
+// The last few per-chunk throughput samples, the oldest overwritten first
+class ThroughputHistory
+{
+public:
+    enum
+    {
+        CAPACITY = 8
+    };
+
+    ThroughputHistory() :
+        m_count(0), m_next(0)
+    {
+    }
+
+    void Add(double bps)
+    {
+        m_samples[m_next] = bps;
+        m_next = (m_next + 1) % CAPACITY;
+        if (m_count < CAPACITY)
+        {
+            m_count++;
+        }
+    }
+
+    uint32_t Size(void) const { return m_count; }
+
+    // i = 0 is the newest sample
+    double Get(uint32_t i) const
+    {
+        return m_samples[(m_next + CAPACITY - 1 - i) % CAPACITY];
+    }
+
+    // Of the newest n samples; 0 when there are none. Robust to one fast outlier.
+    double HarmonicMean(uint32_t n) const
+    {
+        n = n < m_count ? n : m_count;
+        double inverse = 0;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            double s = Get(i);
+            if (s <= 0)
+            {
+                return 0;
+            }
+            inverse += 1.0 / s;
+        }
+        return n ? n / inverse : 0;
+    }
+
+private:
+    double m_samples[CAPACITY];
+    uint32_t m_count;
+    uint32_t m_next;
+};
+
+struct AbrContext
+{
+    const std::vector<uint32_t> *bitrates;  // bps, ascending
+    const ThroughputHistory *history;
+    double throughputBps;                   // passive estimate, 0 before the first chunk
+    double throughputConfidence;            // in it, 0 to 1
+    uint32_t chunkMs;                       // playback time per chunk
+    double bufferMs;                        // buffered playback time
+    double bufferCapacityMs;
+    int32_t lastIndex;                      // -1 before the first chunk
+    uint32_t chunk;                         // index of the chunk to choose for
+    uint32_t chunks;                        // in the stream
+    double probeBps;                        // latest probe estimate, 0 when there is none
+    double probeAgeMs;                      // since that estimate
+    // Bytes of chunk + d at index i as sizes[d * levels + i], for d < chunks - chunk
+    // (dash-manifest.h); 0 when every chunk is its bitrate times chunkMs
+    const uint32_t *sizes;
+};
+
+class AbrAlgorithm
+{
+public:
+    virtual ~AbrAlgorithm() {}
+
+    virtual const char *Name(void) const = 0;
+    // Ladder index for ctx.chunk
+    virtual uint32_t Choose(const AbrContext &ctx) = 0;
+    // Whether the player should run the probe path for ctx.probeBps
+    virtual bool UsesProbe(void) const { return false; }
+};
+
+// Highest ladder index whose bitrate does not exceed bps, 0 if none does
+inline uint32_t HighestBelow(const std::vector<uint32_t> &bitrates, double bps)
+{
+    uint32_t index = 0;
+    for (uint32_t i = 1; i < bitrates.size(); i++)
+    {
+        if (bitrates[i] <= bps)
+        {
+            index = i;
+        }
+    }
+    return index;
+}
+
+//================================================================
+// THROUGHPUT
+//================================================================
+
+// Highest bitrate under a safety share of the passive estimate; the share shrinks by up
+// to m_doubt as the estimator's confidence falls
+class ThroughputAbr : public AbrAlgorithm
+{
+public:
+    ThroughputAbr() :
+        m_safety(0.9), m_doubt(0.2)
+    {
+    }
+
+    virtual const char *Name(void) const { return "throughput"; }
+
+    virtual uint32_t Choose(const AbrContext &ctx)
+    {
+        double safety = m_safety - m_doubt * (1 - ctx.throughputConfidence);
+        return HighestBelow(*ctx.bitrates, ctx.throughputBps * safety);
+    }
+
+private:
+    double m_safety;
+    double m_doubt;
+};
+
+//================================================================
+// BBA
+//================================================================
+
+// BBA-0 (Huang et al.): the bitrate is a function of the buffer level only. Below the
+// reservoir the lowest rate, above reservoir + cushion the highest, linear in between;
+// the rate only moves once the map has crossed a neighbouring ladder step.
+class BbaAbr : public AbrAlgorithm
+{
+public:
+    BbaAbr() :
+        m_reservoir(0.15), m_cushion(0.75)
+    {
+    }
+
+    virtual const char *Name(void) const { return "bba"; }
+
+    virtual uint32_t Choose(const AbrContext &ctx)
+    {
+        const std::vector<uint32_t> &rates = *ctx.bitrates;
+        uint32_t top = (uint32_t)rates.size() - 1;
+        double reservoir = ctx.bufferCapacityMs * m_reservoir;
+        double cushion = ctx.bufferCapacityMs * m_cushion;
+        if (ctx.lastIndex < 0 || ctx.bufferMs <= reservoir)
+        {
+            return 0;
+        }
+        if (ctx.bufferMs >= reservoir + cushion)
+        {
+            return top;
+        }
+
+        double f = rates[0] + (rates[top] - rates[0]) * (ctx.bufferMs - reservoir) / cushion;
+        uint32_t last = (uint32_t)ctx.lastIndex;
+        uint32_t up = last < top ? last + 1 : top;
+        uint32_t down = last > 0 ? last - 1 : 0;
+        if (f >= rates[up])
+        {
+            return HighestBelow(rates, f);
+        }
+        if (f <= rates[down])
+        {
+            // Lowest rate above the map
+            uint32_t i = 0;
+            while (i < top && rates[i] <= f)
+            {
+                i++;
+            }
+            return i;
+        }
+        return last;
+    }
+
+private:
+    double m_reservoir;     // share of the buffer capacity
+    double m_cushion;
+};
+
+//================================================================
+// BOLA
+//================================================================
+
+// BOLA-BASIC (Spiteri et al.): Lyapunov utility maximisation over the buffer level.
+// Picks argmax (V (v_m + gp) - Q) / S_m with v_m = ln(S_m / S_0) and Q in chunks. A
+// capacity under two chunks would make V <= 0 and favour the top rung, so it counts as two.
+class BolaAbr : public AbrAlgorithm
+{
+public:
+    BolaAbr() :
+        m_gp(5.0)
+    {
+    }
+
+    virtual const char *Name(void) const { return "bola"; }
+
+    virtual uint32_t Choose(const AbrContext &ctx)
+    {
+        const std::vector<uint32_t> &rates = *ctx.bitrates;
+        double q = ctx.bufferMs / ctx.chunkMs;
+        double qMax = ctx.bufferCapacityMs / ctx.chunkMs;
+        qMax = qMax > 2 ? qMax : 2;
+        double vMax = log((double)rates.back() / rates[0]);
+        double v = (qMax - 1) / (vMax + m_gp);
+
+        uint32_t best = 0;
+        double bestScore = -1e300;
+        for (uint32_t m = 0; m < rates.size(); m++)
+        {
+            double score = (v * (log((double)rates[m] / rates[0]) + m_gp) - q) / rates[m];
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = m;
+            }
+        }
+        return best;
+    }
+
+private:
+    double m_gp;            // rebuffering vs. quality trade-off
+};
+
+//================================================================
+// MPC
+//================================================================
+
+// RobustMPC (Yin et al.): maximise
+//   sum q(R_k) - lambda sum |q(R_k) - q(R_k-1)| - mu rebuffer seconds
+// over the next HORIZON chunks, with the throughput predicted by the passive estimator
+// (the harmonic mean by default) discounted by the worst recent prediction error. After
+// the first chunk of the horizon a plan moves at most one ladder step per chunk, which
+// bounds a decision at levels x 3^(HORIZON - 1) plans.
+class MpcAbr : public AbrAlgorithm
+{
+public:
+    enum
+    {
+        HORIZON = 5,
+        ERRORS = 5
+    };
+
+    MpcAbr() :
+        m_lambda(1.0), m_mu(4.3), m_prediction(0), m_errorCount(0), m_errorNext(0), m_seenSize(0),
+        m_seenNewest(0)
+    {
+    }
+
+    virtual const char *Name(void) const { return "mpc"; }
+
+    virtual uint32_t Choose(const AbrContext &ctx)
+    {
+        const ThroughputHistory &history = *ctx.history;
+        if (history.Size() == 0 || ctx.throughputBps <= 0)
+        {
+            return 0;
+        }
+
+        // How far off the last prediction was, once per new sample; a Choose without a
+        // download in between (a retry, a skipped segment) has nothing new to score
+        double actual = history.Get(0);
+        bool fresh = history.Size() != m_seenSize || actual != m_seenNewest;
+        m_seenSize = history.Size();
+        m_seenNewest = actual;
+        if (m_prediction > 0 && fresh && actual > 0)
+        {
+            m_errors[m_errorNext] = fabs(m_prediction - actual) / actual;
+            m_errorNext = (m_errorNext + 1) % ERRORS;
+            m_errorCount += m_errorCount < ERRORS ? 1 : 0;
+        }
+        double worst = 0;
+        for (uint32_t i = 0; i < m_errorCount; i++)
+        {
+            worst = m_errors[i] > worst ? m_errors[i] : worst;
+        }
+        m_prediction = ctx.throughputBps;
+
+        m_ctx = &ctx;
+        m_bps = m_prediction / (1 + worst);
+        m_depth = ctx.chunks > ctx.chunk ? ctx.chunks - ctx.chunk : 1;
+        m_depth = m_depth < (uint32_t)HORIZON ? m_depth : (uint32_t)HORIZON;
+        m_bestScore = -1e300;
+        m_best = 0;
+
+        uint32_t levels = (uint32_t)ctx.bitrates->size();
+        for (uint32_t first = 0; first < levels; first++)
+        {
+            double score = Plan(0, first, ctx.lastIndex, ctx.bufferMs / 1000.0, 0);
+            if (score > m_bestScore)
+            {
+                m_bestScore = score;
+                m_best = first;
+            }
+        }
+        return m_best;
+    }
+
+private:
+    // Best score of the plans that take `index` at step `depth` and continue from there
+    double Plan(uint32_t depth, uint32_t index, int32_t prev, double buffer, double score)
+    {
+        const std::vector<uint32_t> &rates = *m_ctx->bitrates;
+        double chunkSec = m_ctx->chunkMs / 1000.0;
+        double bits = m_ctx->sizes ? m_ctx->sizes[depth * rates.size() + index] * 8.0 : rates[index] * chunkSec;
+        double download = bits / m_bps;
+        double rebuffer = download > buffer ? download - buffer : 0;
+        buffer = (buffer > download ? buffer - download : 0) + chunkSec;
+        double cap = m_ctx->bufferCapacityMs / 1000.0;
+        buffer = buffer < cap ? buffer : cap;
+
+        double q = rates[index] / 1e6;
+        score += q - m_mu * rebuffer;
+        if (prev >= 0)
+        {
+            score -= m_lambda * fabs(q - rates[prev] / 1e6);
+        }
+        if (depth + 1 >= m_depth)
+        {
+            return score;
+        }
+
+        double best = -1e300;
+        uint32_t low = index > 0 ? index - 1 : 0;
+        uint32_t high = index + 1 < rates.size() ? index + 1 : index;
+        for (uint32_t next = low; next <= high; next++)
+        {
+            double s = Plan(depth + 1, next, (int32_t)index, buffer, score);
+            best = s > best ? s : best;
+        }
+        return best;
+    }
+
+    double m_lambda;        // per Mbps of quality change
+    double m_mu;            // per second of rebuffering, about the top bitrate in Mbps
+    double m_prediction;
+    double m_errors[ERRORS];
+    uint32_t m_errorCount;
+    uint32_t m_errorNext;
+    uint32_t m_seenSize;    // history as of the last prediction
+    double m_seenNewest;
+
+    // Per decision
+    const AbrContext *m_ctx;
+    double m_bps;
+    uint32_t m_depth;
+    double m_bestScore;
+    uint32_t m_best;
+};
+
+//================================================================
+// PROBE-ASSISTED
+//================================================================
+
+// Throughput-based, but a fresh probe estimate overrides the passive estimate where it
+// is slowest: before the first chunk has been measured, and when the probe
+// reports less than the history (a capacity drop shows in the probe a train after it
+// happens, in the passive estimate only chunks later). A probe reporting more is only
+// trusted with the buffer above the reservoir, so an optimistic probe cannot stall an
+// almost empty buffer.
+class ProbeAbr : public AbrAlgorithm
+{
+public:
+    ProbeAbr() :
+        m_safety(0.9), m_freshChunks(2), m_reservoirChunks(2)
+    {
+    }
+
+    virtual const char *Name(void) const { return "probe"; }
+    virtual bool UsesProbe(void) const { return true; }
+
+    virtual uint32_t Choose(const AbrContext &ctx)
+    {
+        double passive = ctx.throughputBps;
+        double estimate = passive;
+        bool fresh = ctx.probeBps > 0 && ctx.probeAgeMs <= m_freshChunks * ctx.chunkMs;
+        if (fresh)
+        {
+            if (passive <= 0 || ctx.probeBps < passive)
+            {
+                estimate = ctx.probeBps;
+            }
+            else if (ctx.bufferMs >= m_reservoirChunks * ctx.chunkMs)
+            {
+                estimate = ctx.probeBps;
+            }
+        }
+        return HighestBelow(*ctx.bitrates, estimate * m_safety);
+    }
+
+private:
+    double m_safety;
+    double m_freshChunks;       // older estimates are ignored
+    double m_reservoirChunks;
+};
+
+//================================================================
+// REGISTRY
+//================================================================
+
+typedef AbrAlgorithm *(*AbrFactory)(void);
+
+struct AbrEntry
+{
+    const char *name;
+    AbrFactory create;
+};
+
+template <class T>
+AbrAlgorithm *CreateAbrOf(void)
+{
+    return new T;
+}
+
+inline const AbrEntry *AbrRegistry(uint32_t *count)
+{
+    static const AbrEntry entries[] = {
+        { "throughput", &CreateAbrOf<ThroughputAbr> },
+        { "bba", &CreateAbrOf<BbaAbr> },
+        { "bola", &CreateAbrOf<BolaAbr> },
+        { "mpc", &CreateAbrOf<MpcAbr> },
+        { "probe", &CreateAbrOf<ProbeAbr> },
+    };
+    *count = sizeof(entries) / sizeof(entries[0]);
+    return entries;
+}
+
+// 0 when no algorithm has that name
+inline AbrAlgorithm *CreateAbr(const std::string &name)
+{
+    uint32_t count;
+    const AbrEntry *entries = AbrRegistry(&count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (name == entries[i].name)
+        {
+            return entries[i].create();
+        }
+    }
+    return 0;
+}
+
+// "throughput|bba|..." for usage text
+inline std::string AbrNames(void)
+{
+    uint32_t count;
+    const AbrEntry *entries = AbrRegistry(&count);
+    std::string names;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        names += (i ? "|" : "") + std::string(entries[i].name);
+    }
+    return names;
+}
+
+//================================================================
+// DECISION LATENCY
+//================================================================
+
+inline int64_t AbrClockNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Wall-clock cost of the decisions, which simulated time does not show
+struct AbrStats
+{
+    uint32_t decisions;
+    uint32_t switches;
+    int64_t totalNs;
+    int64_t maxNs;
+
+    AbrStats() :
+        decisions(0), switches(0), totalNs(0), maxNs(0)
+    {
+    }
+
+    void Record(int64_t ns, bool switched)
+    {
+        decisions++;
+        switches += switched ? 1 : 0;
+        totalNs += ns;
+        maxNs = ns > maxNs ? ns : maxNs;
+    }
+
+    double MeanUs(void) const { return decisions ? totalNs / 1000.0 / decisions : 0; }
+};
+
+} // namespace dash
+
+#endif // DASH_ABR_H
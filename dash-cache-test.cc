@@ -0,0 +1,130 @@
+// Checks of the dash-cache.h segment cache that need no simulation. Built and run
+// natively by dash-test.sh; exits non-zero if any check fails.
+#include "dash-cache.h"
+
+#include <stdio.h>
+#include <random>
+
+using namespace dash;
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+// Misses once, coalesces while the fetch runs, then hits
+static void MissPendingHit(void)
+{
+    SegmentCache cache(300, CACHE_LRU);
+    uint32_t bytes = 0;
+    Check(cache.Lookup(1, &bytes) == CACHE_MISS, "first request misses");
+    Check(cache.Lookup(1, &bytes) == CACHE_PENDING, "second request joins the fetch");
+    Check(cache.Pending() == 1, "one fetch pending");
+    cache.Fill(1, 100);
+    Check(cache.Pending() == 0, "fill ends the pending state");
+    Check(cache.Lookup(1, &bytes) == CACHE_HIT && bytes == 100, "hit after the fill");
+    const CacheStats &stats = cache.Stats();
+    Check(stats.requests == 3 && stats.misses == 1 && stats.coalesced == 1 && stats.hits == 1, "request counts");
+    Check(stats.HitRatio() == 2.0 / 3, "hit ratio");
+}
+
+// LRU evicts the entry requested longest ago; an entry over the budget is not stored
+static void LruEviction(void)
+{
+    SegmentCache cache(300, CACHE_LRU);
+    uint32_t bytes = 0;
+    for (uint64_t key = 1; key <= 3; key++)
+    {
+        cache.Lookup(key, &bytes);
+        cache.Fill(key, 100);
+    }
+    cache.Lookup(1, &bytes);
+    cache.Lookup(4, &bytes);
+    cache.Fill(4, 100);
+    Check(!cache.Contains(2) && cache.Contains(1) && cache.Contains(3) && cache.Contains(4), "lru victim");
+    Check(cache.Bytes() == 300 && cache.Stats().evictions == 1, "lru bytes and evictions");
+
+    cache.Lookup(5, &bytes);
+    cache.Fill(5, 400);
+    Check(!cache.Contains(5) && cache.Stats().uncacheable == 1, "larger than the budget");
+}
+
+// Popularity keeps the much-requested entry over newer ones, but aging lets a stream of
+// new segments push it out eventually
+static void PopularityAging(void)
+{
+    SegmentCache cache(300, CACHE_POPULARITY);
+    uint32_t bytes = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        if (cache.Lookup(1, &bytes) == CACHE_MISS)
+        {
+            cache.Fill(1, 100);
+        }
+    }
+    for (uint64_t key = 2; key <= 4; key++)
+    {
+        cache.Lookup(key, &bytes);
+        cache.Fill(key, 100);
+    }
+    Check(cache.Contains(1) && !cache.Contains(2), "popular entry kept, oldest single request evicted");
+
+    uint64_t key = 10;
+    while (cache.Contains(1) && key < 100)
+    {
+        cache.Lookup(key, &bytes);
+        cache.Fill(key, 100);
+        key++;
+    }
+    Check(!cache.Contains(1), "popular entry ages out");
+}
+
+// A broken-off fetch leaves nothing behind: the next request misses and fetches again
+static void AbandonedFetch(void)
+{
+    SegmentCache cache(300, CACHE_LRU);
+    uint32_t bytes = 0;
+    cache.Lookup(7, &bytes);
+    cache.Lookup(7, &bytes);
+    cache.Abandon(7);
+    Check(cache.Pending() == 0 && !cache.Contains(7), "abandon clears the pending fetch");
+    Check(cache.Lookup(7, &bytes) == CACHE_MISS, "request after an abandon misses");
+    Check(cache.Stats().misses == 2, "two origin fetches");
+}
+
+// A random workload never goes over the budget
+static void StaysInBudget(void)
+{
+    std::mt19937 rng(1);
+    SegmentCache cache(50000, CACHE_POPULARITY);
+    uint32_t bytes = 0;
+    bool within = true;
+    for (int i = 0; i < 200000; i++)
+    {
+        uint64_t key = rng() % 1000;
+        if (cache.Lookup(key, &bytes) == CACHE_MISS)
+        {
+            cache.Fill(key, 100 + key % 50);
+        }
+        within = within && cache.Bytes() <= cache.Budget();
+    }
+    Check(within, "bytes within the budget");
+    Check(cache.Pending() == 0, "no fetch left pending");
+}
+
+int main(void)
+{
+    MissPendingHit();
+    LruEviction();
+    PopularityAging();
+    AbandonedFetch();
+    StaysInBudget();
+    printf("dash-cache-test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+// Segment cache of the edge node in as.cc, between the clients and the DASH servers. It
+// holds (segment, representation) entries under a byte budget and evicts either the least
+// recently used or the least popular one. Popularity is LFU with dynamic aging (LFU-DA):
+// an entry ranks at its request count plus the rank of the last eviction, so segments that
+// everyone watched a while ago age out instead of pinning the cache.
+//
+// Misses on their way to the origin are tracked too, so concurrent requests for one
+// segment share one fetch. The cache only decides and counts; the owner keeps the bytes,
+// the waiting requests and the connections, and reports each fetch back with Fill, or
+// with Abandon when it broke off.
+#ifndef DASH_CACHE_H
+#define DASH_CACHE_H
+
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace dash {
+
+enum CachePolicy
+{
+    CACHE_LRU,
+    CACHE_POPULARITY
+};
+
+enum CacheLookup
+{
+    CACHE_HIT,          // stored; serve it now
+    CACHE_PENDING,      // another request's fetch is on its way; wait for it
+    CACHE_MISS          // fetch it from the origin and report back with Fill
+};
+
+// "lru" or "popularity"; false for anything else
+inline bool ParseCachePolicy(const std::string &name, CachePolicy *policy)
+{
+    if (name == "lru")
+    {
+        *policy = CACHE_LRU;
+        return true;
+    }
+    if (name == "popularity")
+    {
+        *policy = CACHE_POPULARITY;
+        return true;
+    }
+    return false;
+}
+
+inline const char *CachePolicyName(CachePolicy policy)
+{
+    return policy == CACHE_POPULARITY ? "popularity" : "lru";
+}
+
+struct CacheStats
+{
+    uint64_t requests;          // hits + coalesced + misses
+    uint64_t hits;
+    uint64_t coalesced;         // joined a fetch already running
+    uint64_t misses;            // one origin fetch each
+    uint64_t fetchedBytes;      // from the origin
+    uint64_t evictions;
+    uint64_t evictedBytes;
+    uint64_t uncacheable;       // fetched but larger than the budget
+
+    CacheStats() :
+        requests(0), hits(0), coalesced(0), misses(0), fetchedBytes(0), evictions(0), evictedBytes(0),
+        uncacheable(0)
+    {
+    }
+
+    // Requests that did not go to the origin themselves
+    double HitRatio(void) const
+    {
+        return requests ? (double)(hits + coalesced) / requests : 0;
+    }
+};
+
+class SegmentCache
+{
+public:
+    explicit SegmentCache(uint64_t budgetBytes = 0, CachePolicy policy = CACHE_LRU) :
+        m_budget(budgetBytes), m_policy(policy), m_bytes(0), m_tick(0), m_age(0)
+    {
+    }
+
+    static uint64_t Key(uint32_t segment, uint32_t representation)
+    {
+        return (uint64_t)segment << 32 | representation;
+    }
+
+    // Classifies a request and counts it; *bytes is the stored size on a hit
+    CacheLookup Lookup(uint64_t key, uint32_t *bytes)
+    {
+        m_stats.requests++;
+        std::unordered_map<uint64_t, Entry>::iterator it = m_entries.find(key);
+        if (it != m_entries.end())
+        {
+            m_stats.hits++;
+            Entry &entry = it->second;
+            m_order.erase(Rank(entry, key));
+            entry.requests++;
+            entry.tick = ++m_tick;
+            entry.priority = Priority(entry.requests);
+            m_order.insert(Rank(entry, key));
+            *bytes = entry.bytes;
+            return CACHE_HIT;
+        }
+        std::unordered_map<uint64_t, uint64_t>::iterator pending = m_pending.find(key);
+        if (pending != m_pending.end())
+        {
+            m_stats.coalesced++;
+            pending->second++;
+            return CACHE_PENDING;
+        }
+        m_stats.misses++;
+        m_pending[key] = 1;
+        return CACHE_MISS;
+    }
+
+    // The origin's answer to a miss, 0 bytes for none: stores it if it fits in the budget,
+    // evicting what it must, and ends the pending state
+    void Fill(uint64_t key, uint32_t bytes)
+    {
+        std::unordered_map<uint64_t, uint64_t>::iterator pending = m_pending.find(key);
+        uint64_t requests = pending != m_pending.end() ? pending->second : 1;
+        if (pending != m_pending.end())
+        {
+            m_pending.erase(pending);
+        }
+        m_stats.fetchedBytes += bytes;
+        if (bytes == 0 || m_entries.count(key))
+        {
+            return;
+        }
+        if (bytes > m_budget)
+        {
+            m_stats.uncacheable++;
+            return;
+        }
+        while (m_bytes + bytes > m_budget)
+        {
+            Evict();
+        }
+        Entry &entry = m_entries[key];
+        entry.bytes = bytes;
+        entry.requests = requests;
+        entry.tick = ++m_tick;
+        entry.priority = Priority(requests);
+        m_order.insert(Rank(entry, key));
+        m_bytes += bytes;
+    }
+
+    // A fetch that failed: the next request for the segment misses again
+    void Abandon(uint64_t key)
+    {
+        m_pending.erase(key);
+    }
+
+    bool Contains(uint64_t key) const
+    {
+        return m_entries.count(key) != 0;
+    }
+
+    uint64_t Bytes(void) const { return m_bytes; }
+    uint64_t Budget(void) const { return m_budget; }
+    size_t Entries(void) const { return m_entries.size(); }
+    size_t Pending(void) const { return m_pending.size(); }
+    CachePolicy Policy(void) const { return m_policy; }
+    const CacheStats &Stats(void) const { return m_stats; }
+
+private:
+    struct Entry
+    {
+        uint32_t bytes;
+        uint64_t requests;
+        uint64_t tick;          // of the last request
+        uint64_t priority;      // 0 under LRU: the tick alone orders
+    };
+
+    // Eviction order: lowest priority first, the least recently used among equals
+    struct Rank
+    {
+        uint64_t priority;
+        uint64_t tick;
+        uint64_t key;
+
+        Rank(const Entry &entry, uint64_t k) :
+            priority(entry.priority), tick(entry.tick), key(k)
+        {
+        }
+
+        bool operator<(const Rank &other) const
+        {
+            if (priority != other.priority)
+            {
+                return priority < other.priority;
+            }
+            return tick < other.tick;
+        }
+    };
+
+    uint64_t Priority(uint64_t requests) const
+    {
+        return m_policy == CACHE_POPULARITY ? m_age + requests : 0;
+    }
+
+    void Evict(void)
+    {
+        std::set<Rank>::iterator victim = m_order.begin();
+        std::unordered_map<uint64_t, Entry>::iterator it = m_entries.find(victim->key);
+        m_age = victim->priority;
+        m_bytes -= it->second.bytes;
+        m_stats.evictions++;
+        m_stats.evictedBytes += it->second.bytes;
+        m_entries.erase(it);
+        m_order.erase(victim);
+    }
+
+    uint64_t m_budget;
+    CachePolicy m_policy;
+    uint64_t m_bytes;
+    uint64_t m_tick;
+    uint64_t m_age;             // LFU-DA: priority of the last victim
+    std::unordered_map<uint64_t, Entry> m_entries;
+    std::set<Rank> m_order;
+    std::unordered_map<uint64_t, uint64_t> m_pending;   // key -> requests waiting on it
+    CacheStats m_stats;
+};
+
+} // namespace dash
+
+#endif // DASH_CACHE_H
@@ -0,0 +1,78 @@
+// Checks of the dash-http.h parser that need no simulation. Built and run natively by
+// dash-test.sh; exits non-zero on the first failure.
+#include "dash-http.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace dash;
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+// Feeds text in one segment and returns the first event, HTTP_MORE if it needs more
+static HttpEvent Feed(HttpParser &parser, const char *text)
+{
+    size_t offset = 0;
+    return parser.Next((const uint8_t *)text, strlen(text), &offset);
+}
+
+// A bad start line fails the stream for good: the valid requests after it are not parsed
+static void BadStartLineSticks(void)
+{
+    HttpParser requests(HTTP_REQUEST);
+    Check(Feed(requests, "PUT /seg/1/0 HTTP/1.1\r\n") == HTTP_ERROR, "bad request line");
+    Check(strcmp(requests.Error(), "bad request line") == 0, "request error reason");
+    for (int i = 0; i < 3; i++)
+    {
+        Check(Feed(requests, "GET /seg/1/0 HTTP/1.1\r\nHost: dash\r\n\r\n") == HTTP_ERROR,
+            "valid request after a bad request line");
+    }
+
+    HttpParser responses(HTTP_RESPONSE);
+    Check(Feed(responses, "HTTP/1.1 999 Odd\r\n") == HTTP_ERROR, "bad status line");
+    for (int i = 0; i < 3; i++)
+    {
+        Check(Feed(responses, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n") == HTTP_ERROR,
+            "valid response after a bad status line");
+    }
+}
+
+// The same with the bad line split across two segments
+static void SplitBadStartLineSticks(void)
+{
+    HttpParser requests(HTTP_REQUEST);
+    Check(Feed(requests, "GET /seg/x") == HTTP_MORE, "first half of a bad request line");
+    Check(Feed(requests, "/0 HTTP/1.1\r\nGET /seg/1/0 HTTP/1.1\r\n\r\n") == HTTP_ERROR,
+        "second half of a bad request line");
+    Check(Feed(requests, "GET /seg/1/0 HTTP/1.1\r\n\r\n") == HTTP_ERROR, "valid request after a split bad line");
+}
+
+// Reset starts over after an error
+static void ResetRecovers(void)
+{
+    HttpParser requests(HTTP_REQUEST);
+    Check(Feed(requests, "garbage\r\n") == HTTP_ERROR, "garbage");
+    requests.Reset();
+    Check(Feed(requests, "GET /seg/7/2 HTTP/1.1\r\nRange: bytes=10-19\r\n\r\n") == HTTP_HEADERS, "after Reset");
+    Check(requests.Message().segment == 7 && requests.Message().representation == 2, "segment after Reset");
+    Check(requests.Message().hasRange && requests.Message().first == 10 && requests.Message().last == 19,
+        "range after Reset");
+}
+
+int main(void)
+{
+    BadStartLineSticks();
+    SplitBadStartLineSticks();
+    ResetRecovers();
+    printf("dash-http-test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
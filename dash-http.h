@@ -0,0 +1,419 @@
+// HTTP/1.1-style framing of segment downloads between the DASH client and server in as.cc.
+// A segment is GET /seg/<segment>/<representation>, optionally for a byte range; the
+// answer is a status line, Content-Length (and Content-Range for a range) and the body.
+// Connections are kept alive unless a side says "Connection: close", and requests may be
+// pipelined: responses come back in request order.
+//
+// HttpParser runs incrementally over whatever the TCP receive path hands it. Header lines
+// are parsed in place in the received segment; only a line split across two segments is
+// held in a small buffer. Body bytes are skipped over, never copied or inspected, which
+// also suits ns-3's virtual (zero-filled) payloads. The parser sees byte ranges, never
+// sockets, so dash-http-test.cc drives it without a simulation.
+#ifndef DASH_HTTP_H
+#define DASH_HTTP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+namespace dash {
+
+enum HttpMode
+{
+    HTTP_REQUEST,       // the server's side of the stream
+    HTTP_RESPONSE       // the client's
+};
+
+enum HttpEvent
+{
+    HTTP_MORE,          // everything consumed; the message goes on in the next segment
+    HTTP_HEADERS,       // Message() has the start line and the headers
+    HTTP_BODY,          // BodyBytes() body bytes were skipped over
+    HTTP_DONE,          // message complete; the next byte starts another one
+    HTTP_ERROR          // malformed, the stream cannot be resynchronized
+};
+
+enum
+{
+    HTTP_MAX_HEADER = 8192
+};
+
+const uint64_t HTTP_OPEN_RANGE = ~(uint64_t)0;   // "bytes=N-": up to the end
+
+struct HttpMessage
+{
+    // Request
+    uint32_t segment;
+    uint32_t representation;
+    // Range of a request, Content-Range of a response
+    bool hasRange;
+    uint64_t first;
+    uint64_t last;              // inclusive, HTTP_OPEN_RANGE for an open request range
+    uint64_t total;             // Content-Range only
+    // Response
+    uint32_t status;
+    uint64_t contentLength;
+    bool keepAlive;
+    uint32_t headerBytes;       // start line and headers, the blank line included
+};
+
+//================================================================
+// PARSER
+//================================================================
+
+class HttpParser
+{
+public:
+    explicit HttpParser(HttpMode mode = HTTP_REQUEST) :
+        m_mode(mode), m_error(0)
+    {
+        Reset();
+    }
+
+    void Reset(void)
+    {
+        m_state = START;
+        m_remaining = 0;
+        m_bodyBytes = 0;
+        m_line.clear();
+        memset(&m_message, 0, sizeof(m_message));
+        m_message.keepAlive = true;
+        m_message.last = HTTP_OPEN_RANGE;
+    }
+
+    // Parses data[*offset, len) up to the next event and moves *offset past what it used
+    HttpEvent Next(const uint8_t *data, size_t len, size_t *offset)
+    {
+        switch (m_state)
+        {
+        case FAILED:
+            return HTTP_ERROR;
+
+        case COMPLETE:
+            m_state = START;
+            m_remaining = 0;
+            m_line.clear();
+            return HTTP_DONE;
+
+        case BODY:
+        {
+            if (*offset >= len)
+            {
+                return HTTP_MORE;
+            }
+            uint64_t n = len - *offset < m_remaining ? len - *offset : m_remaining;
+            *offset += n;
+            m_remaining -= n;
+            m_bodyBytes = n;
+            if (m_remaining == 0)
+            {
+                m_state = COMPLETE;
+            }
+            return HTTP_BODY;
+        }
+
+        default:
+            break;
+        }
+
+        while (*offset < len)
+        {
+            if (m_state == START && m_line.empty())
+            {
+                // A new message
+                memset(&m_message, 0, sizeof(m_message));
+                m_message.keepAlive = true;
+                m_message.last = HTTP_OPEN_RANGE;
+            }
+
+            const uint8_t *begin = data + *offset;
+            const uint8_t *newline = (const uint8_t *)memchr(begin, '\n', len - *offset);
+            size_t take = newline ? (size_t)(newline - begin) + 1 : len - *offset;
+            m_message.headerBytes += (uint32_t)take;
+            *offset += take;
+            if (m_message.headerBytes > HTTP_MAX_HEADER)
+            {
+                return Fail("header too long");
+            }
+            if (!newline)
+            {
+                m_line.append((const char *)begin, take);
+                return HTTP_MORE;
+            }
+
+            // The line in place, unless its start came with an earlier segment
+            const char *line = (const char *)begin;
+            size_t n = take - 1;
+            if (!m_line.empty())
+            {
+                m_line.append((const char *)begin, take - 1);
+                line = m_line.data();
+                n = m_line.size();
+            }
+            if (n > 0 && line[n - 1] == '\r')
+            {
+                n--;
+            }
+
+            bool ok;
+            if (m_state == START)
+            {
+                ok = m_mode == HTTP_REQUEST ? ParseRequestLine(line, n) : ParseStatusLine(line, n);
+                if (ok)
+                {
+                    m_state = HEADERS;
+                }
+            }
+            else if (n == 0)
+            {
+                m_line.clear();
+                m_remaining = m_mode == HTTP_RESPONSE ? m_message.contentLength : 0;
+                m_state = m_remaining > 0 ? BODY : COMPLETE;
+                return HTTP_HEADERS;
+            }
+            else
+            {
+                ok = ParseHeader(line, n);
+            }
+            m_line.clear();
+            if (!ok)
+            {
+                return HTTP_ERROR;
+            }
+        }
+        return HTTP_MORE;
+    }
+
+    const HttpMessage &Message(void) const { return m_message; }
+    // Of the last HTTP_BODY
+    uint64_t BodyBytes(void) const { return m_bodyBytes; }
+    uint64_t BodyRemaining(void) const { return m_remaining; }
+    // Why the last HTTP_ERROR
+    const char *Error(void) const { return m_error ? m_error : ""; }
+
+private:
+    enum State
+    {
+        START,
+        HEADERS,
+        BODY,
+        COMPLETE,
+        FAILED
+    };
+
+    HttpEvent Fail(const char *why)
+    {
+        m_state = FAILED;
+        m_error = why;
+        return HTTP_ERROR;
+    }
+
+    // Reads a decimal number at line[*at]
+    static bool Number(const char *line, size_t n, size_t *at, uint64_t *value)
+    {
+        size_t start = *at;
+        uint64_t v = 0;
+        while (*at < n && line[*at] >= '0' && line[*at] <= '9' && *at - start < 19)
+        {
+            v = v * 10 + (line[*at] - '0');
+            (*at)++;
+        }
+        *value = v;
+        return *at > start;
+    }
+
+    static bool Literal(const char *line, size_t n, size_t *at, const char *text)
+    {
+        size_t k = strlen(text);
+        if (n - *at < k || strncasecmp(line + *at, text, k) != 0)
+        {
+            return false;
+        }
+        *at += k;
+        return true;
+    }
+
+    bool ParseVersion(const char *line, size_t n, size_t *at)
+    {
+        if (Literal(line, n, at, "HTTP/1.1"))
+        {
+            return true;
+        }
+        if (Literal(line, n, at, "HTTP/1.0"))
+        {
+            m_message.keepAlive = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool ParseRequestLine(const char *line, size_t n)
+    {
+        size_t at = 0;
+        uint64_t segment, representation;
+        if (!Literal(line, n, &at, "GET /seg/") || !Number(line, n, &at, &segment) ||
+            !Literal(line, n, &at, "/") || !Number(line, n, &at, &representation) ||
+            !Literal(line, n, &at, " ") || !ParseVersion(line, n, &at) || at != n ||
+            segment > 0xffffffffu || representation > 0xffffffffu)
+        {
+            Fail("bad request line");
+            return false;
+        }
+        m_message.segment = (uint32_t)segment;
+        m_message.representation = (uint32_t)representation;
+        return true;
+    }
+
+    bool ParseStatusLine(const char *line, size_t n)
+    {
+        size_t at = 0;
+        uint64_t status;
+        if (!ParseVersion(line, n, &at) || !Literal(line, n, &at, " ") || !Number(line, n, &at, &status) ||
+            status < 100 || status > 599)
+        {
+            Fail("bad status line");
+            return false;
+        }
+        m_message.status = (uint32_t)status;
+        return true;
+    }
+
+    // Headers this layer does not know are skipped
+    bool ParseHeader(const char *line, size_t n)
+    {
+        size_t at = 0;
+        bool ok = true;
+        if (Literal(line, n, &at, "Content-Length:"))
+        {
+            Spaces(line, n, &at);
+            ok = Number(line, n, &at, &m_message.contentLength);
+        }
+        else if (Literal(line, n, &at, "Range:"))
+        {
+            Spaces(line, n, &at);
+            ok = Literal(line, n, &at, "bytes=") && Number(line, n, &at, &m_message.first) &&
+                Literal(line, n, &at, "-");
+            if (ok && !Number(line, n, &at, &m_message.last))
+            {
+                m_message.last = HTTP_OPEN_RANGE;
+            }
+            ok = ok && m_message.first <= m_message.last;
+            m_message.hasRange = ok;
+        }
+        else if (Literal(line, n, &at, "Content-Range:"))
+        {
+            Spaces(line, n, &at);
+            ok = Literal(line, n, &at, "bytes ") && Number(line, n, &at, &m_message.first) &&
+                Literal(line, n, &at, "-") && Number(line, n, &at, &m_message.last) &&
+                Literal(line, n, &at, "/") && Number(line, n, &at, &m_message.total);
+            m_message.hasRange = ok;
+        }
+        else if (Literal(line, n, &at, "Connection:"))
+        {
+            Spaces(line, n, &at);
+            if (Literal(line, n, &at, "close"))
+            {
+                m_message.keepAlive = false;
+            }
+            else if (Literal(line, n, &at, "keep-alive"))
+            {
+                m_message.keepAlive = true;
+            }
+        }
+        if (!ok)
+        {
+            Fail("bad header");
+        }
+        return ok;
+    }
+
+    static void Spaces(const char *line, size_t n, size_t *at)
+    {
+        while (*at < n && (line[*at] == ' ' || line[*at] == '\t'))
+        {
+            (*at)++;
+        }
+    }
+
+    HttpMode m_mode;
+    State m_state;
+    HttpMessage m_message;
+    uint64_t m_remaining;       // body bytes still to come
+    uint64_t m_bodyBytes;
+    std::string m_line;         // a line split across segments, so far
+    const char *m_error;
+};
+
+//================================================================
+// MESSAGES
+//================================================================
+
+// Returns the length written to out, at most size - 1. first = 0 and last =
+// HTTP_OPEN_RANGE ask for the whole segment without a Range header.
+inline size_t FormatHttpRequest(char *out, size_t size, uint32_t segment, uint32_t representation,
+    uint64_t first, uint64_t last, bool keepAlive)
+{
+    int n = snprintf(out, size, "GET /seg/%u/%u HTTP/1.1\r\nHost: dash\r\n", segment, representation);
+    if (first > 0 || last != HTTP_OPEN_RANGE)
+    {
+        if (last == HTTP_OPEN_RANGE)
+        {
+            n += snprintf(out + n, size - n, "Range: bytes=%llu-\r\n", (unsigned long long)first);
+        }
+        else
+        {
+            n += snprintf(out + n, size - n, "Range: bytes=%llu-%llu\r\n", (unsigned long long)first,
+                (unsigned long long)last);
+        }
+    }
+    n += snprintf(out + n, size - n, "Connection: %s\r\n\r\n", keepAlive ? "keep-alive" : "close");
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
+
+// The status for a request of a segment of segmentBytes (0: no such segment), with the
+// byte range to send in *first and *length
+inline uint32_t ResolveHttpRequest(const HttpMessage &request, uint32_t segmentBytes, uint64_t *first,
+    uint64_t *length)
+{
+    *first = 0;
+    *length = 0;
+    if (segmentBytes == 0)
+    {
+        return 404;
+    }
+    if (!request.hasRange)
+    {
+        *length = segmentBytes;
+        return 200;
+    }
+    if (request.first >= segmentBytes)
+    {
+        return 416;
+    }
+    uint64_t last = request.last < segmentBytes ? request.last : segmentBytes - 1;
+    *first = request.first;
+    *length = last - request.first + 1;
+    return 206;
+}
+
+inline size_t FormatHttpResponse(char *out, size_t size, uint32_t status, uint64_t first, uint64_t length,
+    uint64_t total, bool keepAlive)
+{
+    const char *reason = status == 200 ? "OK" : status == 206 ? "Partial Content" : status == 404 ? "Not Found" :
+        status == 416 ? "Range Not Satisfiable" : "Bad Request";
+    int n = snprintf(out, size, "HTTP/1.1 %u %s\r\nContent-Length: %llu\r\n", status, reason,
+        (unsigned long long)length);
+    if (status == 206)
+    {
+        n += snprintf(out + n, size - n, "Content-Range: bytes %llu-%llu/%llu\r\n", (unsigned long long)first,
+            (unsigned long long)(first + length - 1), (unsigned long long)total);
+    }
+    n += snprintf(out + n, size - n, "Connection: %s\r\n\r\n", keepAlive ? "keep-alive" : "close");
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
+
+} // namespace dash
+
+#endif // DASH_HTTP_H
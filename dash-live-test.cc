@@ -0,0 +1,124 @@
+// Checks of the dash-live.h schedule, rate control and meters that need no simulation,
+// and of BOLA under a live latency target. Built and run natively by dash-test.sh; exits
+// non-zero if any check fails.
+#include "dash-live.h"
+#include "dash-abr.h"
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace dash;
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+static bool Near(double a, double b)
+{
+    return fabs(a - b) < 1e-9;
+}
+
+// Chunks become ready as the encoder finishes them, the last one shorter when the chunk
+// does not divide the segment
+static void Schedule(void)
+{
+    LiveSchedule even(2000, 500);
+    Check(even.Chunks() == 4 && even.EdgeSegment(4100) == 2, "chunks and edge segment");
+    Check(even.ChunksReady(2, 4000) == 0 && even.ChunksReady(2, 4500) == 1, "first chunk ready");
+    Check(even.ChunksReady(2, 5999) == 3 && even.ChunksReady(2, 6000) == 4, "last chunk ready");
+    Check(even.ChunkReadyMs(2, 0) == 4500 && even.ChunkReadyMs(2, 3) == 6000, "chunk ready times");
+    Check(even.BytesReady(2, 1000, 5000) == 500, "bytes ready");
+    Check(even.ChunksIn(499, 1000) == 1 && even.ChunksIn(500, 1000) == 2 && even.ChunksIn(1000, 1000) == 4,
+        "chunks in a byte count");
+
+    LiveSchedule uneven(2000, 700);
+    Check(uneven.Chunks() == 3 && uneven.ChunkEndMs(3) == 2000, "short last chunk");
+    Check(uneven.ChunksReady(0, 1999) == 2 && uneven.ChunksReady(0, 2000) == 3, "short last chunk ready");
+}
+
+// Proportional inside the ramp, capped outside it, off within the tolerance and when a
+// speed-up would drain a short buffer
+static void PlaybackRate(void)
+{
+    LiveConfig config;
+    Check(LivePlaybackRate(config, 3050, 1000) == 1.0, "within the tolerance");
+    Check(Near(LivePlaybackRate(config, 3500, 1000), 1.025), "half the ramp");
+    Check(Near(LivePlaybackRate(config, 5000, 1000), 1.05), "capped speed-up");
+    Check(LivePlaybackRate(config, 5000, 100) == 1.0, "no speed-up on a short buffer");
+    Check(Near(LivePlaybackRate(config, 1500, 1000), 0.95), "capped slow-down");
+}
+
+// Four 100 kB bursts at 8 Mbps with the encoder idle in between: the active rate is the
+// path's, not the encoding bitrate
+static void ActiveRate(void)
+{
+    ActiveThroughput meter(50);
+    double ms = 0;
+    for (int chunk = 0; chunk < 4; chunk++)
+    {
+        for (int k = 0; k < 100; k++)
+        {
+            meter.Add(ms, 1000);
+            ms += 1;
+        }
+        ms += 400;
+    }
+    Check(Near(meter.Take(), 8e6), "active throughput");
+    Check(meter.Take() == 0, "nothing since the last take");
+}
+
+static void Histogram(void)
+{
+    LatencyHistogram histogram;
+    Check(histogram.Percentile(0.5) == 0, "empty percentile");
+    for (int i = 0; i < 1000; i++)
+    {
+        histogram.Add(2000 + i);
+    }
+    Check(histogram.Percentile(0.5) == 2475 && histogram.Percentile(0.99) == 2975, "percentiles are bin middles");
+    Check(Near(histogram.Mean(), 2499.5) && histogram.Max() == 2999, "mean and exact maximum");
+    histogram.Add(1e6);
+    Check(histogram.Percentile(1.0) == (LatencyHistogram::BINS - 0.5) * LatencyHistogram::BIN_MS,
+        "overflow lands in the last bin");
+}
+
+// A live target of one segment leaves BOLA a one-chunk buffer: it must still start at the
+// lowest rung and climb as the buffer fills, not take the top one on a nearly empty buffer
+static void BolaOneSegmentBuffer(void)
+{
+    std::vector<uint32_t> bitrates;
+    for (uint32_t k = 1; k <= 6; k++)
+    {
+        bitrates.push_back(k * 700000);
+    }
+    ThroughputHistory history;
+    AbrContext ctx = AbrContext();
+    ctx.bitrates = &bitrates;
+    ctx.history = &history;
+    ctx.chunkMs = 2000;
+    ctx.bufferCapacityMs = 2000;
+    AbrAlgorithm *bola = CreateAbr("bola");
+    ctx.bufferMs = 250;
+    Check(bola->Choose(ctx) == 0, "bola on a nearly empty one-segment buffer");
+    ctx.bufferMs = 2000;
+    Check(bola->Choose(ctx) > 0, "bola on a full one-segment buffer");
+    delete bola;
+}
+
+int main(void)
+{
+    Schedule();
+    PlaybackRate();
+    ActiveRate();
+    Histogram();
+    BolaOneSegmentBuffer();
+    printf("dash-live-test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+// Live streaming for as.cc: segments produced in real time and delivered chunk by chunk as
+// the encoder finishes them (CMAF-style low-latency DASH), the playback-rate control that
+// holds a client at its latency target, and what live measurement needs on top of on
+// demand: a throughput meter that leaves out the waits for the encoder, and a latency
+// histogram. Times are milliseconds since the stream started, which as.cc puts at
+// simulation time 0.
+#ifndef DASH_LIVE_H
+#define DASH_LIVE_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace dash {
+
+struct LiveConfig
+{
+    uint32_t targetLatencyMs;   // capture to display
+    double maxRateChange;       // playback rate stays within 1 +- this
+    uint32_t rampMs;            // latency error that gets the whole rate change
+    uint32_t toleranceMs;       // no correction within the target +- this
+    uint32_t minBufferMs;       // no speed-up with less buffered
+    double idleMs;              // gaps between arrivals longer than this are idle
+
+    LiveConfig() :
+        targetLatencyMs(3000), maxRateChange(0.05), rampMs(1000), toleranceMs(100), minBufferMs(500),
+        idleMs(50)
+    {
+    }
+};
+
+// The encoder's timeline: segment s is produced from s * segmentMs on, one chunk every
+// chunkMs (the last one shorter if chunkMs does not divide segmentMs), and chunk c ends
+// at byte size * (c + 1) / Chunks() of the segment
+class LiveSchedule
+{
+public:
+    explicit LiveSchedule(uint32_t segmentMs = 2000, uint32_t chunkMs = 500) :
+        m_segmentMs(segmentMs), m_chunkMs(chunkMs < 1 ? 1 : chunkMs > segmentMs ? segmentMs : chunkMs)
+    {
+    }
+
+    uint32_t SegmentMs(void) const { return m_segmentMs; }
+    uint32_t ChunkMs(void) const { return m_chunkMs; }
+
+    uint32_t Chunks(void) const
+    {
+        return (m_segmentMs + m_chunkMs - 1) / m_chunkMs;
+    }
+
+    // The segment being produced at ms: a player joining then starts there
+    uint32_t EdgeSegment(int64_t ms) const
+    {
+        return ms > 0 ? (uint32_t)(ms / m_segmentMs) : 0;
+    }
+
+    // Media time in the first chunks chunks of a segment
+    uint32_t ChunkEndMs(uint32_t chunks) const
+    {
+        uint64_t ms = (uint64_t)chunks * m_chunkMs;
+        return ms < m_segmentMs ? (uint32_t)ms : m_segmentMs;
+    }
+
+    int64_t ChunkReadyMs(uint32_t segment, uint32_t chunk) const
+    {
+        return (int64_t)segment * m_segmentMs + ChunkEndMs(chunk + 1);
+    }
+
+    // Chunks of the segment finished at ms
+    uint32_t ChunksReady(uint32_t segment, int64_t ms) const
+    {
+        int64_t t = ms - (int64_t)segment * m_segmentMs;
+        if (t < 0)
+        {
+            return 0;
+        }
+        return t >= m_segmentMs ? Chunks() : (uint32_t)(t / m_chunkMs);
+    }
+
+    uint64_t BytesReady(uint32_t segment, uint32_t segmentBytes, int64_t ms) const
+    {
+        return (uint64_t)segmentBytes * ChunksReady(segment, ms) / Chunks();
+    }
+
+    // Whole chunks in the first bytes of a segment of segmentBytes
+    uint32_t ChunksIn(uint64_t bytes, uint32_t segmentBytes) const
+    {
+        if (segmentBytes == 0 || bytes >= segmentBytes)
+        {
+            return Chunks();
+        }
+        return (uint32_t)(bytes * Chunks() / segmentBytes);
+    }
+
+private:
+    uint32_t m_segmentMs;
+    uint32_t m_chunkMs;
+};
+
+// Proportional to the latency error, zero inside the tolerance. Speeding up is off while
+// the buffer is short, since it would only trade latency for a stall.
+inline double LivePlaybackRate(const LiveConfig &config, double latencyMs, double bufferMs)
+{
+    double error = latencyMs - config.targetLatencyMs;
+    if ((error <= config.toleranceMs && error >= -(double)config.toleranceMs) ||
+        (error > 0 && bufferMs < config.minBufferMs))
+    {
+        return 1.0;
+    }
+    double ramp = error / (config.rampMs ? config.rampMs : 1);
+    ramp = ramp > 1 ? 1 : ramp < -1 ? -1 : ramp;
+    return 1.0 + ramp * config.maxRateChange;
+}
+
+// Download rate over the time data was actually arriving. Live responses come in bursts,
+// one per chunk, with the connection idle in between while the encoder works; over the
+// whole response the rate is the encoding bitrate, not the path's. A gap longer than
+// idleMs starts a new burst, and the first arrival of a burst counts no bytes, since the
+// time it took is unknown.
+class ActiveThroughput
+{
+public:
+    explicit ActiveThroughput(double idleMs = 50) :
+        m_idleMs(idleMs), m_lastMs(-1), m_bytes(0), m_activeMs(0)
+    {
+    }
+
+    void Add(double ms, uint64_t bytes)
+    {
+        if (m_lastMs >= 0 && ms - m_lastMs <= m_idleMs)
+        {
+            m_bytes += bytes;
+            m_activeMs += ms - m_lastMs;
+        }
+        m_lastMs = ms;
+    }
+
+    // Since the last Take
+    uint64_t Bytes(void) const { return m_bytes; }
+    double ActiveMs(void) const { return m_activeMs; }
+
+    // Rate since the last Take, 0 if there was no active time; a burst running on
+    // continues into the next measurement
+    double Take(void)
+    {
+        double bps = m_activeMs > 0 ? m_bytes * 8000.0 / m_activeMs : 0;
+        m_bytes = 0;
+        m_activeMs = 0;
+        return bps;
+    }
+
+private:
+    double m_idleMs;
+    double m_lastMs;
+    uint64_t m_bytes;
+    double m_activeMs;
+};
+
+// Latencies in BIN_MS bins; anything past the last bin lands in it, the maximum is exact
+class LatencyHistogram
+{
+public:
+    enum
+    {
+        BIN_MS = 50,
+        BINS = 600              // 30 s
+    };
+
+    LatencyHistogram()
+    {
+        Reset();
+    }
+
+    void Reset(void)
+    {
+        memset(m_bins, 0, sizeof(m_bins));
+        m_count = 0;
+        m_sum = 0;
+        m_max = 0;
+    }
+
+    void Add(double ms)
+    {
+        ms = ms > 0 ? ms : 0;
+        uint32_t bin = (uint32_t)(ms / BIN_MS);
+        m_bins[bin < BINS ? bin : BINS - 1]++;
+        m_count++;
+        m_sum += ms;
+        m_max = ms > m_max ? ms : m_max;
+    }
+
+    uint64_t Count(void) const { return m_count; }
+    double Mean(void) const { return m_count ? m_sum / m_count : 0; }
+    double Max(void) const { return m_max; }
+
+    // Middle of the bin holding the p-th fraction of the samples; 0 with none
+    double Percentile(double p) const
+    {
+        if (m_count == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * (m_count - 1));
+        uint64_t seen = 0;
+        for (uint32_t b = 0; b < BINS; b++)
+        {
+            seen += m_bins[b];
+            if (seen > rank)
+            {
+                return (b + 0.5) * BIN_MS;
+            }
+        }
+        return m_max;
+    }
+
+private:
+    uint32_t m_bins[BINS];
+    uint64_t m_count;
+    double m_sum;
+    double m_max;
+};
+
+} // namespace dash
+
+#endif // DASH_LIVE_H
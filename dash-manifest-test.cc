@@ -0,0 +1,134 @@
+// Checks of the dash-manifest.h catalog that need no simulation. Built and run natively
+// by dash-test.sh; exits non-zero if any check fails.
+#include "dash-manifest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace dash;
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+static std::vector<uint32_t> Ladder(void)
+{
+    std::vector<uint32_t> ladder;
+    for (uint32_t kbps = 700; kbps <= 4200; kbps += 700)
+    {
+        ladder.push_back(kbps * 1000);
+    }
+    return ladder;
+}
+
+// A scratch file for the catalog round trips; removed by the caller
+static std::string TempPath(void)
+{
+    char path[] = "/tmp/dash-manifest-test.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return path;
+}
+
+// Constant bitrate gives every segment its nominal size; VBR keeps the nominal average
+static void SynthesizedSizes(void)
+{
+    Manifest manifest;
+    Check(manifest.Synthesize(Ladder(), 512, 2000, 0, 1), "synthesize cbr");
+    Check(manifest.Representations() == 6 && manifest.Segments() == 512, "cbr dimensions");
+    Check(manifest.SegmentBytes(0, 5) == 4200000 / 8 * 2, "cbr segment size");
+    Check(manifest.SegmentBytes(512, 0) == 0 && manifest.SegmentBytes(0, 6) == 0, "sizes past the end");
+    Check(manifest.SegmentSizes(512) == 0, "size row past the end");
+
+    Check(manifest.Synthesize(Ladder(), 100000, 2000, 0.3, 7), "synthesize vbr");
+    double sum = 0;
+    uint32_t peak = 0;
+    for (uint32_t s = 0; s < manifest.Segments(); s++)
+    {
+        sum += manifest.SegmentBytes(s, 2);
+        peak = manifest.SegmentBytes(s, 2) > peak ? manifest.SegmentBytes(s, 2) : peak;
+    }
+    double ratio = sum / manifest.Segments() / (2100000 / 8 * 2.0);
+    Check(ratio > 0.99 && ratio < 1.01, "vbr keeps the nominal average");
+    Check(manifest.Representation(2).peakBitrate == (uint32_t)(peak * 8.0 * 1000 / 2000), "vbr peak bitrate");
+}
+
+// Write then Open gives back the same catalog
+static void RoundTrip(void)
+{
+    std::string path = TempPath();
+    Manifest written;
+    written.Synthesize(Ladder(), 1000, 2000, 0.3, 3);
+    Check(written.Write(path), "write");
+
+    Manifest read;
+    std::string error;
+    Check(read.Open(path, &error), "open a written catalog");
+    Check(read.Bitrates() == written.Bitrates(), "round trip bitrates");
+    uint32_t mismatches = 0;
+    for (uint32_t s = 0; s < written.Segments(); s++)
+    {
+        for (uint32_t r = 0; r < written.Representations(); r++)
+        {
+            mismatches += read.SegmentBytes(s, r) != written.SegmentBytes(s, r);
+        }
+    }
+    Check(mismatches == 0, "round trip sizes");
+
+    // A truncated file no longer matches its header
+    Check(truncate(path.c_str(), 1000) == 0, "truncate");
+    Check(!read.Open(path, &error) && !read.IsOpen(), "truncated catalog");
+    unlink(path.c_str());
+
+    Check(!read.Open("/nonexistent/catalog", &error), "missing file");
+}
+
+// A zero bitrate would give BOLA log(0): neither Open nor Synthesize takes one
+static void ZeroBitrateRejected(void)
+{
+    std::vector<uint32_t> ladder = Ladder();
+    ladder[0] = 0;
+    Manifest synthesized;
+    Check(!synthesized.Synthesize(ladder, 10, 2000, 0, 1) && !synthesized.IsOpen(), "synthesize a zero bitrate");
+    Check(!synthesized.Synthesize(std::vector<uint32_t>(), 10, 2000, 0, 1), "synthesize no representations");
+
+    // The same ladder on disk: write a good catalog and zero its lowest bitrate
+    std::string path = TempPath();
+    Manifest good;
+    good.Synthesize(Ladder(), 10, 2000, 0, 1);
+    good.Write(path);
+    FILE *file = fopen(path.c_str(), "r+b");
+    uint32_t zero = 0;
+    Check(file && fseek(file, sizeof(ManifestHeader), SEEK_SET) == 0 && fwrite(&zero, sizeof(zero), 1, file) == 1,
+        "patch the catalog");
+    if (file)
+    {
+        fclose(file);
+    }
+    Manifest opened;
+    std::string error;
+    Check(!opened.Open(path, &error) && !opened.IsOpen(), "open a zero bitrate");
+    Check(error.find("zero bitrate") != std::string::npos, "zero bitrate reason");
+    unlink(path.c_str());
+}
+
+int main(void)
+{
+    SynthesizedSizes();
+    RoundTrip();
+    ZeroBitrateRejected();
+    printf("dash-manifest-test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
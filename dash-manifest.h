@@ -0,0 +1,281 @@
+// Segment catalog of the DASH content in as.cc: the bitrate ladder and the size of every
+// segment at every representation, so that VBR content can be simulated. The catalog is a
+// binary file mapped as is; nothing is parsed at startup, and a segment's size is one
+// array index away.
+//
+//   ManifestHeader          32 bytes
+//   ManifestRepresentation  16 bytes each, ascending by bitrate
+//   uint32_t sizes[segments][representations]
+//                           bytes of each segment, segment-major: the choices for one
+//                           segment, and those for the segments after it, are contiguous
+//
+// Host byte order, like the probe captures (bw-capture.h). Without a file the catalog can
+// also be synthesized in memory, and written out for reuse with Write.
+#ifndef DASH_MANIFEST_H
+#define DASH_MANIFEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dash {
+
+enum
+{
+    MANIFEST_MAGIC = 0x4e414d44,    // "DMAN"
+    MANIFEST_VERSION = 1
+};
+
+struct ManifestHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t representations;
+    uint32_t segments;
+    uint32_t segmentMs;             // playback time of every segment
+    uint32_t reserved[3];
+};
+
+struct ManifestRepresentation
+{
+    uint32_t bitrate;               // nominal, bps
+    uint32_t peakBitrate;           // of its largest segment, bps
+    uint32_t reserved[2];
+};
+
+static_assert(sizeof(ManifestHeader) == 32, "manifest header layout");
+static_assert(sizeof(ManifestRepresentation) == 16, "manifest representation layout");
+
+class Manifest
+{
+public:
+    Manifest() :
+        m_map(0), m_mapSize(0), m_header(0), m_representations(0), m_sizes(0)
+    {
+    }
+
+    ~Manifest()
+    {
+        Close();
+    }
+
+    // Owns the mapping; a copy would unmap it twice
+    Manifest(const Manifest &) = delete;
+    Manifest &operator=(const Manifest &) = delete;
+
+    // Maps a catalog file; false with a reason in *error
+    bool Open(const std::string &path, std::string *error)
+    {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            *error = path + ": cannot open";
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ManifestHeader))
+        {
+            close(fd);
+            *error = path + ": too short for a manifest";
+            return false;
+        }
+        void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            *error = path + ": mmap failed";
+            return false;
+        }
+        m_map = map;
+        m_mapSize = st.st_size;
+
+        const ManifestHeader *header = (const ManifestHeader *)map;
+        if (header->magic != MANIFEST_MAGIC || header->version != MANIFEST_VERSION)
+        {
+            Close();
+            *error = path + ": not a version 1 manifest";
+            return false;
+        }
+        uint64_t expected = sizeof(ManifestHeader) + (uint64_t)header->representations * sizeof(ManifestRepresentation) +
+            (uint64_t)header->representations * header->segments * sizeof(uint32_t);
+        if (header->representations == 0 || header->segments == 0 || header->segmentMs == 0 ||
+            expected != (uint64_t)st.st_size)
+        {
+            Close();
+            *error = path + ": header does not match the file size";
+            return false;
+        }
+        const ManifestRepresentation *reps = (const ManifestRepresentation *)(header + 1);
+        if (!Bind(header, reps, (const uint32_t *)(reps + header->representations), error))
+        {
+            Close();
+            *error = path + ": " + *error;
+            return false;
+        }
+        // Requests walk the segments in order
+        madvise(m_map, m_mapSize, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    // In-memory catalog: every representation at its nominal bitrate, times a per-segment
+    // scene complexity shared by all representations. vbr is the standard deviation of
+    // that factor's logarithm; 0 gives constant bitrate. False, and closed, for a ladder
+    // Open would reject.
+    bool Synthesize(const std::vector<uint32_t> &bitrates, uint32_t segments, uint32_t segmentMs, double vbr,
+        uint32_t seed)
+    {
+        Close();
+        uint32_t reps = (uint32_t)bitrates.size();
+        m_owned.assign(sizeof(ManifestHeader) + reps * sizeof(ManifestRepresentation) +
+            (size_t)reps * segments * sizeof(uint32_t), 0);
+        ManifestHeader *header = (ManifestHeader *)&m_owned[0];
+        header->magic = MANIFEST_MAGIC;
+        header->version = MANIFEST_VERSION;
+        header->representations = reps;
+        header->segments = segments;
+        header->segmentMs = segmentMs;
+        ManifestRepresentation *rep = (ManifestRepresentation *)(header + 1);
+        uint32_t *sizes = (uint32_t *)(rep + reps);
+
+        // exp(N(-vbr^2/2, vbr)) has mean 1, so the nominal bitrate stays the average
+        std::mt19937 rng(seed);
+        std::normal_distribution<double> normal(-vbr * vbr / 2, vbr);
+        for (uint32_t s = 0; s < segments; s++)
+        {
+            double complexity = vbr > 0 ? exp(normal(rng)) : 1.0;
+            for (uint32_t r = 0; r < reps; r++)
+            {
+                double bytes = bitrates[r] / 8.0 * segmentMs / 1000.0 * complexity;
+                sizes[(size_t)s * reps + r] = bytes < 1 ? 1 : (uint32_t)bytes;
+            }
+        }
+        for (uint32_t r = 0; r < reps; r++)
+        {
+            rep[r].bitrate = bitrates[r];
+            uint32_t peak = 0;
+            for (uint32_t s = 0; s < segments; s++)
+            {
+                peak = sizes[(size_t)s * reps + r] > peak ? sizes[(size_t)s * reps + r] : peak;
+            }
+            rep[r].peakBitrate = (uint32_t)(peak * 8.0 * 1000 / segmentMs);
+        }
+        std::string error;
+        if (!Bind(header, rep, sizes, &error))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool Write(const std::string &path) const
+    {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+        bool ok = fwrite(m_header, sizeof(ManifestHeader), 1, file) == 1 &&
+            fwrite(m_representations, sizeof(ManifestRepresentation), Representations(), file) == Representations() &&
+            fwrite(m_sizes, sizeof(uint32_t), (size_t)Representations() * Segments(), file) ==
+                (size_t)Representations() * Segments();
+        return fclose(file) == 0 && ok;
+    }
+
+    void Close(void)
+    {
+        if (m_map)
+        {
+            munmap(m_map, m_mapSize);
+        }
+        m_map = 0;
+        m_mapSize = 0;
+        m_owned.clear();
+        m_header = 0;
+        m_representations = 0;
+        m_sizes = 0;
+        m_bitrates.clear();
+    }
+
+    bool IsOpen(void) const { return m_header != 0; }
+    uint32_t Representations(void) const { return m_header->representations; }
+    uint32_t Segments(void) const { return m_header->segments; }
+    uint32_t SegmentMs(void) const { return m_header->segmentMs; }
+
+    // Nominal bitrates, ascending; the ladder the ABR algorithms choose from
+    const std::vector<uint32_t> &Bitrates(void) const { return m_bitrates; }
+
+    const ManifestRepresentation &Representation(uint32_t rep) const { return m_representations[rep]; }
+
+    // 0 for a segment or representation past the end
+    uint32_t SegmentBytes(uint32_t segment, uint32_t rep) const
+    {
+        if (segment >= m_header->segments || rep >= m_header->representations)
+        {
+            return 0;
+        }
+        return m_sizes[(size_t)segment * m_header->representations + rep];
+    }
+
+    // Sizes of segment and everything after it, Representations() per segment
+    const uint32_t *SegmentSizes(uint32_t segment) const
+    {
+        return segment < m_header->segments ? m_sizes + (size_t)segment * m_header->representations : 0;
+    }
+
+private:
+    bool Bind(const ManifestHeader *header, const ManifestRepresentation *reps, const uint32_t *sizes,
+        std::string *error)
+    {
+        if (header->representations == 0)
+        {
+            *error = "no representations";
+            return false;
+        }
+        // BOLA takes the log of every bitrate
+        if (reps[0].bitrate == 0)
+        {
+            *error = "representation 0 has a zero bitrate";
+            return false;
+        }
+        for (uint32_t r = 1; r < header->representations; r++)
+        {
+            if (reps[r].bitrate <= reps[r - 1].bitrate)
+            {
+                *error = "representations are not ascending by bitrate";
+                return false;
+            }
+        }
+        m_header = header;
+        m_representations = reps;
+        m_sizes = sizes;
+        m_bitrates.clear();
+        for (uint32_t r = 0; r < header->representations; r++)
+        {
+            m_bitrates.push_back(reps[r].bitrate);
+        }
+        return true;
+    }
+
+    void *m_map;
+    size_t m_mapSize;
+    std::vector<uint8_t> m_owned;   // a synthesized catalog, in the file layout
+
+    const ManifestHeader *m_header;
+    const ManifestRepresentation *m_representations;
+    const uint32_t *m_sizes;
+    std::vector<uint32_t> m_bitrates;
+};
+
+} // namespace dash
+
+#endif // DASH_MANIFEST_H
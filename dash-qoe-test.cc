@@ -0,0 +1,91 @@
+// Checks of the dash-qoe.h tracker that need no simulation. Built and run natively by
+// dash-test.sh; exits non-zero if any check fails.
+#include "dash-qoe.h"
+
+#include <stdio.h>
+
+using namespace dash;
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+static bool Near(double a, double b)
+{
+    return fabs(a - b) < 1e-9;
+}
+
+// A short session with a startup delay, two switches and one stall, against the linear
+// model worked out by hand
+static void SessionSummary(void)
+{
+    QoeTracker tracker(QoeWeights(), 1000);
+    tracker.Reset(100);
+    tracker.Chunk(1000000);
+    tracker.Play(600);
+    tracker.Chunk(2000000);
+    tracker.Stall(3000);
+    tracker.Stall(3200);    // already stalled: not a second stall
+    tracker.Chunk(1000000);
+    tracker.Play(4000);
+    tracker.End(5000);
+
+    QoeSummary summary = tracker.Summary();
+    Check(summary.startupMs == 500, "startup delay");
+    Check(summary.stalls == 1 && summary.stallMs == 1000, "stall count and time");
+    Check(summary.chunks == 3 && Near(summary.avgBitrateKbps, 4000.0 / 3), "chunks and average bitrate");
+    Check(summary.switches == 2 && Near(summary.switchKbps, 2000), "switches");
+    // 4 Mbps of chunks - 1.0 x 2 Mbps of switching - 4.3 x 1 s stalled - 4.3 x 0.5 s startup
+    Check(Near(summary.qoe, 4 - 2 - 4.3 - 2.15), "qoe");
+    Check(Near(summary.qoePerChunk, summary.qoe / 3), "qoe per chunk");
+}
+
+// A session that never played reports no startup delay, and End closes an open stall
+static void NeverPlayed(void)
+{
+    QoeTracker tracker;
+    tracker.Reset(0);
+    tracker.Stall(0);
+    tracker.End(2500);
+    QoeSummary summary = tracker.Summary();
+    Check(summary.startupMs == -1, "no startup delay without playback");
+    Check(summary.stalls == 1 && summary.stallMs == 2500, "open stall closed at the end");
+    Check(summary.chunks == 0 && summary.avgBitrateKbps == 0 && summary.qoePerChunk == 0, "no chunks");
+}
+
+// Samples come at most once per interval, aligned to the session start, and include a
+// stall still in progress
+static void SampleInterval(void)
+{
+    QoeTracker tracker(QoeWeights(), 1000);
+    tracker.Reset(100);
+    tracker.Chunk(1000000);
+    tracker.Play(600);
+    QoeSample sample;
+    Check(tracker.Sample(600, 2000, &sample), "first sample");
+    Check(sample.bitrateKbps == 1000 && sample.chunks == 1 && sample.bufferMs == 2000, "first sample fields");
+    Check(!tracker.Sample(900, 3000, &sample), "no second sample within the interval");
+    Check(!tracker.Sample(1099, 3000, &sample), "interval aligned to the session start");
+    tracker.Stall(1000);
+    Check(tracker.Sample(1500, 0, &sample), "sample in the next interval");
+    Check(sample.stalls == 1 && sample.stallMs == 500, "stall in progress");
+
+    QoeTracker silent(QoeWeights(), 0);
+    Check(!silent.Sample(1000, 0, &sample), "no samples with a zero interval");
+}
+
+int main(void)
+{
+    SessionSummary();
+    NeverPlayed();
+    SampleInterval();
+    printf("dash-qoe-test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+// Session QoE for the DASH client in as.cc, kept incrementally as the player reports
+// events, so comparing ABR algorithms needs no post-processing of the logs.
+//
+// The summary has what the linear QoE model (Yin et al.) needs:
+//   QoE = sum q(R_k) - lambda sum |q(R_k) - q(R_k-1)| - mu stall seconds - muStartup startup seconds
+// with q the chunk bitrate in Mbps. The player passes every event its simulated time in
+// milliseconds; the engine keeps no clock of its own.
+#ifndef DASH_QOE_H
+#define DASH_QOE_H
+
+#include <stdint.h>
+#include <math.h>
+
+namespace dash {
+
+struct QoeWeights
+{
+    double lambda;      // per Mbps of bitrate change
+    double mu;          // per second of stalling
+    double muStartup;   // per second of startup delay
+
+    // MPC's weights for a ladder topping out at 4.3 Mbps
+    QoeWeights() :
+        lambda(1.0), mu(4.3), muStartup(4.3)
+    {
+    }
+};
+
+struct QoeSummary
+{
+    int64_t startupMs;          // session start to first playback, -1 if it never played
+    uint32_t stalls;
+    int64_t stallMs;
+    uint32_t chunks;
+    double avgBitrateKbps;
+    uint32_t switches;
+    double switchKbps;          // summed |bitrate change| over the switches
+    double qoe;                 // the linear model above
+    double qoePerChunk;
+};
+
+// One row of the low-rate time series
+struct QoeSample
+{
+    int64_t ms;
+    double bufferMs;
+    uint32_t bitrateKbps;       // of the newest chunk
+    uint32_t chunks;
+    uint32_t stalls;
+    int64_t stallMs;            // including a stall in progress
+    uint32_t switches;
+    double qoe;                 // so far
+};
+
+class QoeTracker
+{
+public:
+    explicit QoeTracker(const QoeWeights &weights = QoeWeights(), int64_t intervalMs = 1000) :
+        m_weights(weights), m_intervalMs(intervalMs)
+    {
+        Reset(0);
+    }
+
+    void Reset(int64_t ms)
+    {
+        m_startMs = ms;
+        m_startupMs = -1;
+        m_stalled = false;
+        m_stallStartMs = 0;
+        m_stalls = 0;
+        m_stallMs = 0;
+        m_chunks = 0;
+        m_lastBitrate = 0;
+        m_bitrateSum = 0;
+        m_switches = 0;
+        m_switchBps = 0;
+        m_nextSampleMs = ms;
+    }
+
+    uint32_t Chunks(void) const
+    {
+        return m_chunks;
+    }
+
+    // A chunk finished downloading
+    void Chunk(uint32_t bitrateBps)
+    {
+        if (m_chunks > 0 && bitrateBps != m_lastBitrate)
+        {
+            m_switches++;
+            m_switchBps += fabs((double)bitrateBps - (double)m_lastBitrate);
+        }
+        m_chunks++;
+        m_bitrateSum += bitrateBps;
+        m_lastBitrate = bitrateBps;
+    }
+
+    // Playback (re)started: ends the startup delay or the current stall
+    void Play(int64_t ms)
+    {
+        if (m_startupMs < 0)
+        {
+            m_startupMs = ms - m_startMs;
+        }
+        if (m_stalled)
+        {
+            m_stallMs += ms - m_stallStartMs;
+            m_stalled = false;
+        }
+    }
+
+    void Stall(int64_t ms)
+    {
+        if (!m_stalled)
+        {
+            m_stalled = true;
+            m_stallStartMs = ms;
+            m_stalls++;
+        }
+    }
+
+    // Closes a stall still in progress
+    void End(int64_t ms)
+    {
+        if (m_stalled)
+        {
+            m_stallMs += ms - m_stallStartMs;
+            m_stallStartMs = ms;
+        }
+    }
+
+    QoeSummary Summary(void) const
+    {
+        QoeSummary s;
+        s.startupMs = m_startupMs;
+        s.stalls = m_stalls;
+        s.stallMs = m_stallMs;
+        s.chunks = m_chunks;
+        s.avgBitrateKbps = m_chunks ? m_bitrateSum / 1000.0 / m_chunks : 0;
+        s.switches = m_switches;
+        s.switchKbps = m_switchBps / 1000;
+        s.qoe = Qoe(m_stallMs);
+        s.qoePerChunk = m_chunks ? s.qoe / m_chunks : 0;
+        return s;
+    }
+
+    // Called on every player event; fills *out at most once per interval. The series is
+    // as sparse as the events, never denser than the interval, and costs no timers.
+    bool Sample(int64_t ms, double bufferMs, QoeSample *out)
+    {
+        if (m_intervalMs <= 0 || ms < m_nextSampleMs)
+        {
+            return false;
+        }
+        m_nextSampleMs = ms - (ms - m_startMs) % m_intervalMs + m_intervalMs;
+
+        int64_t stallMs = m_stallMs + (m_stalled ? ms - m_stallStartMs : 0);
+        out->ms = ms;
+        out->bufferMs = bufferMs;
+        out->bitrateKbps = m_lastBitrate / 1000;
+        out->chunks = m_chunks;
+        out->stalls = m_stalls;
+        out->stallMs = stallMs;
+        out->switches = m_switches;
+        out->qoe = Qoe(stallMs);
+        return true;
+    }
+
+private:
+    double Qoe(int64_t stallMs) const
+    {
+        double startup = m_startupMs > 0 ? m_startupMs / 1000.0 : 0;
+        return m_bitrateSum / 1e6 - m_weights.lambda * m_switchBps / 1e6 - m_weights.mu * stallMs / 1000.0 -
+            m_weights.muStartup * startup;
+    }
+
+    QoeWeights m_weights;
+    int64_t m_intervalMs;
+
+    int64_t m_startMs;
+    int64_t m_startupMs;
+    bool m_stalled;
+    int64_t m_stallStartMs;
+    uint32_t m_stalls;
+    int64_t m_stallMs;
+    uint32_t m_chunks;
+    uint32_t m_lastBitrate;
+    uint64_t m_bitrateSum;
+    uint32_t m_switches;
+    double m_switchBps;
+    int64_t m_nextSampleMs;
+};
+
+} // namespace dash
+
+#endif // DASH_QOE_H
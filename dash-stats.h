@@ -0,0 +1,470 @@
+// Typed statistics out of the DASH simulation in as.cc. The apps hand fixed-size records
+// to a StatsSink, which copies them into per-table batches; full batches go to a writer
+// thread that formats and writes them, so neither string formatting nor file I/O runs
+// on the simulator's thread. This replaces grepping NS_LOG output and parsing it with awk.
+//
+// A table is one record type described by a column list, written as
+//   <path>.csv   a header line of column names, then one comma-separated row per record
+//   <path>.bin   a StatsFileHeader, the StatsFileColumn list, then the raw records in host
+//                byte order, to be mmap'ed or read with numpy.fromfile at the given offset
+// Records reach the files in the order they were written; Close flushes everything.
+#ifndef DASH_STATS_H
+#define DASH_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dash-qoe.h"
+
+namespace dash {
+
+enum StatsType
+{
+    STATS_I64 = 0,
+    STATS_U32 = 1,
+    STATS_F64 = 2
+};
+
+enum StatsFormat
+{
+    STATS_CSV = 1,
+    STATS_BINARY = 2
+};
+
+struct StatsColumn
+{
+    const char *name;
+    StatsType type;
+    size_t offset;
+    int decimals;               // STATS_F64 in CSV: fixed, this many after the point
+};
+
+enum
+{
+    STATS_MAGIC = 0x44535453,   // "DSTS"
+    STATS_VERSION = 1
+};
+
+struct StatsFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t columns;
+    uint64_t dataOffset;        // first record
+};
+
+struct StatsFileColumn
+{
+    char name[24];
+    uint32_t type;              // StatsType
+    uint32_t offset;
+};
+
+static_assert(sizeof(StatsFileHeader) == 24, "stats header layout");
+static_assert(sizeof(StatsFileColumn) == 32, "stats column layout");
+
+//================================================================
+// RECORDS
+//================================================================
+
+// Per downloaded chunk; the columns of the old statistics.dat
+struct ChunkStats
+{
+    double time;                // s
+    uint32_t node;
+    uint32_t bpsAverage;
+    uint32_t kbpsLastChunk;
+    uint32_t nextBitrate;       // bps
+    uint32_t chunkCount;        // in the buffer since the last stall
+    uint32_t totalChunks;
+    uint32_t downloadMs;
+};
+
+// Per downloaded chunk; the columns of the old buffer.dat
+struct BufferStats
+{
+    double time;                // s
+    uint32_t node;
+    uint32_t bufferS;
+    double throughputKbps;      // the last chunk's kilobits, its rate over a nominal second
+    double estimatedKbps;       // of the last chunk
+    uint32_t videoKbps;         // of the last request
+};
+
+// The QoE series of dash-qoe.h, one row per QoeTracker::Sample
+struct QoeStats
+{
+    uint32_t node;
+    QoeSample sample;
+};
+
+#define DASH_STATS_COLUMN(record, field, type, decimals) { #field, type, offsetof(record, field), decimals }
+
+static const StatsColumn CHUNK_STATS_COLUMNS[] = {
+    DASH_STATS_COLUMN(ChunkStats, time, STATS_F64, 3),
+    DASH_STATS_COLUMN(ChunkStats, node, STATS_U32, 0),
+    DASH_STATS_COLUMN(ChunkStats, bpsAverage, STATS_U32, 0),
+    DASH_STATS_COLUMN(ChunkStats, kbpsLastChunk, STATS_U32, 0),
+    DASH_STATS_COLUMN(ChunkStats, nextBitrate, STATS_U32, 0),
+    DASH_STATS_COLUMN(ChunkStats, chunkCount, STATS_U32, 0),
+    DASH_STATS_COLUMN(ChunkStats, totalChunks, STATS_U32, 0),
+    DASH_STATS_COLUMN(ChunkStats, downloadMs, STATS_U32, 0),
+};
+
+static const StatsColumn BUFFER_STATS_COLUMNS[] = {
+    DASH_STATS_COLUMN(BufferStats, time, STATS_F64, 3),
+    DASH_STATS_COLUMN(BufferStats, node, STATS_U32, 0),
+    DASH_STATS_COLUMN(BufferStats, bufferS, STATS_U32, 0),
+    DASH_STATS_COLUMN(BufferStats, throughputKbps, STATS_F64, 0),
+    DASH_STATS_COLUMN(BufferStats, estimatedKbps, STATS_F64, 0),
+    DASH_STATS_COLUMN(BufferStats, videoKbps, STATS_U32, 0),
+};
+
+static const StatsColumn QOE_STATS_COLUMNS[] = {
+    { "node", STATS_U32, offsetof(QoeStats, node), 0 },
+    { "ms", STATS_I64, offsetof(QoeStats, sample) + offsetof(QoeSample, ms), 0 },
+    { "bufferMs", STATS_F64, offsetof(QoeStats, sample) + offsetof(QoeSample, bufferMs), 3 },
+    { "bitrateKbps", STATS_U32, offsetof(QoeStats, sample) + offsetof(QoeSample, bitrateKbps), 0 },
+    { "chunks", STATS_U32, offsetof(QoeStats, sample) + offsetof(QoeSample, chunks), 0 },
+    { "stalls", STATS_U32, offsetof(QoeStats, sample) + offsetof(QoeSample, stalls), 0 },
+    { "stallMs", STATS_I64, offsetof(QoeStats, sample) + offsetof(QoeSample, stallMs), 0 },
+    { "switches", STATS_U32, offsetof(QoeStats, sample) + offsetof(QoeSample, switches), 0 },
+    { "qoe", STATS_F64, offsetof(QoeStats, sample) + offsetof(QoeSample, qoe), 3 },
+};
+
+#undef DASH_STATS_COLUMN
+
+//================================================================
+// SINK
+//================================================================
+
+class StatsSink
+{
+public:
+    enum
+    {
+        MAX_QUEUED = 32     // batches; past that the simulator waits for the writer
+    };
+
+    // Records per batch handed to the writer thread
+    explicit StatsSink(uint32_t batchRecords = 4096) :
+        m_batchRecords(batchRecords ? batchRecords : 1), m_stop(false), m_busy(false), m_records(0), m_batches(0), m_maxQueued(0)
+    {
+    }
+
+    ~StatsSink()
+    {
+        Close();
+    }
+
+    // Opens <path>.csv and/or <path>.bin for records of one type; returns the table's id,
+    // or -1 if a file could not be created
+    template <class T, size_t N>
+    int AddTable(const std::string &path, const StatsColumn (&columns)[N], uint32_t formats)
+    {
+        Table *table = new Table;
+        table->recordSize = sizeof(T);
+        table->columns.assign(columns, columns + N);
+        table->csv = 0;
+        table->bin = 0;
+        if (((formats & STATS_CSV) && !OpenCsv(path + ".csv", table)) ||
+            ((formats & STATS_BINARY) && !OpenBinary(path + ".bin", table)))
+        {
+            CloseTable(table);
+            return -1;
+        }
+        table->pending.reserve(m_batchRecords * sizeof(T));
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_thread.joinable())
+        {
+            m_stop = false;
+            m_thread = std::thread(&StatsSink::Writer, this);
+        }
+        m_tables.push_back(table);
+        return (int)m_tables.size() - 1;
+    }
+
+    // Copies the record; the simulator's thread pays a memcpy and, once per batch, a handoff
+    template <class T>
+    void Write(int table, const T &record)
+    {
+        if (table < 0)
+        {
+            return;
+        }
+        Table &t = *m_tables[table];
+        const char *bytes = (const char *)&record;
+        t.pending.insert(t.pending.end(), bytes, bytes + sizeof(T));
+        m_records++;
+        if (t.pending.size() >= m_batchRecords * t.recordSize)
+        {
+            Submit(table);
+        }
+    }
+
+    // Hands every partial batch to the writer and waits until all of it is on disk
+    void Flush(void)
+    {
+        for (size_t i = 0; i < m_tables.size(); i++)
+        {
+            Submit((int)i);
+        }
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_idle.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+        for (size_t i = 0; i < m_tables.size(); i++)
+        {
+            if (m_tables[i]->csv)
+            {
+                fflush(m_tables[i]->csv);
+            }
+            if (m_tables[i]->bin)
+            {
+                fflush(m_tables[i]->bin);
+            }
+        }
+    }
+
+    // Flushes, stops the writer and closes the files. Safe to call twice.
+    void Close(void)
+    {
+        if (!m_thread.joinable())
+        {
+            return;
+        }
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stop = true;
+        }
+        m_work.notify_one();
+        m_thread.join();
+        for (size_t i = 0; i < m_tables.size(); i++)
+        {
+            CloseTable(m_tables[i]);
+        }
+        m_tables.clear();
+    }
+
+    uint64_t Records(void) const { return m_records; }
+    uint64_t Batches(void) const { return m_batches; }
+    // Most batches ever waiting for the writer; it keeping up shows as 1, MAX_QUEUED
+    // means the simulation was held up by the disk
+    uint32_t MaxQueued(void) const { return m_maxQueued; }
+
+private:
+    struct Table
+    {
+        uint32_t recordSize;
+        std::vector<StatsColumn> columns;
+        FILE *csv;
+        FILE *bin;
+        std::vector<char> pending;
+    };
+
+    struct Batch
+    {
+        int table;
+        std::vector<char> bytes;
+    };
+
+    static void CloseTable(Table *table)
+    {
+        if (table->csv)
+        {
+            fclose(table->csv);
+        }
+        if (table->bin)
+        {
+            fclose(table->bin);
+        }
+        delete table;
+    }
+
+    bool OpenCsv(const std::string &path, Table *table)
+    {
+        if (!(table->csv = fopen(path.c_str(), "w")))
+        {
+            return false;
+        }
+        setvbuf(table->csv, 0, _IOFBF, 1 << 20);
+        for (size_t c = 0; c < table->columns.size(); c++)
+        {
+            fprintf(table->csv, "%s%s", c ? "," : "", table->columns[c].name);
+        }
+        fputc('\n', table->csv);
+        return true;
+    }
+
+    bool OpenBinary(const std::string &path, Table *table)
+    {
+        if (!(table->bin = fopen(path.c_str(), "wb")))
+        {
+            return false;
+        }
+        setvbuf(table->bin, 0, _IOFBF, 1 << 20);
+        StatsFileHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = STATS_MAGIC;
+        header.version = STATS_VERSION;
+        header.recordSize = table->recordSize;
+        header.columns = (uint32_t)table->columns.size();
+        header.dataOffset = sizeof(header) + header.columns * sizeof(StatsFileColumn);
+        fwrite(&header, sizeof(header), 1, table->bin);
+        for (size_t c = 0; c < table->columns.size(); c++)
+        {
+            StatsFileColumn column;
+            memset(&column, 0, sizeof(column));
+            strncpy(column.name, table->columns[c].name, sizeof(column.name) - 1);
+            column.type = table->columns[c].type;
+            column.offset = (uint32_t)table->columns[c].offset;
+            fwrite(&column, sizeof(column), 1, table->bin);
+        }
+        return true;
+    }
+
+    void Submit(int table)
+    {
+        Table &t = *m_tables[table];
+        if (t.pending.empty())
+        {
+            return;
+        }
+        Batch batch;
+        batch.table = table;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_room.wait(lock, [this] { return m_queue.size() < MAX_QUEUED; });
+            m_queue.push_back(batch);
+            m_queue.back().bytes.swap(t.pending);
+            if (!m_spare.empty())
+            {
+                // A buffer the writer is done with, capacity and all
+                t.pending.swap(m_spare.back());
+                m_spare.pop_back();
+            }
+            m_maxQueued = std::max<uint32_t>(m_maxQueued, (uint32_t)m_queue.size());
+        }
+        if (t.pending.capacity() == 0)
+        {
+            t.pending.reserve(m_batchRecords * t.recordSize);
+        }
+        m_batches++;
+        m_work.notify_one();
+    }
+
+    void Writer(void)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_busy = false;
+        for (;;)
+        {
+            m_work.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                return;
+            }
+            Batch batch;
+            batch.table = m_queue.front().table;
+            batch.bytes.swap(m_queue.front().bytes);
+            m_queue.pop_front();
+            m_room.notify_one();
+            // Tables are heap-allocated, so the entry stays put while the lock is dropped
+            const Table &t = *m_tables[batch.table];
+            m_busy = true;
+            lock.unlock();
+
+            WriteBatch(t, batch.bytes);
+
+            lock.lock();
+            m_busy = false;
+            batch.bytes.clear();
+            m_spare.push_back(std::vector<char>());
+            m_spare.back().swap(batch.bytes);
+            if (m_queue.empty())
+            {
+                m_idle.notify_all();
+            }
+        }
+    }
+
+    static void WriteBatch(const Table &t, const std::vector<char> &bytes)
+    {
+        size_t count = bytes.size() / t.recordSize;
+        if (t.bin)
+        {
+            fwrite(&bytes[0], t.recordSize, count, t.bin);
+        }
+        if (!t.csv)
+        {
+            return;
+        }
+        char line[512];
+        for (size_t r = 0; r < count; r++)
+        {
+            const char *record = &bytes[r * t.recordSize];
+            int used = 0;
+            for (size_t c = 0; c < t.columns.size() && used < (int)sizeof(line) - 32; c++)
+            {
+                const StatsColumn &column = t.columns[c];
+                const char *sep = c ? "," : "";
+                const char *field = record + column.offset;
+                int n;
+                if (column.type == STATS_I64)
+                {
+                    int64_t v;
+                    memcpy(&v, field, sizeof(v));
+                    n = snprintf(line + used, sizeof(line) - used, "%s%lld", sep, (long long)v);
+                }
+                else if (column.type == STATS_U32)
+                {
+                    uint32_t v;
+                    memcpy(&v, field, sizeof(v));
+                    n = snprintf(line + used, sizeof(line) - used, "%s%u", sep, v);
+                }
+                else
+                {
+                    double v;
+                    memcpy(&v, field, sizeof(v));
+                    n = snprintf(line + used, sizeof(line) - used, "%s%.*f", sep, column.decimals, v);
+                }
+                // snprintf returns what the field would have taken; a truncated row keeps
+                // the last byte for its newline
+                used = std::min(used + std::max(n, 0), (int)sizeof(line) - 1);
+            }
+            line[used++] = '\n';
+            fwrite(line, 1, used, t.csv);
+        }
+    }
+
+    uint32_t m_batchRecords;
+    std::vector<Table *> m_tables;      // grown by the simulator's thread, under m_lock
+
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+    std::condition_variable m_room;
+    std::deque<Batch> m_queue;
+    std::vector<std::vector<char> > m_spare;
+    bool m_stop;
+    bool m_busy;
+
+    uint64_t m_records;
+    uint64_t m_batches;
+    uint32_t m_maxQueued;
+};
+
+} // namespace dash
+
+#endif // DASH_STATS_H
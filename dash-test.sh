@@ -0,0 +1,10 @@
+#!/bin/bash
+# Builds and runs the native checks of the shared DASH headers (no ns-3 needed).
+# Exits non-zero on the first failing check program.
+
+mkdir -p ../build/native
+for test in dash-*-test.cc; do
+    bin=../build/native/$(basename $test .cc)
+    g++ -std=c++11 -O2 -Wall -Wextra -o $bin $test || exit 1
+    $bin || exit 1
+done
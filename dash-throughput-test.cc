@@ -0,0 +1,121 @@
+// Checks of the dash-throughput.h estimators and ground truth that need no simulation.
+// Built and run natively by dash-test.sh; exits non-zero if any check fails.
+#include "dash-throughput.h"
+#include "dash-abr.h"
+
+#include <stdio.h>
+#include <random>
+
+using namespace dash;
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+static bool Near(double a, double b)
+{
+    return fabs(a - b) <= 1e-6 * (fabs(b) > 1 ? fabs(b) : 1);
+}
+
+static ThroughputSample Sample(uint64_t bytes, double durationMs, uint64_t activeBytes = 0, double activeMs = 0)
+{
+    ThroughputSample sample;
+    sample.bytes = bytes;
+    sample.durationMs = durationMs;
+    sample.activeBytes = activeBytes;
+    sample.activeMs = activeMs;
+    return sample;
+}
+
+// The running sums must not drift from the player's own harmonic mean over a long run
+static void HarmonicMatchesHistory(void)
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> uniform(2e5, 5e6);
+    HarmonicEstimator estimator;
+    ThroughputHistory history;
+    bool same = true;
+    for (int i = 0; i < 100000 && same; i++)
+    {
+        ThroughputSample sample = Sample((uint64_t)(uniform(rng) / 8), 1000);
+        estimator.Add(sample);
+        history.Add(sample.Bps());
+        same = Near(estimator.Estimate().bps, history.HarmonicMean(5));
+    }
+    Check(same, "harmonic estimator matches the history over 100k samples");
+}
+
+// Steady at 4 Mbps, then a drop to 1 Mbps: the estimate follows down step by step
+static void EwmaFollowsDrop(void)
+{
+    DualEwmaEstimator estimator;
+    for (int i = 0; i < 10; i++)
+    {
+        estimator.Add(Sample(4000000 / 8 * 2, 2000));
+    }
+    Check(Near(estimator.Estimate().bps, 4e6), "ewma steady state");
+    double last = estimator.Estimate().bps;
+    bool falling = true;
+    for (int i = 0; i < 4; i++)
+    {
+        estimator.Add(Sample(1000000 / 8 * 2, 2000));
+        double bps = estimator.Estimate().bps;
+        falling = falling && bps < last && bps > 1e6;
+        last = bps;
+    }
+    Check(falling, "ewma falls towards the new rate");
+    Check(last < 2e6, "ewma close to the new rate after four segments");
+}
+
+// Idle time is left out: bytes over the active time, summed across the window
+static void ActiveExcludesIdle(void)
+{
+    ActiveEstimator estimator;
+    Check(estimator.Estimate().bps == 0, "active estimator with no samples");
+    estimator.Add(Sample(500000, 2000, 495000, 495));
+    estimator.Add(Sample(50000, 200, 40000, 100));
+    Check(Near(estimator.Estimate().bps, 535000 * 8000.0 / 595), "active rate over the active time");
+    estimator.Add(Sample(0, 0));
+    Check(Near(estimator.Estimate().bps, 535000 * 8000.0 / 595), "empty sample ignored");
+}
+
+static void CrossTrafficTruth(void)
+{
+    CrossTraffic traffic(8e6);
+    traffic.Add(0, 20000, 3000000);
+    traffic.Add(10000, 20000, 1000000);
+    Check(traffic.AvailableBps(5000) == 5e6 && traffic.AvailableBps(15000) == 4e6, "available capacity");
+    Check(Near(traffic.MeanAvailableBps(9000, 11000), 4.5e6), "mean across a source edge");
+    Check(Near(traffic.MeanAvailableBps(19000, 21000), 6e6), "mean across the end of the traffic");
+
+    CrossTraffic saturated(2e6);
+    saturated.Add(0, 20000, 3000000);
+    Check(saturated.AvailableBps(5000) == 0, "never below zero");
+}
+
+static void Registry(void)
+{
+    Check(EstimatorNames() == "harmonic|ewma|active", "estimator names");
+    ThroughputEstimator *estimator = CreateEstimator("ewma");
+    Check(estimator && std::string(estimator->Name()) == "ewma", "create by name");
+    delete estimator;
+    Check(CreateEstimator("nope") == 0, "unknown estimator");
+}
+
+int main(void)
+{
+    HarmonicMatchesHistory();
+    EwmaFollowsDrop();
+    ActiveExcludesIdle();
+    CrossTrafficTruth();
+    Registry();
+    printf("dash-throughput-test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,477 @@
+// Passive throughput estimators for the DASH client in as.cc: what the segment downloads
+// so far say about the path, as an estimate and a confidence in it that the ABR
+// algorithms (dash-abr.h) read from their context.
+//
+//   harmonic  sliding-window harmonic mean of the per-segment rates
+//   ewma      exponentially weighted averages at two time scales, the lower one wins
+//   active    bytes over active transfer time across the window: large segments weigh
+//             more than small ones, and idle time within a download does not count
+//
+// Every estimator takes a sample per segment in O(1) and never allocates after
+// construction. They are created by name from the registry at the bottom, like the ABR
+// algorithms. For scoring them in simulation, CrossTraffic holds the known competing
+// load on the bottleneck. Nothing in here depends on ns-3; times are in milliseconds.
+#ifndef DASH_THROUGHPUT_H
+#define DASH_THROUGHPUT_H
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace dash {
+
+//================================================================
+// SAMPLES
+//================================================================
+
+// One segment's download
+struct ThroughputSample
+{
+    uint64_t bytes;
+    double durationMs;          // request (or end of the segment before) to last byte
+    uint64_t activeBytes;       // arrived while data was flowing (dash-live.h ActiveThroughput)
+    double activeMs;            // 0 if not measured
+    bool paced;                 // the server sent at the encoder's pace (live): the
+                                // duration is the encoder's, not the path's
+
+    ThroughputSample() :
+        bytes(0), durationMs(0), activeBytes(0), activeMs(0), paced(false)
+    {
+    }
+
+    // Rate over the active time, the whole download if that was not measured
+    double ActiveBps(void) const
+    {
+        if (activeMs > 0)
+        {
+            return activeBytes * 8000.0 / activeMs;
+        }
+        return durationMs > 0 ? bytes * 8000.0 / durationMs : 0;
+    }
+
+    // The segment's rate: over the whole download, or the active part for a paced one
+    double Bps(void) const
+    {
+        return paced ? ActiveBps() : durationMs > 0 ? bytes * 8000.0 / durationMs : 0;
+    }
+
+    // Time the rate was measured over
+    double MeasuredMs(void) const
+    {
+        return paced && activeMs > 0 ? activeMs : durationMs;
+    }
+};
+
+struct ThroughputEstimate
+{
+    double bps;                 // 0 before the first sample
+    double confidence;          // 0 (no data, or samples all over the place) to 1
+
+    ThroughputEstimate() :
+        bps(0), confidence(0)
+    {
+    }
+};
+
+class ThroughputEstimator
+{
+public:
+    virtual ~ThroughputEstimator() {}
+
+    virtual const char *Name(void) const = 0;
+    virtual void Add(const ThroughputSample &sample) = 0;
+    virtual ThroughputEstimate Estimate(void) const = 0;
+};
+
+// Running sums over the newest WINDOW values, for the mean, spread and harmonic mean
+template <uint32_t WINDOW>
+class SlidingSums
+{
+public:
+    SlidingSums() :
+        m_count(0), m_next(0), m_sum(0), m_sumSquares(0), m_sumInverse(0), m_weight(0)
+    {
+    }
+
+    // value > 0; Weight() sums the weights, e.g. bytes
+    void Push(double value, double weight = 1)
+    {
+        if (m_count == WINDOW)
+        {
+            double old = m_values[m_next];
+            m_sum -= old;
+            m_sumSquares -= old * old;
+            m_sumInverse -= 1 / old;
+            m_weight -= m_weights[m_next];
+        }
+        else
+        {
+            m_count++;
+        }
+        m_values[m_next] = value;
+        m_weights[m_next] = weight;
+        m_sum += value;
+        m_sumSquares += value * value;
+        m_sumInverse += 1 / value;
+        m_weight += weight;
+        m_next = (m_next + 1) % WINDOW;
+    }
+
+    uint32_t Count(void) const { return m_count; }
+    double Fill(void) const { return (double)m_count / WINDOW; }
+    double Weight(void) const { return m_weight; }
+
+    double HarmonicMean(void) const
+    {
+        return m_sumInverse > 0 ? m_count / m_sumInverse : 0;
+    }
+
+    // Coefficient of variation, 0 for fewer than two values
+    double Spread(void) const
+    {
+        if (m_count < 2 || m_sum <= 0)
+        {
+            return 0;
+        }
+        double mean = m_sum / m_count;
+        double variance = m_sumSquares / m_count - mean * mean;
+        return variance > 0 ? sqrt(variance) / mean : 0;
+    }
+
+    // A full window of consistent values is worth 1
+    double Confidence(void) const
+    {
+        return Fill() / (1 + Spread());
+    }
+
+private:
+    double m_values[WINDOW];
+    double m_weights[WINDOW];
+    uint32_t m_count;
+    uint32_t m_next;
+    double m_sum;
+    double m_sumSquares;
+    double m_sumInverse;
+    double m_weight;
+};
+
+//================================================================
+// ESTIMATORS
+//================================================================
+
+// Harmonic mean of the last WINDOW segment rates: one fast outlier barely moves it. With
+// these samples it is the estimate the throughput ABR always used.
+class HarmonicEstimator : public ThroughputEstimator
+{
+public:
+    enum
+    {
+        WINDOW = 5
+    };
+
+    virtual const char *Name(void) const { return "harmonic"; }
+
+    virtual void Add(const ThroughputSample &sample)
+    {
+        double bps = sample.Bps();
+        if (bps > 0)
+        {
+            m_rates.Push(bps);
+        }
+    }
+
+    virtual ThroughputEstimate Estimate(void) const
+    {
+        ThroughputEstimate e;
+        e.bps = m_rates.HarmonicMean();
+        e.confidence = m_rates.Confidence();
+        return e;
+    }
+
+private:
+    SlidingSums<WINDOW> m_rates;
+};
+
+// Two averages decaying with download time (Shaka's estimator): the fast one follows a
+// drop within seconds, the slow one keeps a short burst from lifting the estimate, and
+// the lower of the two is the estimate. Each average starts from zero and is divided by
+// the weight its samples have accumulated, so early estimates are not biased low.
+class DualEwmaEstimator : public ThroughputEstimator
+{
+public:
+    DualEwmaEstimator(double fastHalfLifeMs = 3000, double slowHalfLifeMs = 8000) :
+        m_fastHalfLifeMs(fastHalfLifeMs), m_slowHalfLifeMs(slowHalfLifeMs), m_fast(0), m_slow(0), m_totalMs(0)
+    {
+    }
+
+    virtual const char *Name(void) const { return "ewma"; }
+
+    virtual void Add(const ThroughputSample &sample)
+    {
+        double bps = sample.Bps();
+        double ms = sample.MeasuredMs();
+        if (bps <= 0 || ms <= 0)
+        {
+            return;
+        }
+        double fast = pow(0.5, ms / m_fastHalfLifeMs);
+        double slow = pow(0.5, ms / m_slowHalfLifeMs);
+        m_fast = fast * m_fast + (1 - fast) * bps;
+        m_slow = slow * m_slow + (1 - slow) * bps;
+        m_totalMs += ms;
+    }
+
+    virtual ThroughputEstimate Estimate(void) const
+    {
+        ThroughputEstimate e;
+        if (m_totalMs <= 0)
+        {
+            return e;
+        }
+        double slowWeight = 1 - pow(0.5, m_totalMs / m_slowHalfLifeMs);
+        double fast = m_fast / (1 - pow(0.5, m_totalMs / m_fastHalfLifeMs));
+        double slow = m_slow / slowWeight;
+        e.bps = std::min(fast, slow);
+        // The slow average's share of real data, times how far the two agree
+        e.confidence = slowWeight * e.bps / std::max(fast, slow);
+        return e;
+    }
+
+private:
+    double m_fastHalfLifeMs;
+    double m_slowHalfLifeMs;
+    double m_fast;
+    double m_slow;
+    double m_totalMs;
+};
+
+// Bytes over active time across the last WINDOW segments. A small segment spends much of
+// its download in slow start and a round trip of request latency, so it understates the
+// path; weighting by bytes lets it count for what it carried. Time without data arriving
+// is left out whether the server was waiting for the encoder or the client for a
+// retransmission.
+class ActiveEstimator : public ThroughputEstimator
+{
+public:
+    enum
+    {
+        WINDOW = 5
+    };
+
+    ActiveEstimator() :
+        m_next(0), m_msSum(0)
+    {
+        std::fill(m_ms, m_ms + WINDOW, 0.0);
+    }
+
+    virtual const char *Name(void) const { return "active"; }
+
+    virtual void Add(const ThroughputSample &sample)
+    {
+        double bps = sample.ActiveBps();
+        if (bps <= 0)
+        {
+            return;
+        }
+        double bytes = sample.activeMs > 0 ? (double)sample.activeBytes : (double)sample.bytes;
+        double ms = sample.activeMs > 0 ? sample.activeMs : sample.durationMs;
+        if (m_rates.Count() == WINDOW)
+        {
+            m_msSum -= m_ms[m_next];
+        }
+        m_ms[m_next] = ms;
+        m_msSum += ms;
+        m_next = (m_next + 1) % WINDOW;
+        m_rates.Push(bps, bytes);
+    }
+
+    virtual ThroughputEstimate Estimate(void) const
+    {
+        ThroughputEstimate e;
+        e.bps = m_msSum > 0 ? m_rates.Weight() * 8000.0 / m_msSum : 0;
+        e.confidence = m_rates.Confidence();
+        return e;
+    }
+
+private:
+    SlidingSums<WINDOW> m_rates;    // rates, weighted by bytes
+    double m_ms[WINDOW];
+    uint32_t m_next;
+    double m_msSum;
+};
+
+//================================================================
+// REGISTRY
+//================================================================
+
+typedef ThroughputEstimator *(*EstimatorFactory)(void);
+
+struct EstimatorEntry
+{
+    const char *name;
+    EstimatorFactory create;
+};
+
+template <class T>
+ThroughputEstimator *CreateEstimatorOf(void)
+{
+    return new T;
+}
+
+inline const EstimatorEntry *EstimatorRegistry(uint32_t *count)
+{
+    static const EstimatorEntry entries[] = {
+        { "harmonic", &CreateEstimatorOf<HarmonicEstimator> },
+        { "ewma", &CreateEstimatorOf<DualEwmaEstimator> },
+        { "active", &CreateEstimatorOf<ActiveEstimator> },
+    };
+    *count = sizeof(entries) / sizeof(entries[0]);
+    return entries;
+}
+
+// 0 when no estimator has that name
+inline ThroughputEstimator *CreateEstimator(const std::string &name)
+{
+    uint32_t count;
+    const EstimatorEntry *entries = EstimatorRegistry(&count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (name == entries[i].name)
+        {
+            return entries[i].create();
+        }
+    }
+    return 0;
+}
+
+// "harmonic|ewma|active" for usage text
+inline std::string EstimatorNames(void)
+{
+    uint32_t count;
+    const EstimatorEntry *entries = EstimatorRegistry(&count);
+    std::string names;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        names += (i ? "|" : "") + std::string(entries[i].name);
+    }
+    return names;
+}
+
+//================================================================
+// GROUND TRUTH
+//================================================================
+
+// Constant-rate cross traffic on the bottleneck, each source on from startMs to stopMs.
+// What it leaves over is what a client could have measured, shared among the clients.
+class CrossTraffic
+{
+public:
+    struct Source
+    {
+        int64_t startMs;
+        int64_t stopMs;
+        uint64_t bps;
+    };
+
+    explicit CrossTraffic(double capacityBps) :
+        m_capacityBps(capacityBps)
+    {
+    }
+
+    void Add(int64_t startMs, int64_t stopMs, uint64_t bps)
+    {
+        Source source;
+        source.startMs = startMs;
+        source.stopMs = stopMs;
+        source.bps = bps;
+        m_sources.push_back(source);
+    }
+
+    size_t Sources(void) const { return m_sources.size(); }
+    const Source &GetSource(size_t i) const { return m_sources[i]; }
+    double CapacityBps(void) const { return m_capacityBps; }
+
+    // Capacity the cross traffic leaves at ms, never below 0
+    double AvailableBps(double ms) const
+    {
+        double load = 0;
+        for (size_t i = 0; i < m_sources.size(); i++)
+        {
+            if (ms >= m_sources[i].startMs && ms < m_sources[i].stopMs)
+            {
+                load += m_sources[i].bps;
+            }
+        }
+        return load < m_capacityBps ? m_capacityBps - load : 0;
+    }
+
+    // Mean of AvailableBps over [fromMs, toMs), exact: constant between source edges
+    double MeanAvailableBps(double fromMs, double toMs) const
+    {
+        if (toMs <= fromMs)
+        {
+            return AvailableBps(fromMs);
+        }
+        std::vector<double> edges(1, fromMs);
+        for (size_t i = 0; i < m_sources.size(); i++)
+        {
+            if (m_sources[i].startMs > fromMs && m_sources[i].startMs < toMs)
+            {
+                edges.push_back(m_sources[i].startMs);
+            }
+            if (m_sources[i].stopMs > fromMs && m_sources[i].stopMs < toMs)
+            {
+                edges.push_back(m_sources[i].stopMs);
+            }
+        }
+        edges.push_back(toMs);
+        std::sort(edges.begin(), edges.end());
+        double area = 0;
+        for (size_t i = 0; i + 1 < edges.size(); i++)
+        {
+            area += AvailableBps(edges[i]) * (edges[i + 1] - edges[i]);
+        }
+        return area / (toMs - fromMs);
+    }
+
+private:
+    double m_capacityBps;
+    std::vector<Source> m_sources;
+};
+
+// An estimator's error against the ground truth, sampled before each segment's own
+// sample goes in: the estimate the ABR had versus what the path then delivered
+struct EstimatorScore
+{
+    uint32_t samples;
+    double absErrorBps;
+    double errorBps;            // estimate - truth: positive is optimistic
+    double confidence;
+
+    EstimatorScore() :
+        samples(0), absErrorBps(0), errorBps(0), confidence(0)
+    {
+    }
+
+    void Add(const ThroughputEstimate &estimate, double truthBps)
+    {
+        if (estimate.bps <= 0)
+        {
+            return;
+        }
+        samples++;
+        absErrorBps += fabs(estimate.bps - truthBps);
+        errorBps += estimate.bps - truthBps;
+        confidence += estimate.confidence;
+    }
+
+    double MeanAbsErrorBps(void) const { return samples ? absErrorBps / samples : 0; }
+    double BiasBps(void) const { return samples ? errorBps / samples : 0; }
+    double MeanConfidence(void) const { return samples ? confidence / samples : 0; }
+};
+
+} // namespace dash
+
+#endif // DASH_THROUGHPUT_H
@@ -0,0 +1,43 @@
+#!/bin/bash
+# Checks that bwprobe and the ns-3 clients estimate the same thing from the same probes.
+# For IGI (Pathload-Simulation) and SLoPS (Pathload-SimulationTwo):
+#   1. the simulation records what its client estimator saw (bw-records.h log)
+#   2. bwprobe replays that log and must reproduce the simulation's estimates
+#   3. bwprobe probes over loopback and records its own log
+#   4. the simulation replays the native log through its client code path
+#   5. bwprobe compares the simulation's replay estimates with the native ones
+# Needs bwprobe.sh to have been run. Exits non-zero on the first mismatch.
+
+BWPROBE=../build/native/bwprobe
+OUT=parity
+mkdir -p $OUT
+
+check()
+{
+    "$@" | tee -a $OUT/parity.txt
+    if [ ${PIPESTATUS[0]} -ne 0 ]; then
+        echo "parity.sh: failed: $*"
+        exit 1
+    fi
+}
+
+run_method()
+{
+    local method=$1 scenario=$2
+    ../waf --run "$scenario --records=$PWD/$OUT/sim-$method.rec" > $OUT/sim-$method.txt 2>&1
+    check $BWPROBE replay --log $OUT/sim-$method.rec
+
+    $BWPROBE server --once > $OUT/native-server-$method.txt 2>&1 &
+    sleep 0.5
+    $BWPROBE client --method $method --record $OUT/native-$method.rec > $OUT/native-$method.txt
+    wait
+    check $BWPROBE replay --log $OUT/native-$method.rec
+
+    ../waf --run "$scenario --replay=$PWD/$OUT/native-$method.rec --records=$PWD/$OUT/replay-$method.rec" \
+        > $OUT/replay-$method.txt 2>&1
+    check $BWPROBE replay --log $OUT/native-$method.rec --against $OUT/replay-$method.rec
+}
+
+: > $OUT/parity.txt
+run_method igi Pathload-Simulation
+run_method slops Pathload-SimulationTwo
@@ -1,5 +1,5 @@
 #!/bin/bash
 
-../waf --run HAS 2>&1 | tee result.txt
-awk -f parse-dash.awk result.txt
-#gnuplot dash-ploter
\ No newline at end of file
+# statistics.csv, buffer.csv and qoe.csv come straight from the simulation (dash-stats.h)
+../waf --run as 2>&1 | tee result.txt
+#gnuplot dash-ploter